@@ -6,6 +6,9 @@
 CC ?= gcc
 CFLAGS ?= -std=c99 -Wall -Wextra -pedantic -O0 -g3
 
+# the parallel loader uses POSIX threads
+LDLIBS ?= -pthread
+
 # set to 'YES' use valgrind to search for memory errors while testing
 TEST_WITH_VALGRIND ?= YES
 
@@ -0,0 +1,361 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "arrow.h"
+
+/* one child of an exported struct array */
+typedef struct {
+	const char* name;
+	char format[24];
+	const void* data;
+	const uint8_t* validity;
+	int64_t null_count;
+	bool nullable;
+} arrow_column;
+
+/* The memory of a schema and it's children, which is freed once they have
+ * all been released, since a consumer may move children out of their
+ * parent and release them separately. */
+typedef struct {
+	int refs;
+	size_t n;
+	struct ArrowSchema* children;
+	struct ArrowSchema** pointers;
+	char** names;
+	char** formats;
+} schema_holder;
+
+/* the same for an array, along with the data it's buffers point at */
+typedef struct {
+	int refs;
+	size_t n;
+	struct ArrowArray* children;
+	struct ArrowArray** pointers;
+	const void** buffers;
+
+	void* owned[3];
+	openvcd_table* table;
+} array_holder;
+
+/* data buffers must not be NULL, even when there are no rows */
+static const uint64_t no_data[1] = {0};
+
+static void free_schema_holder(schema_holder* h) {
+	for (size_t i = 0 ; i < h->n ; i++) {
+		if (h->names != NULL) { free(h->names[i]); }
+		if (h->formats != NULL) { free(h->formats[i]); }
+	}
+	free(h->names);
+	free(h->formats);
+	free(h->children);
+	free(h->pointers);
+	free(h);
+}
+
+static void unref_schema(schema_holder* h) {
+	if (__atomic_sub_fetch(&(h->refs), 1, __ATOMIC_ACQ_REL) == 0) { free_schema_holder(h); }
+}
+
+static void release_schema_child(struct ArrowSchema* s) {
+	unref_schema((schema_holder*) s->private_data);
+	s->release = NULL;
+}
+
+static void release_schema(struct ArrowSchema* s) {
+	schema_holder* h;
+
+	h = (schema_holder*) s->private_data;
+	for (size_t i = 0 ; i < h->n ; i++) {
+		if (h->pointers[i]->release != NULL) { h->pointers[i]->release(h->pointers[i]); }
+	}
+
+	unref_schema(h);
+	s->release = NULL;
+}
+
+static void free_array_holder(array_holder* h) {
+	for (size_t i = 0 ; i < sizeof(h->owned) / sizeof(h->owned[0]) ; i++) { free(h->owned[i]); }
+	if (h->table != NULL) { openvcd_free_table(h->table); }
+	free(h->children);
+	free(h->pointers);
+	free(h->buffers);
+	free(h);
+}
+
+static void unref_array(array_holder* h) {
+	if (__atomic_sub_fetch(&(h->refs), 1, __ATOMIC_ACQ_REL) == 0) { free_array_holder(h); }
+}
+
+static void release_array_child(struct ArrowArray* a) {
+	unref_array((array_holder*) a->private_data);
+	a->release = NULL;
+}
+
+static void release_array(struct ArrowArray* a) {
+	array_holder* h;
+
+	h = (array_holder*) a->private_data;
+	for (size_t i = 0 ; i < h->n ; i++) {
+		if (h->pointers[i]->release != NULL) { h->pointers[i]->release(h->pointers[i]); }
+	}
+
+	unref_array(h);
+	a->release = NULL;
+}
+
+static int export_schema(const arrow_column* columns, size_t n, struct ArrowSchema* schema) {
+	struct ArrowSchema* c;
+	schema_holder* h;
+
+	h = calloc(1, sizeof(schema_holder));
+	if (h == NULL) { return -1; }
+
+	h->n = n;
+	h->children = calloc(n + 1, sizeof(struct ArrowSchema));
+	h->pointers = calloc(n + 1, sizeof(struct ArrowSchema*));
+	h->names = calloc(n + 1, sizeof(char*));
+	h->formats = calloc(n + 1, sizeof(char*));
+	if ((h->children == NULL) || (h->pointers == NULL) || (h->names == NULL) || (h->formats == NULL)) {
+		free_schema_holder(h);
+		return -1;
+	}
+
+	for (size_t i = 0 ; i < n ; i++) {
+		h->names[i] = strdup(columns[i].name);
+		h->formats[i] = strdup(columns[i].format);
+		if ((h->names[i] == NULL) || (h->formats[i] == NULL)) {
+			free_schema_holder(h);
+			return -1;
+		}
+
+		c = &(h->children[i]);
+		c->format = h->formats[i];
+		c->name = h->names[i];
+		c->flags = columns[i].nullable ? ARROW_FLAG_NULLABLE : 0;
+		c->release = release_schema_child;
+		c->private_data = h;
+		h->pointers[i] = c;
+	}
+
+	h->refs = (int) n + 1;
+
+	memset(schema, 0, sizeof(struct ArrowSchema));
+	schema->format = "+s";
+	schema->name = "";
+	schema->n_children = (int64_t) n;
+	schema->children = h->pointers;
+	schema->release = release_schema;
+	schema->private_data = h;
+
+	return 0;
+}
+
+/* Export columns of the given length, taking h, which has the data they
+ * point at. On failure, h is free-ed but not the data. */
+static int export_array(const arrow_column* columns, size_t n, int64_t length, array_holder* h, struct ArrowArray* array) {
+	struct ArrowArray* c;
+
+	h->n = n;
+	h->children = calloc(n + 1, sizeof(struct ArrowArray));
+	h->pointers = calloc(n + 1, sizeof(struct ArrowArray*));
+	h->buffers = calloc((2 * n) + 1, sizeof(void*));
+	if ((h->children == NULL) || (h->pointers == NULL) || (h->buffers == NULL)) {
+		free(h->children);
+		free(h->pointers);
+		free(h->buffers);
+		free(h);
+		return -1;
+	}
+
+	for (size_t i = 0 ; i < n ; i++) {
+		h->buffers[1 + (2 * i)] = columns[i].validity;
+		h->buffers[2 + (2 * i)] = (columns[i].data != NULL) ? columns[i].data : no_data;
+
+		c = &(h->children[i]);
+		c->length = length;
+		c->null_count = columns[i].null_count;
+		c->n_buffers = 2;
+		c->buffers = &(h->buffers[1 + (2 * i)]);
+		c->release = release_array_child;
+		c->private_data = h;
+		h->pointers[i] = c;
+	}
+
+	h->refs = (int) n + 1;
+
+	/* the struct itself has no nulls, which needs no bitmap */
+	memset(array, 0, sizeof(struct ArrowArray));
+	array->length = length;
+	array->n_buffers = 1;
+	array->buffers = &(h->buffers[0]);
+	array->n_children = (int64_t) n;
+	array->children = h->pointers;
+	array->release = release_array;
+	array->private_data = h;
+
+	return 0;
+}
+
+static int export_columns(const arrow_column* columns, size_t n, int64_t length, array_holder* h, struct ArrowSchema* schema, struct ArrowArray* array) {
+	if (export_schema(columns, n, schema) != 0) {
+		free(h);
+		return -1;
+	}
+
+	if (export_array(columns, n, length, h, array) != 0) {
+		schema->release(schema);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the format of a signal's value columns */
+static void value_format(char* format, size_t size, bool real, unsigned int nwords) {
+	if (real) {
+		snprintf(format, size, "g");
+	} else if (nwords == 1) {
+		snprintf(format, size, "L");
+	} else {
+		snprintf(format, size, "w:%u", nwords * 8);
+	}
+}
+
+int openvcd_signal_to_arrow(openvcd_wave* w, openvcd_signal* s, struct ArrowSchema* schema, struct ArrowArray* array) {
+	openvcd_decoded_block* d;
+	arrow_column columns[3];
+	array_holder* h;
+	uint64_t* times;
+	uint64_t* aval;
+	uint64_t* bval;
+	size_t count;
+
+	if (openvcd_wave_load_signal(w, s) != 0) { return -1; }
+
+	h = calloc(1, sizeof(array_holder));
+	times = malloc((s->change_count + 1) * sizeof(uint64_t));
+	aval = malloc((s->change_count + 1) * s->nwords * sizeof(uint64_t));
+	bval = malloc((s->change_count + 1) * s->nwords * sizeof(uint64_t));
+	if ((h == NULL) || (times == NULL) || (aval == NULL) || (bval == NULL)) {
+		free(h);
+		free(times);
+		free(aval);
+		free(bval);
+		return -1;
+	}
+	h->owned[0] = times;
+	h->owned[1] = aval;
+	h->owned[2] = bval;
+
+	/* the decoded blocks already have the layout of the columns */
+	count = 0;
+	for (size_t i = 0 ; i < s->nblocks ; i++) {
+		d = openvcd_decode_block(s, i);
+		if ((d == NULL) || (count + d->count > s->change_count)) {
+			if (d != NULL) { openvcd_free_decoded_block(d); }
+			free_array_holder(h);
+			return -1;
+		}
+
+		memcpy(times + count, d->times, d->count * sizeof(uint64_t));
+		memcpy(aval + (count * s->nwords), d->aval, d->count * s->nwords * sizeof(uint64_t));
+		memcpy(bval + (count * s->nwords), d->bval, d->count * s->nwords * sizeof(uint64_t));
+		count += d->count;
+		openvcd_free_decoded_block(d);
+	}
+
+	memset(columns, 0, sizeof(columns));
+	columns[0].name = "time";
+	strcpy(columns[0].format, "L");
+	columns[0].data = times;
+
+	columns[1].name = "value";
+	value_format(columns[1].format, sizeof(columns[1].format), s->real, s->nwords);
+	columns[1].data = aval;
+
+	columns[2].name = "xz";
+	value_format(columns[2].format, sizeof(columns[2].format), false, s->nwords);
+	columns[2].data = bval;
+
+	if (export_columns(columns, s->real ? 2 : 3, (int64_t) count, h, schema, array) != 0) {
+		free(times);
+		free(aval);
+		free(bval);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* the name of a signal's first variable */
+static const char* signal_name(const openvcd_signal* s) {
+	if (s->var == NULL) { return s->id_code; }
+	return (s->var->reference != NULL) ? s->var->reference->identifier : s->var->identifier_code;
+}
+
+int openvcd_table_to_arrow(openvcd_table* t, const char** names, struct ArrowSchema* schema, struct ArrowArray* array) {
+	arrow_column* columns;
+	const openvcd_column* c;
+	char** xz_names;
+	array_holder* h;
+	const char* name;
+	size_t n;
+	int rc;
+
+	columns = calloc((2 * t->ncolumns) + 1, sizeof(arrow_column));
+	xz_names = calloc(t->ncolumns + 1, sizeof(char*));
+	h = calloc(1, sizeof(array_holder));
+	if ((columns == NULL) || (xz_names == NULL) || (h == NULL)) {
+		free(columns);
+		free(xz_names);
+		free(h);
+		return -1;
+	}
+
+	columns[0].name = "time";
+	strcpy(columns[0].format, "L");
+	columns[0].data = t->times;
+	n = 1;
+
+	rc = 0;
+	for (size_t i = 0 ; (i < t->ncolumns) && (rc == 0) ; i++) {
+		c = &(t->columns[i]);
+		name = (names != NULL) ? names[i] : signal_name(c->signal);
+
+		columns[n].name = name;
+		value_format(columns[n].format, sizeof(columns[n].format), c->signal->real, c->nwords);
+		columns[n].data = c->aval;
+		columns[n].validity = c->validity;
+		columns[n].null_count = (int64_t) c->null_count;
+		columns[n].nullable = true;
+		n++;
+
+		if (c->signal->real) { continue; }
+
+		if (asprintf(&(xz_names[i]), "%s.xz", name) < 0) {
+			xz_names[i] = NULL;
+			rc = -1;
+			break;
+		}
+		columns[n] = columns[n - 1];
+		columns[n].name = xz_names[i];
+		columns[n].data = c->bval;
+		n++;
+	}
+
+	/* with no rows, the table has no bitmaps, and no nulls either */
+	if ((rc == 0) && (export_columns(columns, n, (int64_t) t->nrows, h, schema, array) == 0)) {
+		h->table = t;
+	} else {
+		if (rc != 0) { free(h); }
+		rc = -1;
+	}
+
+	for (size_t i = 0 ; i < t->ncolumns ; i++) { free(xz_names[i]); }
+	free(xz_names);
+	free(columns);
+
+	return rc;
+}
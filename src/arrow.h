@@ -0,0 +1,122 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements exporting value changes and sampled tables through
+ * the Arrow C data interface, so that analysis tools built on Arrow can
+ * read them without going through a text format and without OpenVCD
+ * depending on the Arrow library. Only the stable ABI below is used.
+ *
+ * Each export is a struct array, one child per column, with it's schema.
+ * Values of 64 bits or fewer are uint64 columns, real values float64
+ * columns, and wider values fixed size binary columns holding the value's
+ * words in order, least significant first, in the machine's byte order.
+ * The bits which are x or z are exported as a second column in the same
+ * form, see value.h for how the two planes encode each state.
+ *
+ * A table from openvcd_sample() is already laid out the way Arrow expects,
+ * with it's validity bitmaps in Arrow's bit order, so it's buffers are
+ * handed over as they are and the table is freed when the last array is
+ * released. The changes of a signal are stored compressed, so they are
+ * decoded once into new buffers which are handed over in the same way.
+ */
+
+#ifndef OPENVCD_ARROW_H
+#define OPENVCD_ARROW_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "wave.h"
+#include "lazy.h"
+#include "sample.h"
+
+/**** TYPES ******************************************************************/
+
+/* The Arrow C data interface, as given by the Arrow specification. */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+	const char* format;
+	const char* name;
+	const char* metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema** children;
+	struct ArrowSchema* dictionary;
+
+	void (*release)(struct ArrowSchema*);
+	void* private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void** buffers;
+	struct ArrowArray** children;
+	struct ArrowArray* dictionary;
+
+	void (*release)(struct ArrowArray*);
+	void* private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Export the changes of a signal.
+ *
+ * The columns are "time", "value", and unless the signal is real, "xz".
+ * Lazily opened signals are loaded.
+ *
+ * @param w
+ * @param s
+ * @param schema Set to the schema, which the caller must release.
+ * @param array Set to the array, which the caller must release.
+ *
+ * @return 0 on success, or -1 on failure.
+ */
+int openvcd_signal_to_arrow(openvcd_wave* w, openvcd_signal* s, struct ArrowSchema* schema, struct ArrowArray* array);
+
+/**
+ * @brief Export a table of samples.
+ *
+ * The columns are "time", then for each column of the table one with it's
+ * name and, unless the signal is real, one with it's name followed by
+ * ".xz". Rows with no value are null in both.
+ *
+ * On success the array takes ownership of the table, which must not be
+ * used or free-ed afterwards.
+ *
+ * @param t
+ * @param names The name of each column of the table, or NULL to use the
+ * names of the signals' variables.
+ * @param schema Set to the schema, which the caller must release.
+ * @param array Set to the array, which the caller must release.
+ *
+ * @return 0 on success, or -1 on failure, in which case the table is still
+ * the caller's.
+ */
+int openvcd_table_to_arrow(openvcd_table* t, const char** names, struct ArrowSchema* schema, struct ArrowArray* array);
+
+#endif /* OPENVCD_ARROW_H */
@@ -0,0 +1,158 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "arrow.h"
+
+static const char* input =
+	"$timescale 1ns $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 c clk $end\n"
+	"$var reg 8 n count [7:0] $end\n"
+	"$var reg 70 w bus [69:0] $end\n"
+	"$var real 64 r level $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\n0c\nb1x n\nr1.5 r\n"
+	"#5\n1c\nb11 n\n"
+	"#10\n0c\nb1000000000000000000000000000000000000000000000000000000000000000011 w\n"
+	"#15\n1c\nb100 n\nr-2 r\n";
+
+static const uint64_t* buffer(const struct ArrowArray* a, size_t child) {
+	return (const uint64_t*) a->children[child]->buffers[1];
+}
+
+void test_arrow_signal(void) {
+	struct ArrowSchema schema;
+	struct ArrowArray array;
+	const double* reals;
+	openvcd_wave* w;
+
+	w = load_string(input);
+
+	should_equal(openvcd_signal_to_arrow(w, openvcd_wave_find_signal(w, "n"), &schema, &array), 0);
+	should_equal(strcmp(schema.format, "+s"), 0);
+	should_equal(schema.n_children, 3);
+	should_equal(strcmp(schema.children[0]->name, "time"), 0);
+	should_equal(strcmp(schema.children[1]->format, "L"), 0);
+	should_equal(strcmp(schema.children[2]->name, "xz"), 0);
+
+	should_equal(array.length, 3);
+	should_equal(array.n_children, 3);
+	should_equal(array.children[0]->n_buffers, 2);
+	should_be_null(array.children[0]->buffers[0]);
+	should_equal(buffer(&array, 0)[2], 15);
+	should_equal(buffer(&array, 1)[0], 3);
+	should_equal(buffer(&array, 2)[0], 1);
+	should_equal(buffer(&array, 1)[1], 3);
+	should_equal(buffer(&array, 2)[1], 0);
+	should_equal(buffer(&array, 1)[2], 4);
+
+	schema.release(&schema);
+	array.release(&array);
+	should_be_null(schema.release);
+	should_be_null(array.release);
+
+	/* wide values are fixed size binary, least significant word first */
+	should_equal(openvcd_signal_to_arrow(w, openvcd_wave_find_signal(w, "w"), &schema, &array), 0);
+	should_equal(strcmp(schema.children[1]->format, "w:16"), 0);
+	should_equal(array.length, 1);
+	should_equal(buffer(&array, 1)[0], 3);
+	should_equal(buffer(&array, 1)[1], 4);
+	schema.release(&schema);
+	array.release(&array);
+
+	should_equal(openvcd_signal_to_arrow(w, openvcd_wave_find_signal(w, "r"), &schema, &array), 0);
+	should_equal(schema.n_children, 2);
+	should_equal(strcmp(schema.children[1]->format, "g"), 0);
+	reals = (const double*) array.children[1]->buffers[1];
+	should_equal_epsilon(reals[0], 1.5, 0.0001);
+	should_equal_epsilon(reals[1], -2.0, 0.0001);
+	schema.release(&schema);
+	array.release(&array);
+
+	openvcd_free_wave(w);
+}
+
+void test_arrow_table(void) {
+	struct ArrowSchema schema;
+	struct ArrowArray array;
+	struct ArrowArray moved;
+	openvcd_signal* signals[3];
+	openvcd_sample_spec spec;
+	const char* names[3] = {"count", "bus", "level"};
+	openvcd_table* t;
+	openvcd_wave* w;
+	const uint8_t* validity;
+
+	w = load_string(input);
+
+	signals[0] = openvcd_wave_find_signal(w, "n");
+	signals[1] = openvcd_wave_find_signal(w, "w");
+	signals[2] = openvcd_wave_find_signal(w, "r");
+	spec.clock = openvcd_wave_find_signal(w, "c");
+	spec.edge = OPENVCD_EDGE_POSEDGE;
+	spec.signals = signals;
+	spec.nsignals = 3;
+	spec.from = 0;
+	spec.to = UINT64_MAX;
+	spec.before_edge = true;
+
+	t = openvcd_sample(w, &spec);
+	should_not_be_null(t);
+	should_equal(t->nrows, 2);
+
+	/* the table's own buffers are handed over */
+	should_equal(openvcd_table_to_arrow(t, NULL, &schema, &array), 0);
+	should_equal(schema.n_children, 6);
+	should_equal(strcmp(schema.children[1]->name, "count"), 0);
+	should_equal(strcmp(schema.children[2]->name, "count.xz"), 0);
+	should_equal(strcmp(schema.children[4]->format, "w:16"), 0);
+	should_equal(strcmp(schema.children[5]->name, "level"), 0);
+	should_equal(schema.children[3]->flags, ARROW_FLAG_NULLABLE);
+	should_equal(array.length, 2);
+	should_be_true(array.children[1]->buffers[1] == (const void*) t->columns[0].aval);
+	should_be_true(array.children[0]->buffers[1] == (const void*) t->times);
+
+	/* the bus has no value before the first edge */
+	should_equal(array.children[3]->null_count, 1);
+	should_equal(array.children[1]->null_count, 0);
+	validity = (const uint8_t*) array.children[1]->buffers[0];
+	should_equal(validity[0] & 3, 3);
+	should_equal(buffer(&array, 2)[0], 1);
+	should_equal(buffer(&array, 2)[1], 0);
+
+	/* a child moved out of the array outlives it */
+	moved = *(array.children[1]);
+	array.children[1]->release = NULL;
+	array.release(&array);
+	schema.release(&schema);
+	should_equal(((const uint64_t*) moved.buffers[1])[1], 3);
+	moved.release(&moved);
+	should_be_null(moved.release);
+
+	/* with names given, and no rows */
+	spec.from = 100;
+	t = openvcd_sample(w, &spec);
+	should_not_be_null(t);
+	should_equal(openvcd_table_to_arrow(t, names, &schema, &array), 0);
+	should_equal(strcmp(schema.children[3]->name, "bus"), 0);
+	should_equal(strcmp(schema.children[4]->name, "bus.xz"), 0);
+	should_equal(array.length, 0);
+	should_not_be_null(array.children[1]->buffers[1]);
+	array.release(&array);
+	schema.release(&schema);
+
+	openvcd_free_wave(w);
+}
+
+int main(void) {
+	test_arrow_signal();
+	test_arrow_table();
+	return 0;
+}
@@ -0,0 +1,142 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "background.h"
+
+static void report(openvcd_loader* l, size_t bytes) {
+	__atomic_store_n(&(l->bytes), bytes, __ATOMIC_RELAXED);
+	if (l->progress != NULL) {
+		l->progress(l->progress_ctx, bytes, l->w->end_time);
+	}
+	l->reported = bytes;
+}
+
+static openvcd_parser_error apply_change(void* ctx, const openvcd_change* c) {
+	openvcd_loader* l;
+	size_t bytes;
+
+	l = (openvcd_loader*) ctx;
+
+	if ((++l->records % OPENVCD_BLOCK_CHANGES) == 0) {
+		if (__atomic_load_n(&(l->cancel), __ATOMIC_RELAXED)) {
+			return OPENVCD_ERROR_GENERAL;
+		}
+
+		bytes = l->p->body_offset + l->p->changes_base + c->offset;
+		__atomic_store_n(&(l->bytes), bytes, __ATOMIC_RELAXED);
+		if (bytes - l->reported >= OPENVCD_PROGRESS_BYTES) { report(l, bytes); }
+	}
+
+	return openvcd_wave_apply(l->w, c);
+}
+
+static void* load_changes(void* arg) {
+	openvcd_loader* l;
+
+	l = (openvcd_loader*) arg;
+
+	openvcd_parse_changes(l->p, apply_change, l);
+	if (__atomic_load_n(&(l->cancel), __ATOMIC_RELAXED) &&
+		(l->p->state == OPENVCD_PARSER_STATE_ERROR) &&
+		(l->p->error == OPENVCD_ERROR_GENERAL)) {
+		openvcd_load_error(l->p, OPENVCD_ERROR_GENERAL, "load cancelled",
+			__atomic_load_n(&(l->bytes), __ATOMIC_RELAXED) - l->p->body_offset);
+	}
+
+	if (l->p->state != OPENVCD_PARSER_STATE_ERROR) {
+		report(l, l->p->body_offset + l->p->changes_base);
+	}
+
+	__atomic_store_n(&(l->done), 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+openvcd_loader* openvcd_load_background(openvcd_parser* p, openvcd_progress progress, void* ctx) {
+	openvcd_loader* l;
+
+	l = malloc(sizeof(openvcd_loader));
+	if (l == NULL) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate loader", 0);
+		return NULL;
+	}
+
+	l->epochs = openvcd_new_epochs();
+	if (l->epochs == NULL) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate loader", 0);
+		free(l);
+		return NULL;
+	}
+
+	l->w = openvcd_load_header(p);
+	if (l->w == NULL) {
+		openvcd_free_epochs(l->epochs);
+		free(l);
+		return NULL;
+	}
+	openvcd_wave_share(l->w, l->epochs);
+
+	l->p = p;
+	l->progress = progress;
+	l->progress_ctx = ctx;
+	l->records = 0;
+	l->reported = 0;
+	l->bytes = p->body_offset;
+	l->done = 0;
+	l->cancel = 0;
+
+	/* without a thread, the caller just has to wait for everything */
+	l->started = (pthread_create(&(l->thread), NULL, load_changes, l) == 0);
+	if (!l->started) { load_changes(l); }
+
+	return l;
+}
+
+void openvcd_loader_cancel(openvcd_loader* l) {
+	__atomic_store_n(&(l->cancel), 1, __ATOMIC_RELAXED);
+}
+
+bool openvcd_loader_done(const openvcd_loader* l) {
+	return __atomic_load_n(&(l->done), __ATOMIC_ACQUIRE) != 0;
+}
+
+size_t openvcd_loader_bytes(const openvcd_loader* l) {
+	return __atomic_load_n(&(l->bytes), __ATOMIC_RELAXED);
+}
+
+int openvcd_loader_wait(openvcd_loader* l) {
+	if (l->started) {
+		pthread_join(l->thread, NULL);
+		l->started = false;
+	}
+
+	return (l->p->state == OPENVCD_PARSER_STATE_ERROR) ? -1 : 0;
+}
+
+openvcd_wave* openvcd_loader_take(openvcd_loader* l) {
+	openvcd_signal* s;
+	openvcd_wave* w;
+	int i;
+
+	if ((openvcd_loader_wait(l) != 0) || (l->w == NULL)) { return NULL; }
+
+	/* the epochs go with the loader */
+	w = l->w;
+	vec_foreach(&(w->signals), s, i) {
+		s->epochs = NULL;
+	}
+	l->w = NULL;
+
+	return w;
+}
+
+void openvcd_free_loader(openvcd_loader* l) {
+	openvcd_loader_cancel(l);
+	openvcd_loader_wait(l);
+
+	if (l->w != NULL) { openvcd_free_wave(l->w); }
+	openvcd_free_epochs(l->epochs);
+	free(l);
+}
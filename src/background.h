@@ -0,0 +1,159 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements loading a VCD file in the background, so that a
+ * viewer can show the design's hierarchy as soon as the declarations have
+ * been read, rather than once the whole file has.
+ *
+ * openvcd_load_background() reads the declarations on the calling thread,
+ * and returns with the waveform's scopes and signals in place. The value
+ * changes are then loaded on another thread, and can be read from any
+ * thread as they arrive, using the functions in live.h with the loader's
+ * epochs.
+ *
+ * Every OPENVCD_BLOCK_CHANGES records the loader checks whether it has been
+ * cancelled, and now and then it reports how far it has got to a progress
+ * callback.
+ */
+
+#ifndef OPENVCD_BACKGROUND_H
+#define OPENVCD_BACKGROUND_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "util.h"
+#include "parser.h"
+#include "wave.h"
+#include "live.h"
+
+/**** TYPES ******************************************************************/
+
+/* the least number of bytes read between calls to the progress callback */
+#define OPENVCD_PROGRESS_BYTES (1024 * 1024)
+
+/* called on the loading thread with the number of bytes of the input read
+ * so far, and the latest simulation time loaded */
+typedef void (*openvcd_progress)(void* ctx, size_t bytes, uint64_t time);
+
+typedef struct {
+	/* only used by the loading thread until it is finished */
+	openvcd_parser* p;
+
+	/* the waveform being loaded, NULL once it has been taken */
+	openvcd_wave* w;
+
+	/* for reading w while it is loaded, see live.h */
+	openvcd_epochs* epochs;
+
+	openvcd_progress progress;
+	void* progress_ctx;
+
+	pthread_t thread;
+	bool started;
+
+	/* records applied, and bytes read as of the last progress report */
+	uint64_t records;
+	size_t reported;
+
+	/* written by the loading thread, and read by any */
+	size_t bytes;
+	int done;
+
+	/* set by openvcd_loader_cancel() */
+	int cancel;
+} openvcd_loader;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Read the declarations of a VCD file, then load it's value changes
+ * on another thread.
+ *
+ * The parser must not be used again until the load has finished, see
+ * openvcd_loader_wait().
+ *
+ * @param p
+ * @param progress Called now and then while loading, and once at the end.
+ * May be NULL.
+ * @param ctx Passed to progress.
+ *
+ * @return The new loader, whose waveform already has every scope and
+ * signal, or NULL if the declarations could not be read, in which case
+ * the error is in the parser.
+ */
+openvcd_loader* openvcd_load_background(openvcd_parser* p, openvcd_progress progress, void* ctx);
+
+/**
+ * @brief Ask a loader to stop.
+ *
+ * The load then fails, with the parser's error string saying it was
+ * cancelled.
+ *
+ * @param l
+ */
+void openvcd_loader_cancel(openvcd_loader* l);
+
+/**
+ * @brief Return true once a loader has finished, successfully or not.
+ *
+ * @param l
+ *
+ * @return
+ */
+bool openvcd_loader_done(const openvcd_loader* l);
+
+/**
+ * @brief Return the number of bytes of the input a loader has read.
+ *
+ * @param l
+ *
+ * @return
+ */
+size_t openvcd_loader_bytes(const openvcd_loader* l);
+
+/**
+ * @brief Wait for a loader to finish.
+ *
+ * @param l
+ *
+ * @return 0 if every change was loaded, or -1 on error or if the load was
+ * cancelled, in which case the details are in the parser.
+ */
+int openvcd_loader_wait(openvcd_loader* l);
+
+/**
+ * @brief Wait for a loader to finish, and take it's waveform.
+ *
+ * There must be no readers left, since the waveform is no longer shared
+ * afterwards.
+ *
+ * @param l
+ *
+ * @return The waveform, which the caller must free, or NULL if the load
+ * failed.
+ */
+openvcd_wave* openvcd_loader_take(openvcd_loader* l);
+
+/**
+ * @brief Free a loader, cancelling it first if it hasn't finished.
+ *
+ * The waveform is free-ed too, unless it has been taken.
+ *
+ * @param l
+ */
+void openvcd_free_loader(openvcd_loader* l);
+
+#endif /* OPENVCD_BACKGROUND_H */
@@ -0,0 +1,163 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "background.h"
+
+typedef struct {
+	size_t calls;
+	size_t bytes;
+	uint64_t time;
+	bool bad;
+} progress_ctx;
+
+/* a clock, and a counter in top.core which steps with it */
+static char* make_counter(int nsteps, size_t* length) {
+	char* buffer;
+	FILE* f;
+
+	f = open_memstream(&buffer, length);
+	should_not_be_null(f);
+
+	fprintf(f, "$timescale 1ns $end\n$scope module top $end\n");
+	fprintf(f, "$var wire 1 c clk $end\n$scope module core $end\n");
+	fprintf(f, "$var wire 8 v data $end\n$upscope $end\n");
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+	for (int t = 0 ; t < nsteps ; t++) {
+		fprintf(f, "#%d\n%dc\nb%d%d%d%d v\n", t * 2, t % 2,
+			(t >> 3) & 1, (t >> 2) & 1, (t >> 1) & 1, t & 1);
+	}
+
+	fclose(f);
+	return buffer;
+}
+
+static void on_progress(void* arg, size_t bytes, uint64_t time) {
+	progress_ctx* ctx;
+
+	ctx = (progress_ctx*) arg;
+	if ((bytes < ctx->bytes) || (time < ctx->time)) { ctx->bad = true; }
+	ctx->bytes = bytes;
+	ctx->time = time;
+	ctx->calls++;
+}
+
+void test_load_background(void) {
+	openvcd_parser* p;
+	openvcd_loader* l;
+	openvcd_wave* w;
+	openvcd_signal* v;
+	progress_ctx ctx;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	uint64_t end;
+	char* buffer;
+	size_t length;
+
+	buffer = make_counter(400000, &length);
+	should_be_true(length > 2 * OPENVCD_PROGRESS_BYTES);
+	memset(&ctx, 0, sizeof(ctx));
+
+	p = string_parser(buffer, length);
+	l = openvcd_load_background(p, on_progress, &ctx);
+	should_not_be_null(l);
+
+	/* the hierarchy is there straight away */
+	should_not_be_null(l->w->root);
+	should_be_true(kh_containsk(openvcd_mscope, l->w->root->child_scopes, "top"));
+	v = openvcd_wave_find_signal(l->w, "v");
+	should_not_be_null(v);
+
+	/* and so is whatever has been loaded so far */
+	while (!openvcd_loader_done(l)) {
+		end = openvcd_live_end_time(l->w);
+		if ((end > 0) && openvcd_live_value_at(l->epochs, v, end - 1, aval, bval)) {
+			should_equal(aval[0], ((end - 1) / 2) & 0xf);
+		}
+		should_be_true(openvcd_loader_bytes(l) <= length);
+	}
+
+	should_equal(openvcd_loader_wait(l), 0);
+	check_parser_error(p);
+	should_be_true(ctx.calls >= 2);
+	should_be_false(ctx.bad);
+	should_equal(ctx.bytes, length);
+	should_equal(ctx.time, 2 * (400000 - 1));
+	should_equal(openvcd_loader_bytes(l), length);
+
+	w = openvcd_loader_take(l);
+	should_not_be_null(w);
+	should_be_null(openvcd_loader_take(l));
+	openvcd_free_loader(l);
+
+	should_equal(w->end_time, 2 * (400000 - 1));
+	should_equal(openvcd_wave_find_signal(w, "c")->change_count, 400000);
+	should_equal(openvcd_wave_find_signal(w, "v")->change_count, 400000);
+	openvcd_free_wave(w);
+	openvcd_free_parser(p);
+
+	free(buffer);
+}
+
+void test_load_background_cancel(void) {
+	openvcd_parser* p;
+	openvcd_loader* l;
+	char* buffer;
+	size_t length;
+
+	buffer = make_counter(400000, &length);
+
+	p = string_parser(buffer, length);
+	l = openvcd_load_background(p, NULL, NULL);
+	should_not_be_null(l);
+	openvcd_loader_cancel(l);
+	should_equal(openvcd_loader_wait(l), -1);
+	parser_should_error(p);
+	should_not_be_null(strstr(p->error_string, "load cancelled"));
+	should_be_null(openvcd_loader_take(l));
+	openvcd_free_loader(l);
+	openvcd_free_parser(p);
+
+	/* freeing a loader which is still going cancels it */
+	p = string_parser(buffer, length);
+	l = openvcd_load_background(p, NULL, NULL);
+	should_not_be_null(l);
+	openvcd_free_loader(l);
+	openvcd_free_parser(p);
+
+	free(buffer);
+}
+
+void test_load_background_errors(void) {
+	const char* bad_header = "$var wire 1 ! a $end $scope";
+	const char* bad_body = "$var wire 1 ! a $end $enddefinitions $end #0 1! #5 1?\n";
+	openvcd_parser* p;
+	openvcd_loader* l;
+
+	p = string_parser((char*) bad_header, strlen(bad_header));
+	should_be_null(openvcd_load_background(p, NULL, NULL));
+	parser_should_error(p);
+	openvcd_free_parser(p);
+
+	p = string_parser((char*) bad_body, strlen(bad_body));
+	l = openvcd_load_background(p, NULL, NULL);
+	should_not_be_null(l);
+	should_equal(openvcd_loader_wait(l), -1);
+	parser_should_error(p);
+	should_be_null(openvcd_loader_take(l));
+	openvcd_free_loader(l);
+	openvcd_free_parser(p);
+}
+
+int main(void) {
+	test_load_background();
+	test_load_background_cancel();
+	test_load_background_errors();
+	return 0;
+}
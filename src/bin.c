@@ -0,0 +1,660 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "bin.h"
+
+typedef vec_t(openvcd_bin_scope) bin_scopelist;
+typedef vec_t(openvcd_bin_var) bin_varlist;
+
+/* the hierarchy, flattened into the tables that will be written */
+typedef struct {
+	const openvcd_wave* w;
+	const openvcd_heatmap* activity;
+	vec_char_t strings;
+	bin_scopelist scopes;
+	bin_varlist vars;
+} bin_builder;
+
+/* a stream which keeps track of how much has been written to it */
+typedef struct {
+	FILE* stream;
+	uint64_t position;
+	int rc;
+} bin_writer;
+
+static uint64_t align(uint64_t n) {
+	return (n + (OPENVCD_BIN_ALIGN - 1)) & ~((uint64_t) (OPENVCD_BIN_ALIGN - 1));
+}
+
+static uint64_t add_string(bin_builder* b, const char* s) {
+	uint64_t offset;
+	int length;
+
+	if (s == NULL) { return OPENVCD_BIN_NO_STRING; }
+
+	offset = (uint64_t) b->strings.length;
+	length = (int) strlen(s) + 1;
+	vec_pusharr(&(b->strings), s, length);
+
+	/* vec_pusharr() fails silently */
+	if ((uint64_t) b->strings.length != offset + (uint64_t) length) {
+		return OPENVCD_BIN_NO_STRING;
+	}
+
+	return offset;
+}
+
+static int build_var(bin_builder* b, const openvcd_var* v, uint32_t scope) {
+	openvcd_bin_var bv;
+	size_t signal;
+
+	if (!openvcd_wave_signal_number(b->w, v->identifier_code,
+		strlen(v->identifier_code), &signal)) {
+		return -1;
+	}
+
+	memset(&bv, 0, sizeof(bv));
+	bv.name = add_string(b, (v->reference == NULL) ? "" : v->reference->identifier);
+	bv.signal = signal;
+	bv.scope = scope;
+	bv.type = (uint32_t) v->type;
+	bv.msb_index = (v->reference == NULL) ? -1 : v->reference->msb_index;
+	bv.lsb_index = (v->reference == NULL) ? -1 : v->reference->lsb_index;
+	bv.width = v->width;
+
+	if (bv.name == OPENVCD_BIN_NO_STRING) { return -1; }
+
+	return vec_push(&(b->vars), bv);
+}
+
+/* write a scope, and then it's children in the order they were declared */
+static int build_scope(bin_builder* b, const openvcd_scope* s, uint32_t parent) {
+	openvcd_bin_scope bs;
+	openvcd_child* children;
+	uint32_t index;
+	size_t n;
+	int rc;
+
+	memset(&bs, 0, sizeof(bs));
+	index = (uint32_t) b->scopes.length;
+	bs.name = add_string(b, s->identifier);
+	bs.parent = parent;
+	bs.type = (uint32_t) s->type;
+
+	if (bs.name == OPENVCD_BIN_NO_STRING) { return -1; }
+	if (vec_push(&(b->scopes), bs) != 0) { return -1; }
+
+	children = openvcd_scope_children(s, &n);
+	if (children == NULL) { return -1; }
+
+	/* children are always written after their parent */
+	rc = 0;
+	for (size_t i = 0 ; (i < n) && (rc == 0) ; i++) {
+		if (children[i].var != NULL) {
+			rc = build_var(b, children[i].var, index);
+		} else {
+			rc = build_scope(b, children[i].scope, index);
+		}
+	}
+
+	free(children);
+
+	return rc;
+}
+
+/* build the string table and hierarchy, and fill in the header */
+static int build(bin_builder* b, openvcd_bin_header* h) {
+	const openvcd_wave* w;
+	openvcd_signal* s;
+	int i;
+
+	w = b->w;
+
+	memset(h, 0, sizeof(openvcd_bin_header));
+	memcpy(h->magic, OPENVCD_BIN_MAGIC, 8);
+	h->byte_order = OPENVCD_BIN_BYTE_ORDER;
+	h->version = OPENVCD_BIN_VERSION;
+	h->timescale_n = w->timescale.n;
+	h->timescale_unit = (uint32_t) w->timescale.u;
+	h->end_time = w->end_time;
+
+	h->version_string = add_string(b, w->version);
+	h->date_string = add_string(b, w->date);
+	if ((w->version != NULL) && (h->version_string == OPENVCD_BIN_NO_STRING)) { return -1; }
+	if ((w->date != NULL) && (h->date_string == OPENVCD_BIN_NO_STRING)) { return -1; }
+
+	if ((w->root != NULL) && (build_scope(b, w->root, OPENVCD_BIN_NO_PARENT) != 0)) {
+		return -1;
+	}
+
+	vec_foreach(&(w->signals), s, i) {
+		h->nblocks += s->nblocks;
+		h->data_length += s->data_length;
+	}
+
+	h->nscopes = (uint64_t) b->scopes.length;
+	h->nvars = (uint64_t) b->vars.length;
+	h->nsignals = (uint64_t) w->signals.length;
+
+	/* the identifier codes follow the rest of the strings, in signal
+	 * order, see write_signals() */
+	h->strings_offset = align(sizeof(openvcd_bin_header));
+	h->strings_length = (uint64_t) b->strings.length;
+	vec_foreach(&(w->signals), s, i) {
+		h->strings_length += strlen(s->id_code) + 1;
+	}
+
+	h->scopes_offset = align(h->strings_offset + h->strings_length);
+	h->vars_offset = align(h->scopes_offset + (h->nscopes * sizeof(openvcd_bin_scope)));
+	h->signals_offset = align(h->vars_offset + (h->nvars * sizeof(openvcd_bin_var)));
+	h->blocks_offset = align(h->signals_offset + (h->nsignals * sizeof(openvcd_bin_signal)));
+	h->data_offset = align(h->blocks_offset + (h->nblocks * sizeof(openvcd_block)));
+
+	h->nsnapshots = w->snapshots.nsnapshots;
+	h->ndirty = w->snapshots.ndirty;
+	h->snapshot_data_length = w->snapshots.data_length;
+	h->snapshots_offset = align(h->data_offset + h->data_length);
+	h->dirty_offset = align(h->snapshots_offset + (h->nsnapshots * sizeof(openvcd_snapshot)));
+	h->snapshot_data_offset = align(h->dirty_offset + (h->ndirty * sizeof(uint64_t)));
+
+	if (b->activity != NULL) {
+		h->activity_width = b->activity->width;
+		h->nactivity = b->activity->nbuckets;
+	}
+	h->activity_offset = align(h->snapshot_data_offset + h->snapshot_data_length);
+
+	return 0;
+}
+
+static void put(bin_writer* bw, const void* data, size_t length) {
+	if ((bw->rc != 0) || (length == 0)) { return; }
+	if (fwrite(data, 1, length, bw->stream) != length) {
+		bw->rc = -1;
+		return;
+	}
+	bw->position += length;
+}
+
+/* pad with zeros up to the given offset */
+static void pad(bin_writer* bw, uint64_t offset) {
+	static const char zeros[OPENVCD_BIN_ALIGN];
+
+	if (offset > bw->position) {
+		put(bw, zeros, (size_t) (offset - bw->position));
+	}
+}
+
+static void write_signals(bin_writer* bw, const openvcd_wave* w, uint64_t id_code) {
+	openvcd_bin_signal bs;
+	openvcd_signal* s;
+	uint64_t first_block;
+	uint64_t data_offset;
+	int i;
+
+	first_block = 0;
+	data_offset = 0;
+	vec_foreach(&(w->signals), s, i) {
+		memset(&bs, 0, sizeof(bs));
+		bs.id_code = id_code;
+		bs.first_block = first_block;
+		bs.nblocks = s->nblocks;
+		bs.data_offset = data_offset;
+		bs.data_length = s->data_length;
+		bs.change_count = s->change_count;
+		bs.width = s->width;
+		bs.flags = s->real ? OPENVCD_BIN_SIGNAL_REAL : 0;
+		put(bw, &bs, sizeof(bs));
+
+		id_code += strlen(s->id_code) + 1;
+		first_block += s->nblocks;
+		data_offset += s->data_length;
+	}
+}
+
+/* write the sections which come from a source, which must write exactly the
+ * expected number of bytes */
+static void put_source(bin_writer* bw, int (*write)(void*, FILE*), void* ctx, uint64_t length) {
+	if (bw->rc != 0) { return; }
+	if (write(ctx, bw->stream) != 0) {
+		bw->rc = -1;
+		return;
+	}
+	bw->position += length;
+}
+
+static int write_file(const bin_builder* b, const openvcd_bin_header* h, const openvcd_bin_source* source, FILE* stream) {
+	const openvcd_wave* w;
+	openvcd_signal* s;
+	bin_writer bw;
+	int i;
+
+	w = b->w;
+	bw.stream = stream;
+	bw.position = 0;
+	bw.rc = 0;
+
+	put(&bw, h, sizeof(openvcd_bin_header));
+
+	pad(&bw, h->strings_offset);
+	put(&bw, b->strings.data, (size_t) b->strings.length);
+	vec_foreach(&(w->signals), s, i) {
+		put(&bw, s->id_code, strlen(s->id_code) + 1);
+	}
+
+	pad(&bw, h->scopes_offset);
+	put(&bw, b->scopes.data, sizeof(openvcd_bin_scope) * (size_t) b->scopes.length);
+
+	pad(&bw, h->vars_offset);
+	put(&bw, b->vars.data, sizeof(openvcd_bin_var) * (size_t) b->vars.length);
+
+	pad(&bw, h->signals_offset);
+	write_signals(&bw, w, (uint64_t) b->strings.length);
+
+	pad(&bw, h->blocks_offset);
+	if (source != NULL) {
+		put_source(&bw, source->write_blocks, source->ctx, h->nblocks * sizeof(openvcd_block));
+	} else {
+		vec_foreach(&(w->signals), s, i) {
+			put(&bw, s->blocks, sizeof(openvcd_block) * s->nblocks);
+		}
+	}
+
+	pad(&bw, h->data_offset);
+	if (source != NULL) {
+		put_source(&bw, source->write_data, source->ctx, h->data_length);
+	} else {
+		vec_foreach(&(w->signals), s, i) {
+			put(&bw, s->data, s->data_length);
+		}
+	}
+
+	pad(&bw, h->snapshots_offset);
+	put(&bw, w->snapshots.snapshots, sizeof(openvcd_snapshot) * w->snapshots.nsnapshots);
+	pad(&bw, h->dirty_offset);
+	put(&bw, w->snapshots.dirty, sizeof(uint64_t) * w->snapshots.ndirty);
+	pad(&bw, h->snapshot_data_offset);
+	put(&bw, w->snapshots.data, w->snapshots.data_length);
+
+	pad(&bw, h->activity_offset);
+	if (b->activity != NULL) {
+		put(&bw, b->activity->counts, sizeof(uint64_t) * b->activity->nbuckets);
+	}
+
+	return bw.rc;
+}
+
+int openvcd_bin_write(const openvcd_wave* w, FILE* stream) {
+	return openvcd_bin_write_from(w, NULL, stream);
+}
+
+/* the activity of a waveform whose changes are in memory */
+static openvcd_heatmap* count_activity(const openvcd_wave* w) {
+	openvcd_heatmap* h;
+	openvcd_signal* s;
+	int i;
+
+	h = openvcd_new_heatmap(OPENVCD_HEATMAP_BUCKETS, w->end_time);
+	if (h == NULL) { return NULL; }
+
+	vec_foreach(&(w->signals), s, i) {
+		if (openvcd_heatmap_add_signal(h, s) != 0) {
+			openvcd_free_heatmap(h);
+			return NULL;
+		}
+	}
+
+	return h;
+}
+
+int openvcd_bin_write_from(const openvcd_wave* w, const openvcd_bin_source* source, FILE* stream) {
+	openvcd_heatmap* activity;
+	openvcd_bin_header h;
+	bin_builder b;
+	int rc;
+
+	/* changes which come from a source can't be counted here */
+	activity = NULL;
+	if ((w->activity == NULL) && (source == NULL)) {
+		activity = count_activity(w);
+		if (activity == NULL) { return -1; }
+	}
+
+	b.w = w;
+	b.activity = (w->activity != NULL) ? w->activity : activity;
+	vec_init(&(b.strings));
+	vec_init(&(b.scopes));
+	vec_init(&(b.vars));
+
+	rc = build(&b, &h);
+	if (rc == 0) { rc = write_file(&b, &h, source, stream); }
+
+	vec_deinit(&(b.strings));
+	vec_deinit(&(b.scopes));
+	vec_deinit(&(b.vars));
+	if (activity != NULL) { openvcd_free_heatmap(activity); }
+
+	return rc;
+}
+
+/* true if the n elements of size bytes at offset fit in the file */
+static bool in_bounds(size_t length, uint64_t offset, uint64_t n, size_t size) {
+	if (offset > length) { return false; }
+	if ((size != 0) && (n > (length - offset) / size)) { return false; }
+	return true;
+}
+
+static bool check_header(const openvcd_bin_header* h, size_t length) {
+	if (length < sizeof(openvcd_bin_header)) { return false; }
+	if (memcmp(h->magic, OPENVCD_BIN_MAGIC, 8) != 0) { return false; }
+	if (h->byte_order != OPENVCD_BIN_BYTE_ORDER) { return false; }
+	if (h->version != OPENVCD_BIN_VERSION) { return false; }
+
+	return in_bounds(length, h->strings_offset, h->strings_length, 1) &&
+		in_bounds(length, h->scopes_offset, h->nscopes, sizeof(openvcd_bin_scope)) &&
+		in_bounds(length, h->vars_offset, h->nvars, sizeof(openvcd_bin_var)) &&
+		in_bounds(length, h->signals_offset, h->nsignals, sizeof(openvcd_bin_signal)) &&
+		in_bounds(length, h->blocks_offset, h->nblocks, sizeof(openvcd_block)) &&
+		in_bounds(length, h->data_offset, h->data_length, 1) &&
+		in_bounds(length, h->snapshots_offset, h->nsnapshots, sizeof(openvcd_snapshot)) &&
+		in_bounds(length, h->dirty_offset, h->ndirty, sizeof(uint64_t)) &&
+		in_bounds(length, h->snapshot_data_offset, h->snapshot_data_length, 1) &&
+		in_bounds(length, h->activity_offset, h->nactivity, sizeof(uint64_t));
+}
+
+/* a copy of the activity section, so that it can be freed with the wave like
+ * any other, or NULL if it is empty or not a valid histogram */
+static openvcd_heatmap* read_activity(const char* mapping, const openvcd_bin_header* h) {
+	openvcd_heatmap* activity;
+
+	if ((h->nactivity < 2) || (h->activity_width == 0)) { return NULL; }
+	if ((h->activity_width & (h->activity_width - 1)) != 0) { return NULL; }
+
+	activity = openvcd_new_heatmap((size_t) h->nactivity, 0);
+	if (activity == NULL) { return NULL; }
+
+	activity->width = h->activity_width;
+	memcpy(activity->counts, mapping + h->activity_offset, (size_t) h->nactivity * sizeof(uint64_t));
+
+	return activity;
+}
+
+/* a null terminated string from the string table, or NULL if the offset is
+ * invalid */
+static const char* get_string(const char* mapping, const openvcd_bin_header* h, uint64_t offset) {
+	const char* s;
+
+	if (offset >= h->strings_length) { return NULL; }
+
+	s = mapping + h->strings_offset + offset;
+	if (memchr(s, '\0', (size_t) (h->strings_length - offset)) == NULL) {
+		return NULL;
+	}
+
+	return s;
+}
+
+/* rebuild the scope tree, returning the root */
+static openvcd_scope* read_scopes(const char* mapping, const openvcd_bin_header* h, openvcd_scope** scopes) {
+	const openvcd_bin_scope* bs;
+	openvcd_scope* parent;
+	const char* name;
+
+	bs = (const openvcd_bin_scope*) (mapping + h->scopes_offset);
+	for (uint64_t i = 0 ; i < h->nscopes ; i++) {
+		scopes[i] = NULL;
+		name = get_string(mapping, h, bs[i].name);
+		if (name == NULL) { return NULL; }
+
+		/* only the first scope may be the root */
+		if ((i == 0) != (bs[i].parent == OPENVCD_BIN_NO_PARENT)) { return NULL; }
+		if ((i != 0) && (bs[i].parent >= i)) { return NULL; }
+		if (bs[i].type > OPENVCD_SCOPE_TASK) { return NULL; }
+		parent = (i == 0) ? NULL : scopes[bs[i].parent];
+
+		scopes[i] = openvcd_alloc_scope(parent, (char*) name, (openvcd_scope_type) bs[i].type);
+		if (scopes[i] == NULL) { return NULL; }
+	}
+
+	return scopes[0];
+}
+
+/* true if every signal has the width of one of it's variables, checked
+ * before the widths are used to allocate anything */
+static bool check_widths(const char* mapping, const openvcd_bin_header* h) {
+	const openvcd_bin_signal* bs;
+	const openvcd_bin_var* bv;
+	bool* matched;
+	bool valid;
+
+	bs = (const openvcd_bin_signal*) (mapping + h->signals_offset);
+	bv = (const openvcd_bin_var*) (mapping + h->vars_offset);
+
+	matched = calloc((size_t) h->nsignals + 1, sizeof(bool));
+	if (matched == NULL) { return false; }
+
+	/* real values are always 64 bits, whatever the declared width */
+	for (uint64_t i = 0 ; i < h->nvars ; i++) {
+		if (bv[i].signal >= h->nsignals) { continue; }
+		if (bs[bv[i].signal].flags & OPENVCD_BIN_SIGNAL_REAL) {
+			matched[bv[i].signal] = (bs[bv[i].signal].width == 64);
+		} else if (bv[i].width == bs[bv[i].signal].width) {
+			matched[bv[i].signal] = true;
+		}
+	}
+
+	valid = true;
+	for (uint64_t i = 0 ; i < h->nsignals ; i++) {
+		if ((bs[i].width == 0) || !matched[i]) { valid = false; }
+	}
+
+	free(matched);
+	return valid;
+}
+
+static int read_signals(openvcd_wave* w, const char* mapping, const openvcd_bin_header* h) {
+	const openvcd_bin_signal* bs;
+	openvcd_block* blocks;
+	openvcd_signal* s;
+	const char* id;
+
+	bs = (const openvcd_bin_signal*) (mapping + h->signals_offset);
+	blocks = (openvcd_block*) (mapping + h->blocks_offset);
+	for (uint64_t i = 0 ; i < h->nsignals ; i++) {
+		id = get_string(mapping, h, bs[i].id_code);
+		if (id == NULL) { return -1; }
+		if (!in_bounds(h->nblocks, bs[i].first_block, bs[i].nblocks, 1)) { return -1; }
+		if (!in_bounds(h->data_length, bs[i].data_offset, bs[i].data_length, 1)) { return -1; }
+
+		s = openvcd_wave_add_signal(w, id, bs[i].width, bs[i].flags & OPENVCD_BIN_SIGNAL_REAL);
+		if ((s == NULL) || ((uint64_t) w->signals.length != i + 1)) { return -1; }
+
+		/* the mapping is read only, so the signal must not be
+		 * appended to, but the const can't be expressed here */
+		s->owned = false;
+		s->blocks = blocks + bs[i].first_block;
+		s->nblocks = (size_t) bs[i].nblocks;
+		s->blocks_capacity = s->nblocks;
+		s->data = (unsigned char*) (mapping + h->data_offset + bs[i].data_offset);
+		s->data_length = (size_t) bs[i].data_length;
+		s->data_capacity = s->data_length;
+		s->change_count = bs[i].change_count;
+		if (s->nblocks > 0) {
+			s->last_flags = s->blocks[s->nblocks - 1].flags & (OPENVCD_BLOCK_LAST_STATE | OPENVCD_BLOCK_LAST_XZ);
+		}
+	}
+
+	return 0;
+}
+
+static int read_vars(openvcd_wave* w, const char* mapping, const openvcd_bin_header* h, openvcd_scope** scopes) {
+	const openvcd_bin_var* bv;
+	openvcd_reference* r;
+	openvcd_signal* s;
+	openvcd_var* v;
+	const char* name;
+
+	bv = (const openvcd_bin_var*) (mapping + h->vars_offset);
+	for (uint64_t i = 0 ; i < h->nvars ; i++) {
+		name = get_string(mapping, h, bv[i].name);
+		if (name == NULL) { return -1; }
+		if ((bv[i].scope >= h->nscopes) || (bv[i].signal >= h->nsignals)) { return -1; }
+		if (bv[i].type > OPENVCD_VAR_WOR) { return -1; }
+		s = w->signals.data[bv[i].signal];
+
+		r = openvcd_alloc_reference((char*) name, bv[i].lsb_index, bv[i].msb_index);
+		if (r == NULL) { return -1; }
+
+		v = openvcd_alloc_var(scopes[bv[i].scope], (openvcd_var_type) bv[i].type,
+			bv[i].width, r, s->id_code);
+		if (v == NULL) {
+			openvcd_free_reference(r);
+			return -1;
+		}
+
+		if (s->var == NULL) { s->var = v; }
+	}
+
+	return 0;
+}
+
+static openvcd_wave* read_wave(const char* mapping, const openvcd_bin_header* h) {
+	openvcd_timescale ts;
+	openvcd_scope** scopes;
+	openvcd_scope* root;
+	openvcd_wave* w;
+	const char* version;
+	const char* date;
+	int rc;
+
+	if (h->timescale_unit > openvcd_unit_undefined) { return NULL; }
+
+	scopes = calloc((size_t) h->nscopes + 1, sizeof(openvcd_scope*));
+	if (scopes == NULL) { return NULL; }
+
+	root = read_scopes(mapping, h, scopes);
+	if ((root == NULL) && (h->nscopes != 0)) {
+		/* the tree is only partially built, but every scope is
+		 * reachable from the first one */
+		if (scopes[0] != NULL) { openvcd_free_scope(scopes[0]); }
+		free(scopes);
+		return NULL;
+	}
+
+	ts.n = h->timescale_n;
+	ts.u = (openvcd_unit) h->timescale_unit;
+	w = openvcd_alloc_wave(root, ts);
+	if (w == NULL) {
+		if (root != NULL) { openvcd_free_scope(root); }
+		free(scopes);
+		return NULL;
+	}
+	w->end_time = h->end_time;
+
+	version = get_string(mapping, h, h->version_string);
+	date = get_string(mapping, h, h->date_string);
+	if (version != NULL) { w->version = strdup(version); }
+	if (date != NULL) { w->date = strdup(date); }
+
+	rc = check_widths(mapping, h) ? read_signals(w, mapping, h) : -1;
+	if (rc == 0) { rc = read_vars(w, mapping, h, scopes); }
+	free(scopes);
+
+	/* snapshots are checked as they are decoded, see wave.c */
+	w->snapshots.owned = false;
+	w->snapshots.snapshots = (openvcd_snapshot*) (mapping + h->snapshots_offset);
+	w->snapshots.nsnapshots = (size_t) h->nsnapshots;
+	w->snapshots.dirty = (uint64_t*) (mapping + h->dirty_offset);
+	w->snapshots.ndirty = (size_t) h->ndirty;
+	w->snapshots.data = (unsigned char*) (mapping + h->snapshot_data_offset);
+	w->snapshots.data_length = (size_t) h->snapshot_data_length;
+
+	w->activity = read_activity(mapping, h);
+
+	if (rc != 0) {
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+openvcd_wave* openvcd_bin_open(const char* path) {
+	const openvcd_bin_header* h;
+	openvcd_wave* w;
+	void* mapping;
+	size_t length;
+
+	mapping = openvcd_map_file(path, &length);
+	if (mapping == NULL) { return NULL; }
+
+	h = (const openvcd_bin_header*) mapping;
+	if (!check_header(h, length)) {
+		openvcd_unmap(mapping, length);
+		return NULL;
+	}
+
+	w = read_wave((const char*) mapping, h);
+	if (w == NULL) {
+		openvcd_unmap(mapping, length);
+		return NULL;
+	}
+
+	w->mapping = mapping;
+	w->mapping_length = length;
+
+	w->cache = openvcd_alloc_cache(0);
+	if (w->cache == NULL) {
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+int openvcd_bin_convert(const char* vcd_path, const char* bin_path, uint64_t time_interval, uint64_t change_interval, char** error) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	FILE* in;
+	FILE* out;
+	int rc;
+
+	if (error != NULL) { *error = NULL; }
+
+	in = fopen(vcd_path, "r");
+	if (in == NULL) {
+		if (error != NULL) { *error = strdup("failed to open file"); }
+		return -1;
+	}
+
+	source.input_stream = in;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	if (p == NULL) {
+		fclose(in);
+		return -1;
+	}
+
+	w = openvcd_load_snapshots(p, time_interval, change_interval);
+	if (w == NULL) {
+		if ((error != NULL) && (p->error_string != NULL)) { *error = strdup(p->error_string); }
+		openvcd_free_parser(p);
+		fclose(in);
+		return -1;
+	}
+	openvcd_free_parser(p);
+	fclose(in);
+
+	rc = -1;
+	out = fopen(bin_path, "wb");
+	if (out != NULL) {
+		rc = openvcd_bin_write(w, out);
+		if (fclose(out) != 0) { rc = -1; }
+	}
+	if ((rc != 0) && (error != NULL)) { *error = strdup("failed to write output"); }
+
+	openvcd_free_wave(w);
+
+	return rc;
+}
@@ -0,0 +1,224 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements OpenVCD's native binary waveform format.
+ *
+ * A binary file holds the same information as an openvcd_wave: the scope
+ * hierarchy, the dense signal table, and each signal's compressed change
+ * blocks. It is laid out so that it can be mapped into memory and queried
+ * directly; the reader only builds the scope tree and signal table, and the
+ * signals' blocks and data point straight into the mapping. Opening a file
+ * therefore costs time proportional to the hierarchy rather than the number
+ * of changes, and concurrent readers share the page cache.
+ *
+ * The file consists of the header followed by these sections, each of which
+ * starts at a multiple of OPENVCD_BIN_ALIGN bytes:
+ *
+ *	strings	null terminated strings, referred to by offset
+ *	scopes	openvcd_bin_scope[nscopes], parents always precede children
+ *	vars	openvcd_bin_var[nvars]
+ *	signals	openvcd_bin_signal[nsignals]
+ *	blocks	openvcd_block[nblocks], each signal's blocks are contiguous
+ *	data	the encoded changes of every signal, see wave.h
+ *	snapshots	openvcd_snapshot[nsnapshots]
+ *	dirty	uint64_t[ndirty], the signals listed by the snapshots
+ *	snapshot data	the encoded snapshots
+ *	activity	uint64_t[nactivity], the changes per bucket of time
+ *
+ * The snapshot sections are empty if the waveform had no snapshots. The
+ * activity section is a histogram of the changes of every signal over the
+ * whole waveform, see heatmap.h, so that a reader can show where the
+ * waveform is busy without touching the blocks.
+ * All integers are in the byte order of the machine which wrote the file,
+ * which the reader checks using the byte_order field.
+ */
+
+#ifndef OPENVCD_BIN_H
+#define OPENVCD_BIN_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "scope.h"
+#include "parser.h"
+#include "wave.h"
+#include "cache.h"
+#include "heatmap.h"
+
+/**** TYPES ******************************************************************/
+
+#define OPENVCD_BIN_MAGIC "OVCDWAVE"
+#define OPENVCD_BIN_VERSION 3
+#define OPENVCD_BIN_BYTE_ORDER 0x0102030405060708ULL
+#define OPENVCD_BIN_ALIGN 64
+
+/* parent of the root scope */
+#define OPENVCD_BIN_NO_PARENT UINT32_MAX
+
+/* string offset used for absent strings */
+#define OPENVCD_BIN_NO_STRING UINT64_MAX
+
+/* flags for openvcd_bin_signal */
+#define OPENVCD_BIN_SIGNAL_REAL 0x1
+
+typedef struct {
+	char magic[8];
+	uint64_t byte_order;
+	uint32_t version;
+	int32_t timescale_n;
+	uint32_t timescale_unit;
+	uint32_t reserved0;
+	uint64_t end_time;
+
+	uint64_t nscopes;
+	uint64_t nvars;
+	uint64_t nsignals;
+	uint64_t nblocks;
+
+	/* byte offsets of each section from the start of the file */
+	uint64_t strings_offset;
+	uint64_t strings_length;
+	uint64_t scopes_offset;
+	uint64_t vars_offset;
+	uint64_t signals_offset;
+	uint64_t blocks_offset;
+	uint64_t data_offset;
+	uint64_t data_length;
+
+	/* string offsets of the $version and $date text */
+	uint64_t version_string;
+	uint64_t date_string;
+
+	uint64_t nsnapshots;
+	uint64_t snapshots_offset;
+	uint64_t ndirty;
+	uint64_t dirty_offset;
+	uint64_t snapshot_data_offset;
+	uint64_t snapshot_data_length;
+
+	/* the width of each bucket of the activity section, or 0 if the
+	 * section is empty */
+	uint64_t activity_width;
+	uint64_t nactivity;
+	uint64_t activity_offset;
+} openvcd_bin_header;
+
+typedef struct {
+	uint64_t name;
+	uint32_t parent;
+	uint32_t type;
+} openvcd_bin_scope;
+
+typedef struct {
+	/* the reference identifier */
+	uint64_t name;
+
+	uint64_t signal;
+	uint32_t scope;
+	uint32_t type;
+	int32_t msb_index;
+	int32_t lsb_index;
+	uint32_t width;
+	uint32_t reserved;
+} openvcd_bin_var;
+
+typedef struct {
+	uint64_t id_code;
+
+	/* index of the signal's first block in the blocks section */
+	uint64_t first_block;
+	uint64_t nblocks;
+
+	/* the signal's encoded changes, relative to the data section */
+	uint64_t data_offset;
+	uint64_t data_length;
+
+	uint64_t change_count;
+	uint32_t width;
+	uint32_t flags;
+} openvcd_bin_signal;
+
+/* Writes the blocks and data sections for a waveform whose changes are not
+ * held in memory, see openvcd_bin_write_from(). */
+typedef struct {
+	/* write the blocks of every signal, in signal order, with offsets
+	 * relative to the start of the signal's data */
+	int (*write_blocks)(void* ctx, FILE* stream);
+
+	/* write the data of every signal, in signal order */
+	int (*write_data)(void* ctx, FILE* stream);
+
+	void* ctx;
+} openvcd_bin_source;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Write a waveform to a stream in the binary format.
+ *
+ * @param w
+ * @param stream
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_bin_write(const openvcd_wave* w, FILE* stream);
+
+/**
+ * @brief Write a waveform to a stream, with it's changes from a source.
+ *
+ * This is the same as openvcd_bin_write(), except that the blocks and data
+ * of the signals are written by the source rather than taken from the
+ * signals. The signals' nblocks, data_length, and change_count must be set
+ * to the totals the source will write.
+ *
+ * @param w
+ * @param source
+ * @param stream
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_bin_write_from(const openvcd_wave* w, const openvcd_bin_source* source, FILE* stream);
+
+/**
+ * @brief Open a binary waveform file.
+ *
+ * The file is mapped read-only, and the mapping is released when the
+ * waveform is free-ed with openvcd_free_wave(). Signals of the returned
+ * waveform can be queried, but not appended to. The waveform has a cache
+ * of OPENVCD_CACHE_DEFAULT_BLOCKS blocks, see openvcd_wave_value_at(). It's
+ * activity is read from the file, if the file has any.
+ *
+ * @param path
+ *
+ * @return The waveform, or NULL if the file could not be opened or is not a
+ * valid binary waveform.
+ */
+openvcd_wave* openvcd_bin_open(const char* path);
+
+/**
+ * @brief Convert a VCD file to a binary waveform file.
+ *
+ * @param vcd_path
+ * @param bin_path
+ * @param time_interval Snapshot interval, see openvcd_wave_set_snapshots().
+ * @param change_interval
+ * @param error If not NULL, set on failure to a message describing the
+ * problem which must be free-ed, or NULL if memory ran out.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_bin_convert(const char* vcd_path, const char* bin_path, uint64_t time_interval, uint64_t change_interval, char** error);
+
+#endif /* OPENVCD_BIN_H */
@@ -0,0 +1,329 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+#include <stddef.h>
+
+#include "test_util.h"
+#include "bin.h"
+
+static char* vcd =
+	"$date today $end\n"
+	"$timescale 1us $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 ! clk $end\n"
+	"$var reg 8 # data [7:0] $end\n"
+	"$scope task t $end\n"
+	"$var real 64 % level $end\n"
+	"$var wire 1 ! clk_copy $end\n"
+	"$upscope $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\n$dumpvars\n0!\nbx #\nr1.25 %\n$end\n";
+
+/* write a VCD with a few hundred changes to a temporary file */
+static void write_input(const char* path) {
+	FILE* f;
+
+	f = fopen(path, "w");
+	fputs(vcd, f);
+	for (int t = 1 ; t <= 600 ; t++) {
+		fprintf(f, "#%d\n%d!\n", t * 2, t % 2);
+		if (t % 3 == 0) { fprintf(f, "b%d%d%d #\n", (t >> 2) & 1, (t >> 1) & 1, t & 1); }
+	}
+	fprintf(f, "#1300\nr-3 %%\n");
+	fclose(f);
+}
+
+static void temp_path(char* path) {
+	int fd;
+
+	fd = mkstemp(path);
+	should_be_true(fd >= 0);
+	close(fd);
+}
+
+/* overwrite 4 bytes of a file */
+static void write_u32(const char* path, uint64_t offset, uint32_t value) {
+	FILE* f;
+
+	f = fopen(path, "r+");
+	should_not_be_null(f);
+	should_equal(fseek(f, (long) offset, SEEK_SET), 0);
+	should_equal(fwrite(&value, sizeof(value), 1, f), 1);
+	fclose(f);
+}
+
+static openvcd_scope* child_scope(openvcd_scope* s, const char* name) {
+	khint_t k;
+
+	k = kh_get(openvcd_mscope, s->child_scopes, name);
+	if (k == kh_end(s->child_scopes)) { return NULL; }
+	return kh_val(s->child_scopes, k);
+}
+
+void test_bin_roundtrip(void) {
+	char vcd_path[] = "/tmp/openvcd-bin-vcd-XXXXXX";
+	char bin_path[] = "/tmp/openvcd-bin-XXXXXX";
+	openvcd_scope* top;
+	openvcd_scope* t;
+	openvcd_signal* s;
+	openvcd_var* v;
+	openvcd_wave* w;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	khint_t k;
+
+	temp_path(vcd_path);
+	temp_path(bin_path);
+	write_input(vcd_path);
+
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, NULL), 0);
+	w = openvcd_bin_open(bin_path);
+	should_not_be_null(w);
+	should_not_be_null(w->mapping);
+
+	should_equal(w->end_time, 1300);
+	should_equal(w->timescale.n, 1);
+	should_equal(w->timescale.u, openvcd_unit_us);
+	str_should_equal(w->date, "today");
+	should_be_null(w->version);
+	should_equal(w->signals.length, 3);
+
+	/* the hierarchy */
+	should_not_be_null(w->root);
+	top = child_scope(w->root, "top");
+	should_not_be_null(top);
+	should_equal(top->type, OPENVCD_SCOPE_MODULE);
+	t = child_scope(top, "t");
+	should_not_be_null(t);
+	should_equal(t->type, OPENVCD_SCOPE_TASK);
+
+	k = kh_get(openvcd_mvar, top->child_variables, "#");
+	should_be_true(k != kh_end(top->child_variables));
+	v = kh_val(top->child_variables, k);
+	str_should_equal(v->reference->identifier, "data");
+	should_equal(v->reference->msb_index, 7);
+	should_equal(v->reference->lsb_index, 0);
+	should_equal(v->width, 8);
+	should_equal(v->type, OPENVCD_VAR_REG);
+
+	k = kh_get(openvcd_mvar, t->child_variables, "!");
+	should_be_true(k != kh_end(t->child_variables));
+	str_should_equal(kh_val(t->child_variables, k)->reference->identifier, "clk_copy");
+
+	/* the values */
+	s = openvcd_wave_find_signal(w, "!");
+	should_not_be_null(s);
+	should_be_false(s->owned);
+	should_equal(s->change_count, 601);
+	should_be_true(s->nblocks > 1);
+	should_be_true(openvcd_value_at(s, 1001, aval, bval));
+	should_equal(aval[0], 0);
+	should_be_true(openvcd_value_at(s, 1003, aval, bval));
+	should_equal(aval[0], 1);
+	should_equal(openvcd_signal_append(s, 2000, aval, bval), -1);
+
+	s = openvcd_wave_find_signal(w, "#");
+	should_be_true(openvcd_value_at(s, 1, aval, bval));
+	should_equal(bval[0], 0xff);
+	should_be_true(openvcd_value_at(s, 600, aval, bval));
+	should_equal(aval[0], 300 & 7);
+	should_equal(bval[0], 0);
+
+	s = openvcd_wave_find_signal(w, "%");
+	should_be_true(s->real);
+	should_be_true(openvcd_value_at(s, 1299, aval, bval));
+	should_equal_epsilon(openvcd_value_real(aval), 1.25, 0.0001);
+	should_be_true(openvcd_value_at(s, 1300, aval, bval));
+	should_equal_epsilon(openvcd_value_real(aval), -3.0, 0.0001);
+
+	openvcd_free_wave(w);
+	unlink(vcd_path);
+	unlink(bin_path);
+}
+
+void test_bin_order(void) {
+	char vcd_path[] = "/tmp/openvcd-bin-vcd-XXXXXX";
+	char bin_path[] = "/tmp/openvcd-bin-XXXXXX";
+	const openvcd_bin_header* h;
+	const openvcd_bin_scope* bs;
+	const openvcd_bin_var* bv;
+	char name[16];
+	char* buffer;
+	long length;
+	FILE* f;
+
+	temp_path(vcd_path);
+	temp_path(bin_path);
+
+	/* declared in the reverse of any order a hash might give */
+	f = fopen(vcd_path, "w");
+	fputs("$timescale 1ns $end\n$scope module top $end\n", f);
+	for (int i = 19 ; i >= 0 ; i--) { fprintf(f, "$var wire 1 %c n%d $end\n", 'A' + i, i); }
+	for (int i = 7 ; i >= 0 ; i--) { fprintf(f, "$scope module s%d $end\n$upscope $end\n", i); }
+	fputs("$upscope $end\n$enddefinitions $end\n#0\n", f);
+	fclose(f);
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, NULL), 0);
+
+	f = fopen(bin_path, "rb");
+	should_not_be_null(f);
+	fseek(f, 0, SEEK_END);
+	length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buffer = malloc((size_t) length);
+	should_equal(fread(buffer, 1, (size_t) length, f), (size_t) length);
+	fclose(f);
+
+	/* the root, top, and then top's scopes */
+	h = (const openvcd_bin_header*) buffer;
+	bs = (const openvcd_bin_scope*) (buffer + h->scopes_offset);
+	should_equal(h->nscopes, 10);
+	str_should_equal(buffer + h->strings_offset + bs[1].name, "top");
+	for (int i = 0 ; i < 8 ; i++) {
+		snprintf(name, sizeof(name), "s%d", 7 - i);
+		str_should_equal(buffer + h->strings_offset + bs[2 + i].name, name);
+	}
+
+	bv = (const openvcd_bin_var*) (buffer + h->vars_offset);
+	should_equal(h->nvars, 20);
+	for (int i = 0 ; i < 20 ; i++) {
+		snprintf(name, sizeof(name), "n%d", 19 - i);
+		str_should_equal(buffer + h->strings_offset + bv[i].name, name);
+	}
+
+	free(buffer);
+	unlink(vcd_path);
+	unlink(bin_path);
+}
+
+void test_bin_snapshots(void) {
+	char vcd_path[] = "/tmp/openvcd-bin-vcd-XXXXXX";
+	char bin_path[] = "/tmp/openvcd-bin-XXXXXX";
+	openvcd_state* state;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	int i;
+
+	temp_path(vcd_path);
+	temp_path(bin_path);
+	write_input(vcd_path);
+
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 100, 0, NULL), 0);
+	w = openvcd_bin_open(bin_path);
+	should_not_be_null(w);
+	should_be_false(w->snapshots.owned);
+	should_equal(w->snapshots.nsnapshots, 14);
+
+	state = openvcd_alloc_state(w);
+	for (uint64_t t = 0 ; t < 1400 ; t += 13) {
+		should_equal(openvcd_wave_state_at(w, t, state), 0);
+		vec_foreach(&(w->signals), s, i) {
+			should_equal(state->valid[i], openvcd_value_at(s, t, aval, bval));
+			should_equal(state->aval[s->word], aval[0]);
+			should_equal(state->bval[s->word], bval[0]);
+		}
+	}
+	openvcd_free_state(state);
+
+	openvcd_free_wave(w);
+	unlink(vcd_path);
+	unlink(bin_path);
+}
+
+void test_bin_invalid(void) {
+	char vcd_path[] = "/tmp/openvcd-bin-vcd-XXXXXX";
+	char bin_path[] = "/tmp/openvcd-bin-XXXXXX";
+	openvcd_bin_header h;
+	char* error;
+	FILE* f;
+
+	temp_path(vcd_path);
+	temp_path(bin_path);
+	write_input(vcd_path);
+
+	/* not a binary file */
+	should_be_null(openvcd_bin_open(vcd_path));
+	should_be_null(openvcd_bin_open("/nonexistent/openvcd"));
+
+	/* sections past the end of the file */
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, NULL), 0);
+	f = fopen(bin_path, "r+");
+	should_equal(fread(&h, sizeof(h), 1, f), 1);
+	h.nblocks += 1000000;
+	fseek(f, 0, SEEK_SET);
+	should_equal(fwrite(&h, sizeof(h), 1, f), 1);
+	fclose(f);
+	should_be_null(openvcd_bin_open(bin_path));
+
+	/* a newer version */
+	h.nblocks -= 1000000;
+	h.version = OPENVCD_BIN_VERSION + 1;
+	f = fopen(bin_path, "r+");
+	should_equal(fwrite(&h, sizeof(h), 1, f), 1);
+	fclose(f);
+	should_be_null(openvcd_bin_open(bin_path));
+
+	/* types past the end of their enums */
+	h.version = OPENVCD_BIN_VERSION;
+	h.timescale_unit = openvcd_unit_undefined + 1;
+	f = fopen(bin_path, "r+");
+	should_equal(fwrite(&h, sizeof(h), 1, f), 1);
+	fclose(f);
+	should_be_null(openvcd_bin_open(bin_path));
+
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, NULL), 0);
+	write_u32(bin_path, h.scopes_offset + offsetof(openvcd_bin_scope, type), OPENVCD_SCOPE_TASK + 1);
+	should_be_null(openvcd_bin_open(bin_path));
+
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, NULL), 0);
+	write_u32(bin_path, h.vars_offset + offsetof(openvcd_bin_var, type), OPENVCD_VAR_WOR + 1);
+	should_be_null(openvcd_bin_open(bin_path));
+
+	/* signal widths which are zero, or not the declared width */
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, NULL), 0);
+	write_u32(bin_path, h.signals_offset + offsetof(openvcd_bin_signal, width), 0);
+	should_be_null(openvcd_bin_open(bin_path));
+
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, NULL), 0);
+	write_u32(bin_path, h.signals_offset + offsetof(openvcd_bin_signal, width), 0x7fffffff);
+	should_be_null(openvcd_bin_open(bin_path));
+
+	/* the VCD can't be parsed */
+	f = fopen(vcd_path, "w");
+	fputs("$var wire 1 ! a $end\n", f);
+	fclose(f);
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, NULL), -1);
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, &error), -1);
+	should_not_be_null(error);
+	should_not_be_null(strstr(error, "$enddefinitions"));
+	free(error);
+
+	should_equal(openvcd_bin_convert("/nonexistent/openvcd", bin_path, 0, 0, &error), -1);
+	str_should_equal(error, "failed to open file");
+	free(error);
+
+	write_input(vcd_path);
+	should_equal(openvcd_bin_convert(vcd_path, "/nonexistent/openvcd", 0, 0, &error), -1);
+	str_should_equal(error, "failed to write output");
+	free(error);
+	should_equal(openvcd_bin_convert(vcd_path, bin_path, 0, 0, &error), 0);
+	should_be_null(error);
+
+	unlink(vcd_path);
+	unlink(bin_path);
+}
+
+int main(void) {
+	test_bin_roundtrip();
+	test_bin_order();
+	test_bin_snapshots();
+	test_bin_invalid();
+	return 0;
+}
@@ -0,0 +1,241 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "cache.h"
+
+openvcd_cache* openvcd_alloc_cache(size_t capacity) {
+	openvcd_cache* c;
+
+	c = malloc(sizeof(openvcd_cache));
+	if (c == NULL) { return NULL; }
+
+	c->entries = kh_init(openvcd_mcache);
+	if (c->entries == NULL) {
+		free(c);
+		return NULL;
+	}
+
+	c->capacity = (capacity == 0) ? OPENVCD_CACHE_DEFAULT_BLOCKS : capacity;
+	c->count = 0;
+	c->budget = 0;
+	c->bytes = 0;
+	c->hits = 0;
+	c->misses = 0;
+	c->head = NULL;
+	c->tail = NULL;
+
+	return c;
+}
+
+void openvcd_cache_clear(openvcd_cache* c) {
+	openvcd_cache_entry* e;
+	openvcd_cache_entry* next;
+
+	for (e = c->head ; e != NULL ; e = next) {
+		next = e->next;
+		openvcd_free_decoded_block(e->decoded);
+		free(e);
+	}
+
+	kh_clear(openvcd_mcache, c->entries);
+	c->head = NULL;
+	c->tail = NULL;
+	c->count = 0;
+	c->bytes = 0;
+}
+
+void openvcd_free_cache(openvcd_cache* c) {
+	openvcd_cache_clear(c);
+	kh_destroy(openvcd_mcache, c->entries);
+	free(c);
+}
+
+static void unlink_entry(openvcd_cache* c, openvcd_cache_entry* e) {
+	if (e->prev != NULL) { e->prev->next = e->next; } else { c->head = e->next; }
+	if (e->next != NULL) { e->next->prev = e->prev; } else { c->tail = e->prev; }
+	e->prev = NULL;
+	e->next = NULL;
+}
+
+static void push_front(openvcd_cache* c, openvcd_cache_entry* e) {
+	e->prev = NULL;
+	e->next = c->head;
+	if (c->head != NULL) { c->head->prev = e; }
+	c->head = e;
+	if (c->tail == NULL) { c->tail = e; }
+}
+
+static bool over_budget(const openvcd_cache* c) {
+	return (c->count > c->capacity) || ((c->budget != 0) && (c->bytes > c->budget));
+}
+
+/* evict until the cache fits, but always keep the most recently used
+ * entry */
+static void evict(openvcd_cache* c) {
+	openvcd_cache_entry* e;
+
+	while (over_budget(c) && (c->count > 1)) {
+		e = c->tail;
+		unlink_entry(c, e);
+		kh_delk(openvcd_mcache, c->entries, e->key);
+		openvcd_free_decoded_block(e->decoded);
+		c->bytes -= e->size;
+		free(e);
+		c->count--;
+	}
+}
+
+void openvcd_cache_set_budget(openvcd_cache* c, size_t budget) {
+	c->budget = budget;
+	evict(c);
+}
+
+/* the bytes allocated for an entry and it's block */
+static size_t entry_size(const openvcd_decoded_block* d) {
+	return sizeof(openvcd_cache_entry) + sizeof(openvcd_decoded_block) +
+		((size_t) d->count * (1 + (2 * (size_t) d->nwords)) * sizeof(uint64_t));
+}
+
+const openvcd_decoded_block* openvcd_cache_get(openvcd_cache* c, const openvcd_signal* s, size_t block) {
+	openvcd_cache_entry* e;
+	openvcd_cache_key key;
+	khint_t k;
+	int khret;
+
+	key.signal = s;
+	key.block = block;
+
+	k = kh_get(openvcd_mcache, c->entries, key);
+	if (k != kh_end(c->entries)) {
+		e = kh_val(c->entries, k);
+		unlink_entry(c, e);
+		push_front(c, e);
+		c->hits++;
+		return e->decoded;
+	}
+
+	c->misses++;
+
+	e = malloc(sizeof(openvcd_cache_entry));
+	if (e == NULL) { return NULL; }
+
+	e->key = key;
+	e->decoded = openvcd_decode_block(s, block);
+	if (e->decoded == NULL) {
+		free(e);
+		return NULL;
+	}
+
+	k = kh_put(openvcd_mcache, c->entries, key, &khret);
+	if (khret <= 0) {
+		openvcd_free_decoded_block(e->decoded);
+		free(e);
+		return NULL;
+	}
+	kh_val(c->entries, k) = e;
+
+	e->size = entry_size(e->decoded);
+	push_front(c, e);
+	c->count++;
+	c->bytes += e->size;
+
+	/* never evicts e, since it is the most recently used */
+	evict(c);
+
+	return e->decoded;
+}
+
+bool openvcd_cache_value_at(openvcd_cache* c, const openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval) {
+	const openvcd_decoded_block* d;
+	size_t block;
+	long i;
+
+	if (!openvcd_signal_find_block(s, t, &block)) { return false; }
+
+	d = openvcd_cache_get(c, s, block);
+	if (d == NULL) { return false; }
+
+	i = openvcd_decoded_block_find(d, t);
+	if (i < 0) { return false; }
+
+	memcpy(aval, d->aval + ((size_t) i * s->nwords), s->nwords * sizeof(uint64_t));
+	memcpy(bval, d->bval + ((size_t) i * s->nwords), s->nwords * sizeof(uint64_t));
+
+	return true;
+}
+
+openvcd_shared_cache* openvcd_alloc_shared_cache(size_t budget, size_t nshards) {
+	openvcd_shared_cache* c;
+	size_t share;
+
+	if (budget == 0) { budget = OPENVCD_CACHE_DEFAULT_BUDGET; }
+	if (nshards == 0) { nshards = OPENVCD_CACHE_DEFAULT_SHARDS; }
+
+	c = malloc(sizeof(openvcd_shared_cache));
+	if (c == NULL) { return NULL; }
+
+	c->shards = calloc(nshards, sizeof(openvcd_cache_shard));
+	if (c->shards == NULL) {
+		free(c);
+		return NULL;
+	}
+
+	/* the budget alone limits the shards */
+	share = (budget / nshards == 0) ? 1 : budget / nshards;
+	for (c->nshards = 0 ; c->nshards < nshards ; c->nshards++) {
+		c->shards[c->nshards].cache = openvcd_alloc_cache(SIZE_MAX);
+		if (c->shards[c->nshards].cache == NULL) {
+			openvcd_free_shared_cache(c);
+			return NULL;
+		}
+		openvcd_cache_set_budget(c->shards[c->nshards].cache, share);
+		pthread_mutex_init(&(c->shards[c->nshards].lock), NULL);
+	}
+
+	return c;
+}
+
+void openvcd_free_shared_cache(openvcd_shared_cache* c) {
+	for (size_t i = 0 ; i < c->nshards ; i++) {
+		openvcd_free_cache(c->shards[i].cache);
+		pthread_mutex_destroy(&(c->shards[i].lock));
+	}
+	free(c->shards);
+	free(c);
+}
+
+bool openvcd_shared_cache_value_at(openvcd_shared_cache* c, const openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval) {
+	openvcd_cache_shard* shard;
+	openvcd_cache_key key;
+	bool found;
+
+	/* the shard is picked by the block, so that each block is only cached
+	 * once */
+	if (!openvcd_signal_find_block(s, t, &(key.block))) { return false; }
+	key.signal = s;
+
+	/* the low bits of the hash pick the bucket within the shard, so use
+	 * the high ones here */
+	shard = &(c->shards[(openvcd_cache_key_hash(key) >> 16) % c->nshards]);
+
+	pthread_mutex_lock(&(shard->lock));
+	found = openvcd_cache_value_at(shard->cache, s, t, aval, bval);
+	pthread_mutex_unlock(&(shard->lock));
+
+	return found;
+}
+
+void openvcd_shared_cache_stats(openvcd_shared_cache* c, openvcd_cache_stats* stats) {
+	memset(stats, 0, sizeof(openvcd_cache_stats));
+
+	for (size_t i = 0 ; i < c->nshards ; i++) {
+		pthread_mutex_lock(&(c->shards[i].lock));
+		stats->hits += c->shards[i].cache->hits;
+		stats->misses += c->shards[i].cache->misses;
+		stats->blocks += c->shards[i].cache->count;
+		stats->bytes += c->shards[i].cache->bytes;
+		pthread_mutex_unlock(&(c->shards[i].lock));
+	}
+}
@@ -0,0 +1,230 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements a bounded cache of decoded blocks.
+ *
+ * Decoding a block is much more expensive than looking up a value in an
+ * already decoded one, and interactive use tends to query the same few
+ * blocks over and over. The cache keeps up to a fixed number of decoded
+ * blocks, and optionally up to a number of bytes of them, and evicts the
+ * least recently used one when it is full.
+ *
+ * A cache is not safe to use from several threads at once. For that there
+ * is openvcd_shared_cache, which splits a budget of bytes between shards
+ * that each have their own lock, so that threads querying different blocks
+ * rarely wait on each other. The block a key belongs to decides it's
+ * shard, and values are copied out under the shard's lock, since another
+ * thread may evict the block as soon as it is released.
+ *
+ * Entries are keyed by signal and block number, and are not invalidated
+ * when a signal is appended to, so a signal's last block should not be
+ * queried through a cache while changes are still being appended to it.
+ */
+
+#ifndef OPENVCD_CACHE_H
+#define OPENVCD_CACHE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "khash.h"
+#include "util.h"
+#include "wave.h"
+
+/**** TYPES ******************************************************************/
+
+#define OPENVCD_CACHE_DEFAULT_BLOCKS 4096
+
+/* defaults of openvcd_alloc_shared_cache() */
+#define OPENVCD_CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+#define OPENVCD_CACHE_DEFAULT_SHARDS 16
+
+typedef struct {
+	const openvcd_signal* signal;
+	size_t block;
+} openvcd_cache_key;
+
+typedef struct openvcd_cache_entry_t {
+	openvcd_cache_key key;
+	openvcd_decoded_block* decoded;
+
+	/* the bytes allocated for decoded */
+	size_t size;
+
+	/* neighbours in the recently used list */
+	struct openvcd_cache_entry_t* prev;
+	struct openvcd_cache_entry_t* next;
+} openvcd_cache_entry;
+
+#define openvcd_cache_key_hash(_k) \
+	kh_int64_hash_func(((khint64_t) (uintptr_t) (_k).signal) ^ \
+		((khint64_t) (_k).block * 0x9e3779b97f4a7c15ULL))
+
+#define openvcd_cache_key_eq(_a, _b) \
+	(((_a).signal == (_b).signal) && ((_a).block == (_b).block))
+
+KHASH_INIT(openvcd_mcache, openvcd_cache_key, openvcd_cache_entry*, 1, openvcd_cache_key_hash, openvcd_cache_key_eq)
+
+typedef struct openvcd_cache_t {
+	/* the maximum number of decoded blocks */
+	size_t capacity;
+	size_t count;
+
+	/* the maximum bytes of decoded blocks, or 0 for no limit, and the
+	 * bytes currently held */
+	size_t budget;
+	size_t bytes;
+
+	/* lookups which found the block, and which had to decode it */
+	uint64_t hits;
+	uint64_t misses;
+
+	/* most and least recently used entries */
+	openvcd_cache_entry* head;
+	openvcd_cache_entry* tail;
+
+	khash_t(openvcd_mcache)* entries;
+} openvcd_cache;
+
+typedef struct {
+	pthread_mutex_t lock;
+	openvcd_cache* cache;
+} openvcd_cache_shard;
+
+typedef struct {
+	size_t nshards;
+	openvcd_cache_shard* shards;
+} openvcd_shared_cache;
+
+/* the totals over the shards of a openvcd_shared_cache */
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	size_t blocks;
+	size_t bytes;
+} openvcd_cache_stats;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Allocate a new, empty cache.
+ *
+ * @param capacity The maximum number of decoded blocks to keep, or 0 to use
+ * OPENVCD_CACHE_DEFAULT_BLOCKS.
+ *
+ * @return The new cache, or NULL on failure.
+ */
+openvcd_cache* openvcd_alloc_cache(size_t capacity);
+
+/**
+ * @brief Limit the bytes of decoded blocks a cache keeps, evicting blocks if
+ * it already holds more.
+ *
+ * The most recently used block is always kept, even if it alone is larger
+ * than the budget.
+ *
+ * @param c
+ * @param budget The maximum bytes, or 0 for no limit besides the capacity.
+ */
+void openvcd_cache_set_budget(openvcd_cache* c, size_t budget);
+
+/**
+ * @brief Free a cache, and every block in it.
+ *
+ * @param c
+ */
+void openvcd_free_cache(openvcd_cache* c);
+
+/**
+ * @brief Remove every block from a cache.
+ *
+ * @param c
+ */
+void openvcd_cache_clear(openvcd_cache* c);
+
+/**
+ * @brief Get a decoded block, decoding it if it is not in the cache.
+ *
+ * @param c
+ * @param s
+ * @param block
+ *
+ * @return The decoded block, which is owned by the cache and only valid
+ * until the next call to openvcd_cache_get(), or NULL if it could not be
+ * decoded.
+ */
+const openvcd_decoded_block* openvcd_cache_get(openvcd_cache* c, const openvcd_signal* s, size_t block);
+
+/**
+ * @brief Get the value of a signal at time t, see openvcd_value_at().
+ *
+ * @param c
+ * @param s
+ * @param t
+ * @param aval
+ * @param bval
+ *
+ * @return false if the signal has no value at time t.
+ */
+bool openvcd_cache_value_at(openvcd_cache* c, const openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval);
+
+/**
+ * @brief Allocate a new, empty cache which can be used from several threads.
+ *
+ * @param budget The maximum bytes of decoded blocks to keep, or 0 to use
+ * OPENVCD_CACHE_DEFAULT_BUDGET. It is split evenly between the shards.
+ * @param nshards The number of shards, or 0 to use
+ * OPENVCD_CACHE_DEFAULT_SHARDS.
+ *
+ * @return The new cache, or NULL on failure.
+ */
+openvcd_shared_cache* openvcd_alloc_shared_cache(size_t budget, size_t nshards);
+
+/**
+ * @brief Free a shared cache, which no thread may still be using.
+ *
+ * @param c
+ */
+void openvcd_free_shared_cache(openvcd_shared_cache* c);
+
+/**
+ * @brief Get the value of a signal at time t, see openvcd_value_at().
+ *
+ * This may be called from several threads at once, as long as no changes
+ * are being appended to the signal.
+ *
+ * @param c
+ * @param s
+ * @param t
+ * @param aval
+ * @param bval
+ *
+ * @return false if the signal has no value at time t, or it's block could
+ * not be decoded.
+ */
+bool openvcd_shared_cache_value_at(openvcd_shared_cache* c, const openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval);
+
+/**
+ * @brief Add up the counters of every shard.
+ *
+ * The shards are locked one at a time, so the totals may be slightly
+ * inconsistent if the cache is in use.
+ *
+ * @param c
+ * @param stats
+ */
+void openvcd_shared_cache_stats(openvcd_shared_cache* c, openvcd_cache_stats* stats);
+
+#endif /* OPENVCD_CACHE_H */
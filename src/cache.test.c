@@ -0,0 +1,224 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "cache.h"
+#include "pool.h"
+
+/* a wave with one 8 bit signal "a" which counts up once per time unit */
+static openvcd_wave* counter_wave(uint64_t nchanges) {
+	openvcd_timescale ts;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	uint64_t aval[1];
+	uint64_t bval[1];
+
+	ts.n = 1;
+	ts.u = openvcd_unit_ns;
+	w = openvcd_alloc_wave(NULL, ts);
+	s = openvcd_wave_add_signal(w, "a", 8, false);
+	for (uint64_t i = 0 ; i < nchanges ; i++) {
+		aval[0] = i & 0xff;
+		bval[0] = 0;
+		openvcd_signal_append(s, i, aval, bval);
+	}
+
+	return w;
+}
+
+void test_cache_lru(void) {
+	const openvcd_decoded_block* d0;
+	const openvcd_decoded_block* d;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	openvcd_cache* c;
+
+	w = counter_wave(OPENVCD_BLOCK_CHANGES * 4);
+	s = w->signals.data[0];
+	should_equal(s->nblocks, 4);
+
+	c = openvcd_alloc_cache(2);
+	should_not_be_null(c);
+	should_equal(c->capacity, 2);
+
+	d0 = openvcd_cache_get(c, s, 0);
+	should_not_be_null(d0);
+	should_equal(d0->times[0], 0);
+	should_equal(openvcd_cache_get(c, s, 0), d0);
+	should_equal(c->count, 1);
+
+	d = openvcd_cache_get(c, s, 1);
+	should_equal(d->times[0], OPENVCD_BLOCK_CHANGES);
+	should_equal(c->count, 2);
+
+	/* block 0 is the most recently used, so block 1 is evicted */
+	should_equal(openvcd_cache_get(c, s, 0), d0);
+	openvcd_cache_get(c, s, 2);
+	should_equal(c->count, 2);
+	should_equal(c->head->key.block, 2);
+	should_equal(c->tail->key.block, 0);
+	should_be_false(kh_containsk(openvcd_mcache, c->entries, ((openvcd_cache_key) {s, 1})));
+
+	should_be_null(openvcd_cache_get(c, s, 4));
+	should_equal(c->count, 2);
+
+	openvcd_cache_clear(c);
+	should_equal(c->count, 0);
+	should_be_null(c->head);
+
+	openvcd_free_cache(c);
+	openvcd_free_wave(w);
+}
+
+void test_cache_value_at(void) {
+	openvcd_signal* s;
+	openvcd_wave* w;
+	openvcd_cache* c;
+	uint64_t aval[1];
+	uint64_t bval[1];
+
+	w = counter_wave(1000);
+	s = w->signals.data[0];
+	c = openvcd_alloc_cache(0);
+	should_equal(c->capacity, OPENVCD_CACHE_DEFAULT_BLOCKS);
+
+	for (uint64_t t = 0 ; t < 1100 ; t += 3) {
+		should_be_true(openvcd_cache_value_at(c, s, t, aval, bval));
+		should_equal(aval[0], ((t < 1000) ? t : 999) & 0xff);
+		should_equal(bval[0], 0);
+	}
+	should_equal(c->count, s->nblocks);
+
+	openvcd_free_cache(c);
+	openvcd_free_wave(w);
+}
+
+void test_cache_budget(void) {
+	const openvcd_decoded_block* d;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	openvcd_cache* c;
+	size_t size;
+
+	w = counter_wave(OPENVCD_BLOCK_CHANGES * 8);
+	s = w->signals.data[0];
+
+	c = openvcd_alloc_cache(0);
+	should_not_be_null(c);
+	should_equal(c->budget, 0);
+
+	d = openvcd_cache_get(c, s, 0);
+	should_not_be_null(d);
+	size = c->bytes;
+	should_be_true(size > d->count * 3 * sizeof(uint64_t));
+	should_equal(c->misses, 1);
+	should_equal(c->hits, 0);
+
+	/* room for three blocks of the same size */
+	openvcd_cache_set_budget(c, (3 * size) + (size / 2));
+	for (size_t i = 0 ; i < 8 ; i++) {
+		should_not_be_null(openvcd_cache_get(c, s, i));
+		should_be_true(c->bytes <= c->budget);
+	}
+	should_equal(c->count, 3);
+	should_equal(c->bytes, 3 * size);
+	should_equal(c->misses, 8);
+
+	should_not_be_null(openvcd_cache_get(c, s, 6));
+	should_not_be_null(openvcd_cache_get(c, s, 7));
+	should_equal(c->hits, 3);
+
+	/* the most recently used block is kept even when it doesn't fit */
+	openvcd_cache_set_budget(c, 1);
+	should_equal(c->count, 1);
+	should_equal(c->head->key.block, 7);
+	should_equal(c->bytes, size);
+
+	openvcd_cache_clear(c);
+	should_equal(c->bytes, 0);
+
+	openvcd_free_cache(c);
+	openvcd_free_wave(w);
+}
+
+typedef struct {
+	openvcd_shared_cache* cache;
+	openvcd_signal** signals;
+	size_t nsignals;
+	int failures;
+} shared_job;
+
+/* a scrolling viewer: each task sweeps a window over every signal */
+static void scroll(void* ctx, size_t i) {
+	const openvcd_signal* s;
+	shared_job* job;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	uint64_t t;
+
+	job = (shared_job*) ctx;
+	for (size_t j = 0 ; j < 2000 ; j++) {
+		s = job->signals[j % job->nsignals];
+		t = ((i * 97) + (j / 2)) % (OPENVCD_BLOCK_CHANGES * 4);
+		if (!openvcd_shared_cache_value_at(job->cache, s, t, aval, bval) ||
+			(aval[0] != (t & 0xff)) || (bval[0] != 0)) {
+			__atomic_add_fetch(&(job->failures), 1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void test_shared_cache(void) {
+	openvcd_cache_stats stats;
+	openvcd_wave* waves[3];
+	openvcd_signal* signals[3];
+	openvcd_pool* pool;
+	shared_job job;
+	size_t budget;
+
+	for (size_t i = 0 ; i < 3 ; i++) {
+		waves[i] = counter_wave(OPENVCD_BLOCK_CHANGES * 4);
+		signals[i] = waves[i]->signals.data[0];
+	}
+
+	job.cache = openvcd_alloc_shared_cache(0, 0);
+	should_not_be_null(job.cache);
+	should_equal(job.cache->nshards, OPENVCD_CACHE_DEFAULT_SHARDS);
+	should_equal(job.cache->shards[0].cache->budget, OPENVCD_CACHE_DEFAULT_BUDGET / OPENVCD_CACHE_DEFAULT_SHARDS);
+	openvcd_free_shared_cache(job.cache);
+
+	/* a ceiling of a few blocks per shard */
+	budget = 4 * 64 * 1024;
+	job.cache = openvcd_alloc_shared_cache(budget, 4);
+	should_not_be_null(job.cache);
+	job.signals = signals;
+	job.nsignals = 3;
+	job.failures = 0;
+
+	pool = openvcd_new_pool(4);
+	should_not_be_null(pool);
+	openvcd_pool_run(pool, scroll, &job, 32);
+	should_equal(job.failures, 0);
+
+	openvcd_shared_cache_stats(job.cache, &stats);
+	should_equal(stats.hits + stats.misses, 32 * 2000);
+	should_be_true(stats.hits > 10 * stats.misses);
+	should_be_true(stats.blocks > 0);
+	should_be_true(stats.bytes <= budget);
+
+	openvcd_free_pool(pool);
+	openvcd_free_shared_cache(job.cache);
+	for (size_t i = 0 ; i < 3 ; i++) { openvcd_free_wave(waves[i]); }
+}
+
+int main(void) {
+	test_cache_lru();
+	test_cache_value_at();
+	test_cache_budget();
+	test_shared_cache();
+	return 0;
+}
@@ -0,0 +1,129 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "collection.h"
+
+static bool scope_eq(const void* a, const void* b) {
+	return openvcd_scope_equal((const openvcd_scope*) a, (const openvcd_scope*) b);
+}
+
+static void free_scope(void* s) {
+	openvcd_free_scope((openvcd_scope*) s);
+}
+
+/* swap the wave's scope tree for the shared copy of it */
+static void share_root(openvcd_intern* hierarchies, openvcd_wave* w) {
+	openvcd_scope* root;
+
+	if (w->root == NULL) { return; }
+
+	/* if the tree can't be added, the wave just keeps it's own */
+	root = openvcd_intern_put(hierarchies, openvcd_scope_hash(w->root), scope_eq, w->root);
+	if (root == NULL) { return; }
+
+	if (root == w->root) {
+		w->root_owned = false;
+	} else {
+		openvcd_wave_set_root(w, root, false);
+	}
+}
+
+static void load_entry(void* ctx, size_t i) {
+	openvcd_collection* c;
+	openvcd_collection_entry* e;
+	openvcd_input_source source;
+	openvcd_parser* p;
+	char* mapping;
+	size_t length;
+
+	c = (openvcd_collection*) ctx;
+	e = &(c->entries[i]);
+
+	mapping = openvcd_map_file(e->path, &length);
+	if (mapping == NULL) {
+		e->error_string = strdup("failed to open file");
+		return;
+	}
+
+	source.input_string = mapping;
+	p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, length);
+	if (p == NULL) {
+		e->error_string = strdup("failed to allocate parser");
+		openvcd_unmap(mapping, length);
+		return;
+	}
+
+	e->wave = openvcd_load(p);
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) {
+		e->error_string = strdup(p->error_string);
+	}
+	openvcd_free_parser(p);
+	openvcd_unmap(mapping, length);
+
+	if (e->wave != NULL) { share_root(c->hierarchies, e->wave); }
+}
+
+openvcd_collection* openvcd_load_collection(const char** paths, size_t npaths, unsigned int nthreads) {
+	openvcd_collection* c;
+	openvcd_pool* pool;
+
+	c = malloc(sizeof(openvcd_collection));
+	if (c == NULL) { return NULL; }
+
+	c->nentries = 0;
+	c->entries = calloc((npaths > 0) ? npaths : 1, sizeof(openvcd_collection_entry));
+	c->hierarchies = openvcd_new_intern(0);
+	if ((c->entries == NULL) || (c->hierarchies == NULL)) {
+		openvcd_free_collection(c);
+		return NULL;
+	}
+
+	for (size_t i = 0 ; i < npaths ; i++) {
+		c->entries[i].path = strdup(paths[i]);
+		if (c->entries[i].path == NULL) {
+			openvcd_free_collection(c);
+			return NULL;
+		}
+		c->nentries++;
+	}
+
+	if (nthreads == 0) { nthreads = openvcd_processors(); }
+	if (nthreads > npaths) { nthreads = (unsigned int) npaths; }
+
+	/* without a pool, everything runs on this thread */
+	pool = (nthreads > 1) ? openvcd_new_pool(nthreads) : NULL;
+	openvcd_pool_run(pool, load_entry, c, c->nentries);
+	if (pool != NULL) { openvcd_free_pool(pool); }
+
+	return c;
+}
+
+void openvcd_free_collection(openvcd_collection* c) {
+	if (c->entries != NULL) {
+		for (size_t i = 0 ; i < c->nentries ; i++) {
+			if (c->entries[i].wave != NULL) { openvcd_free_wave(c->entries[i].wave); }
+			free(c->entries[i].path);
+			free(c->entries[i].error_string);
+		}
+		free(c->entries);
+	}
+
+	/* after the waves, which refer to the trees */
+	if (c->hierarchies != NULL) { openvcd_free_intern(c->hierarchies, free_scope); }
+
+	free(c);
+}
+
+openvcd_wave* openvcd_collection_find(const openvcd_collection* c, const char* path) {
+	for (size_t i = 0 ; i < c->nentries ; i++) {
+		if (strcmp(c->entries[i].path, path) == 0) { return c->entries[i].wave; }
+	}
+
+	return NULL;
+}
+
+size_t openvcd_collection_hierarchies(const openvcd_collection* c) {
+	return c->hierarchies->count;
+}
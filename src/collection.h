@@ -0,0 +1,106 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements loading many VCD files at once into a collection,
+ * for instance every dump from a regression run.
+ *
+ * Files are loaded one task each on a thread pool. Dumps of the same design
+ * almost always declare the same hierarchy, so as each file is loaded, it's
+ * scope tree is looked up in an intern pool shared by all the workers. If an
+ * equal tree is already there, the file's waveform is switched over to it
+ * and it's own copy is free-ed, so each distinct hierarchy is only kept in
+ * memory once, no matter how many files declare it.
+ *
+ * Scope trees own their names, so names are shared a whole hierarchy at a
+ * time, rather than one string at a time.
+ */
+
+#ifndef OPENVCD_COLLECTION_H
+#define OPENVCD_COLLECTION_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "parser.h"
+#include "scope.h"
+#include "wave.h"
+#include "intern.h"
+#include "pool.h"
+
+/**** TYPES ******************************************************************/
+
+typedef struct {
+	char* path;
+
+	/* NULL if the file could not be loaded */
+	openvcd_wave* wave;
+
+	/* why the file could not be loaded, or NULL */
+	char* error_string;
+} openvcd_collection_entry;
+
+typedef struct {
+	/* in the order the paths were given */
+	openvcd_collection_entry* entries;
+	size_t nentries;
+
+	/* the distinct scope trees, which the waves refer to */
+	openvcd_intern* hierarchies;
+} openvcd_collection;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Load many VCD files in parallel.
+ *
+ * A file which can't be loaded doesn't stop the others from loading, it's
+ * entry just has no waveform, and says why in it's error_string.
+ *
+ * @param paths
+ * @param npaths
+ * @param nthreads The number of threads to use, or 0 to use one for each
+ * processor.
+ *
+ * @return The new collection, or NULL on failure.
+ */
+openvcd_collection* openvcd_load_collection(const char** paths, size_t npaths, unsigned int nthreads);
+
+/**
+ * @brief Free a collection, including all of it's waveforms.
+ *
+ * @param c
+ */
+void openvcd_free_collection(openvcd_collection* c);
+
+/**
+ * @brief Find the waveform loaded from a file.
+ *
+ * @param c
+ * @param path The path, exactly as it was given.
+ *
+ * @return The waveform, or NULL if there is none.
+ */
+openvcd_wave* openvcd_collection_find(const openvcd_collection* c, const char* path);
+
+/**
+ * @brief Return the number of distinct hierarchies in a collection.
+ *
+ * @param c
+ *
+ * @return
+ */
+size_t openvcd_collection_hierarchies(const openvcd_collection* c);
+
+#endif /* OPENVCD_COLLECTION_H */
@@ -0,0 +1,108 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "collection.h"
+
+#define NFILES 12
+
+/* write a small dump of one of two designs, with values that depend on
+ * seed */
+static void write_design(char* path, int design, int seed) {
+	FILE* f;
+
+	f = temp_file(path);
+
+	fprintf(f, "$timescale 1ns $end\n$scope module top $end\n");
+	fprintf(f, "$var wire 1 c clk $end\n");
+	fprintf(f, "$scope module core $end\n");
+	for (int i = 0 ; i < 20 ; i++) {
+		fprintf(f, "$var wire 8 s%d sig%d $end\n", i, i);
+	}
+	if (design == 1) { fprintf(f, "$var wire 8 extra extra $end\n"); }
+	fprintf(f, "$upscope $end\n$upscope $end\n$enddefinitions $end\n");
+
+	for (int t = 0 ; t < 100 ; t++) {
+		fprintf(f, "#%d\n%dc\n", t * 10, t % 2);
+		fprintf(f, "b%d s%d\n", (t + seed) % 2, t % 20);
+	}
+
+	fclose(f);
+}
+
+void test_load_collection(void) {
+	char paths[NFILES][32];
+	const char* names[NFILES + 1];
+	openvcd_collection* c;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	uint64_t aval;
+	uint64_t bval;
+	int i;
+
+	for (int k = 0 ; k < NFILES ; k++) {
+		strcpy(paths[k], "/tmp/openvcd-coll-XXXXXX");
+		write_design(paths[k], (k % 4 == 3) ? 1 : 0, k);
+		names[k] = paths[k];
+	}
+	names[NFILES] = "/nonexistent/openvcd";
+
+	c = openvcd_load_collection(names, NFILES + 1, 4);
+	should_not_be_null(c);
+	should_equal(c->nentries, NFILES + 1);
+
+	/* only two distinct designs */
+	should_equal(openvcd_collection_hierarchies(c), 2);
+
+	for (int k = 0 ; k < NFILES ; k++) {
+		w = openvcd_collection_find(c, paths[k]);
+		should_not_be_null(w);
+		should_be_null(c->entries[k].error_string);
+		should_be_false(w->root_owned);
+
+		/* files of the same design share one tree */
+		if (k >= 4) { should_equal(w->root, openvcd_collection_find(c, paths[k - 4])->root); }
+		if (k % 4 != 3) { should_not_equal(w->root, openvcd_collection_find(c, paths[3])->root); }
+
+		/* and every signal refers to a variable in the shared tree */
+		vec_foreach(&(w->signals), s, i) {
+			should_not_be_null(s->var);
+			str_should_equal(s->var->identifier_code, s->id_code);
+		}
+
+		/* while the changes are still the file's own */
+		s = openvcd_wave_find_signal(w, "s0");
+		should_not_be_null(s);
+		should_be_true(openvcd_value_at(s, 0, &aval, &bval));
+		should_equal(aval, (uint64_t) (k % 2));
+	}
+
+	should_be_null(openvcd_collection_find(c, "/nonexistent/openvcd"));
+	should_not_be_null(c->entries[NFILES].error_string);
+	should_be_null(openvcd_collection_find(c, "/not/loaded"));
+
+	openvcd_free_collection(c);
+	for (int k = 0 ; k < NFILES ; k++) { unlink(paths[k]); }
+}
+
+void test_load_collection_empty(void) {
+	openvcd_collection* c;
+
+	c = openvcd_load_collection(NULL, 0, 0);
+	should_not_be_null(c);
+	should_equal(c->nentries, 0);
+	should_equal(openvcd_collection_hierarchies(c), 0);
+	openvcd_free_collection(c);
+}
+
+int main(void) {
+	test_load_collection();
+	test_load_collection_empty();
+	return 0;
+}
@@ -0,0 +1,214 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "cursor.h"
+
+/* the time of signal i's next change */
+static uint64_t next_time(const openvcd_cursor* c, size_t i) {
+	return c->blocks[i]->times[c->next[i]];
+}
+
+static void sift_down(openvcd_cursor* c, size_t pos) {
+	size_t smallest;
+	size_t child;
+	size_t temp;
+
+	for (;;) {
+		smallest = pos;
+		for (child = (2 * pos) + 1 ; (child <= (2 * pos) + 2) && (child < c->nheap) ; child++) {
+			if (next_time(c, c->heap[child]) < next_time(c, c->heap[smallest])) {
+				smallest = child;
+			}
+		}
+		if (smallest == pos) { return; }
+
+		temp = c->heap[pos];
+		c->heap[pos] = c->heap[smallest];
+		c->heap[smallest] = temp;
+		pos = smallest;
+	}
+}
+
+static void build_heap(openvcd_cursor* c) {
+	for (size_t i = c->nheap ; i > 0 ; i--) { sift_down(c, i - 1); }
+}
+
+/* decode a signal's block, or drop it's old one if there are no more */
+static int load(openvcd_cursor* c, size_t i, size_t block) {
+	if (c->blocks[i] != NULL) {
+		openvcd_free_decoded_block(c->blocks[i]);
+		c->blocks[i] = NULL;
+	}
+
+	c->block[i] = block;
+	c->next[i] = 0;
+	if (block >= c->signals[i]->nblocks) { return 0; }
+
+	c->blocks[i] = openvcd_decode_block(c->signals[i], block);
+	return (c->blocks[i] == NULL) ? -1 : 0;
+}
+
+/* move a signal past it's next change, to the following block if need be */
+static int advance(openvcd_cursor* c, size_t i) {
+	c->next[i]++;
+	if (c->next[i] < c->blocks[i]->count) { return 0; }
+
+	return load(c, i, c->block[i] + 1);
+}
+
+static void set_value(openvcd_cursor* c, size_t i, uint32_t change) {
+	const openvcd_decoded_block* d;
+	size_t nwords;
+
+	d = c->blocks[i];
+	nwords = c->signals[i]->nwords;
+	memcpy(c->aval + c->offsets[i], d->aval + (change * nwords), nwords * sizeof(uint64_t));
+	memcpy(c->bval + c->offsets[i], d->bval + (change * nwords), nwords * sizeof(uint64_t));
+	c->valid[i] = true;
+}
+
+void openvcd_free_cursor(openvcd_cursor* c) {
+	if (c->blocks != NULL) {
+		for (size_t i = 0 ; i < c->nsignals ; i++) {
+			if (c->blocks[i] != NULL) { openvcd_free_decoded_block(c->blocks[i]); }
+		}
+	}
+
+	free(c->signals);
+	free(c->offsets);
+	free(c->aval);
+	free(c->bval);
+	free(c->valid);
+	free(c->changed);
+	free(c->blocks);
+	free(c->block);
+	free(c->next);
+	free(c->heap);
+	free(c->marks);
+	free(c);
+}
+
+openvcd_cursor* openvcd_new_cursor(openvcd_wave* w, openvcd_signal** signals, size_t n) {
+	openvcd_cursor* c;
+	size_t nwords;
+
+	c = calloc(1, sizeof(openvcd_cursor));
+	if (c == NULL) { return NULL; }
+
+	c->nsignals = n;
+	c->signals = calloc(n + 1, sizeof(openvcd_signal*));
+	c->offsets = calloc(n + 1, sizeof(size_t));
+	c->valid = calloc(n + 1, sizeof(bool));
+	c->changed = calloc(n + 1, sizeof(size_t));
+	c->blocks = calloc(n + 1, sizeof(openvcd_decoded_block*));
+	c->block = calloc(n + 1, sizeof(size_t));
+	c->next = calloc(n + 1, sizeof(uint32_t));
+	c->heap = calloc(n + 1, sizeof(size_t));
+	c->marks = calloc(n + 1, sizeof(uint64_t));
+	if ((c->signals == NULL) || (c->offsets == NULL) || (c->valid == NULL) ||
+		(c->changed == NULL) || (c->blocks == NULL) || (c->block == NULL) ||
+		(c->next == NULL) || (c->heap == NULL) || (c->marks == NULL)) {
+		openvcd_free_cursor(c);
+		return NULL;
+	}
+
+	nwords = 0;
+	for (size_t i = 0 ; i < n ; i++) {
+		if (openvcd_wave_load_signal(w, signals[i]) != 0) {
+			openvcd_free_cursor(c);
+			return NULL;
+		}
+		c->signals[i] = signals[i];
+		c->offsets[i] = nwords;
+		nwords += signals[i]->nwords;
+	}
+
+	c->aval = calloc(nwords + 1, sizeof(uint64_t));
+	c->bval = calloc(nwords + 1, sizeof(uint64_t));
+	if ((c->aval == NULL) || (c->bval == NULL)) {
+		openvcd_free_cursor(c);
+		return NULL;
+	}
+
+	for (size_t i = 0 ; i < n ; i++) {
+		if (load(c, i, 0) != 0) {
+			openvcd_free_cursor(c);
+			return NULL;
+		}
+		if (c->blocks[i] != NULL) { c->heap[c->nheap++] = i; }
+	}
+	build_heap(c);
+
+	/* marks start at 0, so the first step must not be */
+	c->generation = 1;
+
+	return c;
+}
+
+bool openvcd_cursor_peek(const openvcd_cursor* c, uint64_t* t) {
+	if (c->nheap == 0) { return false; }
+
+	*t = next_time(c, c->heap[0]);
+	return true;
+}
+
+int openvcd_cursor_next(openvcd_cursor* c) {
+	uint64_t t;
+	size_t i;
+	int rc;
+
+	if (!openvcd_cursor_peek(c, &t)) { return 0; }
+
+	c->generation++;
+	c->nchanged = 0;
+	c->time = t;
+
+	while ((c->nheap > 0) && (next_time(c, c->heap[0]) == t)) {
+		i = c->heap[0];
+
+		set_value(c, i, c->next[i]);
+		if (c->marks[i] != c->generation) {
+			c->marks[i] = c->generation;
+			c->changed[c->nchanged++] = i;
+		}
+
+		rc = advance(c, i);
+		if (c->blocks[i] == NULL) { c->heap[0] = c->heap[--(c->nheap)]; }
+		sift_down(c, 0);
+		if (rc != 0) { return -1; }
+	}
+
+	return 1;
+}
+
+int openvcd_cursor_seek(openvcd_cursor* c, uint64_t t) {
+	size_t block;
+	long change;
+
+	c->nheap = 0;
+	c->nchanged = 0;
+	c->time = t;
+
+	for (size_t i = 0 ; i < c->nsignals ; i++) {
+		c->valid[i] = false;
+
+		if (!openvcd_signal_find_block(c->signals[i], t, &block)) {
+			if (load(c, i, 0) != 0) { return -1; }
+		} else {
+			if (load(c, i, block) != 0) { return -1; }
+
+			/* the block starts at or before t, so there is a change */
+			change = openvcd_decoded_block_find(c->blocks[i], t);
+			set_value(c, i, (uint32_t) change);
+			c->next[i] = (uint32_t) change;
+			if (advance(c, i) != 0) { return -1; }
+		}
+
+		if (c->blocks[i] != NULL) { c->heap[c->nheap++] = i; }
+	}
+	build_heap(c);
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements a cursor which walks the changes of several signals
+ * of a waveform together, in time order.
+ *
+ * The current value of every signal is kept in one dense array, and each
+ * step applies all of the changes at the next time any of the signals
+ * changes and lists which signals they were. Code which needs the values of
+ * many signals at many times can then read them from the array, rather than
+ * looking each one up with openvcd_value_at().
+ *
+ * Only one decoded block of each signal is held at once, and the signals
+ * are kept in a heap ordered by the time of their next change, so a step
+ * costs O(log n) for each signal which changed in it.
+ */
+
+#ifndef OPENVCD_CURSOR_H
+#define OPENVCD_CURSOR_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "wave.h"
+#include "lazy.h"
+
+/**** TYPES ******************************************************************/
+
+typedef struct {
+	/* the signals being walked */
+	openvcd_signal** signals;
+	size_t nsignals;
+
+	/* the time of the changes applied by the last step */
+	uint64_t time;
+
+	/* the current value of signal i is at aval + offsets[i] and
+	 * bval + offsets[i], and is only meaningful if valid[i] is set */
+	size_t* offsets;
+	uint64_t* aval;
+	uint64_t* bval;
+	bool* valid;
+
+	/* the signals which changed in the last step, each listed once */
+	size_t* changed;
+	size_t nchanged;
+
+	/* the decoded block of each signal, it's number, and the next change
+	 * in it which hasn't been applied */
+	openvcd_decoded_block** blocks;
+	size_t* block;
+	uint32_t* next;
+
+	/* signals with changes left, ordered by the time of the next one */
+	size_t* heap;
+	size_t nheap;
+
+	/* the step in which each signal was last listed in changed */
+	uint64_t* marks;
+	uint64_t generation;
+} openvcd_cursor;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Create a cursor over some of the signals of a waveform.
+ *
+ * Lazily opened signals are loaded. The cursor starts before the first
+ * change, with no value valid. The same signal may be given more than once.
+ *
+ * @param w
+ * @param signals
+ * @param n
+ *
+ * @return The cursor, which must be free-ed with openvcd_free_cursor(), or
+ * NULL on failure.
+ */
+openvcd_cursor* openvcd_new_cursor(openvcd_wave* w, openvcd_signal** signals, size_t n);
+
+/**
+ * @brief Free a cursor.
+ *
+ * @param c
+ */
+void openvcd_free_cursor(openvcd_cursor* c);
+
+/**
+ * @brief Apply every change at the next time any of the signals changes.
+ *
+ * @param c
+ *
+ * @return 1 if there were changes, 0 if there are none left, or -1 if a
+ * block could not be decoded.
+ */
+int openvcd_cursor_next(openvcd_cursor* c);
+
+/**
+ * @brief Get the time of the next change without applying it.
+ *
+ * @param c
+ * @param t Set to the time.
+ *
+ * @return false if there are no changes left.
+ */
+bool openvcd_cursor_peek(const openvcd_cursor* c, uint64_t* t);
+
+/**
+ * @brief Move the cursor to time t.
+ *
+ * Afterwards each signal has it's value at time t, and the next step
+ * applies the first changes after t. No signal is listed as changed.
+ *
+ * @param c
+ * @param t
+ *
+ * @return 0 on success, or -1 if a block could not be decoded.
+ */
+int openvcd_cursor_seek(openvcd_cursor* c, uint64_t t);
+
+#endif /* OPENVCD_CURSOR_H */
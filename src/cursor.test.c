@@ -0,0 +1,170 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "cursor.h"
+
+static const char* input =
+	"$timescale 1ns $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 c clk $end\n"
+	"$var reg 70 w bus [69:0] $end\n"
+	"$var wire 1 q quiet $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\n0c\nb0 w\n"
+	"#5\n1c\n0c\n1c\n"
+	"#10\n0c\nb1000000000000000000000000000000000000000000000000000000000000000011 w\n"
+	"#20\n1c\n";
+
+static openvcd_cursor* cursor(openvcd_wave* w) {
+	openvcd_signal* signals[4];
+	openvcd_cursor* c;
+
+	signals[0] = openvcd_wave_find_signal(w, "c");
+	signals[1] = openvcd_wave_find_signal(w, "w");
+	signals[2] = openvcd_wave_find_signal(w, "q");
+	signals[3] = signals[0];
+	c = openvcd_new_cursor(w, signals, 4);
+	should_not_be_null(c);
+
+	return c;
+}
+
+void test_cursor_next(void) {
+	openvcd_cursor* c;
+	openvcd_wave* w;
+	uint64_t t;
+
+	w = load_string(input);
+	c = cursor(w);
+
+	should_be_false(c->valid[0]);
+	should_be_true(openvcd_cursor_peek(c, &t));
+	should_equal(t, 0);
+
+	/* both copies of the clock change together */
+	should_equal(openvcd_cursor_next(c), 1);
+	should_equal(c->time, 0);
+	should_equal(c->nchanged, 3);
+	should_be_true(c->valid[0]);
+	should_be_true(c->valid[1]);
+	should_be_false(c->valid[2]);
+	should_equal(c->aval[c->offsets[3]], 0);
+
+	/* several changes at one time are applied in order, listed once */
+	should_equal(openvcd_cursor_next(c), 1);
+	should_equal(c->time, 5);
+	should_equal(c->nchanged, 2);
+	should_equal(c->aval[c->offsets[0]], 1);
+
+	should_equal(openvcd_cursor_next(c), 1);
+	should_equal(c->time, 10);
+	should_equal(c->nchanged, 3);
+	should_equal(c->aval[c->offsets[0]], 0);
+	should_equal(c->aval[c->offsets[1]], 3);
+	should_equal(c->aval[c->offsets[1] + 1], 0x4);
+
+	should_equal(openvcd_cursor_next(c), 1);
+	should_equal(c->time, 20);
+	should_equal(openvcd_cursor_next(c), 0);
+	should_be_false(openvcd_cursor_peek(c, &t));
+
+	openvcd_free_cursor(c);
+	openvcd_free_wave(w);
+}
+
+void test_cursor_seek(void) {
+	openvcd_cursor* c;
+	openvcd_wave* w;
+
+	w = load_string(input);
+	c = cursor(w);
+
+	should_equal(openvcd_cursor_seek(c, 7), 0);
+	should_equal(c->nchanged, 0);
+	should_be_true(c->valid[0]);
+	should_equal(c->aval[c->offsets[0]], 1);
+	should_equal(c->aval[c->offsets[1]], 0);
+
+	should_equal(openvcd_cursor_next(c), 1);
+	should_equal(c->time, 10);
+	should_equal(c->aval[c->offsets[1]], 3);
+
+	/* back to before the first change */
+	should_equal(openvcd_cursor_seek(c, 0), 0);
+	should_equal(c->aval[c->offsets[1]], 0);
+	should_equal(openvcd_cursor_next(c), 1);
+	should_equal(c->time, 5);
+
+	should_equal(openvcd_cursor_seek(c, 20), 0);
+	should_equal(c->aval[c->offsets[0]], 1);
+	should_equal(openvcd_cursor_next(c), 0);
+
+	openvcd_free_cursor(c);
+	openvcd_free_wave(w);
+}
+
+/* many signals across several blocks stay in time order */
+void test_cursor_many(void) {
+	openvcd_signal* signals[8];
+	openvcd_cursor* c;
+	openvcd_wave* w;
+	uint64_t last;
+	uint64_t seen;
+	char* buffer;
+	size_t length;
+	FILE* f;
+
+	f = open_memstream(&buffer, &length);
+	should_not_be_null(f);
+	fprintf(f, "$scope module top $end\n");
+	for (int i = 0 ; i < 8 ; i++) { fprintf(f, "$var wire 1 %c s%d $end\n", 'a' + i, i); }
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+	for (int t = 0 ; t < 2000 ; t++) {
+		fprintf(f, "#%d\n", t);
+		for (int i = 0 ; i < 8 ; i++) {
+			if (t % (i + 1) == 0) { fprintf(f, "%d%c\n", (t / (i + 1)) % 2, 'a' + i); }
+		}
+	}
+	fclose(f);
+
+	w = load_string(buffer);
+	for (int i = 0 ; i < 8 ; i++) {
+		char id[2] = {(char) ('a' + i), '\0'};
+		signals[i] = openvcd_wave_find_signal(w, id);
+	}
+	c = openvcd_new_cursor(w, signals, 8);
+	should_not_be_null(c);
+
+	last = 0;
+	seen = 0;
+	while (openvcd_cursor_next(c) > 0) {
+		if (seen > 0) { should_be_true(c->time > last); }
+		last = c->time;
+		seen += c->nchanged;
+
+		for (size_t i = 0 ; i < c->nchanged ; i++) {
+			should_equal(c->time % (c->changed[i] + 1), 0);
+			should_equal(c->aval[c->offsets[c->changed[i]]], (c->time / (c->changed[i] + 1)) % 2);
+		}
+	}
+	should_equal(last, 1999);
+	should_equal(seen, 2000 + 1000 + 667 + 500 + 400 + 334 + 286 + 250);
+
+	openvcd_free_cursor(c);
+	openvcd_free_wave(w);
+	free(buffer);
+}
+
+int main(void) {
+	test_cursor_next();
+	test_cursor_seek();
+	test_cursor_many();
+	return 0;
+}
@@ -0,0 +1,462 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "diff.h"
+
+/* mapping of dotted paths to the signals of their variables */
+KHASH_MAP_INIT_STR(openvcd_mpath, openvcd_signal*)
+
+/* walks the changes of one side of a pair */
+typedef struct {
+	openvcd_signal* s;
+
+	/* times are multiplied by this to put them in the common timescale */
+	uint64_t scale;
+
+	/* the decoded block being walked, it's number, and the next change
+	 * in it */
+	openvcd_decoded_block* d;
+	size_t block;
+	uint32_t next;
+
+	/* the value as of the last change applied, padded with zeros to the
+	 * wider of the two signals */
+	bool known;
+	uint64_t* aval;
+	uint64_t* bval;
+} diff_cursor;
+
+/* the dotted paths of a waveform's variables, in the order they were
+ * declared, and an index of them */
+typedef struct {
+	khash_t(openvcd_mpath)* index;
+	vec_str_t order;
+} diff_paths;
+
+static void free_paths(diff_paths* paths) {
+	char* path;
+	int i;
+
+	if (paths->index != NULL) { kh_destroy(openvcd_mpath, paths->index); }
+	vec_foreach(&(paths->order), path, i) { free(path); }
+	vec_deinit(&(paths->order));
+}
+
+/* the dotted path of a variable, with it's bit range if it has one so that
+ * the slices of a bus are told apart */
+static char* var_path(const openvcd_var* v, const char* prefix) {
+	const openvcd_reference* r;
+	const char* dot;
+	char* path;
+	int rc;
+
+	r = v->reference;
+	dot = (*prefix == '\0') ? "" : ".";
+	if (r == NULL) {
+		rc = asprintf(&path, "%s%s%s", prefix, dot, v->identifier_code);
+	} else if (r->msb_index < 0) {
+		rc = asprintf(&path, "%s%s%s", prefix, dot, r->identifier);
+	} else if (r->lsb_index == r->msb_index) {
+		rc = asprintf(&path, "%s%s%s[%d]", prefix, dot, r->identifier, r->msb_index);
+	} else {
+		rc = asprintf(&path, "%s%s%s[%d:%d]", prefix, dot, r->identifier, r->msb_index, r->lsb_index);
+	}
+
+	return (rc < 0) ? NULL : path;
+}
+
+static int add_paths(openvcd_wave* w, diff_paths* paths, const openvcd_scope* s, const char* prefix);
+
+static int add_var(openvcd_wave* w, diff_paths* paths, const openvcd_var* v, const char* prefix) {
+	char* path;
+	int khret;
+	khint_t k;
+	size_t n;
+
+	if (!openvcd_wave_signal_number(w, v->identifier_code, strlen(v->identifier_code), &n)) {
+		return -1;
+	}
+
+	path = var_path(v, prefix);
+	if (path == NULL) { return -1; }
+	if (vec_push(&(paths->order), path) != 0) {
+		free(path);
+		return -1;
+	}
+
+	/* two variables with the same path couldn't be told apart */
+	k = kh_put(openvcd_mpath, paths->index, path, &khret);
+	if (khret <= 0) { return -1; }
+	kh_val(paths->index, k) = w->signals.data[n];
+
+	return 0;
+}
+
+static int add_scope(openvcd_wave* w, diff_paths* paths, const openvcd_scope* s, const char* prefix) {
+	char* path;
+	int rc;
+
+	if (asprintf(&path, "%s%s%s", prefix, (*prefix == '\0') ? "" : ".", s->identifier) < 0) {
+		return -1;
+	}
+	rc = add_paths(w, paths, s, path);
+	free(path);
+
+	return rc;
+}
+
+static int add_paths(openvcd_wave* w, diff_paths* paths, const openvcd_scope* s, const char* prefix) {
+	openvcd_child* children;
+	size_t n;
+	int rc;
+
+	children = openvcd_scope_children(s, &n);
+	if (children == NULL) { return -1; }
+
+	rc = 0;
+	for (size_t i = 0 ; (i < n) && (rc == 0) ; i++) {
+		if (children[i].var != NULL) {
+			rc = add_var(w, paths, children[i].var, prefix);
+		} else {
+			rc = add_scope(w, paths, children[i].scope, prefix);
+		}
+	}
+	free(children);
+
+	return rc;
+}
+
+/* map the dotted path of every variable in a waveform to it's signal,
+ * failing if two variables have the same path */
+static int map_paths(openvcd_wave* w, diff_paths* paths) {
+	vec_init(&(paths->order));
+	paths->index = kh_init(openvcd_mpath);
+	if (paths->index == NULL) { return -1; }
+
+	return add_paths(w, paths, w->root, "");
+}
+
+static openvcd_signal* find_path(const diff_paths* paths, const char* path) {
+	khint_t k;
+
+	k = kh_get(openvcd_mpath, paths->index, path);
+	if (k == kh_end(paths->index)) { return NULL; }
+
+	return kh_val(paths->index, k);
+}
+
+/* true if a block is identical in both signals, so that they hold the same
+ * changes */
+static bool same_block(const openvcd_signal* a, const openvcd_signal* b, size_t block) {
+	const openvcd_block* ba;
+	const openvcd_block* bb;
+
+	ba = &(a->blocks[block]);
+	bb = &(b->blocks[block]);
+
+	if ((ba->first_time != bb->first_time) || (ba->last_time != bb->last_time)) { return false; }
+	if ((ba->count != bb->count) || (ba->size != bb->size)) { return false; }
+
+	return memcmp(a->data + ba->offset, b->data + bb->offset, ba->size) == 0;
+}
+
+/* the number of leading blocks which are identical in both signals, the
+ * changes in them can be skipped without being decoded */
+static size_t same_prefix(const openvcd_signal* a, uint64_t scale_a, const openvcd_signal* b, uint64_t scale_b) {
+	size_t block;
+
+	if ((scale_a != scale_b) || (a->nwords != b->nwords)) { return 0; }
+
+	for (block = 0 ; (block < a->nblocks) && (block < b->nblocks) ; block++) {
+		if (!same_block(a, b, block)) { break; }
+	}
+
+	return block;
+}
+
+/* start a cursor at a block, with the value from the block before it */
+static int start_cursor(diff_cursor* c, openvcd_signal* s, uint64_t scale, size_t block, unsigned int nwords) {
+	openvcd_decoded_block* d;
+
+	c->s = s;
+	c->scale = scale;
+	c->d = NULL;
+	c->block = block;
+	c->next = 0;
+	c->known = false;
+	c->aval = calloc(2 * (size_t) nwords, sizeof(uint64_t));
+	if (c->aval == NULL) { return -1; }
+	c->bval = c->aval + nwords;
+
+	if (block == 0) { return 0; }
+
+	d = openvcd_decode_block(s, block - 1);
+	if (d == NULL) { return -1; }
+	if (d->count > 0) {
+		memcpy(c->aval, d->aval + ((size_t) (d->count - 1) * d->nwords), d->nwords * sizeof(uint64_t));
+		memcpy(c->bval, d->bval + ((size_t) (d->count - 1) * d->nwords), d->nwords * sizeof(uint64_t));
+		c->known = true;
+	}
+	openvcd_free_decoded_block(d);
+
+	return 0;
+}
+
+static void free_cursor(diff_cursor* c) {
+	if (c->d != NULL) { openvcd_free_decoded_block(c->d); }
+	free(c->aval);
+}
+
+/* find the time of the cursor's next change, decoding blocks as needed,
+ * returns -1 on failure, 0 if there are no more changes, and 1 otherwise */
+static int peek(diff_cursor* c, uint64_t* t) {
+	while ((c->d == NULL) || (c->next >= c->d->count)) {
+		if (c->d != NULL) {
+			openvcd_free_decoded_block(c->d);
+			c->d = NULL;
+			c->block++;
+		}
+		if (c->block >= c->s->nblocks) { return 0; }
+
+		c->d = openvcd_decode_block(c->s, c->block);
+		if (c->d == NULL) { return -1; }
+		c->next = 0;
+	}
+
+	/* a time which can't be put in the common timescale can't be
+	 * compared */
+	if (c->d->times[c->next] > UINT64_MAX / c->scale) { return -1; }
+	*t = c->d->times[c->next] * c->scale;
+
+	return 1;
+}
+
+/* apply the cursor's next change */
+static void advance(diff_cursor* c) {
+	size_t offset;
+
+	offset = (size_t) c->next * c->d->nwords;
+	memcpy(c->aval, c->d->aval + offset, c->d->nwords * sizeof(uint64_t));
+	memcpy(c->bval, c->d->bval + offset, c->d->nwords * sizeof(uint64_t));
+	c->known = true;
+	c->next++;
+}
+
+static void report(const openvcd_diff_mapping* mapping, openvcd_diff_mismatch* m) {
+	if (mapping->handler != NULL) { mapping->handler(mapping->ctx, m); }
+}
+
+/* report a path which has no signal on one side */
+static long report_missing(const openvcd_diff_mapping* mapping, const char* path_a, const openvcd_signal* a, const char* path_b, const openvcd_signal* b) {
+	openvcd_diff_mismatch m;
+
+	memset(&m, 0, sizeof(m));
+	m.path_a = path_a;
+	m.path_b = path_b;
+	m.a = a;
+	m.b = b;
+	report(mapping, &m);
+
+	return 1;
+}
+
+/* compare one pair of signals, returning the number of mismatches */
+static long diff_pair(const openvcd_diff_mapping* mapping, const char* path_a, openvcd_signal* a, uint64_t scale_a, const char* path_b, openvcd_signal* b, uint64_t scale_b) {
+	openvcd_diff_mismatch m;
+	diff_cursor ca;
+	diff_cursor cb;
+	unsigned int nwords;
+	size_t block;
+	uint64_t ta;
+	uint64_t tb;
+	uint64_t t;
+	long count;
+	int ra;
+	int rb;
+
+	block = same_prefix(a, scale_a, b, scale_b);
+	if ((block == a->nblocks) && (block == b->nblocks)) { return 0; }
+
+	nwords = (a->nwords > b->nwords) ? a->nwords : b->nwords;
+	memset(&ca, 0, sizeof(ca));
+	memset(&cb, 0, sizeof(cb));
+	if ((start_cursor(&ca, a, scale_a, block, nwords) != 0) || (start_cursor(&cb, b, scale_b, block, nwords) != 0)) {
+		free_cursor(&ca);
+		free_cursor(&cb);
+		return -1;
+	}
+
+	m.path_a = path_a;
+	m.path_b = path_b;
+	m.a = a;
+	m.b = b;
+
+	count = 0;
+	while ((mapping->max_mismatches == 0) || ((size_t) count < mapping->max_mismatches)) {
+		ra = peek(&ca, &ta);
+		rb = peek(&cb, &tb);
+		if ((ra < 0) || (rb < 0)) {
+			count = -1;
+			break;
+		}
+		if ((ra == 0) && (rb == 0)) { break; }
+
+		if (ra == 0) {
+			t = tb;
+		} else if (rb == 0) {
+			t = ta;
+		} else {
+			t = (ta < tb) ? ta : tb;
+		}
+
+		/* every change at the same time is applied, so only the last
+		 * one is compared */
+		while ((ra > 0) && (ta == t)) {
+			advance(&ca);
+			ra = peek(&ca, &ta);
+		}
+		while ((rb > 0) && (tb == t)) {
+			advance(&cb);
+			rb = peek(&cb, &tb);
+		}
+		if ((ra < 0) || (rb < 0)) {
+			count = -1;
+			break;
+		}
+
+		if ((ca.known == cb.known) && (!ca.known || openvcd_value_eq(nwords, ca.aval, ca.bval, cb.aval, cb.bval))) {
+			continue;
+		}
+
+		m.time = t;
+		m.aval_a = ca.known ? ca.aval : NULL;
+		m.bval_a = ca.known ? ca.bval : NULL;
+		m.aval_b = cb.known ? cb.aval : NULL;
+		m.bval_b = cb.known ? cb.bval : NULL;
+		report(mapping, &m);
+		count++;
+	}
+
+	free_cursor(&ca);
+	free_cursor(&cb);
+
+	return count;
+}
+
+/* load a pair of signals and compare them, unloading whichever of them
+ * weren't loaded already so that only one pair is held at once */
+static long load_pair(const openvcd_diff_mapping* mapping, openvcd_wave* a, const char* path_a, openvcd_signal* sa, uint64_t scale_a, openvcd_wave* b, const char* path_b, openvcd_signal* sb, uint64_t scale_b) {
+	bool loaded_a;
+	bool loaded_b;
+	long n;
+
+	loaded_a = sa->loaded;
+	loaded_b = sb->loaded;
+
+	n = -1;
+	if ((openvcd_wave_load_signal(a, sa) == 0) && (openvcd_wave_load_signal(b, sb) == 0)) {
+		n = diff_pair(mapping, path_a, sa, scale_a, path_b, sb, scale_b);
+	}
+
+	if (!loaded_a) { openvcd_wave_unload_signal(a, sa); }
+	if (!loaded_b) { openvcd_wave_unload_signal(b, sb); }
+
+	return n;
+}
+
+/* compare the given pairs of paths */
+static long diff_pairs(openvcd_wave* a, const diff_paths* paths_a, uint64_t scale_a, openvcd_wave* b, const diff_paths* paths_b, uint64_t scale_b, const openvcd_diff_mapping* mapping) {
+	openvcd_signal* sa;
+	openvcd_signal* sb;
+	const char* pa;
+	const char* pb;
+	long total;
+	long n;
+
+	total = 0;
+	for (size_t i = 0 ; i < mapping->npairs ; i++) {
+		pa = mapping->pairs[i].a;
+		pb = mapping->pairs[i].b;
+		sa = find_path(paths_a, pa);
+		sb = find_path(paths_b, pb);
+
+		if ((sa == NULL) || (sb == NULL)) {
+			total += report_missing(mapping, pa, sa, pb, sb);
+			continue;
+		}
+
+		n = load_pair(mapping, a, pa, sa, scale_a, b, pb, sb, scale_b);
+		if (n < 0) { return -1; }
+		total += n;
+	}
+
+	return total;
+}
+
+/* compare every path in either waveform, in the order they were declared */
+static long diff_all(openvcd_wave* a, const diff_paths* paths_a, uint64_t scale_a, openvcd_wave* b, const diff_paths* paths_b, uint64_t scale_b, const openvcd_diff_mapping* mapping) {
+	openvcd_signal* sa;
+	openvcd_signal* sb;
+	char* path;
+	long total;
+	long n;
+	int i;
+
+	total = 0;
+	vec_foreach(&(paths_a->order), path, i) {
+		sa = find_path(paths_a, path);
+		sb = find_path(paths_b, path);
+
+		if (sb == NULL) {
+			total += report_missing(mapping, path, sa, path, NULL);
+			continue;
+		}
+
+		n = load_pair(mapping, a, path, sa, scale_a, b, path, sb, scale_b);
+		if (n < 0) { return -1; }
+		total += n;
+	}
+
+	vec_foreach(&(paths_b->order), path, i) {
+		if (find_path(paths_a, path) != NULL) { continue; }
+		total += report_missing(mapping, path, NULL, path, find_path(paths_b, path));
+	}
+
+	return total;
+}
+
+long openvcd_diff(openvcd_wave* a, openvcd_wave* b, const openvcd_diff_mapping* mapping) {
+	diff_paths paths_a;
+	diff_paths paths_b;
+	openvcd_timescale timescales[2];
+	openvcd_timescale common;
+	uint64_t scales[2];
+	long total;
+	int rc_a;
+	int rc_b;
+
+	rc_a = map_paths(a, &paths_a);
+	rc_b = map_paths(b, &paths_b);
+	if ((rc_a != 0) || (rc_b != 0)) {
+		free_paths(&paths_a);
+		free_paths(&paths_b);
+		return -1;
+	}
+
+	timescales[0] = a->timescale;
+	timescales[1] = b->timescale;
+	openvcd_timescale_common(timescales, 2, &common, scales);
+
+	if (mapping->npairs > 0) {
+		total = diff_pairs(a, &paths_a, scales[0], b, &paths_b, scales[1], mapping);
+	} else {
+		total = diff_all(a, &paths_a, scales[0], b, &paths_b, scales[1], mapping);
+	}
+
+	free_paths(&paths_a);
+	free_paths(&paths_b);
+
+	return total;
+}
@@ -0,0 +1,118 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements comparing two waveforms, for instance the dumps of a
+ * design before and after a change.
+ *
+ * Signals are matched up by their dotted paths, such as "top.core.data",
+ * with the bit range of the variable if it has one, as in
+ * "top.core.data[7:0]" or "top.core.data[3]", so that the slices of a bus
+ * are told apart. Either all paths in both waveforms are compared, in the
+ * order they were declared, or a given list of pairs.
+ * Each pair is then compared by walking both signals' changes in time
+ * order, a block at a time, and reporting the times at which their values
+ * differ to a handler. Signals of lazily opened waveforms (see lazy.h) are
+ * loaded whole when their pair is compared and unloaded straight after, so
+ * memory use is bounded by the largest pair rather than by the files.
+ * However each signal is loaded separately, which reads the chunks of the
+ * file which may contain it once per signal.
+ *
+ * Times are compared in the finer of the two timescales, so a dump in ns
+ * can be compared with the same dump in ps. When the timescales are the
+ * same, blocks which are byte for byte identical in both signals are
+ * skipped without being decoded, which makes signals which haven't changed
+ * between the two dumps cheap to compare.
+ */
+
+#ifndef OPENVCD_DIFF_H
+#define OPENVCD_DIFF_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "wave.h"
+#include "lazy.h"
+
+/**** TYPES ******************************************************************/
+
+typedef struct {
+	/* the paths of the signals being compared */
+	const char* path_a;
+	const char* path_b;
+
+	/* the signals, one of which is NULL if it's path has no match */
+	const openvcd_signal* a;
+	const openvcd_signal* b;
+
+	/* the time of the mismatch, in the finer of the two timescales */
+	uint64_t time;
+
+	/* each signal's value at that time, or NULL if it has none */
+	const uint64_t* aval_a;
+	const uint64_t* bval_a;
+	const uint64_t* aval_b;
+	const uint64_t* bval_b;
+} openvcd_diff_mismatch;
+
+typedef void (*openvcd_diff_handler)(void* ctx, const openvcd_diff_mismatch* m);
+
+typedef struct {
+	/* a path in each waveform */
+	const char* a;
+	const char* b;
+} openvcd_diff_pair;
+
+typedef struct {
+	/* the signals to compare, if there are none then every path which
+	 * is in either waveform is */
+	const openvcd_diff_pair* pairs;
+	size_t npairs;
+
+	/* the most mismatches to report for each pair, 0 for all of them */
+	size_t max_mismatches;
+
+	openvcd_diff_handler handler;
+	void* ctx;
+} openvcd_diff_mapping;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Compare two waveforms.
+ *
+ * For each pair of signals, every time at which either changes and their
+ * values then differ is reported in time order, up to the mapping's limit.
+ * A signal has no value before it's first change, which only matches the
+ * other having none too. Values of different widths are compared as if the
+ * narrower was extended with zeros.
+ *
+ * A path which doesn't name a variable in it's waveform is reported once,
+ * with time 0 and it's signal NULL.
+ *
+ * @param a
+ * @param b
+ * @param mapping
+ *
+ * Signals which were already loaded are left loaded, and lazily opened
+ * signals which weren't are unloaded once they have been compared.
+ *
+ * @return The number of mismatches reported, or -1 on failure, for instance
+ * if a lazily opened signal could not be loaded, a time overflows when it
+ * is put in the finer timescale, or two variables of a waveform have the
+ * same path.
+ */
+long openvcd_diff(openvcd_wave* a, openvcd_wave* b, const openvcd_diff_mapping* mapping);
+
+#endif /* OPENVCD_DIFF_H */
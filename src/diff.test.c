@@ -0,0 +1,347 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "diff.h"
+
+#define MAX_SEEN 64
+
+typedef struct {
+	size_t count;
+	char* paths[MAX_SEEN];
+	uint64_t times[MAX_SEEN];
+	bool missing_a[MAX_SEEN];
+	bool missing_b[MAX_SEEN];
+	uint64_t aval_a[MAX_SEEN];
+	uint64_t aval_b[MAX_SEEN];
+	bool known_a[MAX_SEEN];
+} seen_t;
+
+static void seen(void* ctx, const openvcd_diff_mismatch* m) {
+	seen_t* s;
+
+	s = (seen_t*) ctx;
+	if (s->count == MAX_SEEN) { return; }
+
+	s->paths[s->count] = strdup((m->path_a != NULL) ? m->path_a : m->path_b);
+	s->times[s->count] = m->time;
+	s->missing_a[s->count] = (m->a == NULL);
+	s->missing_b[s->count] = (m->b == NULL);
+	s->known_a[s->count] = (m->aval_a != NULL);
+	s->aval_a[s->count] = (m->aval_a != NULL) ? m->aval_a[0] : 0;
+	s->aval_b[s->count] = (m->aval_b != NULL) ? m->aval_b[0] : 0;
+	s->count++;
+}
+
+static void free_seen(seen_t* s) {
+	for (size_t i = 0 ; i < s->count ; i++) { free(s->paths[i]); }
+	s->count = 0;
+}
+
+/* write a waveform which counts up on top.core.data every step, with
+ * the given timescale and number of time units per step, and a different
+ * value at one step unless bad is -1 */
+static void write_counter(FILE* f, const char* timescale, uint64_t step, int steps, int bad, const char* extra) {
+	int value;
+
+	fprintf(f, "$timescale %s $end\n$scope module top $end\n$scope module core $end\n"
+		"$var reg 8 d data [7:0] $end\n$upscope $end\n"
+		"$var wire 1 c clk $end\n%s$upscope $end\n$enddefinitions $end\n",
+		timescale, extra);
+	for (int i = 0 ; i < steps ; i++) {
+		value = (i == bad) ? 0xff : (i & 0xff);
+		fprintf(f, "#%lu\n%dc\nb", (unsigned long) ((uint64_t) i * step), i % 2);
+		for (int bit = 7 ; bit >= 0 ; bit--) { fputc('0' + ((value >> bit) & 1), f); }
+		fprintf(f, " d\n");
+	}
+}
+
+/* load a waveform written by write_counter() */
+static openvcd_wave* counter(const char* timescale, uint64_t step, int steps, int bad, const char* extra) {
+	openvcd_wave* w;
+	char* buffer;
+	size_t length;
+	FILE* f;
+
+	f = open_memstream(&buffer, &length);
+	should_not_be_null(f);
+	write_counter(f, timescale, step, steps, bad, extra);
+	fclose(f);
+
+	w = load_buffer(buffer, length);
+	free(buffer);
+
+	return w;
+}
+
+void test_diff_timescales(void) {
+	openvcd_diff_mapping mapping;
+	openvcd_wave* a;
+	openvcd_wave* b;
+	seen_t s;
+
+	memset(&s, 0, sizeof(s));
+	memset(&mapping, 0, sizeof(mapping));
+	mapping.handler = seen;
+	mapping.ctx = &s;
+
+	/* the same changes, in ns and 100ps */
+	a = counter("1ns", 1, 100, -1, "");
+	b = counter("100ps", 10, 100, -1, "");
+	should_equal(openvcd_diff(a, b, &mapping), 0);
+	should_equal(s.count, 0);
+	openvcd_free_wave(b);
+
+	/* the same times in ps is a different waveform */
+	b = counter("1ps", 1, 100, -1, "");
+	mapping.max_mismatches = 3;
+	should_equal(openvcd_diff(a, b, &mapping), 6);
+	should_equal(s.count, 6);
+	free_seen(&s);
+	openvcd_free_wave(b);
+
+	openvcd_free_wave(a);
+}
+
+void test_diff_mismatches(void) {
+	openvcd_diff_mapping mapping;
+	openvcd_wave* a;
+	openvcd_wave* b;
+	seen_t s;
+
+	memset(&s, 0, sizeof(s));
+	memset(&mapping, 0, sizeof(mapping));
+	mapping.handler = seen;
+	mapping.ctx = &s;
+
+	a = counter("1ns", 10, 50, -1, "");
+	b = counter("1ns", 10, 50, 20, "$var wire 4 j junk $end\n");
+
+	should_equal(openvcd_diff(a, b, &mapping), 2);
+	should_equal(s.count, 2);
+	for (size_t i = 0 ; i < s.count ; i++) {
+		if (strcmp(s.paths[i], "top.junk") == 0) {
+			should_be_true(s.missing_a[i]);
+			should_be_false(s.missing_b[i]);
+			continue;
+		}
+		should_equal(strcmp(s.paths[i], "top.core.data[7:0]"), 0);
+		should_be_true(s.known_a[i]);
+	}
+
+	/* the paths only in b come after the others, and the change after
+	 * the bad value puts it right */
+	should_equal(strcmp(s.paths[0], "top.core.data[7:0]"), 0);
+	should_equal(s.times[0], 200);
+	should_equal(s.aval_a[0], 20);
+	should_equal(s.aval_b[0], 0xff);
+	free_seen(&s);
+
+	openvcd_free_wave(a);
+	openvcd_free_wave(b);
+}
+
+void test_diff_pairs(void) {
+	openvcd_diff_pair pairs[] = {
+		{ "top.clk", "top.clk" },
+		{ "top.core.data[7:0]", "top.clk" },
+		{ "top.core.data[7:0]", "top.core.nothing" },
+	};
+	openvcd_diff_mapping mapping;
+	openvcd_wave* a;
+	openvcd_wave* b;
+	seen_t s;
+
+	memset(&s, 0, sizeof(s));
+	memset(&mapping, 0, sizeof(mapping));
+	mapping.handler = seen;
+	mapping.ctx = &s;
+	mapping.pairs = pairs;
+	mapping.npairs = 3;
+
+	a = counter("1ns", 1, 10, -1, "");
+	b = counter("1ns", 1, 10, -1, "");
+
+	/* data and clk agree at 0 and 1, after which they differ at every
+	 * step, and the last pair is missing on one side */
+	should_equal(openvcd_diff(a, b, &mapping), 8 + 1);
+	should_equal(s.times[0], 2);
+	should_equal(s.aval_a[0], 2);
+	should_equal(s.aval_b[0], 0);
+	should_be_true(s.missing_b[8]);
+	should_be_false(s.missing_a[8]);
+	should_equal(strcmp(s.paths[8], "top.core.data[7:0]"), 0);
+	free_seen(&s);
+
+	/* without a handler they are only counted */
+	mapping.handler = NULL;
+	should_equal(openvcd_diff(a, b, &mapping), 9);
+
+	openvcd_free_wave(a);
+	openvcd_free_wave(b);
+}
+
+void test_diff_blocks(void) {
+	openvcd_diff_mapping mapping;
+	openvcd_signal* s;
+	openvcd_wave* a;
+	openvcd_wave* b;
+	seen_t seen_state;
+	int steps;
+
+	memset(&seen_state, 0, sizeof(seen_state));
+	memset(&mapping, 0, sizeof(mapping));
+	mapping.handler = seen;
+	mapping.ctx = &seen_state;
+
+	/* only the last block differs, so the ones before it are skipped */
+	steps = 3 * OPENVCD_BLOCK_CHANGES + 10;
+	a = counter("1ns", 1, steps, -1, "");
+	b = counter("1ns", 1, steps, steps - 5, "");
+	s = openvcd_wave_find_signal(a, "d");
+	should_not_be_null(s);
+	should_be_true(s->nblocks > 3);
+
+	should_equal(openvcd_diff(a, b, &mapping), 1);
+	should_equal(seen_state.times[0], (uint64_t) (steps - 5));
+	should_equal(seen_state.aval_a[0], (uint64_t) ((steps - 5) & 0xff));
+	should_equal(seen_state.aval_b[0], 0xff);
+	free_seen(&seen_state);
+
+	openvcd_free_wave(a);
+	openvcd_free_wave(b);
+}
+
+/* open a waveform written by write_counter() lazily */
+static openvcd_wave* lazy_counter(char* path, int steps, int bad) {
+	openvcd_wave* w;
+	FILE* f;
+
+	f = temp_file(path);
+	write_counter(f, "1ns", 1, steps, bad, "");
+	fclose(f);
+
+	w = openvcd_open_indexed(path, NULL, 0);
+	should_not_be_null(w);
+
+	return w;
+}
+
+void test_diff_lazy(void) {
+	char path_a[] = "/tmp/openvcd-diff-XXXXXX";
+	char path_b[] = "/tmp/openvcd-diff-XXXXXX";
+	openvcd_diff_mapping mapping;
+	openvcd_signal* s;
+	openvcd_wave* a;
+	openvcd_wave* b;
+	seen_t seen_state;
+	int steps;
+
+	memset(&seen_state, 0, sizeof(seen_state));
+	memset(&mapping, 0, sizeof(mapping));
+	mapping.handler = seen;
+	mapping.ctx = &seen_state;
+
+	steps = 2 * OPENVCD_BLOCK_CHANGES;
+	a = lazy_counter(path_a, steps, -1);
+	b = lazy_counter(path_b, steps, 7);
+
+	/* a signal which was loaded beforehand stays loaded */
+	s = openvcd_wave_find_signal(a, "c");
+	should_not_be_null(s);
+	should_equal(openvcd_wave_load_signal(a, s), 0);
+
+	should_equal(openvcd_diff(a, b, &mapping), 1);
+	should_equal(seen_state.times[0], 7);
+	should_equal(seen_state.aval_b[0], 0xff);
+	free_seen(&seen_state);
+
+	should_be_true(s->loaded);
+	should_equal(s->change_count, (uint64_t) steps);
+
+	/* the others are unloaded once they are compared */
+	s = openvcd_wave_find_signal(a, "d");
+	should_be_false(s->loaded);
+	should_be_null(s->blocks);
+	s = openvcd_wave_find_signal(b, "d");
+	should_be_false(s->loaded);
+	should_equal(s->change_count, 0);
+
+	/* and loaded again when they are needed */
+	should_equal(openvcd_diff(a, b, &mapping), 1);
+	free_seen(&seen_state);
+
+	openvcd_free_wave(a);
+	openvcd_free_wave(b);
+	unlink(path_a);
+	unlink(path_b);
+}
+
+void test_diff_paths(void) {
+	const char* declared[] = { "top.bus[7:4]", "top.bus[3:0]", "top.zz", "top.yy", "top.bit[2]" };
+	openvcd_diff_mapping mapping;
+	openvcd_wave* a;
+	openvcd_wave* b;
+	seen_t s;
+
+	memset(&s, 0, sizeof(s));
+	memset(&mapping, 0, sizeof(mapping));
+	mapping.handler = seen;
+	mapping.ctx = &s;
+
+	/* the slices of a bus are separate paths, and those only in b are
+	 * reported in the order they were declared */
+	a = counter("1ns", 1, 10, -1, "");
+	b = counter("1ns", 1, 10, -1,
+		"$var wire 4 h bus [7:4] $end\n$var wire 4 l bus [3:0] $end\n"
+		"$var wire 1 z zz $end\n$var wire 1 y yy $end\n$var wire 1 t bit [2] $end\n");
+	should_equal(openvcd_diff(a, b, &mapping), 5);
+	should_equal(s.count, 5);
+	for (size_t i = 0 ; i < 5 ; i++) {
+		should_equal(strcmp(s.paths[i], declared[i]), 0);
+		should_be_true(s.missing_a[i]);
+	}
+	free_seen(&s);
+	openvcd_free_wave(b);
+
+	/* two variables with the same path can't be told apart */
+	b = counter("1ns", 1, 10, -1, "$var wire 1 e clk $end\n");
+	should_equal(openvcd_diff(a, b, &mapping), -1);
+	should_equal(s.count, 0);
+	openvcd_free_wave(b);
+
+	openvcd_free_wave(a);
+}
+
+void test_diff_overflow(void) {
+	openvcd_diff_mapping mapping;
+	openvcd_wave* a;
+	openvcd_wave* b;
+
+	memset(&mapping, 0, sizeof(mapping));
+
+	/* 10^5s is too many fs to fit in 64 bits */
+	a = counter("1s", 100000, 2, -1, "");
+	b = counter("1fs", 1, 2, -1, "");
+	should_equal(openvcd_diff(a, b, &mapping), -1);
+
+	openvcd_free_wave(a);
+	openvcd_free_wave(b);
+}
+
+int main(void) {
+	test_diff_timescales();
+	test_diff_mismatches();
+	test_diff_pairs();
+	test_diff_blocks();
+	test_diff_lazy();
+	test_diff_paths();
+	test_diff_overflow();
+	return 0;
+}
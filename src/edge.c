@@ -0,0 +1,120 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "edge.h"
+
+#define LAST_FLAGS (OPENVCD_BLOCK_LAST_STATE | OPENVCD_BLOCK_LAST_XZ)
+
+/* false if the block's flags rule out it containing an edge of the kind */
+static bool may_contain(const openvcd_block* b, openvcd_edge_kind kind) {
+	switch (kind) {
+		case OPENVCD_EDGE_POSEDGE:
+			return (b->flags & OPENVCD_BLOCK_POSEDGE) != 0;
+		case OPENVCD_EDGE_NEGEDGE:
+			return (b->flags & OPENVCD_BLOCK_NEGEDGE) != 0;
+		case OPENVCD_EDGE_XZ:
+			return (b->flags & OPENVCD_BLOCK_XZ) != 0;
+		default:
+			return b->count > 0;
+	}
+}
+
+/* the OPENVCD_BLOCK_LAST_* flags of the j-th change of a decoded block */
+static int change_flags(const openvcd_decoded_block* d, uint32_t j) {
+	const uint64_t* aval;
+	const uint64_t* bval;
+	int flags;
+
+	aval = d->aval + ((size_t) j * d->nwords);
+	bval = d->bval + ((size_t) j * d->nwords);
+
+	flags = (int) (((bval[0] & 1) << 1) | (aval[0] & 1));
+	if (openvcd_value_has_xz(d->nwords, bval)) { flags |= OPENVCD_BLOCK_LAST_XZ; }
+
+	return flags;
+}
+
+bool openvcd_is_edge(const openvcd_signal* s, openvcd_edge_kind kind, int from, int to) {
+	if (kind == OPENVCD_EDGE_ANY) { return true; }
+	if (s->real) { return false; }
+
+	switch (kind) {
+		case OPENVCD_EDGE_POSEDGE:
+			return (from >= 0) && openvcd_state_posedge(from & OPENVCD_BLOCK_LAST_STATE, to & OPENVCD_BLOCK_LAST_STATE);
+		case OPENVCD_EDGE_NEGEDGE:
+			return (from >= 0) && openvcd_state_negedge(from & OPENVCD_BLOCK_LAST_STATE, to & OPENVCD_BLOCK_LAST_STATE);
+		default:
+			return ((to & OPENVCD_BLOCK_LAST_XZ) != 0) && ((from < 0) || ((from & OPENVCD_BLOCK_LAST_XZ) == 0));
+	}
+}
+
+/* look for an edge in a single block, returning 1 if one was found, 0 if
+ * not, or -1 if the block couldn't be decoded */
+static int search_block(const openvcd_signal* s, size_t block, uint64_t t, openvcd_search_direction direction, openvcd_edge_kind kind, uint64_t* found) {
+	openvcd_decoded_block* d;
+	int from;
+	int to;
+	int rc;
+
+	d = openvcd_decode_block(s, block);
+	if (d == NULL) { return -1; }
+
+	/* the value before the block is the last one of the block before it */
+	from = (block == 0) ? -1 : (s->blocks[block - 1].flags & LAST_FLAGS);
+
+	rc = 0;
+	for (uint32_t j = 0 ; j < d->count ; j++) {
+		to = change_flags(d, j);
+
+		if (direction == OPENVCD_SEARCH_NEXT) {
+			if ((d->times[j] > t) && openvcd_is_edge(s, kind, from, to)) {
+				*found = d->times[j];
+				rc = 1;
+				break;
+			}
+		} else {
+			if (d->times[j] >= t) { break; }
+			if (openvcd_is_edge(s, kind, from, to)) {
+				*found = d->times[j];
+				rc = 1;
+			}
+		}
+
+		from = to;
+	}
+
+	openvcd_free_decoded_block(d);
+	return rc;
+}
+
+bool openvcd_find_edge(const openvcd_signal* s, uint64_t t, openvcd_search_direction direction, openvcd_edge_kind kind, uint64_t* found) {
+	size_t block;
+	int rc;
+
+	if (direction == OPENVCD_SEARCH_NEXT) {
+		if (!openvcd_signal_find_block(s, t, &block)) { block = 0; }
+
+		for ( ; block < s->nblocks ; block++) {
+			if (s->blocks[block].last_time <= t) { continue; }
+			if (!may_contain(&(s->blocks[block]), kind)) { continue; }
+
+			rc = search_block(s, block, t, direction, kind, found);
+			if (rc != 0) { return rc > 0; }
+		}
+
+		return false;
+	}
+
+	if ((t == 0) || !openvcd_signal_find_block(s, t - 1, &block)) { return false; }
+
+	for (block++ ; block > 0 ; block--) {
+		if (!may_contain(&(s->blocks[block - 1]), kind)) { continue; }
+
+		rc = search_block(s, block - 1, t, direction, kind, found);
+		if (rc != 0) { return rc > 0; }
+	}
+
+	return false;
+}
@@ -0,0 +1,99 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements finding the next or previous edge of a signal from a
+ * given time, such as the next rising edge of a clock or the first time a
+ * bus goes to x, which is what a viewer does to step between edges.
+ *
+ * Each block of a signal carries flags saying whether it may contain a
+ * rising edge, a falling edge, or a value with x or z bits, and what the
+ * value of it's last change was, see OPENVCD_BLOCK_*. The search walks the
+ * block index from the given time and only decodes blocks whose flags say
+ * they may contain a match, so finding a rare event in a long signal
+ * touches little more than the index.
+ *
+ * Edges are those of bit 0 of the signal, with Verilog's meaning, see
+ * openvcd_state_posedge() and openvcd_state_negedge().
+ */
+
+#ifndef OPENVCD_EDGE_H
+#define OPENVCD_EDGE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "value.h"
+#include "wave.h"
+
+/**** TYPES ******************************************************************/
+
+typedef enum {
+	/* bit 0 rising */
+	OPENVCD_EDGE_POSEDGE,
+
+	/* bit 0 falling */
+	OPENVCD_EDGE_NEGEDGE,
+
+	/* any recorded change */
+	OPENVCD_EDGE_ANY,
+
+	/* a value with x or z bits after one without, or as the first value */
+	OPENVCD_EDGE_XZ,
+} openvcd_edge_kind;
+
+typedef enum {
+	/* the first edge after the given time */
+	OPENVCD_SEARCH_NEXT,
+
+	/* the last edge before the given time */
+	OPENVCD_SEARCH_PREVIOUS,
+} openvcd_search_direction;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Whether a change of a signal is an edge of the given kind.
+ *
+ * Every change is an OPENVCD_EDGE_ANY edge, and real signals have no other
+ * kind.
+ *
+ * @param s
+ * @param kind
+ * @param from The OPENVCD_BLOCK_LAST_* flags of the value before the
+ * change, or -1 if there was none.
+ * @param to The OPENVCD_BLOCK_LAST_* flags of the value after the change.
+ *
+ * @return
+ */
+bool openvcd_is_edge(const openvcd_signal* s, openvcd_edge_kind kind, int from, int to);
+
+/**
+ * @brief Find the nearest edge of a signal from time t.
+ *
+ * Edges at exactly time t are not found, so that calling this again with
+ * the time found steps to the following edge. Real signals only have
+ * OPENVCD_EDGE_ANY edges. The signal must be loaded, see lazy.h.
+ *
+ * @param s
+ * @param t
+ * @param direction
+ * @param kind
+ * @param found Set to the time of the edge.
+ *
+ * @return false if there is no such edge, or a block could not be decoded.
+ */
+bool openvcd_find_edge(const openvcd_signal* s, uint64_t t, openvcd_search_direction direction, openvcd_edge_kind kind, uint64_t* found);
+
+#endif /* OPENVCD_EDGE_H */
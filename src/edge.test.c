@@ -0,0 +1,181 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "edge.h"
+
+static void append(openvcd_signal* s, uint64_t time, int state) {
+	uint64_t aval;
+	uint64_t bval;
+
+	aval = (uint64_t) (state & 1);
+	bval = (uint64_t) ((state >> 1) & 1);
+	should_equal(openvcd_signal_append(s, time, &aval, &bval), 0);
+}
+
+/* a clock which rises at 10, 30, 50, ... and falls at 20, 40, 60, ...
+ * over several blocks, with one x at the given time */
+static openvcd_signal* make_clock(uint64_t changes, uint64_t x) {
+	openvcd_signal* s;
+
+	s = openvcd_alloc_signal("c", 1, false);
+	should_not_be_null(s);
+
+	append(s, 0, OPENVCD_STATE_0);
+	for (uint64_t i = 1 ; i <= changes ; i++) {
+		if (i * 10 == x) {
+			append(s, i * 10, OPENVCD_STATE_X);
+		} else {
+			append(s, i * 10, (i % 2 == 1) ? OPENVCD_STATE_1 : OPENVCD_STATE_0);
+		}
+	}
+
+	return s;
+}
+
+void test_edge_flags(void) {
+	openvcd_signal* s;
+
+	s = make_clock(4 * OPENVCD_BLOCK_CHANGES, 0);
+	should_equal(s->nblocks, 5);
+
+	/* every block has both edges, except the last which has one change */
+	should_equal(s->blocks[0].flags & (OPENVCD_BLOCK_POSEDGE | OPENVCD_BLOCK_NEGEDGE),
+		OPENVCD_BLOCK_POSEDGE | OPENVCD_BLOCK_NEGEDGE);
+	should_equal(s->blocks[0].flags & OPENVCD_BLOCK_XZ, 0);
+	should_equal(s->blocks[0].flags & OPENVCD_BLOCK_LAST_STATE, OPENVCD_STATE_1);
+	should_equal(s->blocks[4].count, 1);
+	should_equal(s->blocks[4].flags, OPENVCD_BLOCK_NEGEDGE | OPENVCD_STATE_0);
+
+	openvcd_free_signal(s);
+}
+
+void test_edge_next(void) {
+	openvcd_signal* s;
+	uint64_t found;
+
+	s = make_clock(4 * OPENVCD_BLOCK_CHANGES, 0);
+
+	should_be_true(openvcd_find_edge(s, 0, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_POSEDGE, &found));
+	should_equal(found, 10);
+	should_be_true(openvcd_find_edge(s, 10, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_POSEDGE, &found));
+	should_equal(found, 30);
+	should_be_true(openvcd_find_edge(s, 10, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_NEGEDGE, &found));
+	should_equal(found, 20);
+	should_be_true(openvcd_find_edge(s, 15, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_ANY, &found));
+	should_equal(found, 20);
+
+	/* across a block boundary */
+	should_be_true(openvcd_find_edge(s, 2560, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_POSEDGE, &found));
+	should_equal(found, 2570);
+
+	should_be_true(openvcd_find_edge(s, 10230, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_NEGEDGE, &found));
+	should_equal(found, 10240);
+	should_be_false(openvcd_find_edge(s, 10230, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_POSEDGE, &found));
+	should_be_false(openvcd_find_edge(s, 10240, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_ANY, &found));
+	should_be_false(openvcd_find_edge(s, 0, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_XZ, &found));
+
+	openvcd_free_signal(s);
+}
+
+void test_edge_previous(void) {
+	openvcd_signal* s;
+	uint64_t found;
+
+	s = make_clock(4 * OPENVCD_BLOCK_CHANGES, 0);
+
+	should_be_true(openvcd_find_edge(s, 30, OPENVCD_SEARCH_PREVIOUS, OPENVCD_EDGE_POSEDGE, &found));
+	should_equal(found, 10);
+	should_be_true(openvcd_find_edge(s, 31, OPENVCD_SEARCH_PREVIOUS, OPENVCD_EDGE_POSEDGE, &found));
+	should_equal(found, 30);
+	should_be_true(openvcd_find_edge(s, 2570, OPENVCD_SEARCH_PREVIOUS, OPENVCD_EDGE_NEGEDGE, &found));
+	should_equal(found, 2560);
+	should_be_true(openvcd_find_edge(s, 100000, OPENVCD_SEARCH_PREVIOUS, OPENVCD_EDGE_POSEDGE, &found));
+	should_equal(found, 10230);
+	should_be_true(openvcd_find_edge(s, 5, OPENVCD_SEARCH_PREVIOUS, OPENVCD_EDGE_ANY, &found));
+	should_equal(found, 0);
+
+	should_be_false(openvcd_find_edge(s, 10, OPENVCD_SEARCH_PREVIOUS, OPENVCD_EDGE_POSEDGE, &found));
+	should_be_false(openvcd_find_edge(s, 0, OPENVCD_SEARCH_PREVIOUS, OPENVCD_EDGE_ANY, &found));
+
+	openvcd_free_signal(s);
+}
+
+void test_edge_xz(void) {
+	openvcd_signal* s;
+	uint64_t found;
+	uint64_t aval[2];
+	uint64_t bval[2];
+
+	/* 1 to x is a falling edge and x to 1 a rising one */
+	s = make_clock(4 * OPENVCD_BLOCK_CHANGES, 7000);
+	should_equal(s->blocks[2].flags & OPENVCD_BLOCK_XZ, OPENVCD_BLOCK_XZ);
+	should_equal(s->blocks[1].flags & OPENVCD_BLOCK_XZ, 0);
+	should_equal(s->blocks[3].flags & OPENVCD_BLOCK_XZ, 0);
+
+	should_be_true(openvcd_find_edge(s, 100, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_XZ, &found));
+	should_equal(found, 7000);
+	should_be_true(openvcd_find_edge(s, 10000, OPENVCD_SEARCH_PREVIOUS, OPENVCD_EDGE_XZ, &found));
+	should_equal(found, 7000);
+	should_be_false(openvcd_find_edge(s, 7000, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_XZ, &found));
+	should_be_true(openvcd_find_edge(s, 6990, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_NEGEDGE, &found));
+	should_equal(found, 7000);
+	should_be_true(openvcd_find_edge(s, 6990, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_POSEDGE, &found));
+	should_equal(found, 7010);
+	openvcd_free_signal(s);
+
+	/* x in a high bit of a vector, and a first value with z */
+	s = openvcd_alloc_signal("v", 70, false);
+	should_not_be_null(s);
+	aval[0] = 0; aval[1] = 0; bval[0] = 0; bval[1] = 0x20;
+	should_equal(openvcd_signal_append(s, 5, aval, bval), 0);
+	bval[1] = 0;
+	should_equal(openvcd_signal_append(s, 6, aval, bval), 0);
+	aval[1] = 0x20; bval[1] = 0x20;
+	should_equal(openvcd_signal_append(s, 8, aval, bval), 0);
+
+	should_be_true(openvcd_find_edge(s, 0, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_XZ, &found));
+	should_equal(found, 5);
+	should_be_true(openvcd_find_edge(s, 5, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_XZ, &found));
+	should_equal(found, 8);
+	should_be_false(openvcd_find_edge(s, 0, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_POSEDGE, &found));
+	openvcd_free_signal(s);
+}
+
+void test_edge_concat(void) {
+	openvcd_signal* a;
+	openvcd_signal* b;
+	uint64_t found;
+
+	/* b's first change is only known to be an edge once it follows a */
+	a = openvcd_alloc_signal("c", 1, false);
+	b = openvcd_alloc_signal("c", 1, false);
+	should_not_be_null(a);
+	should_not_be_null(b);
+	append(a, 0, OPENVCD_STATE_0);
+	append(b, 10, OPENVCD_STATE_1);
+	append(b, 20, OPENVCD_STATE_1);
+
+	should_equal(openvcd_signal_concat(a, b), 0);
+	should_equal(a->last_flags, OPENVCD_STATE_1);
+	should_be_true(openvcd_find_edge(a, 0, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_POSEDGE, &found));
+	should_equal(found, 10);
+	should_be_false(openvcd_find_edge(a, 0, OPENVCD_SEARCH_NEXT, OPENVCD_EDGE_NEGEDGE, &found));
+
+	openvcd_free_signal(a);
+	openvcd_free_signal(b);
+}
+
+int main(void) {
+	test_edge_flags();
+	test_edge_next();
+	test_edge_previous();
+	test_edge_xz();
+	test_edge_concat();
+	return 0;
+}
@@ -0,0 +1,440 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "filter.h"
+
+/* mapping of selected paths to whether they have matched anything */
+KHASH_MAP_INIT_STR(openvcd_mselect, bool)
+
+typedef struct {
+	/* the variable the signal is written as, NULL if it isn't selected */
+	openvcd_var* var;
+
+	/* the text of the signal's latest change before the window, if it
+	 * has one */
+	bool known;
+	openvcd_change_type type;
+	char* value;
+	size_t length;
+	size_t capacity;
+} filter_signal;
+
+typedef struct {
+	const openvcd_filter_options* o;
+	openvcd_wave* w;
+	openvcd_writer* out;
+
+	/* indexed by signal number */
+	filter_signal* signals;
+
+	khash_t(openvcd_mselect)* select;
+
+	/* while declaring, the dotted path of the current scope or variable */
+	char* path;
+	size_t path_length;
+	size_t path_capacity;
+
+	/* while declaring, the scopes from the root down to the current one,
+	 * and how many of them have been written */
+	openvcd_scope** scopes;
+	size_t depth;
+	size_t scopes_capacity;
+	size_t written;
+
+	/* true once the $dumpvars at the start of the window is written */
+	bool started;
+
+	/* the latest time read in the window, which is only written before
+	 * the first selected change at it, or at the end of the input */
+	uint64_t time;
+
+	/* false after a $dumpoff in the input until the next $dumpon, and
+	 * true while the $end of one written to the output is due */
+	bool dumping;
+	bool in_dump;
+
+	/* true once a time after the window has been read */
+	bool finished;
+} filter_state;
+
+/* append a name to the path, returning the length to restore it to */
+static size_t push_path(filter_state* f, const char* name) {
+	size_t length;
+	size_t need;
+	size_t cap;
+	char* path;
+
+	length = f->path_length;
+	need = length + strlen(name) + 2;
+	if (need > f->path_capacity) {
+		cap = (need > 2 * f->path_capacity) ? need : 2 * f->path_capacity;
+		path = realloc(f->path, cap);
+		if (path == NULL) { return SIZE_MAX; }
+		f->path = path;
+		f->path_capacity = cap;
+	}
+
+	if (length > 0) { f->path[f->path_length++] = '.'; }
+	strcpy(f->path + f->path_length, name);
+	f->path_length += strlen(name);
+
+	return length;
+}
+
+static void pop_path(filter_state* f, size_t length) {
+	f->path_length = length;
+	f->path[length] = '\0';
+}
+
+/* true if the current path was selected */
+static bool path_selected(filter_state* f) {
+	khint_t k;
+
+	k = kh_get(openvcd_mselect, f->select, f->path);
+	if (k == kh_end(f->select)) { return false; }
+	kh_val(f->select, k) = true;
+
+	return true;
+}
+
+/* write the $scope of every scope above the variable about to be declared
+ * which hasn't been written yet */
+static int write_scopes(filter_state* f) {
+	openvcd_scope* s;
+
+	for ( ; f->written < f->depth ; f->written++) {
+		s = f->scopes[f->written];
+		if (openvcd_writer_scope(f->out, s->identifier, s->type) != 0) { return -1; }
+	}
+
+	return 0;
+}
+
+static int declare_var(filter_state* f, const openvcd_var* v, bool selected) {
+	openvcd_reference none;
+	const openvcd_reference* r;
+	filter_signal* fs;
+	size_t length;
+	size_t n;
+
+	none.identifier = v->identifier_code;
+	none.msb_index = -1;
+	none.lsb_index = -1;
+	r = (v->reference != NULL) ? v->reference : &none;
+
+	length = push_path(f, r->identifier);
+	if (length == SIZE_MAX) { return -1; }
+	selected = path_selected(f) || selected;
+	pop_path(f, length);
+	if (!selected) { return 0; }
+
+	if (!openvcd_wave_signal_number(f->w, v->identifier_code, strlen(v->identifier_code), &n)) {
+		return -1;
+	}
+	fs = &(f->signals[n]);
+
+	if (write_scopes(f) != 0) { return -1; }
+
+	/* variables which shared a code still do */
+	if (fs->var != NULL) {
+		return (openvcd_writer_alias(f->out, v->type, r->identifier, r->msb_index, r->lsb_index, fs->var) == NULL) ? -1 : 0;
+	}
+
+	fs->var = openvcd_writer_var(f->out, v->type, v->width, r->identifier, r->msb_index, r->lsb_index);
+
+	return (fs->var == NULL) ? -1 : 0;
+}
+
+static int declare_scope(filter_state* f, const openvcd_scope* s, bool selected);
+
+static int declare_child(filter_state* f, openvcd_scope* child, bool selected) {
+	openvcd_scope** scopes;
+	size_t length;
+	size_t cap;
+	int rc;
+
+	length = push_path(f, child->identifier);
+	if (length == SIZE_MAX) { return -1; }
+	selected = path_selected(f) || selected;
+
+	if (f->depth == f->scopes_capacity) {
+		cap = (f->scopes_capacity == 0) ? 16 : f->scopes_capacity * 2;
+		scopes = realloc(f->scopes, cap * sizeof(openvcd_scope*));
+		if (scopes == NULL) { return -1; }
+		f->scopes = scopes;
+		f->scopes_capacity = cap;
+	}
+	f->scopes[f->depth++] = child;
+
+	rc = declare_scope(f, child, selected);
+
+	/* only scopes which had something selected were written */
+	if ((rc == 0) && (f->written == f->depth)) {
+		rc = openvcd_writer_upscope(f->out);
+		f->written--;
+	}
+	f->depth--;
+	pop_path(f, length);
+
+	return rc;
+}
+
+/* declare the children of a scope in the order the input declared them */
+static int declare_scope(filter_state* f, const openvcd_scope* s, bool selected) {
+	openvcd_child* children;
+	size_t n;
+	int rc;
+
+	children = openvcd_scope_children(s, &n);
+	if (children == NULL) { return -1; }
+
+	rc = 0;
+	for (size_t i = 0 ; (i < n) && (rc == 0) ; i++) {
+		if (children[i].var != NULL) {
+			rc = declare_var(f, children[i].var, selected);
+		} else {
+			rc = declare_child(f, children[i].scope, selected);
+		}
+	}
+
+	free(children);
+
+	return rc;
+}
+
+/* remember the value of a change before the window, as it's text */
+static int keep_value(filter_signal* fs, const openvcd_change* c) {
+	size_t cap;
+	char* value;
+
+	if (c->value_length > fs->capacity) {
+		cap = (c->value_length > 2 * fs->capacity) ? c->value_length : 2 * fs->capacity;
+		value = realloc(fs->value, cap);
+		if (value == NULL) { return -1; }
+		fs->value = value;
+		fs->capacity = cap;
+	}
+
+	memcpy(fs->value, c->value, c->value_length);
+	fs->length = c->value_length;
+	fs->type = c->type;
+	fs->known = true;
+
+	return 0;
+}
+
+/* write the values of the selected signals at the start of the window */
+static int start(filter_state* f) {
+	filter_signal* fs;
+
+	f->started = true;
+	f->time = f->o->from;
+
+	if (openvcd_writer_time(f->out, f->o->from) != 0) { return -1; }
+	if (openvcd_writer_command(f->out, "$dumpvars") != 0) { return -1; }
+
+	for (size_t n = 0 ; n < (size_t) f->w->signals.length ; n++) {
+		fs = &(f->signals[n]);
+		if ((fs->var == NULL) || !fs->known) { continue; }
+		if (openvcd_writer_text(f->out, fs->var, fs->type, fs->value, fs->length) != 0) {
+			return -1;
+		}
+	}
+
+	if (openvcd_writer_command(f->out, "$end") != 0) { return -1; }
+
+	/* dumping was already off when the window started */
+	if (!f->dumping) {
+		if (openvcd_writer_command(f->out, "$dumpoff") != 0) { return -1; }
+		if (openvcd_writer_command(f->out, "$end") != 0) { return -1; }
+	}
+
+	return 0;
+}
+
+/* pass $dumpoff and $dumpon, and the $end which closes them, through to
+ * the output */
+static int filter_command(filter_state* f, const openvcd_change* c) {
+	bool off;
+	bool on;
+
+	off = (c->value_length == 8) && (memcmp(c->value, "$dumpoff", 8) == 0);
+	on = (c->value_length == 7) && (memcmp(c->value, "$dumpon", 7) == 0);
+	if (off || on) { f->dumping = on; }
+
+	if (!f->started) { return 0; }
+
+	if (off || on) {
+		f->in_dump = true;
+		if (openvcd_writer_time(f->out, f->time) != 0) { return -1; }
+		return openvcd_writer_command(f->out, on ? "$dumpon" : "$dumpoff");
+	}
+
+	if (f->in_dump && (c->value_length == 4) && (memcmp(c->value, "$end", 4) == 0)) {
+		f->in_dump = false;
+		return openvcd_writer_command(f->out, "$end");
+	}
+
+	return 0;
+}
+
+static openvcd_parser_error filter_change(void* ctx, const openvcd_change* c) {
+	filter_signal* fs;
+	filter_state* f;
+	size_t n;
+
+	f = (filter_state*) ctx;
+
+	/* stopped by openvcd_filter() */
+	if (c->time > f->o->to) {
+		f->finished = true;
+		return OPENVCD_ERROR_GENERAL;
+	}
+
+	if (!f->started && (c->time >= f->o->from)) {
+		if (start(f) != 0) { return OPENVCD_ERROR_GENERAL; }
+	}
+
+	if (c->type == OPENVCD_CHANGE_TIME) {
+		if (f->started) { f->time = c->time; }
+		return OPENVCD_ERROR_NONE;
+	}
+
+	if (c->type == OPENVCD_CHANGE_COMMAND) {
+		return (filter_command(f, c) == 0) ? OPENVCD_ERROR_NONE : OPENVCD_ERROR_GENERAL;
+	}
+
+	if (!openvcd_wave_signal_number(f->w, c->id, c->id_length, &n)) {
+		return OPENVCD_ERROR_SYNTAX;
+	}
+	fs = &(f->signals[n]);
+	if (fs->var == NULL) { return OPENVCD_ERROR_NONE; }
+
+	if (!f->started) {
+		return (keep_value(fs, c) == 0) ? OPENVCD_ERROR_NONE : OPENVCD_ERROR_ALLOC_FAILED;
+	}
+
+	/* the writer only writes the time once, and the value's text is
+	 * copied as it is, since the signal has the same width in the
+	 * output */
+	if ((openvcd_writer_time(f->out, f->time) != 0) ||
+		(openvcd_writer_text(f->out, fs->var, c->type, c->value, c->value_length) != 0)) {
+		return OPENVCD_ERROR_GENERAL;
+	}
+
+	return OPENVCD_ERROR_NONE;
+}
+
+void openvcd_init_filter_options(openvcd_filter_options* o) {
+	o->signals = NULL;
+	o->nsignals = 0;
+	o->from = 0;
+	o->to = UINT64_MAX;
+}
+
+/* declare the selected variables, and check that every path matched */
+static int declare(openvcd_parser* p, filter_state* f) {
+	const char* key;
+	char* what;
+	bool matched;
+	int khret;
+	khint_t k;
+
+	for (size_t i = 0 ; i < f->o->nsignals ; i++) {
+		k = kh_put(openvcd_mselect, f->select, f->o->signals[i], &khret);
+		if (khret < 0) {
+			openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate selection", 0);
+			return -1;
+		}
+		kh_val(f->select, k) = false;
+	}
+
+	if (declare_scope(f, f->w->root, f->o->nsignals == 0) != 0) {
+		openvcd_load_error(p, OPENVCD_ERROR_GENERAL, "failed to declare variables", 0);
+		return -1;
+	}
+
+	kh_foreach(f->select, key, matched,
+		if (!matched) {
+			if (asprintf(&what, "no such variable or scope: %s", key) < 0) { what = NULL; }
+			openvcd_load_error(p, OPENVCD_ERROR_GENERAL, (what != NULL) ? what : "no such variable or scope", 0);
+			free(what);
+			return -1;
+		}
+	);
+
+	return 0;
+}
+
+static void free_state(filter_state* f) {
+	if (f->signals != NULL) {
+		for (size_t n = 0 ; n < (size_t) f->w->signals.length ; n++) {
+			free(f->signals[n].value);
+		}
+		free(f->signals);
+	}
+	if (f->select != NULL) { kh_destroy(openvcd_mselect, f->select); }
+	if (f->out != NULL) { openvcd_free_writer(f->out); }
+	if (f->w != NULL) { openvcd_free_wave(f->w); }
+	free(f->path);
+	free(f->scopes);
+}
+
+int openvcd_filter(openvcd_parser* p, const openvcd_filter_options* o, FILE* stream) {
+	filter_state f;
+
+	memset(&f, 0, sizeof(f));
+	f.o = o;
+	f.dumping = true;
+
+	if (o->from > o->to) {
+		openvcd_load_error(p, OPENVCD_ERROR_GENERAL, "the window ends before it starts", 0);
+		return -1;
+	}
+
+	f.w = openvcd_load_header(p);
+	if (f.w == NULL) { return -1; }
+
+	f.out = openvcd_new_writer(stream, f.w->timescale, f.w->version);
+	f.signals = calloc((size_t) f.w->signals.length + 1, sizeof(filter_signal));
+	f.select = kh_init(openvcd_mselect);
+	if ((f.out == NULL) || (f.signals == NULL) || (f.select == NULL)) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate filter", 0);
+		free_state(&f);
+		return -1;
+	}
+
+	if (declare(p, &f) != 0) {
+		free_state(&f);
+		return -1;
+	}
+
+	openvcd_parse_changes(p, filter_change, &f);
+	if (f.finished) {
+		/* the error only stopped the parser at the end of the window,
+		 * which is also the end of the output */
+		openvcd_clear_error(p);
+		p->state = OPENVCD_PARSER_STATE_RUNNING;
+		openvcd_writer_time(f.out, o->to);
+	}
+
+	/* the input ended before the window started, or inside it, in which
+	 * case it's last time marks the end of the output */
+	if ((p->state != OPENVCD_PARSER_STATE_ERROR) && !f.finished) {
+		if (!f.started) {
+			start(&f);
+		} else {
+			openvcd_writer_time(f.out, f.time);
+		}
+	}
+
+	if (openvcd_writer_flush(f.out) != 0) {
+		openvcd_load_error(p, OPENVCD_ERROR_GENERAL, "failed to write output", p->changes_base);
+	}
+
+	free_state(&f);
+
+	return (p->state == OPENVCD_PARSER_STATE_ERROR) ? -1 : 0;
+}
@@ -0,0 +1,81 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements copying part of a VCD file to a new one, keeping
+ * only some of it's signals, and only the changes within a window of time.
+ *
+ * The input is read once, a chunk at a time, and each value change is
+ * either dropped, remembered as the signal's latest value if it is before
+ * the window, or written straight out with openvcd_writer. Values are
+ * copied as text rather than decoded, and memory use depends on the size
+ * of the hierarchy, not the length of the input.
+ *
+ * The output only declares the selected variables and the scopes which
+ * contain them, with identifier codes numbered from the first again. It
+ * starts with a $dumpvars which gives the value of every selected signal
+ * at the start of the window, so that it can be read on it's own.
+ */
+
+#ifndef OPENVCD_FILTER_H
+#define OPENVCD_FILTER_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "parser.h"
+#include "wave.h"
+#include "writer.h"
+
+/**** TYPES ******************************************************************/
+
+typedef struct {
+	/* Dotted paths such as "top.core.data" of variables to keep. A path
+	 * which names a scope keeps every variable inside it. If there are
+	 * none, every variable is kept. */
+	const char** signals;
+	size_t nsignals;
+
+	/* the first and last times to keep changes for */
+	uint64_t from;
+	uint64_t to;
+} openvcd_filter_options;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Set options which keep everything.
+ *
+ * @param o
+ */
+void openvcd_init_filter_options(openvcd_filter_options* o);
+
+/**
+ * @brief Copy the selected signals and times of a VCD file to a stream.
+ *
+ * The parser must not have read anything yet. Reading stops at the first
+ * time after the end of the window, so the parser may be left part way
+ * through it's input.
+ *
+ * @param p
+ * @param o
+ * @param stream
+ *
+ * @return 0 on success, or -1 on failure, in which case the details are in
+ * the parser. This includes paths which don't name a variable or scope, and
+ * failing to write to the stream.
+ */
+int openvcd_filter(openvcd_parser* p, const openvcd_filter_options* o, FILE* stream);
+
+#endif /* OPENVCD_FILTER_H */
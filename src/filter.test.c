@@ -0,0 +1,303 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "filter.h"
+
+/* every 10 time units, clk toggles, and data and r count up */
+static const char* input =
+	"$version test $end\n"
+	"$timescale 1ns $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 c clk $end\n"
+	"$scope module core $end\n"
+	"$var reg 8 d data [7:0] $end\n"
+	"$var real 64 r level $end\n"
+	"$var wire 1 c clk $end\n"
+	"$upscope $end\n"
+	"$scope module other $end\n"
+	"$var wire 4 o junk $end\n"
+	"$upscope $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n";
+
+/* the header above, followed by 100 steps of changes */
+static char* make_input(size_t* length) {
+	char* buffer;
+	FILE* f;
+
+	f = open_memstream(&buffer, length);
+	should_not_be_null(f);
+
+	fprintf(f, "%s#0\n$dumpvars\n0c\nb0 d\nr0 r\nbx o\n$end\n", input);
+	for (int t = 1 ; t < 100 ; t++) {
+		fprintf(f, "#%d\n%dc\nb%d%d%d%d d\nr%d.5 r\nb%d o\n", t * 10, t % 2,
+			(t >> 3) & 1, (t >> 2) & 1, (t >> 1) & 1, t & 1, t, t & 1);
+	}
+
+	fclose(f);
+	return buffer;
+}
+
+/* filter the input, and load the result */
+static openvcd_wave* filter(const openvcd_filter_options* o, char** output) {
+	openvcd_parser* p;
+	openvcd_wave* w;
+	char* buffer;
+	size_t length;
+	size_t output_length;
+	FILE* f;
+
+	buffer = make_input(&length);
+	f = open_memstream(output, &output_length);
+	should_not_be_null(f);
+
+	p = string_parser(buffer, length);
+	should_equal(openvcd_filter(p, o, f), 0);
+	check_parser_error(p);
+	openvcd_free_parser(p);
+	fclose(f);
+	free(buffer);
+
+	p = string_parser(*output, output_length);
+	w = openvcd_load(p);
+	check_parser_error(p);
+	should_not_be_null(w);
+	openvcd_free_parser(p);
+
+	return w;
+}
+
+/* the scopes and variables are declared in the same order as the input */
+static bool declared_in_order(const char* output) {
+	const char* names[] = { " top ", " clk ", " core ", " data ", " level ", " other ", " junk " };
+	const char* at;
+
+	at = output;
+	for (size_t i = 0 ; i < sizeof(names) / sizeof(names[0]) ; i++) {
+		at = strstr(at, names[i]);
+		if (at == NULL) { return false; }
+	}
+
+	return true;
+}
+
+void test_filter_window(void) {
+	const char* signals[] = { "top.core" };
+	openvcd_filter_options o;
+	openvcd_scope* top;
+	openvcd_scope* core;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	char* output;
+
+	openvcd_init_filter_options(&o);
+	o.signals = signals;
+	o.nsignals = 1;
+	o.from = 255;
+	o.to = 500;
+	w = filter(&o, &output);
+
+	/* only the selected scope is left, with it's codes renumbered */
+	top = child(w->root, "top");
+	should_not_be_null(top);
+	should_equal(kh_size(top->child_scopes), 1);
+	should_equal(kh_size(top->child_variables), 0);
+	core = child(top, "core");
+	should_not_be_null(core);
+	should_equal(kh_size(core->child_variables), 3);
+	should_equal(w->signals.length, 3);
+	should_not_be_null(openvcd_wave_find_signal(w, "!"));
+	should_not_be_null(openvcd_wave_find_signal(w, "\""));
+	should_not_be_null(openvcd_wave_find_signal(w, "#"));
+	should_be_null(openvcd_wave_find_signal(w, "d"));
+
+	s = find_width(w, 1);
+	should_not_be_null(s);
+	should_be_true(openvcd_value_at(s, 255, aval, bval));
+	should_equal(aval[0], 1);
+
+	/* the values from before the window are there at it's start */
+	s = find_width(w, 8);
+	should_not_be_null(s);
+	should_be_false(openvcd_value_at(s, 254, aval, bval));
+	should_be_true(openvcd_value_at(s, 255, aval, bval));
+	should_equal(aval[0], 25 & 0xf);
+	should_be_true(openvcd_value_at(s, 260, aval, bval));
+	should_equal(aval[0], 26 & 0xf);
+	should_be_true(openvcd_value_at(s, 500, aval, bval));
+	should_equal(aval[0], 50 & 0xf);
+	should_equal(s->change_count, 1 + 25);
+
+	s = find_width(w, 64);
+	should_not_be_null(s);
+	should_be_true(s->real);
+	should_be_true(openvcd_value_at(s, 255, aval, bval));
+	should_be_true(openvcd_value_real(aval) == 25.5);
+
+	/* the output runs to the end of the window, and no further */
+	should_equal(w->end_time, 500);
+
+	openvcd_free_wave(w);
+	free(output);
+}
+
+void test_filter_everything(void) {
+	openvcd_filter_options o;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	char* output;
+
+	openvcd_init_filter_options(&o);
+	w = filter(&o, &output);
+
+	/* top.clk and top.core.clk still share a code */
+	should_equal(w->signals.length, 4);
+	should_equal(w->end_time, 990);
+	should_not_be_null(strstr(output, "$version test $end\n$timescale 1ns $end\n"));
+	should_be_true(declared_in_order(output));
+
+	/* top.other.junk */
+	s = find_width(w, 4);
+	should_not_be_null(s);
+	should_be_true(openvcd_value_at(s, 0, aval, bval));
+	should_equal(bval[0], 0xf);
+	should_be_true(openvcd_value_at(s, 990, aval, bval));
+	should_equal(aval[0], 1);
+	should_equal(s->change_count, 100);
+
+	openvcd_free_wave(w);
+	free(output);
+
+	/* a window after the end still has the final values */
+	o.from = 5000;
+	w = filter(&o, &output);
+	should_equal(w->end_time, 5000);
+	for (size_t i = 0 ; i < (size_t) w->signals.length ; i++) {
+		should_equal(w->signals.data[i]->change_count, 1);
+	}
+	openvcd_free_wave(w);
+	free(output);
+}
+
+/* filter the input from a time, with only top.other.junk selected */
+static char* filter_junk(const char* changes, uint64_t from) {
+	const char* signals[] = { "top.other.junk" };
+	openvcd_filter_options o;
+	openvcd_parser* p;
+	char* buffer;
+	char* output;
+	size_t output_length;
+	FILE* f;
+
+	should_be_true(asprintf(&buffer, "%s%s", input, changes) > 0);
+	f = open_memstream(&output, &output_length);
+	should_not_be_null(f);
+
+	openvcd_init_filter_options(&o);
+	o.signals = signals;
+	o.nsignals = 1;
+	o.from = from;
+	p = string_parser(buffer, strlen(buffer));
+	should_equal(openvcd_filter(p, &o, f), 0);
+	check_parser_error(p);
+	openvcd_free_parser(p);
+	fclose(f);
+	free(buffer);
+
+	return output;
+}
+
+void test_filter_times(void) {
+	char* output;
+
+	/* only the times with a change to top.other.junk, and the last */
+	output = filter_junk("#0\n$dumpvars\n0c\nbx o\n$end\n"
+		"#10\n1c\n#20\nb1 o\n#30\n0c\n#40\n1c\n", 5);
+	str_should_equal(strstr(output, "$enddefinitions $end\n"),
+		"$enddefinitions $end\n"
+		"#5\n$dumpvars\nbx !\n$end\n"
+		"#20\nb1 !\n"
+		"#40\n");
+	free(output);
+}
+
+void test_filter_dump(void) {
+	const char* changes =
+		"#0\n$dumpvars\n0c\nb0 o\n$end\n"
+		"#10\n$dumpoff\nxc\nbx o\n$end\n"
+		"#20\n1c\n"
+		"#30\n$dumpon\n1c\nb1 o\n$end\n";
+	char* output;
+
+	output = filter_junk(changes, 5);
+	str_should_equal(strstr(output, "$enddefinitions $end\n"),
+		"$enddefinitions $end\n"
+		"#5\n$dumpvars\nb0 !\n$end\n"
+		"#10\n$dumpoff\nbx !\n$end\n"
+		"#30\n$dumpon\nb1 !\n$end\n");
+	free(output);
+
+	/* dumping is already off at the start of the window */
+	output = filter_junk(changes, 15);
+	str_should_equal(strstr(output, "$enddefinitions $end\n"),
+		"$enddefinitions $end\n"
+		"#15\n$dumpvars\nbx !\n$end\n$dumpoff\n$end\n"
+		"#30\n$dumpon\nb1 !\n$end\n");
+	free(output);
+}
+
+void test_filter_errors(void) {
+	const char* signals[] = { "top.core.data", "top.nothing" };
+	openvcd_filter_options o;
+	openvcd_parser* p;
+	char* buffer;
+	char* output;
+	size_t length;
+	size_t output_length;
+	FILE* f;
+
+	buffer = make_input(&length);
+	f = open_memstream(&output, &output_length);
+	should_not_be_null(f);
+
+	openvcd_init_filter_options(&o);
+	o.signals = signals;
+	o.nsignals = 2;
+	p = string_parser(buffer, length);
+	should_equal(openvcd_filter(p, &o, f), -1);
+	parser_should_error(p);
+	should_not_be_null(strstr(p->error_string, "top.nothing"));
+	openvcd_free_parser(p);
+
+	openvcd_init_filter_options(&o);
+	o.from = 10;
+	o.to = 5;
+	p = string_parser(buffer, length);
+	should_equal(openvcd_filter(p, &o, f), -1);
+	parser_should_error(p);
+	should_not_be_null(strstr(p->error_string, "the window ends before it starts"));
+	openvcd_free_parser(p);
+
+	fclose(f);
+	free(output);
+	free(buffer);
+}
+
+int main(void) {
+	test_filter_window();
+	test_filter_everything();
+	test_filter_times();
+	test_filter_dump();
+	test_filter_errors();
+	return 0;
+}
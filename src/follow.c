@@ -0,0 +1,276 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "follow.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+static int start_notify(const char* path) {
+#ifdef __linux__
+	int fd;
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) { return -1; }
+
+	if (inotify_add_watch(fd, path, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+#else
+	OPENVCD_UNUSED(path);
+	return -1;
+#endif
+}
+
+openvcd_follower* openvcd_new_follower(const char* path, uint64_t time_interval, uint64_t change_interval) {
+	openvcd_input_source source;
+	openvcd_follower* f;
+
+	f = malloc(sizeof(openvcd_follower));
+	if (f == NULL) { return NULL; }
+
+	f->path = strdup(path);
+	f->stream = fopen(path, "r");
+	f->capacity = OPENVCD_LOAD_CHUNK_SIZE;
+	f->buffer = malloc(f->capacity);
+	f->epochs = openvcd_new_epochs();
+
+	/* until the declarations are complete, the parser only holds errors */
+	source.input_stream = f->stream;
+	f->p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+
+	if ((f->path == NULL) || (f->stream == NULL) || (f->buffer == NULL) ||
+		(f->epochs == NULL) || (f->p == NULL)) {
+		if (f->stream != NULL) { fclose(f->stream); }
+		if (f->epochs != NULL) { openvcd_free_epochs(f->epochs); }
+		if (f->p != NULL) { openvcd_free_parser(f->p); }
+		free(f->path);
+		free(f->buffer);
+		free(f);
+		return NULL;
+	}
+
+	f->notify = start_notify(path);
+	f->w = NULL;
+	f->time_interval = time_interval;
+	f->change_interval = change_interval;
+	openvcd_init_scanner(&(f->s), NULL, 0, false);
+	f->length = 0;
+	f->file_offset = 0;
+	f->body_consumed = 0;
+
+	return f;
+}
+
+void openvcd_free_follower(openvcd_follower* f) {
+	/* the wave's arrays first, then any it outgrew */
+	if (f->w != NULL) { openvcd_free_wave(f->w); }
+	openvcd_free_epochs(f->epochs);
+	if (f->notify >= 0) { close(f->notify); }
+	openvcd_clear_scanner(&(f->s));
+	openvcd_free_parser(f->p);
+	fclose(f->stream);
+	free(f->buffer);
+	free(f->path);
+	free(f);
+}
+
+/* the length of the buffer up to and including it's last newline */
+static size_t complete_lines(const openvcd_follower* f) {
+	const char* nl;
+
+	if (f->length == 0) { return 0; }
+	nl = memrchr(f->buffer, '\n', f->length);
+
+	return (nl == NULL) ? 0 : (size_t) (nl - f->buffer) + 1;
+}
+
+/* drop the first n bytes of the buffer */
+static void consume(openvcd_follower* f, size_t n) {
+	memmove(f->buffer, f->buffer + n, f->length - n);
+	f->length -= n;
+}
+
+/* create the waveform once all of the declarations are in the buffer */
+static int read_header(openvcd_follower* f) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	size_t length;
+	size_t body;
+
+	length = complete_lines(f);
+	if (!openvcd_find_body(f->buffer, length, &body)) { return 0; }
+
+	source.input_string = f->buffer;
+	p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, length);
+	if (p == NULL) {
+		openvcd_load_error(f->p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate parser", 0);
+		return -1;
+	}
+
+	/* from here on the parser is only used to report errors, with
+	 * offsets from it's body_offset */
+	openvcd_free_parser(f->p);
+	f->p = p;
+
+	w = openvcd_load_header(p);
+	if (w == NULL) { return -1; }
+
+	if (openvcd_wave_set_snapshots(w, f->time_interval, f->change_interval) != 0) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate snapshot", 0);
+		openvcd_free_wave(w);
+		return -1;
+	}
+
+	openvcd_wave_share(w, f->epochs);
+	__atomic_store_n(&(f->w), w, __ATOMIC_RELEASE);
+
+	consume(f, p->body_offset);
+
+	return 0;
+}
+
+/* store every complete record in the buffer, holding back the rest */
+static int read_changes(openvcd_follower* f) {
+	openvcd_parser_error err;
+	openvcd_scan_status st;
+	openvcd_change c;
+	size_t length;
+
+	length = complete_lines(f);
+	if (length == 0) { return 0; }
+
+	openvcd_scanner_feed(&(f->s), f->buffer, length, false);
+	while ((st = openvcd_scan_next(&(f->s), &c)) == OPENVCD_SCAN_OK) {
+		err = openvcd_wave_apply(f->w, &c);
+		if (err != OPENVCD_ERROR_NONE) {
+			openvcd_load_error(f->p, err, openvcd_change_error(err), f->body_consumed + c.offset);
+			return -1;
+		}
+	}
+
+	if (st == OPENVCD_SCAN_ERROR) {
+		openvcd_load_error(f->p, OPENVCD_ERROR_SYNTAX, f->s.error_string, f->body_consumed + f->s.error_offset);
+		return -1;
+	}
+
+	/* the scanner stopped at the start of the first incomplete record */
+	f->body_consumed += f->s.position;
+	consume(f, f->s.position);
+
+	return 0;
+}
+
+int openvcd_follow_update(openvcd_follower* f) {
+	struct stat st;
+	char* temp;
+	size_t want;
+	size_t n;
+
+	if (f->p->state == OPENVCD_PARSER_STATE_ERROR) { return -1; }
+
+	/* starting over would mean reading the whole file again */
+	if ((fstat(fileno(f->stream), &st) == 0) && ((size_t) st.st_size < f->file_offset)) {
+		openvcd_load_error(f->p, OPENVCD_ERROR_GENERAL, "file was truncated", f->body_consumed + f->length);
+		return -1;
+	}
+
+	do {
+		/* a single record may be larger than the buffer */
+		if (f->length == f->capacity) {
+			temp = realloc(f->buffer, f->capacity * 2);
+			if (temp == NULL) {
+				openvcd_load_error(f->p, OPENVCD_ERROR_ALLOC_FAILED, "failed to grow read buffer", 0);
+				return -1;
+			}
+			f->buffer = temp;
+			f->capacity *= 2;
+		}
+
+		want = f->capacity - f->length;
+		n = fread(f->buffer + f->length, 1, want, f->stream);
+		f->length += n;
+		f->file_offset += n;
+
+		if ((f->w == NULL) && (read_header(f) != 0)) { return -1; }
+		if ((f->w != NULL) && (read_changes(f) != 0)) { return -1; }
+	} while (n == want);
+
+	if (ferror(f->stream)) {
+		openvcd_load_error(f->p, OPENVCD_ERROR_GENERAL, "failed to read file", f->body_consumed + f->length);
+		return -1;
+	}
+
+	/* so that the next update reads whatever is appended */
+	clearerr(f->stream);
+
+	return 0;
+}
+
+openvcd_wave* openvcd_follow_wave(openvcd_follower* f) {
+	return __atomic_load_n(&(f->w), __ATOMIC_ACQUIRE);
+}
+
+static int64_t now_ms(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/* sleep until the file may have changed, or for at most ms */
+static int sleep_for_change(openvcd_follower* f, int ms) {
+	struct timespec ts;
+	struct pollfd pfd;
+	char events[4096];
+
+	if (f->notify < 0) {
+		if ((ms < 0) || (ms > OPENVCD_FOLLOW_POLL_MS)) { ms = OPENVCD_FOLLOW_POLL_MS; }
+		ts.tv_sec = ms / 1000;
+		ts.tv_nsec = (long) (ms % 1000) * 1000000;
+		nanosleep(&ts, NULL);
+		return 0;
+	}
+
+	pfd.fd = f->notify;
+	pfd.events = POLLIN;
+	if ((poll(&pfd, 1, ms) < 0) && (errno != EINTR)) { return -1; }
+
+	/* the events themselves don't matter, only that there were some */
+	while (read(f->notify, events, sizeof(events)) > 0) { }
+
+	return 0;
+}
+
+int openvcd_follow_wait(openvcd_follower* f, int timeout_ms) {
+	struct stat st;
+	int64_t deadline;
+	int64_t left;
+
+	deadline = now_ms() + timeout_ms;
+	for (;;) {
+		if (fstat(fileno(f->stream), &st) != 0) { return -1; }
+		if ((size_t) st.st_size != f->file_offset) { return 1; }
+
+		left = -1;
+		if (timeout_ms >= 0) {
+			left = deadline - now_ms();
+			if (left <= 0) { return 0; }
+		}
+
+		if (sleep_for_change(f, (int) left) != 0) { return -1; }
+	}
+}
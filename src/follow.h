@@ -0,0 +1,147 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements following a VCD file which is still being written,
+ * such as the dump of a simulation that runs for days.
+ *
+ * A follower reads the file up to it's current end, stores every complete
+ * value change in a waveform, and keeps it's place. The next update carries
+ * on from there, with the scanner's time and dump state intact, so nothing
+ * is ever read twice however long the file gets. Only complete lines are
+ * scanned, and whatever follows the last newline is held back until the
+ * rest of it has been written, as is a record which spans lines, like a
+ * $comment which hasn't been closed yet.
+ *
+ * The waveform is only created once the whole of the declarations has been
+ * written. Until then, the header is held back just like a partial line.
+ *
+ * Between updates, openvcd_follow_wait() sleeps until the file grows, using
+ * inotify where it's available, and checking the file's size now and then
+ * where it's not.
+ *
+ * Other threads can read the waveform while it is updated, through the
+ * functions in live.h with the follower's epochs.
+ */
+
+#ifndef OPENVCD_FOLLOW_H
+#define OPENVCD_FOLLOW_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "parser.h"
+#include "scan.h"
+#include "wave.h"
+#include "live.h"
+
+/**** TYPES ******************************************************************/
+
+/* how often the file's size is checked if inotify can't be used, in
+ * milliseconds */
+#define OPENVCD_FOLLOW_POLL_MS 100
+
+typedef struct {
+	char* path;
+	FILE* stream;
+
+	/* the inotify instance watching path, or -1 if the file's size is
+	 * polled instead */
+	int notify;
+
+	/* holds the declarations, and records parse errors */
+	openvcd_parser* p;
+
+	/* NULL until all of the declarations have been written, see
+	 * openvcd_follow_wave() */
+	openvcd_wave* w;
+
+	/* for reading w from other threads, see live.h */
+	openvcd_epochs* epochs;
+
+	uint64_t time_interval;
+	uint64_t change_interval;
+
+	openvcd_scanner s;
+
+	/* bytes read from the file, but not yet scanned */
+	char* buffer;
+	size_t length;
+	size_t capacity;
+
+	/* the number of bytes read from the file */
+	size_t file_offset;
+
+	/* the offset of the start of the buffer in the value change section */
+	size_t body_consumed;
+} openvcd_follower;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Start following a VCD file.
+ *
+ * Nothing is read until openvcd_follow_update() is called.
+ *
+ * @param path
+ * @param time_interval See openvcd_wave_set_snapshots().
+ * @param change_interval See openvcd_wave_set_snapshots().
+ *
+ * @return The new follower, or NULL if the file could not be opened.
+ */
+openvcd_follower* openvcd_new_follower(const char* path, uint64_t time_interval, uint64_t change_interval);
+
+/**
+ * @brief Stop following a file, freeing the follower and it's waveform.
+ *
+ * @param f
+ */
+void openvcd_free_follower(openvcd_follower* f);
+
+/**
+ * @brief Read everything which has been written since the last update.
+ *
+ * Once the declarations are complete, f->w holds every value change up to
+ * the last complete record in the file. After an error, the details are in
+ * f->p in the same way as for any other parse error, and the follower can't
+ * be updated any more.
+ *
+ * @param f
+ *
+ * @return 0 on success, -1 on error.
+ */
+int openvcd_follow_update(openvcd_follower* f);
+
+/**
+ * @brief Wait for the file to grow.
+ *
+ * @param f
+ * @param timeout_ms The longest time to wait, or -1 to wait forever.
+ *
+ * @return 1 if the file has grown since the last update, 0 if it hasn't
+ * within the timeout, or -1 on error.
+ */
+int openvcd_follow_wait(openvcd_follower* f, int timeout_ms);
+
+/**
+ * @brief Get the waveform being followed, from any thread.
+ *
+ * @param f
+ *
+ * @return The waveform, or NULL if the declarations haven't all been read
+ * yet.
+ */
+openvcd_wave* openvcd_follow_wave(openvcd_follower* f);
+
+#endif /* OPENVCD_FOLLOW_H */
@@ -0,0 +1,240 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "test_util.h"
+#include "follow.h"
+
+static size_t file_size(const char* path) {
+	struct stat st;
+
+	should_equal(stat(path, &st), 0);
+	return (size_t) st.st_size;
+}
+
+/* true if the parser's error is reported at offset in the file */
+static bool error_at(const openvcd_parser* p, size_t offset) {
+	char prefix[64];
+
+	snprintf(prefix, sizeof(prefix), "error at byte %lu,", (unsigned long) offset);
+	return strncmp(p->error_string, prefix, strlen(prefix)) == 0;
+}
+
+static void append(const char* path, const char* text) {
+	FILE* f;
+
+	f = fopen(path, "a");
+	should_not_be_null(f);
+	fputs(text, f);
+	fclose(f);
+}
+
+static uint64_t value_at(const openvcd_wave* w, const char* id, uint64_t t) {
+	openvcd_signal* s;
+	uint64_t aval[2];
+	uint64_t bval[2];
+
+	s = openvcd_wave_find_signal(w, id);
+	should_not_be_null(s);
+	should_be_true(openvcd_value_at(s, t, aval, bval));
+
+	return aval[0];
+}
+
+void test_follow(void) {
+	char path[] = "/tmp/openvcd-follow-XXXXXX";
+	openvcd_follower* f;
+	size_t offset;
+	int fd;
+
+	fd = mkstemp(path);
+	should_be_true(fd >= 0);
+	close(fd);
+
+	f = openvcd_new_follower(path, 0, 0);
+	should_not_be_null(f);
+
+	/* nothing to read yet */
+	should_equal(openvcd_follow_wait(f, 10), 0);
+	should_equal(openvcd_follow_update(f), 0);
+	should_be_null(f->w);
+
+	/* the declarations aren't complete until their $end */
+	append(path, "$timescale 1ns $end\n$scope module top $end\n");
+	append(path, "$var wire 1 ! clk $end\n$var wire 4 v data $end\n");
+	append(path, "$upscope $end\n$enddefinitions");
+	should_equal(openvcd_follow_wait(f, 10), 1);
+	should_equal(openvcd_follow_update(f), 0);
+	should_be_null(f->w);
+
+	/* the partial vector is held back */
+	append(path, " $end\n#0\n0!\nb0000 v\n#10\n1!\nb10");
+	should_equal(openvcd_follow_update(f), 0);
+	should_not_be_null(f->w);
+	should_equal(f->w->end_time, 10);
+	should_equal(value_at(f->w, "!", 10), 1);
+	should_equal(value_at(f->w, "v", 10), 0);
+
+	/* as is a comment which hasn't been closed */
+	append(path, "10 v\n$comment still\ngoing\n");
+	should_equal(openvcd_follow_update(f), 0);
+	should_equal(value_at(f->w, "v", 10), 10);
+	should_equal(f->w->end_time, 10);
+
+	/* and a time without it's newline, which could still grow */
+	append(path, "$end\n#2");
+	should_equal(openvcd_follow_update(f), 0);
+	should_equal(f->w->end_time, 10);
+	append(path, "0\n0!\n");
+	should_equal(openvcd_follow_update(f), 0);
+	should_equal(f->w->end_time, 20);
+	should_equal(value_at(f->w, "!", 20), 0);
+	should_equal(openvcd_wave_find_signal(f->w, "!")->change_count, 3);
+
+	/* updating without any new data changes nothing */
+	should_equal(openvcd_follow_wait(f, 0), 0);
+	should_equal(openvcd_follow_update(f), 0);
+	should_equal(openvcd_wave_find_signal(f->w, "!")->change_count, 3);
+
+	/* errors are reported at their offset in the file */
+	offset = file_size(path) + strlen("#30\n");
+	append(path, "#30\n1nosuchsignal\n");
+	should_equal(openvcd_follow_update(f), -1);
+	parser_should_error(f->p);
+	should_not_be_null(strstr(f->p->error_string, "invalid value change"));
+	should_be_true(error_at(f->p, offset));
+	should_equal(openvcd_follow_update(f), -1);
+
+	openvcd_free_follower(f);
+	unlink(path);
+}
+
+/* following a file as it's written gives the same result as loading it */
+void test_follow_large(void) {
+	char path[] = "/tmp/openvcd-follow-XXXXXX";
+	openvcd_input_source source;
+	openvcd_follower* f;
+	openvcd_parser* p;
+	openvcd_wave* expect;
+	openvcd_signal* s;
+	char* buffer;
+	size_t length;
+	size_t written;
+	size_t step;
+	FILE* out;
+	FILE* mem;
+	int fd;
+	int i;
+
+	mem = open_memstream(&buffer, &length);
+	fprintf(mem, "$scope module top $end\n");
+	for (i = 0 ; i < 10 ; i++) { fprintf(mem, "$var wire 16 s%d sig%d $end\n", i, i); }
+	fprintf(mem, "$upscope $end\n$enddefinitions $end\n");
+	for (int t = 0 ; t < 100000 ; t++) {
+		fprintf(mem, "#%d\nb%d%d1 s%d\n", t, (t >> 2) & 1, (t >> 1) & 1, t % 10);
+	}
+	fclose(mem);
+
+	fd = mkstemp(path);
+	should_be_true(fd >= 0);
+	out = fdopen(fd, "w");
+	f = openvcd_new_follower(path, 0, 0);
+	should_not_be_null(f);
+
+	/* write in pieces which don't line up with lines or the buffer */
+	step = OPENVCD_LOAD_CHUNK_SIZE / 3 + 7;
+	for (written = 0 ; written < length ; written += step) {
+		if (step > length - written) { step = length - written; }
+		should_equal(fwrite(buffer + written, 1, step, out), step);
+		fflush(out);
+		should_equal(openvcd_follow_wait(f, -1), 1);
+		should_equal(openvcd_follow_update(f), 0);
+		check_parser_error(f->p);
+	}
+	fclose(out);
+
+	source.input_string = buffer;
+	p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, length);
+	expect = openvcd_load(p);
+	check_parser_error(p);
+
+	should_not_be_null(f->w);
+	should_equal(f->w->end_time, expect->end_time);
+	vec_foreach(&(expect->signals), s, i) {
+		should_equal(openvcd_wave_find_signal(f->w, s->id_code)->change_count, s->change_count);
+	}
+	should_equal(f->body_consumed + f->length + f->p->body_offset, length);
+
+	openvcd_free_wave(expect);
+	openvcd_free_parser(p);
+	openvcd_free_follower(f);
+	free(buffer);
+	unlink(path);
+}
+
+/* as are records the scanner can't make sense of, in a later update */
+void test_follow_syntax_error(void) {
+	char path[] = "/tmp/openvcd-follow-XXXXXX";
+	openvcd_follower* f;
+	size_t offset;
+	int fd;
+
+	fd = mkstemp(path);
+	should_be_true(fd >= 0);
+	close(fd);
+	append(path, "$var wire 1 ! a $end $enddefinitions $end\n#0\n1!\n");
+
+	f = openvcd_new_follower(path, 0, 0);
+	should_not_be_null(f);
+	should_equal(openvcd_follow_update(f), 0);
+
+	offset = file_size(path) + strlen("#10\n0!\n");
+	append(path, "#10\n0!\n#x\n");
+	should_equal(openvcd_follow_update(f), -1);
+	parser_should_error(f->p);
+	should_not_be_null(strstr(f->p->error_string, "invalid simulation time"));
+	should_be_true(error_at(f->p, offset));
+
+	openvcd_free_follower(f);
+	unlink(path);
+}
+
+void test_follow_truncated(void) {
+	char path[] = "/tmp/openvcd-follow-XXXXXX";
+	openvcd_follower* f;
+	int fd;
+
+	fd = mkstemp(path);
+	should_be_true(fd >= 0);
+	close(fd);
+	append(path, "$var wire 1 ! a $end $enddefinitions $end\n#0\n1!\n");
+
+	f = openvcd_new_follower(path, 0, 0);
+	should_not_be_null(f);
+	should_equal(openvcd_follow_update(f), 0);
+	should_not_be_null(f->w);
+
+	should_equal(truncate(path, 10), 0);
+	should_equal(openvcd_follow_wait(f, 0), 1);
+	should_equal(openvcd_follow_update(f), -1);
+	parser_should_error(f->p);
+
+	openvcd_free_follower(f);
+	unlink(path);
+
+	should_be_null(openvcd_new_follower("/nonexistent/openvcd", 0, 0));
+}
+
+int main(void) {
+	test_follow();
+	test_follow_large();
+	test_follow_syntax_error();
+	test_follow_truncated();
+	return 0;
+}
@@ -0,0 +1,212 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "heatmap.h"
+
+/* the signals to count, split evenly between the parts */
+typedef struct {
+	openvcd_signal** signals;
+	size_t nsignals;
+
+	openvcd_heatmap** parts;
+	size_t nparts;
+
+	/* set to -1 if any signal could not be counted */
+	int rc;
+} heatmap_job;
+
+openvcd_heatmap* openvcd_new_heatmap(size_t nbuckets, uint64_t end_time) {
+	openvcd_heatmap* h;
+
+	if (nbuckets < 2) { return NULL; }
+
+	h = malloc(sizeof(openvcd_heatmap));
+	if (h == NULL) { return NULL; }
+
+	h->width = 1;
+	h->nbuckets = nbuckets;
+	h->counts = calloc(nbuckets, sizeof(uint64_t));
+	if (h->counts == NULL) {
+		free(h);
+		return NULL;
+	}
+
+	openvcd_heatmap_cover(h, end_time);
+
+	return h;
+}
+
+void openvcd_free_heatmap(openvcd_heatmap* h) {
+	free(h->counts);
+	free(h);
+}
+
+/* double the width, adding each pair of buckets together */
+static void fold(openvcd_heatmap* h) {
+	size_t half;
+
+	half = (h->nbuckets + 1) / 2;
+	for (size_t i = 0 ; i < half ; i++) {
+		h->counts[i] = h->counts[2 * i] + (((2 * i) + 1 < h->nbuckets) ? h->counts[(2 * i) + 1] : 0);
+	}
+	memset(h->counts + half, 0, (h->nbuckets - half) * sizeof(uint64_t));
+
+	h->width *= 2;
+}
+
+void openvcd_heatmap_cover(openvcd_heatmap* h, uint64_t t) {
+	while (t / h->width >= h->nbuckets) { fold(h); }
+}
+
+void openvcd_heatmap_add(openvcd_heatmap* h, uint64_t t, uint64_t n) {
+	openvcd_heatmap_cover(h, t);
+	h->counts[t / h->width] += n;
+}
+
+int openvcd_heatmap_merge(openvcd_heatmap* dst, const openvcd_heatmap* src) {
+	uint64_t ratio;
+
+	if (dst->nbuckets != src->nbuckets) { return -1; }
+
+	while (dst->width < src->width) { fold(dst); }
+
+	/* both widths are powers of two, so this is too */
+	ratio = dst->width / src->width;
+	for (size_t i = 0 ; i < src->nbuckets ; i++) {
+		dst->counts[i / ratio] += src->counts[i];
+	}
+
+	return 0;
+}
+
+int openvcd_heatmap_add_signal(openvcd_heatmap* h, const openvcd_signal* s) {
+	openvcd_decoded_block* d;
+	const openvcd_block* b;
+
+	for (size_t i = 0 ; i < s->nblocks ; i++) {
+		b = &(s->blocks[i]);
+		if (b->count == 0) { continue; }
+
+		openvcd_heatmap_cover(h, b->last_time);
+		if (b->first_time / h->width == b->last_time / h->width) {
+			h->counts[b->first_time / h->width] += b->count;
+			continue;
+		}
+
+		d = openvcd_decode_block(s, i);
+		if (d == NULL) { return -1; }
+		for (uint32_t j = 0 ; j < d->count ; j++) {
+			openvcd_heatmap_add(h, d->times[j], 1);
+		}
+		openvcd_free_decoded_block(d);
+	}
+
+	return 0;
+}
+
+static void count_part(void* ctx, size_t i) {
+	heatmap_job* job;
+	size_t first;
+	size_t last;
+
+	job = (heatmap_job*) ctx;
+	first = (job->nsignals * i) / job->nparts;
+	last = (job->nsignals * (i + 1)) / job->nparts;
+
+	for (size_t j = first ; j < last ; j++) {
+		if (openvcd_heatmap_add_signal(job->parts[i], job->signals[j]) != 0) {
+			__atomic_store_n(&(job->rc), -1, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+static void select_scope(const openvcd_wave* w, const openvcd_scope* s, bool* selected) {
+	const char* key;
+	openvcd_scope* child;
+	openvcd_var* v;
+	size_t n;
+
+	OPENVCD_UNUSED(key);
+
+	kh_foreach(s->child_variables, key, v,
+		if (openvcd_wave_signal_number(w, v->identifier_code, strlen(v->identifier_code), &n)) {
+			selected[n] = true;
+		}
+	);
+	kh_foreach(s->child_scopes, key, child, select_scope(w, child, selected););
+}
+
+/* the signals of a scope, or every signal, loaded and in signal order */
+static openvcd_signal** select_signals(openvcd_wave* w, const openvcd_scope* scope, size_t* nsignals) {
+	openvcd_signal** signals;
+	bool* selected;
+	openvcd_signal* s;
+	int i;
+
+	signals = malloc(((size_t) w->signals.length + 1) * sizeof(openvcd_signal*));
+	selected = calloc((size_t) w->signals.length + 1, sizeof(bool));
+	if ((signals == NULL) || (selected == NULL)) {
+		free(signals);
+		free(selected);
+		return NULL;
+	}
+
+	if (scope != NULL) { select_scope(w, scope, selected); }
+
+	*nsignals = 0;
+	vec_foreach(&(w->signals), s, i) {
+		if ((scope != NULL) && !selected[i]) { continue; }
+
+		if (openvcd_wave_load_signal(w, s) != 0) {
+			free(signals);
+			free(selected);
+			return NULL;
+		}
+		signals[(*nsignals)++] = s;
+	}
+
+	free(selected);
+	return signals;
+}
+
+openvcd_heatmap* openvcd_wave_heatmap(openvcd_wave* w, openvcd_pool* pool, const openvcd_scope* scope, size_t nbuckets) {
+	openvcd_heatmap* h;
+	heatmap_job job;
+
+	if (nbuckets < 2) { return NULL; }
+
+	job.signals = select_signals(w, scope, &(job.nsignals));
+	if (job.signals == NULL) { return NULL; }
+
+	job.nparts = (pool == NULL) ? 1 : (size_t) pool->nthreads * OPENVCD_HEATMAP_TASKS_PER_THREAD;
+	if (job.nparts > job.nsignals) { job.nparts = (job.nsignals == 0) ? 1 : job.nsignals; }
+	job.rc = 0;
+
+	job.parts = calloc(job.nparts, sizeof(openvcd_heatmap*));
+	if (job.parts == NULL) {
+		free(job.signals);
+		return NULL;
+	}
+	for (size_t i = 0 ; i < job.nparts ; i++) {
+		job.parts[i] = openvcd_new_heatmap(nbuckets, w->end_time);
+		if (job.parts[i] == NULL) { job.rc = -1; }
+	}
+
+	if (job.rc == 0) { openvcd_pool_run(pool, count_part, &job, job.nparts); }
+
+	/* add up the parts into the first */
+	for (size_t i = 1 ; (i < job.nparts) && (job.rc == 0) ; i++) {
+		job.rc = openvcd_heatmap_merge(job.parts[0], job.parts[i]);
+	}
+
+	h = (job.rc == 0) ? job.parts[0] : NULL;
+	for (size_t i = 0 ; i < job.nparts ; i++) {
+		if ((job.parts[i] != NULL) && (job.parts[i] != h)) { openvcd_free_heatmap(job.parts[i]); }
+	}
+	free(job.parts);
+	free(job.signals);
+
+	return h;
+}
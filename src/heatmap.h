@@ -0,0 +1,144 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements a histogram of the number of value changes in each
+ * span of time over a whole waveform, or over the signals of one scope,
+ * which shows where a long run is busy, such as bursts of traffic, and
+ * where it is not, such as during a reset or a hang.
+ *
+ * The buckets all have the same width, which is a power of two, and start
+ * at time 0. A histogram can be built before it's end is known: whenever a
+ * change falls past the last bucket, the width is doubled and neighbouring
+ * buckets are added together, which keeps the counts exact. Two histograms
+ * with the same number of buckets can be added together the same way,
+ * whatever their widths.
+ *
+ * The histogram of a loaded waveform is built from it's block headers: a
+ * block whose first and last changes fall in the same bucket is counted
+ * without decoding it, so only the blocks which straddle a bucket boundary
+ * are decoded. The signals are split between the threads of a pool, each
+ * of which fills it's own histogram, and these are added up at the end.
+ *
+ * The binary format stores the histogram of the whole waveform with
+ * OPENVCD_HEATMAP_BUCKETS buckets, see bin.h.
+ */
+
+#ifndef OPENVCD_HEATMAP_H
+#define OPENVCD_HEATMAP_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "scope.h"
+#include "wave.h"
+#include "lazy.h"
+#include "pool.h"
+
+/**** TYPES ******************************************************************/
+
+/* the number of buckets of the histogram stored in binary files */
+#define OPENVCD_HEATMAP_BUCKETS 4096
+
+/* the number of histograms per thread of a pool, so that work stealing has
+ * something to steal */
+#define OPENVCD_HEATMAP_TASKS_PER_THREAD 4
+
+typedef struct openvcd_heatmap_t {
+	/* bucket i counts the changes at times from i * width up to but not
+	 * including (i + 1) * width */
+	uint64_t width;
+	size_t nbuckets;
+	uint64_t* counts;
+} openvcd_heatmap;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Allocate an empty histogram.
+ *
+ * @param nbuckets Must be at least 2.
+ * @param end_time The width is the smallest which puts this time in a
+ * bucket, or 1 if it is 0.
+ *
+ * @return The new histogram, or NULL on failure.
+ */
+openvcd_heatmap* openvcd_new_heatmap(size_t nbuckets, uint64_t end_time);
+
+/**
+ * @brief Free a histogram.
+ *
+ * @param h
+ */
+void openvcd_free_heatmap(openvcd_heatmap* h);
+
+/**
+ * @brief Widen the buckets of a histogram until time t falls in one.
+ *
+ * @param h
+ * @param t
+ */
+void openvcd_heatmap_cover(openvcd_heatmap* h, uint64_t t);
+
+/**
+ * @brief Count n changes at time t.
+ *
+ * @param h
+ * @param t
+ * @param n
+ */
+void openvcd_heatmap_add(openvcd_heatmap* h, uint64_t t, uint64_t n);
+
+/**
+ * @brief Add the counts of one histogram to another.
+ *
+ * The buckets of whichever histogram is narrower are widened to match.
+ *
+ * @param dst
+ * @param src
+ *
+ * @return 0 on success, or -1 if they have different numbers of buckets.
+ */
+int openvcd_heatmap_merge(openvcd_heatmap* dst, const openvcd_heatmap* src);
+
+/**
+ * @brief Count every change of a signal.
+ *
+ * The signal must be loaded, see lazy.h.
+ *
+ * @param h
+ * @param s
+ *
+ * @return 0 on success, or -1 if a block could not be decoded.
+ */
+int openvcd_heatmap_add_signal(openvcd_heatmap* h, const openvcd_signal* s);
+
+/**
+ * @brief Build the histogram of a waveform's changes, up to it's end time.
+ *
+ * Lazily opened signals are loaded first.
+ *
+ * @param w
+ * @param pool Threads to count the signals with, or NULL to count them on
+ * the calling thread.
+ * @param scope Only count the signals of this scope and the scopes below
+ * it, or NULL to count every signal.
+ * @param nbuckets Must be at least 2.
+ *
+ * @return The histogram, which must be free-ed with openvcd_free_heatmap(),
+ * or NULL on failure.
+ */
+openvcd_heatmap* openvcd_wave_heatmap(openvcd_wave* w, openvcd_pool* pool, const openvcd_scope* scope, size_t nbuckets);
+
+#endif /* OPENVCD_HEATMAP_H */
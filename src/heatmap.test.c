@@ -0,0 +1,219 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "heatmap.h"
+#include "bin.h"
+
+/* a clock which stops at 5000, a counter in a sub-scope which is busy from
+ * 2000 to 3000, and a reset at the start */
+static openvcd_wave* load(char** buffer) {
+	openvcd_wave* w;
+	size_t length;
+	FILE* f;
+
+	f = open_memstream(buffer, &length);
+	should_not_be_null(f);
+	fprintf(f, "$scope module top $end\n$var wire 1 c clk $end\n$var wire 1 r reset $end\n");
+	fprintf(f, "$scope module core $end\n$var reg 8 n count $end\n$var wire 1 c clk $end\n$upscope $end\n");
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n#0\n1r\nb0 n\n#30\n0r\n");
+	for (int t = 50 ; t < 10000 ; t += 5) {
+		fprintf(f, "#%d\n", t);
+		if (t < 5000) { fprintf(f, "%dc\n", (t / 5) % 2); }
+		if ((t >= 2000) && (t < 3000)) { fprintf(f, "b%d%d n\n", (t / 5) & 1, (t / 10) & 1); }
+	}
+	fclose(f);
+
+	w = load_buffer(*buffer, length);
+
+	return w;
+}
+
+/* count the changes of the signals by decoding every block */
+static void count(const openvcd_wave* w, const char** ids, size_t nids, openvcd_heatmap* h) {
+	openvcd_decoded_block* d;
+	openvcd_signal* s;
+
+	for (size_t i = 0 ; i < nids ; i++) {
+		s = openvcd_wave_find_signal(w, ids[i]);
+		for (size_t b = 0 ; b < s->nblocks ; b++) {
+			d = openvcd_decode_block(s, b);
+			should_not_be_null(d);
+			for (uint32_t j = 0 ; j < d->count ; j++) {
+				openvcd_heatmap_add(h, d->times[j], 1);
+			}
+			openvcd_free_decoded_block(d);
+		}
+	}
+}
+
+static void should_match(const openvcd_heatmap* h, const openvcd_heatmap* expect) {
+	should_equal(h->nbuckets, expect->nbuckets);
+	should_equal(h->width, expect->width);
+	for (size_t i = 0 ; i < h->nbuckets ; i++) {
+		should_equal(h->counts[i], expect->counts[i]);
+	}
+}
+
+void test_heatmap_fold(void) {
+	openvcd_heatmap* h;
+	openvcd_heatmap* g;
+
+	should_be_null(openvcd_new_heatmap(1, 0));
+
+	h = openvcd_new_heatmap(5, 0);
+	should_not_be_null(h);
+	should_equal(h->width, 1);
+
+	openvcd_heatmap_add(h, 0, 1);
+	openvcd_heatmap_add(h, 3, 2);
+	openvcd_heatmap_add(h, 4, 3);
+	should_equal(h->width, 1);
+	should_equal(h->counts[3], 2);
+
+	/* 5 only fits once the buckets are 2 wide, then 17 once they are 4 */
+	openvcd_heatmap_add(h, 5, 4);
+	should_equal(h->width, 2);
+	should_equal(h->counts[0], 1);
+	should_equal(h->counts[1], 2);
+	should_equal(h->counts[2], 7);
+	openvcd_heatmap_add(h, 17, 5);
+	should_equal(h->width, 4);
+	should_equal(h->counts[0], 3);
+	should_equal(h->counts[1], 7);
+	should_equal(h->counts[4], 5);
+
+	g = openvcd_new_heatmap(5, 19);
+	should_equal(g->width, 4);
+	openvcd_free_heatmap(g);
+	g = openvcd_new_heatmap(5, 20);
+	should_equal(g->width, 8);
+
+	/* the narrower histogram is widened to match */
+	openvcd_heatmap_add(g, 39, 1);
+	should_equal(openvcd_heatmap_merge(g, h), 0);
+	should_equal(g->width, 8);
+	should_equal(g->counts[0], 10);
+	should_equal(g->counts[2], 5);
+	should_equal(g->counts[4], 1);
+
+	should_equal(openvcd_heatmap_merge(h, g), 0);
+	should_equal(h->width, 8);
+	should_equal(h->counts[0], 20);
+	should_equal(h->counts[2], 10);
+
+	openvcd_free_heatmap(g);
+	g = openvcd_new_heatmap(4, 0);
+	should_equal(openvcd_heatmap_merge(g, h), -1);
+	openvcd_free_heatmap(g);
+	openvcd_free_heatmap(h);
+}
+
+void test_heatmap_wave(void) {
+	const char* all[] = {"c", "r", "n"};
+	const char* core[] = {"c", "n"};
+	openvcd_heatmap* expect;
+	openvcd_heatmap* h;
+	openvcd_scope* scope;
+	openvcd_pool* pool;
+	openvcd_wave* w;
+	char* buffer;
+
+	w = load(&buffer);
+	pool = openvcd_new_pool(4);
+	should_not_be_null(pool);
+
+	should_be_null(openvcd_wave_heatmap(w, NULL, NULL, 1));
+
+	/* with buckets both wider and narrower than a block */
+	for (size_t n = 2 ; n <= 8192 ; n *= 8) {
+		expect = openvcd_new_heatmap(n, w->end_time);
+		count(w, all, 3, expect);
+
+		h = openvcd_wave_heatmap(w, NULL, NULL, n);
+		should_not_be_null(h);
+		should_match(h, expect);
+		openvcd_free_heatmap(h);
+
+		h = openvcd_wave_heatmap(w, pool, NULL, n);
+		should_not_be_null(h);
+		should_match(h, expect);
+		openvcd_free_heatmap(h);
+
+		openvcd_free_heatmap(expect);
+	}
+
+	/* the clock is in both scopes, but only counted once */
+	scope = child(child(w->root, "top"), "core");
+	should_not_be_null(scope);
+	expect = openvcd_new_heatmap(64, w->end_time);
+	count(w, core, 2, expect);
+	h = openvcd_wave_heatmap(w, pool, scope, 64);
+	should_not_be_null(h);
+	should_match(h, expect);
+
+	/* the counter doubles the changes from 2000 to 3000 */
+	should_equal(h->width, 256);
+	should_equal(h->counts[1024 / 256], 51);
+	should_equal(h->counts[2304 / 256], 102);
+	should_equal(h->counts[6000 / 256], 0);
+
+	openvcd_free_heatmap(h);
+	openvcd_free_heatmap(expect);
+
+	openvcd_free_pool(pool);
+	openvcd_free_wave(w);
+	free(buffer);
+}
+
+void test_heatmap_bin(void) {
+	char path[] = "/tmp/openvcd-heatmap-XXXXXX";
+	openvcd_heatmap* expect;
+	openvcd_wave* w;
+	openvcd_wave* r;
+	char* buffer;
+	FILE* f;
+	int fd;
+
+	w = load(&buffer);
+
+	fd = mkstemp(path);
+	should_be_true(fd >= 0);
+	f = fdopen(fd, "wb");
+	should_equal(openvcd_bin_write(w, f), 0);
+	fclose(f);
+
+	r = openvcd_bin_open(path);
+	should_not_be_null(r);
+	should_not_be_null(r->activity);
+	should_equal(r->activity->nbuckets, OPENVCD_HEATMAP_BUCKETS);
+
+	expect = openvcd_wave_heatmap(w, NULL, NULL, OPENVCD_HEATMAP_BUCKETS);
+	should_not_be_null(expect);
+	should_match(r->activity, expect);
+	openvcd_free_heatmap(expect);
+
+	/* and the same from the file's own blocks */
+	expect = openvcd_wave_heatmap(r, NULL, NULL, OPENVCD_HEATMAP_BUCKETS);
+	should_not_be_null(expect);
+	should_match(r->activity, expect);
+	openvcd_free_heatmap(expect);
+
+	openvcd_free_wave(r);
+	openvcd_free_wave(w);
+	free(buffer);
+	unlink(path);
+}
+
+int main(void) {
+	test_heatmap_fold();
+	test_heatmap_wave();
+	test_heatmap_bin();
+	return 0;
+}
@@ -0,0 +1,501 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "index.h"
+
+#include <limits.h>
+
+#define OPENVCD_INDEX_MAGIC "OVCDIDX1"
+
+static openvcd_index* alloc_index(void) {
+	openvcd_index* idx;
+
+	idx = malloc(sizeof(openvcd_index));
+	if (idx == NULL) { return NULL; }
+
+	idx->body_offset = 0;
+	idx->block_size = OPENVCD_INDEX_DEFAULT_BLOCK_SIZE;
+	idx->filter_type = OPENVCD_INDEX_FILTER_EXACT;
+	idx->filter_bits = 0;
+	idx->filter_words = 0;
+	vec_init(&(idx->blocks));
+	vec_init(&(idx->filters));
+	vec_init(&(idx->ids));
+
+	idx->id_numbers = kh_init(openvcd_mid);
+	if (idx->id_numbers == NULL) {
+		free(idx);
+		return NULL;
+	}
+
+	return idx;
+}
+
+void openvcd_free_index(openvcd_index* idx) {
+	char* id;
+	int i;
+
+	vec_foreach(&(idx->ids), id, i) {
+		free(id);
+	}
+	vec_deinit(&(idx->ids));
+	vec_deinit(&(idx->blocks));
+	vec_deinit(&(idx->filters));
+	kh_destroy(openvcd_mid, idx->id_numbers);
+	free(idx);
+}
+
+/* add an identifier code, if it is not already known */
+static int index_add_id(openvcd_index* idx, const char* id, size_t length) {
+	char* key;
+	khint_t k;
+	int khret;
+
+	key = strndup(id, length);
+	if (key == NULL) { return -1; }
+
+	k = kh_put(openvcd_mid, idx->id_numbers, key, &khret);
+	if (khret < 0) {
+		free(key);
+		return -1;
+	} else if (khret == 0) {
+		/* already declared, e.g. the same signal in two scopes */
+		free(key);
+		return 0;
+	}
+
+	kh_val(idx->id_numbers, k) = (size_t) idx->ids.length;
+	if (vec_push(&(idx->ids), key) != 0) {
+		kh_del(openvcd_mid, idx->id_numbers, k);
+		free(key);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* collect every identifier code from the $var declarations in the header */
+static int index_header(openvcd_index* idx, const char* buffer) {
+	openvcd_scanner s;
+	const char* token;
+	size_t length;
+	int remaining;
+	int rc;
+
+	openvcd_init_scanner(&s, buffer, idx->body_offset, true);
+
+	/* the identifier code is the third token after $var */
+	rc = 0;
+	remaining = -1;
+	while (openvcd_scan_token(&s, &token, &length) == OPENVCD_SCAN_OK) {
+		if ((length == 4) && (strncmp(token, "$var", 4) == 0)) {
+			remaining = 3;
+		} else if (remaining > 0) {
+			remaining--;
+			if (remaining == 0) {
+				rc = index_add_id(idx, token, length);
+				if (rc != 0) { break; }
+			}
+		}
+	}
+
+	openvcd_clear_scanner(&s);
+	return rc;
+}
+
+static uint64_t round_up_pow2(uint64_t n) {
+	uint64_t p;
+
+	p = 64;
+	while (p < n) { p <<= 1; }
+	return p;
+}
+
+/* choose between an exact bitmap and a Bloom filter, whichever is smaller */
+static void index_choose_filter(openvcd_index* idx) {
+	uint64_t nids;
+	uint64_t expected;
+	uint64_t bloom_bits;
+
+	nids = (uint64_t) idx->ids.length;
+
+	/* the shortest possible value change is 3 bytes, e.g. "1!\n", but
+	 * in practice they are rarely shorter than 8 */
+	expected = idx->block_size / 8;
+	if (expected > nids) { expected = nids; }
+	bloom_bits = round_up_pow2(expected * OPENVCD_INDEX_BLOOM_BITS_PER_ID);
+
+	if (nids <= bloom_bits) {
+		idx->filter_type = OPENVCD_INDEX_FILTER_EXACT;
+		idx->filter_bits = nids;
+	} else {
+		idx->filter_type = OPENVCD_INDEX_FILTER_BLOOM;
+		idx->filter_bits = bloom_bits;
+	}
+
+	idx->filter_words = (idx->filter_bits + 63) / 64;
+}
+
+static uint64_t bloom_bit(uint64_t h, unsigned int i, uint64_t bits) {
+	/* Kirsch-Mitzenmacher double hashing */
+	return (h + ((uint64_t) i) * ((h >> 32) | 1)) & (bits - 1);
+}
+
+static int index_new_block(openvcd_index* idx, uint64_t offset, uint64_t time) {
+	openvcd_index_block b;
+
+	b.offset = offset;
+	b.length = 0;
+	b.first_time = time;
+	b.last_time = time;
+
+	if (vec_push(&(idx->blocks), b) != 0) { return -1; }
+
+	for (uint64_t i = 0 ; i < idx->filter_words ; i++) {
+		if (vec_push(&(idx->filters), 0) != 0) { return -1; }
+	}
+
+	return 0;
+}
+
+/* record that id changes in the most recent block */
+static int index_mark(openvcd_index* idx, const char* id, size_t length) {
+	uint64_t* words;
+	uint64_t h;
+	uint64_t bit;
+	size_t number;
+
+	if (idx->filter_words == 0) { return -1; }
+	words = idx->filters.data + (idx->filters.length - (int) idx->filter_words);
+
+	if (idx->filter_type == OPENVCD_INDEX_FILTER_EXACT) {
+		/* an identifier code that was never declared */
+		if (!openvcd_index_id_number(idx, id, length, &number)) { return -1; }
+		words[number / 64] |= ((uint64_t) 1) << (number % 64);
+		return 0;
+	}
+
+	h = openvcd_hash(id, length);
+	for (unsigned int i = 0 ; i < OPENVCD_INDEX_BLOOM_HASHES ; i++) {
+		bit = bloom_bit(h, i, idx->filter_bits);
+		words[bit / 64] |= ((uint64_t) 1) << (bit % 64);
+	}
+
+	return 0;
+}
+
+static int index_body(openvcd_index* idx, const char* buffer, size_t length) {
+	openvcd_scanner s;
+	openvcd_change c;
+	openvcd_scan_status st;
+	openvcd_index_block* b;
+	int rc;
+
+	if (index_new_block(idx, idx->body_offset, 0) != 0) { return -1; }
+
+	openvcd_init_scanner(&s, buffer, length, true);
+	s.position = idx->body_offset;
+
+	rc = 0;
+	while ((st = openvcd_scan_next(&s, &c)) == OPENVCD_SCAN_OK) {
+		b = &vec_last(&(idx->blocks));
+
+		if (c.type == OPENVCD_CHANGE_TIME) {
+			if ((c.offset - b->offset) >= idx->block_size) {
+				b->length = c.offset - b->offset;
+				rc = index_new_block(idx, c.offset, c.time);
+				if (rc != 0) { break; }
+				b = &vec_last(&(idx->blocks));
+			}
+			b->last_time = c.time;
+
+		} else if (c.id != NULL) {
+			rc = index_mark(idx, c.id, c.id_length);
+			if (rc != 0) { break; }
+		}
+	}
+
+	if ((rc == 0) && (st != OPENVCD_SCAN_EOF)) { rc = -1; }
+
+	b = &vec_last(&(idx->blocks));
+	b->length = length - b->offset;
+
+	openvcd_clear_scanner(&s);
+	return rc;
+}
+
+openvcd_index* openvcd_build_index(const char* buffer, size_t length, size_t block_size) {
+	openvcd_index* idx;
+	size_t body_offset;
+
+	if (!openvcd_find_body(buffer, length, &body_offset)) { return NULL; }
+
+	idx = alloc_index();
+	if (idx == NULL) { return NULL; }
+
+	idx->body_offset = body_offset;
+	if (block_size != 0) { idx->block_size = block_size; }
+
+	if (index_header(idx, buffer) != 0) {
+		openvcd_free_index(idx);
+		return NULL;
+	}
+
+	index_choose_filter(idx);
+
+	if (index_body(idx, buffer, length) != 0) {
+		openvcd_free_index(idx);
+		return NULL;
+	}
+
+	return idx;
+}
+
+bool openvcd_index_id_number(const openvcd_index* idx, const char* id, size_t length, size_t* number) {
+	char small[64];
+	char* key;
+	khint_t k;
+	bool found;
+
+	key = (length < sizeof(small)) ? small : malloc(length + 1);
+	if (key == NULL) { return false; }
+	memcpy(key, id, length);
+	key[length] = '\0';
+
+	k = kh_get(openvcd_mid, idx->id_numbers, key);
+	found = (k != kh_end(idx->id_numbers));
+	if (found) { *number = kh_val(idx->id_numbers, k); }
+
+	if (key != small) { free(key); }
+
+	return found;
+}
+
+bool openvcd_index_may_contain(const openvcd_index* idx, size_t block, const char* id, size_t length) {
+	const uint64_t* words;
+	uint64_t h;
+	uint64_t bit;
+	size_t number;
+
+	words = idx->filters.data + (block * idx->filter_words);
+
+	if (idx->filter_type == OPENVCD_INDEX_FILTER_EXACT) {
+		if (!openvcd_index_id_number(idx, id, length, &number)) {
+			return false;
+		}
+		return (words[number / 64] >> (number % 64)) & 1;
+	}
+
+	h = openvcd_hash(id, length);
+	for (unsigned int i = 0 ; i < OPENVCD_INDEX_BLOOM_HASHES ; i++) {
+		bit = bloom_bit(h, i, idx->filter_bits);
+		if (!((words[bit / 64] >> (bit % 64)) & 1)) { return false; }
+	}
+
+	return true;
+}
+
+size_t openvcd_index_find_block(const openvcd_index* idx, uint64_t t) {
+	size_t lo;
+	size_t hi;
+	size_t mid;
+
+	/* last_time is non-decreasing, so find the first block that ends
+	 * after t */
+	lo = 0;
+	hi = (size_t) idx->blocks.length;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (idx->blocks.data[mid].last_time > t) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	return lo;
+}
+
+static bool scan_block(const openvcd_index_block* b, const char* buffer, const char* id, size_t length, uint64_t t, openvcd_change* c) {
+	openvcd_scanner s;
+	bool found;
+
+	openvcd_init_scanner(&s, buffer, b->offset + b->length, true);
+	s.position = b->offset;
+	s.time = b->first_time;
+
+	found = false;
+	while (openvcd_scan_next(&s, c) == OPENVCD_SCAN_OK) {
+		if ((c->id != NULL) && (c->time > t) &&
+			openvcd_change_id_eq(c, id, length)) {
+			found = true;
+			break;
+		}
+	}
+
+	openvcd_clear_scanner(&s);
+	return found;
+}
+
+bool openvcd_index_next_change(const openvcd_index* idx, const char* buffer, const char* id, size_t length, uint64_t t, openvcd_change* c) {
+	size_t nblocks;
+
+	nblocks = (size_t) idx->blocks.length;
+	for (size_t i = openvcd_index_find_block(idx, t) ; i < nblocks ; i++) {
+		if (!openvcd_index_may_contain(idx, i, id, length)) { continue; }
+		if (scan_block(&(idx->blocks.data[i]), buffer, id, length, t, c)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int write_u64(FILE* stream, uint64_t v) {
+	return (fwrite(&v, sizeof(v), 1, stream) == 1) ? 0 : -1;
+}
+
+static int read_u64(FILE* stream, uint64_t* v) {
+	return (fread(v, sizeof(*v), 1, stream) == 1) ? 0 : -1;
+}
+
+int openvcd_index_write(const openvcd_index* idx, FILE* stream) {
+	uint64_t length;
+	int rc;
+
+	rc = (fwrite(OPENVCD_INDEX_MAGIC, 8, 1, stream) == 1) ? 0 : -1;
+	rc |= write_u64(stream, idx->body_offset);
+	rc |= write_u64(stream, idx->block_size);
+	rc |= write_u64(stream, (uint64_t) idx->filter_type);
+	rc |= write_u64(stream, idx->filter_bits);
+	rc |= write_u64(stream, (uint64_t) idx->ids.length);
+	rc |= write_u64(stream, (uint64_t) idx->blocks.length);
+	if (rc != 0) { return -1; }
+
+	for (int i = 0 ; i < idx->ids.length ; i++) {
+		length = strlen(idx->ids.data[i]);
+		if (write_u64(stream, length) != 0) { return -1; }
+		if (fwrite(idx->ids.data[i], 1, length, stream) != length) {
+			return -1;
+		}
+	}
+
+	if (fwrite(idx->blocks.data, sizeof(openvcd_index_block),
+		(size_t) idx->blocks.length, stream) != (size_t) idx->blocks.length) {
+		return -1;
+	}
+
+	if (fwrite(idx->filters.data, sizeof(uint64_t),
+		(size_t) idx->filters.length, stream) != (size_t) idx->filters.length) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int read_ids(openvcd_index* idx, FILE* stream, uint64_t nids) {
+	uint64_t length;
+	char* id;
+	int rc;
+
+	for (uint64_t i = 0 ; i < nids ; i++) {
+		if (read_u64(stream, &length) != 0) { return -1; }
+		if (length >= SIZE_MAX) { return -1; }
+		id = malloc(length + 1);
+		if (id == NULL) { return -1; }
+		if (fread(id, 1, length, stream) != length) {
+			free(id);
+			return -1;
+		}
+		rc = index_add_id(idx, id, length);
+		free(id);
+		if (rc != 0) { return -1; }
+	}
+
+	return 0;
+}
+
+static int read_blocks(openvcd_index* idx, FILE* stream, uint64_t nblocks) {
+	uint64_t nwords;
+
+	/* the lists are indexed by int */
+	if (nblocks > INT_MAX) { return -1; }
+	if ((idx->filter_words != 0) && (nblocks > INT_MAX / idx->filter_words)) { return -1; }
+
+	if (vec_reserve(&(idx->blocks), (int) nblocks) != 0) { return -1; }
+	if (fread(idx->blocks.data, sizeof(openvcd_index_block), nblocks, stream) != nblocks) {
+		return -1;
+	}
+	idx->blocks.length = (int) nblocks;
+
+	nwords = nblocks * idx->filter_words;
+	if (vec_reserve(&(idx->filters), (int) nwords) != 0) { return -1; }
+	if (fread(idx->filters.data, sizeof(uint64_t), nwords, stream) != nwords) {
+		return -1;
+	}
+	idx->filters.length = (int) nwords;
+
+	return 0;
+}
+
+/* whether the filter read from a file can be used with nids identifier
+ * codes, which openvcd_index_may_contain() relies on */
+static bool valid_filter(uint64_t filter_type, uint64_t filter_bits, uint64_t nids) {
+	if (nids > INT_MAX) { return false; }
+
+	switch (filter_type) {
+		case OPENVCD_INDEX_FILTER_EXACT:
+			return filter_bits == nids;
+		case OPENVCD_INDEX_FILTER_BLOOM:
+			/* a power of two, see index_choose_filter() */
+			return (filter_bits != 0) && ((filter_bits & (filter_bits - 1)) == 0) &&
+				(filter_bits <= (uint64_t) INT_MAX * 64);
+		default:
+			return false;
+	}
+}
+
+openvcd_index* openvcd_index_read(FILE* stream) {
+	openvcd_index* idx;
+	char magic[8];
+	uint64_t filter_type;
+	uint64_t nids;
+	uint64_t nblocks;
+	int rc;
+
+	if (fread(magic, 8, 1, stream) != 1) { return NULL; }
+	if (memcmp(magic, OPENVCD_INDEX_MAGIC, 8) != 0) { return NULL; }
+
+	idx = alloc_index();
+	if (idx == NULL) { return NULL; }
+
+	rc = read_u64(stream, &(idx->body_offset));
+	rc |= read_u64(stream, &(idx->block_size));
+	rc |= read_u64(stream, &filter_type);
+	rc |= read_u64(stream, &(idx->filter_bits));
+	rc |= read_u64(stream, &nids);
+	rc |= read_u64(stream, &nblocks);
+
+	if ((rc == 0) && !valid_filter(filter_type, idx->filter_bits, nids)) { rc = -1; }
+
+	if (rc == 0) {
+		idx->filter_type = (openvcd_index_filter_type) filter_type;
+		idx->filter_words = (idx->filter_bits + 63) / 64;
+		rc = read_ids(idx, stream, nids);
+	}
+
+	/* every code is written once, so a duplicate would leave exact filters
+	 * with more bits than signals */
+	if ((rc == 0) && ((uint64_t) idx->ids.length != nids)) { rc = -1; }
+
+	if (rc == 0) { rc = read_blocks(idx, stream, nblocks); }
+
+	if (rc != 0) {
+		openvcd_free_index(idx);
+		return NULL;
+	}
+
+	return idx;
+}
@@ -0,0 +1,200 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements a seek index over the value change section of a VCD
+ * file held in memory.
+ *
+ * The value change section is divided into blocks of roughly block_size
+ * bytes. Blocks always begin on a simulation time record, so that scanning
+ * can start at the beginning of any block knowing the current time. For each
+ * block, the index records the byte range, the first and last simulation
+ * times, and a filter of the identifier codes which change within it.
+ *
+ * For small designs the filter is an exact bitmap with one bit per
+ * identifier code. For larger designs, where such a bitmap would be bigger
+ * than the block it describes, a Bloom filter is used instead. Either way,
+ * a block whose filter does not contain a signal can be skipped without
+ * reading it when searching for that signal's next change.
+ */
+
+#ifndef OPENVCD_INDEX_H
+#define OPENVCD_INDEX_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "khash.h"
+#include "vec.h"
+#include "util.h"
+#include "scan.h"
+
+/**** TYPES ******************************************************************/
+
+#define OPENVCD_INDEX_DEFAULT_BLOCK_SIZE 65536
+
+/* bits per identifier code which is expected to appear in a block, when
+ * sizing a Bloom filter */
+#define OPENVCD_INDEX_BLOOM_BITS_PER_ID 8
+
+/* number of hash functions used by Bloom filters */
+#define OPENVCD_INDEX_BLOOM_HASHES 5
+
+typedef enum {
+	/* one bit per identifier code, no false positives */
+	OPENVCD_INDEX_FILTER_EXACT,
+
+	/* a Bloom filter, which may have false positives */
+	OPENVCD_INDEX_FILTER_BLOOM,
+} openvcd_index_filter_type;
+
+typedef struct {
+	/* byte range of the block within the indexed buffer */
+	uint64_t offset;
+	uint64_t length;
+
+	/* the simulation time in effect at the start of the block, and the
+	 * last time record within it */
+	uint64_t first_time;
+	uint64_t last_time;
+} openvcd_index_block;
+
+typedef vec_t(openvcd_index_block) openvcd_index_blocklist;
+
+typedef vec_t(uint64_t) openvcd_index_wordlist;
+
+/* mapping of identifier codes to dense signal numbers */
+KHASH_MAP_INIT_STR(openvcd_mid, size_t)
+
+typedef struct {
+	/* offset of the first byte after $enddefinitions ... $end */
+	uint64_t body_offset;
+
+	/* the target size of each block in bytes */
+	uint64_t block_size;
+
+	openvcd_index_filter_type filter_type;
+
+	/* the number of bits in each block's filter, for exact filters this
+	 * is the number of identifier codes, and for Bloom filters this is
+	 * always a power of two */
+	uint64_t filter_bits;
+	uint64_t filter_words;
+
+	openvcd_index_blocklist blocks;
+
+	/* filter_words words for each block, in block order */
+	openvcd_index_wordlist filters;
+
+	/* every identifier code declared in the header, in declaration
+	 * order; the position in this list is the dense signal number */
+	vec_str_t ids;
+	khash_t(openvcd_mid)* id_numbers;
+} openvcd_index;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Build a seek index over a complete VCD file held in memory.
+ *
+ * The buffer is only read while building the index, but the same buffer must
+ * be passed to later queries.
+ *
+ * @param buffer
+ * @param length
+ * @param block_size The target block size in bytes, or 0 to use
+ * OPENVCD_INDEX_DEFAULT_BLOCK_SIZE.
+ *
+ * @return The new index, which must be free-ed with openvcd_free_index(), or
+ * NULL if the input could not be indexed.
+ */
+openvcd_index* openvcd_build_index(const char* buffer, size_t length, size_t block_size);
+
+/**
+ * @brief Free a previously allocated index.
+ *
+ * @param idx
+ */
+void openvcd_free_index(openvcd_index* idx);
+
+/**
+ * @brief Look up the dense signal number of an identifier code.
+ *
+ * @param idx
+ * @param id
+ * @param length
+ * @param number Set to the signal number if it is found.
+ *
+ * @return true if the identifier code was declared.
+ */
+bool openvcd_index_id_number(const openvcd_index* idx, const char* id, size_t length, size_t* number);
+
+/**
+ * @brief Test if a block might contain a change to the given identifier code.
+ *
+ * @param idx
+ * @param block The block number.
+ * @param id
+ * @param length
+ *
+ * @return false if the block definitely does not change id.
+ */
+bool openvcd_index_may_contain(const openvcd_index* idx, size_t block, const char* id, size_t length);
+
+/**
+ * @brief Find the first block which may contain changes after time t.
+ *
+ * @param idx
+ * @param t
+ *
+ * @return A block number, or the number of blocks if there is none.
+ */
+size_t openvcd_index_find_block(const openvcd_index* idx, uint64_t t);
+
+/**
+ * @brief Find the next change of a signal strictly after time t.
+ *
+ * Blocks whose filter excludes the signal are skipped without being read.
+ *
+ * @param idx
+ * @param buffer The same buffer the index was built from.
+ * @param id
+ * @param length
+ * @param t
+ * @param c Filled in with the change if one is found, pointing into buffer.
+ *
+ * @return true if a change was found.
+ */
+bool openvcd_index_next_change(const openvcd_index* idx, const char* buffer, const char* id, size_t length, uint64_t t, openvcd_change* c);
+
+/**
+ * @brief Write an index to a stream, so it can be re-used later without
+ * re-scanning the input.
+ *
+ * @param idx
+ * @param stream
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_index_write(const openvcd_index* idx, FILE* stream);
+
+/**
+ * @brief Read an index previously written with openvcd_index_write().
+ *
+ * @param stream
+ *
+ * @return The new index, or NULL if the stream could not be read.
+ */
+openvcd_index* openvcd_index_read(FILE* stream);
+
+#endif /* OPENVCD_INDEX_H */
@@ -0,0 +1,211 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "index.h"
+
+/* Generate a VCD with nvars signals, where the clock "!" toggles every time
+ * step and the signal "rare" only changes at time rare_time. */
+static char* make_with_rare(int nvars, int nsteps, int rare_time, size_t* length) {
+	char* buffer;
+	FILE* f;
+
+	f = open_memstream(&buffer, length);
+	fprintf(f, "$timescale 1ns $end\n$scope module top $end\n");
+	fprintf(f, "$var wire 1 ! clk $end\n");
+	fprintf(f, "$var wire 1 rare rare $end\n");
+	for (int i = 0 ; i < nvars ; i++) {
+		fprintf(f, "$var wire 8 v%d data%d $end\n", i, i);
+	}
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+
+	fprintf(f, "#0\n$dumpvars\n0!\n0rare\n$end\n");
+	for (int t = 1 ; t <= nsteps ; t++) {
+		fprintf(f, "#%d\n%d!\n", t, t % 2);
+		if (t == rare_time) { fprintf(f, "1rare\n"); }
+		fprintf(f, "b%d v%d\n", t % 2, t % nvars);
+	}
+
+	fclose(f);
+	return buffer;
+}
+
+static void check_index(openvcd_index* idx, char* vcd, int nvars) {
+	openvcd_change c;
+	size_t skipped;
+
+	should_not_be_null(idx);
+	should_be_true(idx->blocks.length > 10);
+
+	/* the rare signal changes at time 500 and nowhere else afterwards */
+	should_be_true(openvcd_index_next_change(idx, vcd, "rare", 4, 0, &c));
+	should_equal(c.time, 500);
+	should_equal(c.value[0], '1');
+	should_be_false(openvcd_index_next_change(idx, vcd, "rare", 4, 500, &c));
+
+	/* the clock changes every step */
+	should_be_true(openvcd_index_next_change(idx, vcd, "!", 1, 41, &c));
+	should_equal(c.time, 42);
+	should_equal(c.value[0], '0');
+
+	should_be_true(openvcd_index_next_change(idx, vcd, "v3", 2, 3, &c));
+	should_equal(c.time, (uint64_t) (3 + nvars));
+
+	/* nearly every block should be excluded for the rare signal */
+	skipped = 0;
+	for (int i = 0 ; i < idx->blocks.length ; i++) {
+		if (!openvcd_index_may_contain(idx, (size_t) i, "rare", 4)) {
+			skipped++;
+		}
+	}
+	should_be_true(skipped > ((size_t) idx->blocks.length * 3) / 4);
+
+	/* but every block with a clock edge must be included */
+	for (int i = 1 ; i < idx->blocks.length ; i++) {
+		should_be_true(openvcd_index_may_contain(idx, (size_t) i, "!", 1));
+	}
+}
+
+void test_exact_index(void) {
+	openvcd_index* idx;
+	size_t length;
+	char* vcd;
+
+	vcd = make_with_rare(10, 1000, 500, &length);
+
+	idx = openvcd_build_index(vcd, length, 256);
+	should_not_be_null(idx);
+	should_equal(idx->filter_type, OPENVCD_INDEX_FILTER_EXACT);
+	should_equal(idx->ids.length, 12);
+	check_index(idx, vcd, 10);
+
+	/* blocks should tile the body exactly, in time order */
+	should_equal(idx->blocks.data[0].offset, idx->body_offset);
+	for (int i = 1 ; i < idx->blocks.length ; i++) {
+		should_equal(idx->blocks.data[i].offset,
+			idx->blocks.data[i-1].offset + idx->blocks.data[i-1].length);
+		should_be_true(idx->blocks.data[i].first_time >= idx->blocks.data[i-1].last_time);
+		should_equal(vcd[idx->blocks.data[i].offset], '#');
+	}
+
+	openvcd_free_index(idx);
+	free(vcd);
+}
+
+void test_bloom_index(void) {
+	openvcd_index* idx;
+	size_t length;
+	char* vcd;
+
+	vcd = make_with_rare(200, 1000, 500, &length);
+
+	idx = openvcd_build_index(vcd, length, 128);
+	should_not_be_null(idx);
+	should_equal(idx->filter_type, OPENVCD_INDEX_FILTER_BLOOM);
+	check_index(idx, vcd, 200);
+
+	openvcd_free_index(idx);
+	free(vcd);
+}
+
+void test_index_roundtrip(void) {
+	openvcd_index* idx;
+	openvcd_index* idx2;
+	size_t length;
+	char* vcd;
+	FILE* f;
+
+	vcd = make_with_rare(10, 1000, 500, &length);
+	idx = openvcd_build_index(vcd, length, 256);
+	should_not_be_null(idx);
+
+	f = tmpfile();
+	should_not_be_null(f);
+	should_equal(openvcd_index_write(idx, f), 0);
+	rewind(f);
+	idx2 = openvcd_index_read(f);
+	fclose(f);
+
+	should_not_be_null(idx2);
+	should_equal(idx2->blocks.length, idx->blocks.length);
+	should_equal(idx2->filter_type, idx->filter_type);
+	should_equal(idx2->body_offset, idx->body_offset);
+	check_index(idx2, vcd, 10);
+
+	openvcd_free_index(idx2);
+	openvcd_free_index(idx);
+	free(vcd);
+}
+
+void test_index_errors(void) {
+	char* input;
+
+	/* no $enddefinitions */
+	input = "$var wire 1 ! a $end\n#0\n1!\n";
+	should_be_null(openvcd_build_index(input, strlen(input), 0));
+
+	/* undeclared identifier code */
+	input = "$var wire 1 ! a $end\n$enddefinitions $end\n#0\n1?\n";
+	should_be_null(openvcd_build_index(input, strlen(input), 0));
+}
+
+/* write idx, replace the header field at offset with value, and read it
+ * back */
+static openvcd_index* read_corrupt(const openvcd_index* idx, long offset, uint64_t value) {
+	openvcd_index* result;
+	FILE* f;
+
+	f = tmpfile();
+	should_not_be_null(f);
+	should_equal(openvcd_index_write(idx, f), 0);
+	should_equal(fseek(f, offset, SEEK_SET), 0);
+	should_equal(fwrite(&value, sizeof(value), 1, f), 1);
+	rewind(f);
+	result = openvcd_index_read(f);
+	fclose(f);
+
+	return result;
+}
+
+void test_index_corrupt(void) {
+	openvcd_index* exact;
+	openvcd_index* bloom;
+	size_t length;
+	char* vcd;
+
+	vcd = make_with_rare(200, 1000, 500, &length);
+	exact = openvcd_build_index(vcd, length, 0);
+	bloom = openvcd_build_index(vcd, length, 128);
+	should_equal(exact->filter_type, OPENVCD_INDEX_FILTER_EXACT);
+	should_equal(bloom->filter_type, OPENVCD_INDEX_FILTER_BLOOM);
+
+	/* the header is the magic, then body_offset, block_size, filter_type,
+	 * filter_bits, nids and nblocks */
+	should_be_null(read_corrupt(exact, 24, 7));
+	should_be_null(read_corrupt(exact, 32, 199));
+	should_be_null(read_corrupt(exact, 32, 4096));
+	should_be_null(read_corrupt(bloom, 32, bloom->filter_bits + 1));
+	should_be_null(read_corrupt(bloom, 32, 0));
+	should_be_null(read_corrupt(exact, 40, 199));
+	should_be_null(read_corrupt(exact, 40, UINT64_MAX));
+	should_be_null(read_corrupt(exact, 48, UINT64_MAX));
+	should_be_null(read_corrupt(exact, 48, ((uint64_t) 1) << 61));
+
+	openvcd_free_index(bloom);
+	openvcd_free_index(exact);
+	free(vcd);
+}
+
+int main(void) {
+	test_exact_index();
+	test_bloom_index();
+	test_index_roundtrip();
+	test_index_errors();
+	test_index_corrupt();
+	return 0;
+}
@@ -0,0 +1,97 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "intern.h"
+
+openvcd_intern* openvcd_new_intern(size_t nbuckets) {
+	openvcd_intern* pool;
+	size_t size;
+
+	if (nbuckets == 0) { nbuckets = OPENVCD_INTERN_DEFAULT_BUCKETS; }
+	size = 1;
+	while (size < nbuckets) { size *= 2; }
+
+	pool = malloc(sizeof(openvcd_intern));
+	if (pool == NULL) { return NULL; }
+
+	pool->buckets = calloc(size, sizeof(openvcd_intern_entry*));
+	if (pool->buckets == NULL) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->mask = size - 1;
+	pool->count = 0;
+
+	return pool;
+}
+
+void openvcd_free_intern(openvcd_intern* pool, void (*free_item)(void*)) {
+	openvcd_intern_entry* e;
+	openvcd_intern_entry* next;
+
+	for (size_t i = 0 ; i <= pool->mask ; i++) {
+		for (e = pool->buckets[i] ; e != NULL ; e = next) {
+			next = e->next;
+			if (free_item != NULL) { free_item(e->item); }
+			free(e);
+		}
+	}
+
+	free(pool->buckets);
+	free(pool);
+}
+
+/* search the list from e up to, but not including, stop */
+static openvcd_intern_entry* search(openvcd_intern_entry* e, openvcd_intern_entry* stop, uint64_t hash, openvcd_intern_eq eq, const void* key) {
+	for ( ; e != stop ; e = e->next) {
+		if ((e->hash == hash) && eq(e->item, key)) { return e; }
+	}
+
+	return NULL;
+}
+
+void* openvcd_intern_get(openvcd_intern* pool, uint64_t hash, openvcd_intern_eq eq, const void* key) {
+	openvcd_intern_entry* e;
+
+	e = __atomic_load_n(&(pool->buckets[hash & pool->mask]), __ATOMIC_ACQUIRE);
+	e = search(e, NULL, hash, eq, key);
+
+	return (e == NULL) ? NULL : e->item;
+}
+
+void* openvcd_intern_put(openvcd_intern* pool, uint64_t hash, openvcd_intern_eq eq, void* item) {
+	openvcd_intern_entry** bucket;
+	openvcd_intern_entry* found;
+	openvcd_intern_entry* head;
+	openvcd_intern_entry* e;
+
+	bucket = &(pool->buckets[hash & pool->mask]);
+	head = __atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+	found = search(head, NULL, hash, eq, item);
+	if (found != NULL) { return found->item; }
+
+	e = malloc(sizeof(openvcd_intern_entry));
+	if (e == NULL) { return NULL; }
+	e->hash = hash;
+	e->item = item;
+
+	for (;;) {
+		e->next = head;
+		if (__atomic_compare_exchange_n(bucket, &head, e, false,
+			__ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+			__atomic_add_fetch(&(pool->count), 1, __ATOMIC_RELAXED);
+			return item;
+		}
+
+		/* head is now the new head, so only the entries added since need
+		 * to be checked */
+		found = search(head, e->next, hash, eq, item);
+		if (found != NULL) {
+			free(e);
+			return found->item;
+		}
+	}
+}
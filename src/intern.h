@@ -0,0 +1,105 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements an intern pool: a set which keeps one canonical copy
+ * of each distinct item, such as a scope tree, and which any number of
+ * threads can use at once.
+ *
+ * The pool is a hash table with a fixed number of buckets, each a singly
+ * linked list of entries. Entries are never changed or removed once they are
+ * in a list, so lookups read the lists without any locks. A new entry is
+ * linked in at the head of it's bucket with a compare and swap, and if
+ * another thread got there first, the new head is searched again before
+ * trying once more, so two equal items never both end up in the pool.
+ *
+ * The pool does not grow, so the number of buckets should be chosen for the
+ * expected number of distinct items, but too few buckets only makes the
+ * lists longer.
+ */
+
+#ifndef OPENVCD_INTERN_H
+#define OPENVCD_INTERN_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/**** TYPES ******************************************************************/
+
+#define OPENVCD_INTERN_DEFAULT_BUCKETS 1024
+
+/* return true if two items are equal */
+typedef bool (*openvcd_intern_eq)(const void* a, const void* b);
+
+typedef struct openvcd_intern_entry_t {
+	uint64_t hash;
+	void* item;
+	struct openvcd_intern_entry_t* next;
+} openvcd_intern_entry;
+
+typedef struct {
+	openvcd_intern_entry** buckets;
+	size_t mask;
+
+	/* the number of items in the pool */
+	size_t count;
+} openvcd_intern;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Allocate a new, empty intern pool.
+ *
+ * @param nbuckets The number of buckets, which is rounded up to a power of
+ * two, or 0 to use OPENVCD_INTERN_DEFAULT_BUCKETS.
+ *
+ * @return The new pool, or NULL on failure.
+ */
+openvcd_intern* openvcd_new_intern(size_t nbuckets);
+
+/**
+ * @brief Free an intern pool, and optionally every item in it.
+ *
+ * @param pool
+ * @param free_item Called for each item, may be NULL.
+ */
+void openvcd_free_intern(openvcd_intern* pool, void (*free_item)(void*));
+
+/**
+ * @brief Find the item in the pool equal to key, without locking.
+ *
+ * @param pool
+ * @param hash The hash of key.
+ * @param eq
+ * @param key
+ *
+ * @return The item, or NULL if there is none.
+ */
+void* openvcd_intern_get(openvcd_intern* pool, uint64_t hash, openvcd_intern_eq eq, const void* key);
+
+/**
+ * @brief Add an item to the pool, unless an equal one is already there.
+ *
+ * @param pool
+ * @param hash The hash of item.
+ * @param eq
+ * @param item
+ *
+ * @return The item already in the pool, or item itself if it was added, in
+ * which case the pool owns it. NULL on failure.
+ */
+void* openvcd_intern_put(openvcd_intern* pool, uint64_t hash, openvcd_intern_eq eq, void* item);
+
+#endif /* OPENVCD_INTERN_H */
@@ -0,0 +1,99 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "intern.h"
+#include "pool.h"
+
+#define NSTRINGS 2000
+
+static bool string_eq(const void* a, const void* b) {
+	return strcmp((const char*) a, (const char*) b) == 0;
+}
+
+static uint64_t string_hash(const char* s) {
+	uint64_t h = 14695981039346656037ull;
+
+	for ( ; *s != '\0' ; s++) { h = (h ^ (uint8_t) *s) * 1099511628211ull; }
+
+	return h;
+}
+
+typedef struct {
+	openvcd_intern* pool;
+} intern_ctx;
+
+/* every task interns every string, so all of them race on each one */
+static void intern_all(void* ctx, size_t task) {
+	intern_ctx* c;
+	char* s;
+	char* got;
+
+	c = (intern_ctx*) ctx;
+	for (size_t i = 0 ; i < NSTRINGS ; i++) {
+		s = malloc(16);
+		snprintf(s, 16, "s%zu", (i * 7 + task) % NSTRINGS);
+		got = openvcd_intern_put(c->pool, string_hash(s), string_eq, s);
+		should_not_be_null(got);
+		str_should_equal(got, s);
+		if (got != s) { free(s); }
+	}
+}
+
+void test_intern(void) {
+	openvcd_intern* pool;
+	char* a;
+	char* b;
+
+	/* a single bucket, so everything collides */
+	pool = openvcd_new_intern(1);
+	should_not_be_null(pool);
+
+	a = strdup("abc");
+	b = strdup("abc");
+	should_equal(openvcd_intern_put(pool, string_hash(a), string_eq, a), a);
+	should_equal(openvcd_intern_put(pool, string_hash(b), string_eq, b), a);
+	free(b);
+
+	b = strdup("xyz");
+	should_equal(openvcd_intern_put(pool, string_hash(b), string_eq, b), b);
+	should_equal(openvcd_intern_get(pool, string_hash("abc"), string_eq, "abc"), a);
+	should_equal(openvcd_intern_get(pool, string_hash("xyz"), string_eq, "xyz"), b);
+	should_be_null(openvcd_intern_get(pool, string_hash("nope"), string_eq, "nope"));
+	should_equal(pool->count, 2);
+
+	openvcd_free_intern(pool, free);
+}
+
+void test_intern_concurrent(void) {
+	openvcd_pool* workers;
+	intern_ctx c;
+	char key[16];
+
+	c.pool = openvcd_new_intern(64);
+	should_not_be_null(c.pool);
+
+	workers = openvcd_new_pool(4);
+	openvcd_pool_run(workers, intern_all, &c, 16);
+	if (workers != NULL) { openvcd_free_pool(workers); }
+
+	/* each string made it in exactly once */
+	should_equal(c.pool->count, NSTRINGS);
+	for (size_t i = 0 ; i < NSTRINGS ; i++) {
+		snprintf(key, sizeof(key), "s%zu", i);
+		should_not_be_null(openvcd_intern_get(c.pool, string_hash(key), string_eq, key));
+	}
+
+	openvcd_free_intern(c.pool, free);
+}
+
+int main(void) {
+	test_intern();
+	test_intern_concurrent();
+	return 0;
+}
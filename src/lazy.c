@@ -0,0 +1,155 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "lazy.h"
+
+/* parse the declarations of a mapped VCD file into a new waveform */
+static openvcd_wave* open_header(char* mapping, size_t length) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	openvcd_signal* s;
+	int i;
+
+	source.input_string = mapping;
+	p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, length);
+	if (p == NULL) { return NULL; }
+
+	w = openvcd_load_header(p);
+	openvcd_free_parser(p);
+	if (w == NULL) { return NULL; }
+
+	vec_foreach(&(w->signals), s, i) {
+		s->loaded = false;
+	}
+
+	return w;
+}
+
+openvcd_wave* openvcd_open_indexed(const char* path, openvcd_index* idx, size_t cache_blocks) {
+	openvcd_wave* w;
+	char* mapping;
+	size_t length;
+
+	mapping = openvcd_map_file(path, &length);
+	if (mapping == NULL) {
+		if (idx != NULL) { openvcd_free_index(idx); }
+		return NULL;
+	}
+
+	if (idx == NULL) { idx = openvcd_build_index(mapping, length, 0); }
+	w = (idx == NULL) ? NULL : open_header(mapping, length);
+	if (w == NULL) {
+		if (idx != NULL) { openvcd_free_index(idx); }
+		openvcd_unmap(mapping, length);
+		return NULL;
+	}
+
+	w->mapping = mapping;
+	w->mapping_length = length;
+	w->index = idx;
+	if (idx->blocks.length > 0) { w->end_time = vec_last(&(idx->blocks)).last_time; }
+
+	w->cache = openvcd_alloc_cache(cache_blocks);
+	if (w->cache == NULL) {
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+/* append every change to s in one block of the index */
+static int load_block(openvcd_wave* w, openvcd_signal* s, const openvcd_index_block* b) {
+	openvcd_scanner scanner;
+	openvcd_scan_status st;
+	openvcd_change c;
+	size_t length;
+	int rc;
+
+	if ((b->offset > w->mapping_length) || (b->length > w->mapping_length - b->offset)) {
+		return -1;
+	}
+
+	openvcd_init_scanner(&scanner, w->mapping, b->offset + b->length, true);
+	scanner.position = b->offset;
+	scanner.time = b->first_time;
+
+	rc = 0;
+	length = strlen(s->id_code);
+	while ((st = openvcd_scan_next(&scanner, &c)) == OPENVCD_SCAN_OK) {
+		if ((c.id == NULL) || !openvcd_change_id_eq(&c, s->id_code, length)) {
+			continue;
+		}
+		if (openvcd_wave_apply(w, &c) != OPENVCD_ERROR_NONE) {
+			rc = -1;
+			break;
+		}
+	}
+
+	if (st == OPENVCD_SCAN_ERROR) { rc = -1; }
+
+	openvcd_clear_scanner(&scanner);
+	return rc;
+}
+
+/* forget the changes of s, so that it can be loaded again from the start */
+static void forget_changes(openvcd_signal* s) {
+	s->nblocks = 0;
+	s->data_length = 0;
+	s->change_count = 0;
+	s->last_flags = -1;
+
+	/* so that a reader doesn't go on seeing blocks which are gone, or
+	 * which the next load writes over */
+	__atomic_store_n(&(s->published), 0, __ATOMIC_RELEASE);
+}
+
+int openvcd_wave_load_signal(openvcd_wave* w, openvcd_signal* s) {
+	const openvcd_index* idx;
+	size_t length;
+
+	if (s->loaded) { return 0; }
+
+	idx = w->index;
+	if (idx == NULL) { return -1; }
+
+	length = strlen(s->id_code);
+	for (int i = 0 ; i < idx->blocks.length ; i++) {
+		if (!openvcd_index_may_contain(idx, (size_t) i, s->id_code, length)) { continue; }
+		if (load_block(w, s, &(idx->blocks.data[i])) != 0) {
+			forget_changes(s);
+			return -1;
+		}
+	}
+
+	/* set last, so that a reader which sees it set without a lock also
+	 * sees the changes */
+	__atomic_store_n(&(s->loaded), true, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void openvcd_wave_unload_signal(openvcd_wave* w, openvcd_signal* s) {
+	if (!s->loaded || !s->owned || (w->index == NULL)) { return; }
+
+	if (w->cache != NULL) { openvcd_cache_clear(w->cache); }
+
+	forget_changes(s);
+	free(s->blocks);
+	free(s->data);
+	s->blocks = NULL;
+	s->blocks_capacity = 0;
+	s->data = NULL;
+	s->data_capacity = 0;
+	s->loaded = false;
+}
+
+bool openvcd_wave_value_at(openvcd_wave* w, openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval) {
+	if (openvcd_wave_load_signal(w, s) != 0) { return false; }
+
+	if (w->cache != NULL) { return openvcd_cache_value_at(w->cache, s, t, aval, bval); }
+
+	return openvcd_value_at(s, t, aval, bval);
+}
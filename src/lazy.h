@@ -0,0 +1,100 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements lazy loading of waveforms.
+ *
+ * A VCD file with a seek index (see index.h) can be opened without reading
+ * it's value change section. Only the declarations are parsed up front, and
+ * each signal's changes are read from the blocks of the file which the index
+ * says may contain it the first time that signal is queried. Binary files
+ * (see bin.h) are always lazy, since their blocks are only paged in from the
+ * mapping as they are decoded.
+ *
+ * Either way, queries made with openvcd_wave_value_at() go through a bounded
+ * cache of decoded blocks (see cache.h), so memory use depends on the signals
+ * and times which are looked at rather than on the size of the file.
+ */
+
+#ifndef OPENVCD_LAZY_H
+#define OPENVCD_LAZY_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "parser.h"
+#include "index.h"
+#include "wave.h"
+#include "cache.h"
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Open a VCD file lazily.
+ *
+ * The file is mapped read-only, and only it's declarations are parsed. No
+ * signal is loaded until openvcd_wave_load_signal() or
+ * openvcd_wave_value_at() is called on it.
+ *
+ * @param path
+ * @param idx The index of the file, which the waveform takes ownership of.
+ * If NULL, the file is indexed when it is opened.
+ * @param cache_blocks The capacity of the waveform's cache, see
+ * openvcd_alloc_cache().
+ *
+ * @return The waveform, or NULL if the file could not be opened. On failure
+ * idx is free-ed.
+ */
+openvcd_wave* openvcd_open_indexed(const char* path, openvcd_index* idx, size_t cache_blocks);
+
+/**
+ * @brief Load the changes of a signal, if it has not been loaded yet.
+ *
+ * @param w
+ * @param s
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_wave_load_signal(openvcd_wave* w, openvcd_signal* s);
+
+/**
+ * @brief Free the changes of a lazily opened signal, so that it is loaded
+ * again the next time it is needed.
+ *
+ * Signals which weren't opened lazily are left as they are. The waveform's
+ * cache is cleared, since it may hold blocks of s.
+ *
+ * @param w
+ * @param s
+ */
+void openvcd_wave_unload_signal(openvcd_wave* w, openvcd_signal* s);
+
+/**
+ * @brief Get the value of a signal at time t, loading it if needed.
+ *
+ * This is the same as openvcd_value_at(), except that lazily opened signals
+ * are loaded, and the waveform's cache is used if it has one.
+ *
+ * @param w
+ * @param s
+ * @param t
+ * @param aval
+ * @param bval
+ *
+ * @return false if the signal has no value at time t, or could not be
+ * loaded.
+ */
+bool openvcd_wave_value_at(openvcd_wave* w, openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval);
+
+#endif /* OPENVCD_LAZY_H */
@@ -0,0 +1,194 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "lazy.h"
+
+/* write a VCD with nvars 4 bit signals to a temporary file, where signal i
+ * changes every i + 1 time units */
+static void write_periodic(char* path, int nvars, int nsteps) {
+	FILE* f;
+
+	f = temp_file(path);
+
+	fprintf(f, "$timescale 1ns $end\n$scope module top $end\n");
+	for (int i = 0 ; i < nvars ; i++) {
+		fprintf(f, "$var wire 4 s%d sig%d $end\n", i, i);
+	}
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+
+	for (int t = 0 ; t < nsteps ; t++) {
+		fprintf(f, "#%d\n", t);
+		for (int i = 0 ; i < nvars ; i++) {
+			if (t % (i + 1) == 0) {
+				fprintf(f, "b%d%d%d%d s%d\n", (t >> 3) & 1, (t >> 2) & 1,
+					(t >> 1) & 1, t & 1, i);
+			}
+		}
+	}
+
+	fclose(f);
+}
+
+static void check_lazy(openvcd_wave* w, int nvars, int nsteps) {
+	openvcd_signal* s;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	uint64_t expect;
+
+	should_not_be_null(w);
+	should_equal(w->signals.length, nvars);
+	should_equal(w->end_time, (uint64_t) nsteps - 1);
+
+	for (int i = 0 ; i < nvars ; i++) {
+		should_be_false(w->signals.data[i]->loaded);
+		should_equal(w->signals.data[i]->nblocks, 0);
+	}
+
+	/* only the queried signal is loaded */
+	s = openvcd_wave_find_signal(w, "s3");
+	for (uint64_t t = 0 ; t < (uint64_t) nsteps ; t += 5) {
+		should_be_true(openvcd_wave_value_at(w, s, t, aval, bval));
+		expect = t - (t % 4);
+		should_equal(aval[0], expect & 0xf);
+		should_equal(bval[0], 0);
+	}
+	should_be_true(s->loaded);
+	should_equal(s->change_count, (uint64_t) (nsteps + 3) / 4);
+	should_be_false(openvcd_wave_find_signal(w, "s2")->loaded);
+	should_be_true(w->cache->count > 0);
+	should_be_true(w->cache->count <= w->cache->capacity);
+
+	/* loading again is a no-op */
+	should_equal(openvcd_wave_load_signal(w, s), 0);
+	should_equal(s->change_count, (uint64_t) (nsteps + 3) / 4);
+}
+
+void test_lazy_open(void) {
+	char path[] = "/tmp/openvcd-lazy-XXXXXX";
+	openvcd_wave* w;
+
+	write_periodic(path, 20, 2000);
+
+	w = openvcd_open_indexed(path, NULL, 4);
+	check_lazy(w, 20, 2000);
+	should_equal(w->cache->capacity, 4);
+	openvcd_free_wave(w);
+
+	unlink(path);
+}
+
+void test_lazy_saved_index(void) {
+	char path[] = "/tmp/openvcd-lazy-XXXXXX";
+	openvcd_index* idx;
+	openvcd_state* state;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	char* mapping;
+	int period;
+	size_t length;
+	FILE* f;
+
+	write_periodic(path, 20, 2000);
+
+	/* write the index out and read it back, as a viewer would */
+	mapping = openvcd_map_file(path, &length);
+	idx = openvcd_build_index(mapping, length, 1024);
+	f = tmpfile();
+	should_equal(openvcd_index_write(idx, f), 0);
+	openvcd_free_index(idx);
+	openvcd_unmap(mapping, length);
+	rewind(f);
+	idx = openvcd_index_read(f);
+	fclose(f);
+	should_not_be_null(idx);
+
+	w = openvcd_open_indexed(path, idx, 0);
+	check_lazy(w, 20, 2000);
+
+	/* the whole state loads every signal */
+	state = openvcd_alloc_state(w);
+	should_equal(openvcd_wave_state_at(w, 1000, state), 0);
+	for (int i = 0 ; i < 20 ; i++) {
+		/* signals are not numbered in declaration order */
+		s = w->signals.data[i];
+		period = atoi(s->id_code + 1) + 1;
+		should_be_true(s->loaded);
+		should_be_true(state->valid[i]);
+		should_equal(state->aval[s->word], (uint64_t) (1000 - (1000 % period)) & 0xf);
+	}
+	openvcd_free_state(state);
+
+	openvcd_free_wave(w);
+	unlink(path);
+}
+
+void test_lazy_errors(void) {
+	char path[] = "/tmp/openvcd-lazy-XXXXXX";
+	FILE* f;
+	int fd;
+
+	should_be_null(openvcd_open_indexed("/nonexistent/openvcd", NULL, 0));
+
+	fd = mkstemp(path);
+	f = fdopen(fd, "w");
+	fputs("$var wire 1 ! a $end\n#0\n1!\n", f);
+	fclose(f);
+	should_be_null(openvcd_open_indexed(path, NULL, 0));
+	unlink(path);
+}
+
+void test_lazy_load_failure(void) {
+	char path[] = "/tmp/openvcd-lazy-XXXXXX";
+	openvcd_signal* s;
+	openvcd_index* idx;
+	openvcd_wave* w;
+	char* mapping;
+	size_t length;
+	FILE* f;
+
+	/* a bad value for s3 after many good ones, in a later block */
+	write_periodic(path, 4, 2000);
+	f = fopen(path, "a");
+	fputs("#2000\nb1x2z s3\n", f);
+	fclose(f);
+
+	mapping = openvcd_map_file(path, &length);
+	idx = openvcd_build_index(mapping, length, 1024);
+	openvcd_unmap(mapping, length);
+	should_not_be_null(idx);
+	should_be_true(idx->blocks.length > 1);
+
+	w = openvcd_open_indexed(path, idx, 0);
+	should_not_be_null(w);
+	s = openvcd_wave_find_signal(w, "s3");
+
+	/* none of the changes loaded before the bad one are left, where
+	 * readers or another load could see them */
+	for (int i = 0 ; i < 2 ; i++) {
+		should_equal(openvcd_wave_load_signal(w, s), -1);
+		should_be_false(s->loaded);
+		should_equal(s->nblocks, 0);
+		should_equal(s->data_length, 0);
+		should_equal(s->change_count, 0);
+		should_equal(s->last_flags, -1);
+		should_equal(s->published, 0);
+	}
+
+	openvcd_free_wave(w);
+	unlink(path);
+}
+
+int main(void) {
+	test_lazy_open();
+	test_lazy_saved_index();
+	test_lazy_errors();
+	test_lazy_load_failure();
+	return 0;
+}
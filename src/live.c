@@ -0,0 +1,253 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "live.h"
+
+/* a signal's arrays as they were published when a reader started */
+typedef struct {
+	const openvcd_block* blocks;
+	size_t nblocks;
+	uint32_t last_count;
+	const unsigned char* data;
+	size_t data_length;
+} openvcd_live_view;
+
+openvcd_epochs* openvcd_new_epochs(void) {
+	openvcd_epochs* e;
+
+	e = calloc(1, sizeof(openvcd_epochs));
+	if (e == NULL) { return NULL; }
+	e->epoch = 1;
+
+	return e;
+}
+
+void openvcd_free_epochs(openvcd_epochs* e) {
+	for (size_t i = 0 ; i < e->nretired ; i++) {
+		free(e->retired[i].pointer);
+	}
+	free(e->retired);
+	free(e);
+}
+
+int openvcd_epoch_enter(openvcd_epochs* e) {
+	uint64_t epoch;
+	uint64_t empty;
+	uint64_t now;
+
+	for (int i = 0 ; i < OPENVCD_EPOCH_SLOTS ; i++) {
+		empty = 0;
+		epoch = __atomic_load_n(&(e->epoch), __ATOMIC_SEQ_CST);
+		if (__atomic_compare_exchange_n(&(e->slots[i].epoch), &empty, epoch,
+			false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			/* if anything was retired while the slot was taken, the
+			 * loader may have missed it, so start again in the new
+			 * epoch, in which the retired arrays can't be seen */
+			while ((now = __atomic_load_n(&(e->epoch), __ATOMIC_SEQ_CST)) != epoch) {
+				__atomic_store_n(&(e->slots[i].epoch), now, __ATOMIC_SEQ_CST);
+				epoch = now;
+			}
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void openvcd_epoch_exit(openvcd_epochs* e, int slot) {
+	__atomic_store_n(&(e->slots[slot].epoch), 0, __ATOMIC_RELEASE);
+}
+
+/* free everything retired before the oldest reader started */
+static void collect(openvcd_epochs* e) {
+	uint64_t oldest;
+	uint64_t epoch;
+	size_t kept;
+
+	oldest = UINT64_MAX;
+	for (int i = 0 ; i < OPENVCD_EPOCH_SLOTS ; i++) {
+		epoch = __atomic_load_n(&(e->slots[i].epoch), __ATOMIC_SEQ_CST);
+		if ((epoch != 0) && (epoch < oldest)) { oldest = epoch; }
+	}
+
+	kept = 0;
+	for (size_t i = 0 ; i < e->nretired ; i++) {
+		if (e->retired[i].epoch < oldest) {
+			free(e->retired[i].pointer);
+		} else {
+			e->retired[kept++] = e->retired[i];
+		}
+	}
+	e->nretired = kept;
+}
+
+int openvcd_epoch_reserve(openvcd_epochs* e, size_t n) {
+	openvcd_retired* retired;
+	size_t cap;
+
+	if (e->retired_capacity - e->nretired >= n) { return 0; }
+
+	cap = (e->retired_capacity == 0) ? 16 : e->retired_capacity * 2;
+	while (cap - e->nretired < n) { cap *= 2; }
+	retired = realloc(e->retired, cap * sizeof(openvcd_retired));
+	if (retired == NULL) { return -1; }
+	e->retired = retired;
+	e->retired_capacity = cap;
+
+	return 0;
+}
+
+int openvcd_epoch_retire(openvcd_epochs* e, void* pointer) {
+	if (openvcd_epoch_reserve(e, 1) != 0) { return -1; }
+
+	/* readers which start after the increment can't see pointer */
+	e->retired[e->nretired].pointer = pointer;
+	e->retired[e->nretired].epoch = __atomic_fetch_add(&(e->epoch), 1, __ATOMIC_SEQ_CST);
+	e->nretired++;
+
+	collect(e);
+
+	return 0;
+}
+
+void openvcd_wave_share(openvcd_wave* w, openvcd_epochs* e) {
+	openvcd_signal* s;
+	int i;
+
+	vec_foreach(&(w->signals), s, i) {
+		s->epochs = e;
+		s->published = 0;
+		if (s->nblocks > 0) {
+			s->published = OPENVCD_PUBLISHED(s->nblocks, s->blocks[s->nblocks - 1].count);
+		}
+	}
+}
+
+/* the published word is loaded first, so that the arrays loaded after it
+ * hold at least what it describes */
+static void load_view(const openvcd_signal* s, openvcd_live_view* v) {
+	uint64_t published;
+
+	published = __atomic_load_n(&(s->published), __ATOMIC_ACQUIRE);
+	v->nblocks = OPENVCD_PUBLISHED_BLOCKS(published);
+	v->last_count = OPENVCD_PUBLISHED_COUNT(published);
+	v->data_length = __atomic_load_n(&(s->data_length), __ATOMIC_ACQUIRE);
+	v->data = __atomic_load_n(&(s->data), __ATOMIC_ACQUIRE);
+	v->blocks = __atomic_load_n(&(s->blocks), __ATOMIC_ACQUIRE);
+}
+
+/* see openvcd_signal_find_block() */
+static bool find_block(const openvcd_live_view* v, uint64_t t, size_t* block) {
+	size_t lo;
+	size_t hi;
+	size_t mid;
+
+	lo = 0;
+	hi = v->nblocks;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (v->blocks[mid].first_time > t) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	if (lo == 0) { return false; }
+	*block = lo - 1;
+
+	return true;
+}
+
+static openvcd_decoded_block* decode(const openvcd_signal* s, const openvcd_live_view* v, size_t block) {
+	openvcd_block b;
+	size_t size;
+
+	/* the loader is still changing the count, size, and last time of the
+	 * last block, so only it's first time and offset are read */
+	b.first_time = v->blocks[block].first_time;
+	b.offset = v->blocks[block].offset;
+	b.flags = 0;
+	if (block + 1 < v->nblocks) {
+		b.last_time = v->blocks[block].last_time;
+		b.count = v->blocks[block].count;
+		b.size = v->blocks[block].size;
+	} else {
+		size = (b.offset < v->data_length) ? v->data_length - b.offset : 0;
+		b.last_time = b.first_time;
+		b.count = (uint16_t) v->last_count;
+		b.size = (size > UINT32_MAX) ? UINT32_MAX : (uint32_t) size;
+	}
+
+	return openvcd_decode_changes(s, &b, v->data, v->data_length);
+}
+
+bool openvcd_live_value_at(openvcd_epochs* e, const openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval) {
+	openvcd_decoded_block* d;
+	openvcd_live_view v;
+	size_t block;
+	long i;
+	int slot;
+
+	slot = openvcd_epoch_enter(e);
+	if (slot < 0) { return false; }
+
+	load_view(s, &v);
+
+	i = -1;
+	if (find_block(&v, t, &block) && ((d = decode(s, &v, block)) != NULL)) {
+		i = openvcd_decoded_block_find(d, t);
+		if (i >= 0) {
+			memcpy(aval, d->aval + ((size_t) i * s->nwords), s->nwords * sizeof(uint64_t));
+			memcpy(bval, d->bval + ((size_t) i * s->nwords), s->nwords * sizeof(uint64_t));
+		}
+		openvcd_free_decoded_block(d);
+	}
+
+	openvcd_epoch_exit(e, slot);
+
+	return i >= 0;
+}
+
+long openvcd_live_changes(openvcd_epochs* e, const openvcd_signal* s, uint64_t from, uint64_t to, openvcd_live_handler handler, void* ctx) {
+	openvcd_decoded_block* d;
+	openvcd_live_view v;
+	size_t block;
+	size_t w;
+	long count;
+	int slot;
+
+	slot = openvcd_epoch_enter(e);
+	if (slot < 0) { return -1; }
+
+	load_view(s, &v);
+	if (!find_block(&v, from, &block)) { block = 0; }
+
+	count = 0;
+	for ( ; (block < v.nblocks) && (v.blocks[block].first_time <= to) ; block++) {
+		d = decode(s, &v, block);
+		if (d == NULL) {
+			count = -1;
+			break;
+		}
+
+		for (uint32_t i = 0 ; (i < d->count) && (d->times[i] <= to) ; i++) {
+			if (d->times[i] < from) { continue; }
+			w = (size_t) i * s->nwords;
+			handler(ctx, d->times[i], d->aval + w, d->bval + w);
+			count++;
+		}
+
+		openvcd_free_decoded_block(d);
+	}
+
+	openvcd_epoch_exit(e, slot);
+
+	return count;
+}
+
+uint64_t openvcd_live_end_time(const openvcd_wave* w) {
+	return __atomic_load_n(&(w->end_time), __ATOMIC_ACQUIRE);
+}
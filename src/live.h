@@ -0,0 +1,206 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements reading a waveform's signals from any number of
+ * threads while changes are still being appended to it, for instance by a
+ * follower, without either side taking a lock or waiting on the other.
+ *
+ * After appending a change, the loading thread publishes the signal's
+ * number of blocks and the number of changes in it's last block as a single
+ * word, with a release store after the change's bytes are written. Readers
+ * load that word first, and only ever look at those blocks and changes, so
+ * they always see whole changes, however far the loader has got since.
+ * Fields of the last block which the loader keeps updating are never read;
+ * it's count comes from the published word instead.
+ *
+ * The only other problem is memory. When a signal's arrays fill up, the
+ * loader copies them into larger ones, and a reader may still be using the
+ * old ones. These are retired rather than free-ed, and reclaimed by epoch:
+ * each reader holds a slot while it reads, marked with the epoch it
+ * started in, and the loader only frees an array once every reader which
+ * might have seen it has finished. Readers are never waited for, the arrays
+ * are just kept a little longer.
+ *
+ * Snapshots and caches are not safe to use while loading, only the
+ * functions here.
+ */
+
+#ifndef OPENVCD_LIVE_H
+#define OPENVCD_LIVE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "wave.h"
+
+/**** TYPES ******************************************************************/
+
+/* the most readers which can read at once */
+#define OPENVCD_EPOCH_SLOTS 64
+
+/* the published word of a signal, see openvcd_signal */
+#define OPENVCD_PUBLISHED(_nblocks, _count) (((uint64_t) (_nblocks) << 32) | (_count))
+#define OPENVCD_PUBLISHED_BLOCKS(_p) ((size_t) ((_p) >> 32))
+#define OPENVCD_PUBLISHED_COUNT(_p) ((uint32_t) ((_p) & 0xffffffff))
+
+/* kept on it's own cache line, since it is written by it's reader */
+typedef struct {
+	/* the epoch the reader started in, or 0 if the slot is free */
+	uint64_t epoch;
+	char pad[64 - sizeof(uint64_t)];
+} openvcd_epoch_slot;
+
+typedef struct {
+	void* pointer;
+	uint64_t epoch;
+} openvcd_retired;
+
+typedef struct openvcd_epochs_t {
+	/* starts at 1, and goes up by one each time something is retired */
+	uint64_t epoch;
+
+	openvcd_epoch_slot slots[OPENVCD_EPOCH_SLOTS];
+
+	/* only used by the loading thread */
+	openvcd_retired* retired;
+	size_t nretired;
+	size_t retired_capacity;
+} openvcd_epochs;
+
+/* called with each change of a signal by openvcd_live_changes(), aval and
+ * bval are only valid during the call */
+typedef void (*openvcd_live_handler)(void* ctx, uint64_t time, const uint64_t* aval, const uint64_t* bval);
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Allocate a new set of epochs.
+ *
+ * @return The new epochs, or NULL on failure.
+ */
+openvcd_epochs* openvcd_new_epochs(void);
+
+/**
+ * @brief Free a set of epochs and everything retired to it.
+ *
+ * There must be no readers left.
+ *
+ * @param e
+ */
+void openvcd_free_epochs(openvcd_epochs* e);
+
+/**
+ * @brief Start reading.
+ *
+ * Arrays retired from now on won't be free-ed until openvcd_epoch_exit()
+ * is called with the returned slot.
+ *
+ * @param e
+ *
+ * @return The reader's slot, or -1 if there are already
+ * OPENVCD_EPOCH_SLOTS readers.
+ */
+int openvcd_epoch_enter(openvcd_epochs* e);
+
+/**
+ * @brief Stop reading.
+ *
+ * @param e
+ * @param slot As returned by openvcd_epoch_enter().
+ */
+void openvcd_epoch_exit(openvcd_epochs* e, int slot);
+
+/**
+ * @brief Make room to retire n more pointers.
+ *
+ * Only the loading thread may reserve. Once this succeeds, the next n calls
+ * to openvcd_epoch_retire() can't fail.
+ *
+ * @param e
+ * @param n
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_epoch_reserve(openvcd_epochs* e, size_t n);
+
+/**
+ * @brief Free pointer once no reader can be using it.
+ *
+ * Only the loading thread may retire arrays. Anything which can be free-ed
+ * already is free-ed straight away.
+ *
+ * @param e
+ * @param pointer
+ *
+ * @return 0 on success, -1 if pointer could not be recorded, in which case
+ * it is leaked rather than free-ed early. Use openvcd_epoch_reserve() first
+ * to rule this out.
+ */
+int openvcd_epoch_retire(openvcd_epochs* e, void* pointer);
+
+/**
+ * @brief Let a waveform be read while it is loaded.
+ *
+ * Every signal's arrays are retired to e when they grow, rather than being
+ * free-ed. This must be done before the loading starts.
+ *
+ * @param w
+ * @param e
+ */
+void openvcd_wave_share(openvcd_wave* w, openvcd_epochs* e);
+
+/**
+ * @brief Get the value of a signal at time t while it is loaded.
+ *
+ * See openvcd_value_at().
+ *
+ * @param e
+ * @param s
+ * @param t
+ * @param aval
+ * @param bval
+ *
+ * @return false if the signal has no value at time t yet, or there are too
+ * many readers.
+ */
+bool openvcd_live_value_at(openvcd_epochs* e, const openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval);
+
+/**
+ * @brief Pass each change of a signal from time from to time to to a
+ * handler, while it is loaded.
+ *
+ * Changes appended during the call may or may not be included.
+ *
+ * @param e
+ * @param s
+ * @param from
+ * @param to
+ * @param handler
+ * @param ctx
+ *
+ * @return The number of changes passed to the handler, or -1 on failure.
+ */
+long openvcd_live_changes(openvcd_epochs* e, const openvcd_signal* s, uint64_t from, uint64_t to, openvcd_live_handler handler, void* ctx);
+
+/**
+ * @brief Return the latest time a waveform has been loaded up to.
+ *
+ * @param w
+ *
+ * @return
+ */
+uint64_t openvcd_live_end_time(const openvcd_wave* w);
+
+#endif /* OPENVCD_LIVE_H */
@@ -0,0 +1,172 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <pthread.h>
+
+#include "test_util.h"
+#include "live.h"
+
+#define LIVE_TEST_STEPS 200000
+
+typedef struct {
+	openvcd_wave* w;
+	int done;
+} live_ctx;
+
+typedef struct {
+	uint64_t next;
+	long bad;
+} range_ctx;
+
+static openvcd_wave* make_wave(void) {
+	openvcd_timescale ts;
+	openvcd_wave* w;
+
+	ts.n = 1;
+	ts.u = openvcd_unit_ns;
+	w = openvcd_alloc_wave(NULL, ts);
+	should_not_be_null(w);
+	should_not_be_null(openvcd_wave_add_signal(w, "v", 8, false));
+	should_not_be_null(openvcd_wave_add_signal(w, "c", 1, false));
+
+	return w;
+}
+
+/* the value of signal v is always it's time, and c toggles */
+static void* load(void* arg) {
+	live_ctx* ctx;
+	uint64_t aval[1];
+	uint64_t bval[1];
+
+	ctx = (live_ctx*) arg;
+	bval[0] = 0;
+	for (uint64_t t = 0 ; t < LIVE_TEST_STEPS ; t++) {
+		aval[0] = t & 0xff;
+		should_equal(openvcd_signal_append(ctx->w->signals.data[0], t, aval, bval), 0);
+		aval[0] = t & 1;
+		should_equal(openvcd_signal_append(ctx->w->signals.data[1], t, aval, bval), 0);
+		should_equal(openvcd_wave_set_time(ctx->w, t), OPENVCD_ERROR_NONE);
+	}
+	__atomic_store_n(&(ctx->done), 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static void check_change(void* arg, uint64_t time, const uint64_t* aval, const uint64_t* bval) {
+	range_ctx* r;
+
+	r = (range_ctx*) arg;
+	if ((time != r->next) || (aval[0] != (time & 0xff)) || (bval[0] != 0)) { r->bad++; }
+	r->next++;
+}
+
+void test_epochs(void) {
+	openvcd_epochs* e;
+	int slot[2];
+
+	e = openvcd_new_epochs();
+	should_not_be_null(e);
+
+	/* nothing is free-ed while a reader which could see it is reading */
+	slot[0] = openvcd_epoch_enter(e);
+	should_be_true(slot[0] >= 0);
+	should_equal(openvcd_epoch_retire(e, malloc(16)), 0);
+	should_equal(e->nretired, 1);
+
+	/* but readers who started later don't hold anything up */
+	slot[1] = openvcd_epoch_enter(e);
+	should_not_equal(slot[1], slot[0]);
+	openvcd_epoch_exit(e, slot[0]);
+	should_equal(openvcd_epoch_retire(e, malloc(16)), 0);
+	should_equal(e->nretired, 1);
+
+	openvcd_epoch_exit(e, slot[1]);
+	should_equal(openvcd_epoch_retire(e, malloc(16)), 0);
+	should_equal(e->nretired, 0);
+
+	/* once room is reserved, retiring doesn't need to allocate */
+	should_equal(openvcd_epoch_reserve(e, 40), 0);
+	should_be_true(e->retired_capacity >= 40);
+	should_equal(openvcd_epoch_reserve(e, 2), 0);
+
+	for (int i = 0 ; i < OPENVCD_EPOCH_SLOTS ; i++) {
+		should_equal(openvcd_epoch_enter(e), i);
+	}
+	should_equal(openvcd_epoch_enter(e), -1);
+	for (int i = 0 ; i < OPENVCD_EPOCH_SLOTS ; i++) {
+		openvcd_epoch_exit(e, i);
+	}
+
+	openvcd_free_epochs(e);
+}
+
+void test_live_readers(void) {
+	pthread_t loader;
+	openvcd_epochs* e;
+	openvcd_signal* v;
+	openvcd_signal* c;
+	live_ctx ctx;
+	range_ctx r;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	uint64_t end;
+	uint64_t t;
+	long reads;
+
+	e = openvcd_new_epochs();
+	should_not_be_null(e);
+	ctx.w = make_wave();
+	ctx.done = 0;
+	v = ctx.w->signals.data[0];
+	c = ctx.w->signals.data[1];
+
+	/* nothing has been loaded yet */
+	openvcd_wave_share(ctx.w, e);
+	should_be_false(openvcd_live_value_at(e, v, 0, aval, bval));
+
+	should_equal(pthread_create(&loader, NULL, load, &ctx), 0);
+
+	/* everything up to the end time is always there, and whole */
+	reads = 0;
+	while (!__atomic_load_n(&(ctx.done), __ATOMIC_ACQUIRE) || (reads == 0)) {
+		end = openvcd_live_end_time(ctx.w);
+		if (end == 0) { continue; }
+
+		t = ((uint64_t) reads * 7919) % end;
+		should_be_true(openvcd_live_value_at(e, v, t, aval, bval));
+		should_equal(aval[0], t & 0xff);
+		should_be_true(openvcd_live_value_at(e, c, t, aval, bval));
+		should_equal(aval[0], t & 1);
+
+		if (end > 600) {
+			r.next = end - 600;
+			r.bad = 0;
+			should_equal(openvcd_live_changes(e, v, end - 600, end - 300, check_change, &r), 301);
+			should_equal(r.bad, 0);
+		}
+
+		reads++;
+	}
+
+	pthread_join(loader, NULL);
+
+	/* and once loading is done, everything is */
+	r.next = 0;
+	r.bad = 0;
+	should_equal(openvcd_live_changes(e, v, 0, UINT64_MAX, check_change, &r), LIVE_TEST_STEPS);
+	should_equal(r.bad, 0);
+	should_equal(openvcd_live_end_time(ctx.w), LIVE_TEST_STEPS - 1);
+
+	openvcd_free_wave(ctx.w);
+	openvcd_free_epochs(e);
+}
+
+int main(void) {
+	test_epochs();
+	test_live_readers();
+	return 0;
+}
@@ -0,0 +1,682 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "merge.h"
+
+struct merge_node_t;
+
+/* mapping of names to the scopes and variables of the combined hierarchy */
+KHASH_MAP_INIT_STR(openvcd_mmerge, struct merge_node_t*)
+
+/* a scope or variable of the combined hierarchy */
+typedef struct merge_node_t {
+	char* name;
+	bool var;
+
+	/* for scopes, their type and children */
+	openvcd_scope_type scope_type;
+	khash_t(openvcd_mmerge)* children;
+
+	/* position among the parent's children, in the order they were first
+	 * declared by any input, and for scopes how many children they have
+	 * had so far */
+	size_t order;
+	size_t declared;
+
+	/* for variables, as they were declared */
+	openvcd_var_type var_type;
+	unsigned int width;
+	int msb_index;
+	int lsb_index;
+
+	/* for variables, another one which shares it's signal, or NULL if
+	 * this is the first */
+	struct merge_node_t* alias;
+
+	/* for the first variable of a signal, what it was written as */
+	const openvcd_var* written;
+} merge_node;
+
+typedef struct {
+	openvcd_merge* m;
+	merge_node* root;
+
+	/* for each input, the first variable of each signal */
+	merge_node*** signals;
+} merge_state;
+
+static void merge_error(openvcd_merge* m, const char* what, const char* detail) {
+	free(m->error_string);
+	m->error_string = NULL;
+	asprintf(&(m->error_string), "%s%s", what, (detail == NULL) ? "" : detail);
+}
+
+/* copy the error of one of the inputs */
+static void input_error(openvcd_merge* m, size_t i) {
+	const char* detail;
+
+	detail = m->inputs[i].p->error_string;
+	free(m->error_string);
+	m->error_string = NULL;
+	asprintf(&(m->error_string), "input %lu: %s", (unsigned long) i,
+		(detail == NULL) ? "unknown error" : detail);
+}
+
+/* read more of a stream input after any bytes which were held back */
+static int refill(openvcd_merge_input* in) {
+	openvcd_parser* p;
+	size_t carry;
+	size_t want;
+	size_t n;
+	char* temp;
+
+	p = in->p;
+	carry = in->length - in->scanner.position;
+	memmove(in->buffer, in->buffer + in->scanner.position, carry);
+	if (carry == in->capacity) {
+		temp = realloc(in->buffer, in->capacity * 2);
+		if (temp == NULL) {
+			openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to grow read buffer", in->consumed);
+			return -1;
+		}
+		in->buffer = temp;
+		in->capacity *= 2;
+	}
+
+	want = in->capacity - carry;
+	if (p->input_length != 0) {
+		if (p->body_offset + in->consumed >= p->input_length) {
+			want = 0;
+		} else if (p->input_length - p->body_offset - in->consumed < want) {
+			want = p->input_length - p->body_offset - in->consumed;
+		}
+	}
+
+	n = (want == 0) ? 0 : fread(in->buffer + carry, 1, want, p->source.input_stream);
+	if ((n < want) && ferror(p->source.input_stream)) {
+		openvcd_load_error(p, OPENVCD_ERROR_GENERAL, "failed to read input", in->consumed);
+		return -1;
+	}
+	in->consumed += n;
+	in->length = carry + n;
+	openvcd_scanner_feed(&(in->scanner), in->buffer, in->length, n < in->capacity - carry);
+
+	return 0;
+}
+
+/* read the next record of an input into it's head */
+static int read_head(openvcd_merge* m, size_t i) {
+	openvcd_merge_input* in;
+	openvcd_scan_status st;
+
+	in = &(m->inputs[i]);
+	for (;;) {
+		st = openvcd_scan_next(&(in->scanner), &(in->head));
+		if (st == OPENVCD_SCAN_OK) {
+			/* a time which can't be put in the common timescale
+			 * can't be merged */
+			if (in->head.time > UINT64_MAX / in->scale) {
+				openvcd_load_error(in->p, OPENVCD_ERROR_GENERAL, "time overflows the merged timescale",
+					in->consumed - in->length + in->head.offset);
+				input_error(m, i);
+				return -1;
+			}
+			in->has_head = true;
+			in->head.time *= in->scale;
+			return 0;
+		}
+
+		if (st == OPENVCD_SCAN_EOF) {
+			in->has_head = false;
+			return 0;
+		}
+
+		if (st == OPENVCD_SCAN_ERROR) {
+			openvcd_load_error(in->p, OPENVCD_ERROR_SYNTAX, in->scanner.error_string,
+				in->consumed - in->length + in->scanner.error_offset);
+			input_error(m, i);
+			return -1;
+		}
+
+		if ((in->buffer == NULL) || (refill(in) != 0)) {
+			input_error(m, i);
+			return -1;
+		}
+	}
+}
+
+/* true if input i's next record comes before input j's, inputs with no
+ * more records come last */
+static bool before(const openvcd_merge* m, size_t i, size_t j) {
+	const openvcd_merge_input* a;
+	const openvcd_merge_input* b;
+
+	a = &(m->inputs[i]);
+	b = &(m->inputs[j]);
+
+	if (a->has_head != b->has_head) { return a->has_head; }
+	if (a->has_head && (a->head.time != b->head.time)) { return a->head.time < b->head.time; }
+
+	return i < j;
+}
+
+/* play input i's new head up the tree from it's leaf */
+static void replay(openvcd_merge* m, size_t i) {
+	size_t winner;
+	size_t node;
+	size_t t;
+
+	winner = i;
+	for (node = (i + m->ninputs) / 2 ; node > 0 ; node /= 2) {
+		if (before(m, m->tree[node], winner)) {
+			t = m->tree[node];
+			m->tree[node] = winner;
+			winner = t;
+		}
+	}
+
+	m->tree[0] = winner;
+}
+
+static int build_tree(openvcd_merge* m) {
+	size_t* winners;
+	size_t n;
+	size_t a;
+	size_t b;
+
+	n = m->ninputs;
+	winners = malloc(2 * n * sizeof(size_t));
+	if (winners == NULL) { return -1; }
+
+	/* the leaves are n to 2n - 1, with the winner of each node passed up
+	 * and the loser kept */
+	for (size_t i = 0 ; i < n ; i++) { winners[n + i] = i; }
+	for (size_t node = n - 1 ; node > 0 ; node--) {
+		a = winners[2 * node];
+		b = winners[2 * node + 1];
+		if (before(m, b, a)) {
+			winners[node] = b;
+			m->tree[node] = a;
+		} else {
+			winners[node] = a;
+			m->tree[node] = b;
+		}
+	}
+	m->tree[0] = winners[1];
+
+	free(winners);
+	return 0;
+}
+
+static int open_input(openvcd_merge_input* in, openvcd_parser* p) {
+	const char* body;
+	size_t length;
+
+	in->p = p;
+	in->w = openvcd_load_header(p);
+	if (in->w == NULL) { return -1; }
+
+	if (p->type == OPENVCD_PARSER_STRING) {
+		length = 0;
+		body = p->source.input_string + p->body_offset;
+		if (p->body_offset < p->input_length) {
+			/* the input length may be longer than the string */
+			length = strnlen(body, p->input_length - p->body_offset);
+		}
+		openvcd_init_scanner(&(in->scanner), body, length, true);
+		in->length = length;
+		in->consumed = length;
+		return 0;
+	}
+
+	in->capacity = OPENVCD_LOAD_CHUNK_SIZE;
+	in->buffer = malloc(in->capacity);
+	if (in->buffer == NULL) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate read buffer", 0);
+		return -1;
+	}
+
+	openvcd_init_scanner(&(in->scanner), in->buffer, 0, false);
+	return 0;
+}
+
+openvcd_merge* openvcd_new_merge(openvcd_parser** parsers, size_t n) {
+	openvcd_timescale* timescales;
+	openvcd_timescale one;
+	uint64_t* scales;
+	uint64_t scale;
+	openvcd_merge* m;
+
+	if (n == 0) { return NULL; }
+
+	m = calloc(1, sizeof(openvcd_merge));
+	if (m == NULL) { return NULL; }
+
+	m->ninputs = n;
+	m->inputs = calloc(n, sizeof(openvcd_merge_input));
+	m->tree = calloc(n, sizeof(size_t));
+	timescales = calloc(n, sizeof(openvcd_timescale));
+	scales = calloc(n, sizeof(uint64_t));
+	if ((m->inputs == NULL) || (m->tree == NULL) || (timescales == NULL) || (scales == NULL)) {
+		openvcd_load_error(parsers[0], OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate merge", 0);
+		free(timescales);
+		free(scales);
+		openvcd_free_merge(m);
+		return NULL;
+	}
+
+	for (size_t i = 0 ; i < n ; i++) {
+		if (open_input(&(m->inputs[i]), parsers[i]) != 0) {
+			free(timescales);
+			free(scales);
+			openvcd_free_merge(m);
+			return NULL;
+		}
+		timescales[i] = m->inputs[i].w->timescale;
+	}
+
+	/* without a timescale, an input's times can't be interleaved with
+	 * the others', and the common timescale fails only if one of them
+	 * fails on it's own */
+	if (!openvcd_timescale_common(timescales, n, &(m->timescale), scales)) {
+		for (size_t i = 0 ; i < n ; i++) {
+			if (openvcd_timescale_common(&(timescales[i]), 1, &one, &scale)) { continue; }
+			openvcd_load_error(parsers[i], OPENVCD_ERROR_GENERAL, "no valid $timescale, which merging needs", 0);
+			break;
+		}
+		free(timescales);
+		free(scales);
+		openvcd_free_merge(m);
+		return NULL;
+	}
+	for (size_t i = 0 ; i < n ; i++) { m->inputs[i].scale = scales[i]; }
+	free(timescales);
+	free(scales);
+
+	for (size_t i = 0 ; i < n ; i++) {
+		if (read_head(m, i) != 0) {
+			openvcd_free_merge(m);
+			return NULL;
+		}
+	}
+
+	if (build_tree(m) != 0) {
+		openvcd_load_error(parsers[0], OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate merge", 0);
+		openvcd_free_merge(m);
+		return NULL;
+	}
+
+	return m;
+}
+
+void openvcd_free_merge(openvcd_merge* m) {
+	openvcd_merge_input* in;
+
+	if (m->inputs != NULL) {
+		for (size_t i = 0 ; i < m->ninputs ; i++) {
+			in = &(m->inputs[i]);
+			if (in->w == NULL) { continue; }
+			openvcd_clear_scanner(&(in->scanner));
+			openvcd_free_wave(in->w);
+			free(in->buffer);
+		}
+		free(m->inputs);
+	}
+
+	free(m->tree);
+	free(m->error_string);
+	free(m);
+}
+
+int openvcd_merge_next(openvcd_merge* m, size_t* input, openvcd_change* c) {
+	openvcd_merge_input* in;
+	uint64_t time;
+	size_t i;
+
+	for (;;) {
+		i = m->tree[0];
+		in = &(m->inputs[i]);
+
+		if (m->returned) {
+			m->returned = false;
+			time = in->head.time;
+			if (read_head(m, i) != 0) { return -1; }
+
+			/* the input stays in front until it's time moves on */
+			if (!in->has_head || (in->head.time != time)) {
+				replay(m, i);
+				i = m->tree[0];
+				in = &(m->inputs[i]);
+			}
+		}
+
+		if (!in->has_head) { return 0; }
+
+		*input = i;
+		*c = in->head;
+		m->returned = true;
+
+		if (c->type == OPENVCD_CHANGE_TIME) {
+			if (m->has_time && (c->time <= m->time)) { continue; }
+			m->has_time = true;
+			m->time = c->time;
+		}
+
+		return 1;
+	}
+}
+
+static void free_node(merge_node* node) {
+	const char* key;
+	merge_node* child;
+
+	OPENVCD_UNUSED(key);
+
+	if (node == NULL) { return; }
+
+	if (node->children != NULL) {
+		kh_foreach(node->children, key, child, free_node(child););
+		kh_destroy(openvcd_mmerge, node->children);
+	}
+	free(node->name);
+	free(node);
+}
+
+/* find or add a child of a scope, setting created if it was added */
+static merge_node* child_node(merge_node* parent, const char* name, bool var, bool* created) {
+	merge_node* node;
+	int khret;
+	khint_t k;
+
+	*created = false;
+	k = kh_get(openvcd_mmerge, parent->children, name);
+	if (k != kh_end(parent->children)) { return kh_val(parent->children, k); }
+
+	node = calloc(1, sizeof(merge_node));
+	if (node == NULL) { return NULL; }
+	node->var = var;
+	node->name = strdup(name);
+	if (!var) { node->children = kh_init(openvcd_mmerge); }
+	if ((node->name == NULL) || (!var && (node->children == NULL))) {
+		free_node(node);
+		return NULL;
+	}
+
+	k = kh_put(openvcd_mmerge, parent->children, node->name, &khret);
+	if (khret < 0) {
+		free_node(node);
+		return NULL;
+	}
+	kh_val(parent->children, k) = node;
+	node->order = parent->declared++;
+	*created = true;
+
+	return node;
+}
+
+static merge_node* first_node(merge_node* node) {
+	while (node->alias != NULL) { node = node->alias; }
+	return node;
+}
+
+static int combine_var(merge_state* st, size_t i, merge_node* parent, const openvcd_var* v) {
+	openvcd_merge_input* in;
+	merge_node** first;
+	merge_node* node;
+	const char* name;
+	bool created;
+	size_t n;
+
+	in = &(st->m->inputs[i]);
+	name = (v->reference != NULL) ? v->reference->identifier : v->identifier_code;
+
+	if (!openvcd_wave_signal_number(in->w, v->identifier_code, strlen(v->identifier_code), &n)) {
+		merge_error(st->m, "undeclared identifier code: ", v->identifier_code);
+		return -1;
+	}
+	first = &(st->signals[i][n]);
+
+	node = child_node(parent, name, true, &created);
+	if (node == NULL) {
+		merge_error(st->m, "failed to allocate hierarchy", NULL);
+		return -1;
+	}
+
+	if (created) {
+		node->var_type = v->type;
+		node->width = v->width;
+		node->msb_index = (v->reference != NULL) ? v->reference->msb_index : -1;
+		node->lsb_index = (v->reference != NULL) ? v->reference->lsb_index : -1;
+		node->alias = *first;
+		if (*first == NULL) { *first = node; }
+		return 0;
+	}
+
+	if (!node->var) {
+		merge_error(st->m, "variable has the same name as a scope: ", name);
+		return -1;
+	}
+	if (node->width != v->width) {
+		merge_error(st->m, "variable has different widths in different inputs: ", name);
+		return -1;
+	}
+
+	if (*first == NULL) {
+		*first = first_node(node);
+	} else if (*first != first_node(node)) {
+		merge_error(st->m, "variable shares a signal in only some inputs: ", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int combine_scope(merge_state* st, size_t i, merge_node* parent, const openvcd_scope* s);
+
+static int combine_child(merge_state* st, size_t i, merge_node* parent, const openvcd_scope* s) {
+	merge_node* node;
+	bool created;
+
+	node = child_node(parent, s->identifier, false, &created);
+	if (node == NULL) {
+		merge_error(st->m, "failed to allocate hierarchy", NULL);
+		return -1;
+	}
+	if (node->var) {
+		merge_error(st->m, "scope has the same name as a variable: ", s->identifier);
+		return -1;
+	}
+	if (created) { node->scope_type = s->type; }
+
+	return combine_scope(st, i, node, s);
+}
+
+/* combine the children of a scope in the order the input declared them, so
+ * that nodes are created in that order */
+static int combine_scope(merge_state* st, size_t i, merge_node* parent, const openvcd_scope* s) {
+	openvcd_child* children;
+	size_t n;
+	int rc;
+
+	children = openvcd_scope_children(s, &n);
+	if (children == NULL) {
+		merge_error(st->m, "failed to allocate hierarchy", NULL);
+		return -1;
+	}
+
+	rc = 0;
+	for (size_t j = 0 ; (j < n) && (rc == 0) ; j++) {
+		if (children[j].var != NULL) {
+			rc = combine_var(st, i, parent, children[j].var);
+		} else {
+			rc = combine_child(st, i, parent, children[j].scope);
+		}
+	}
+
+	free(children);
+
+	return rc;
+}
+
+static int declare_node(openvcd_writer* out, merge_node* node);
+
+static int declare_child(openvcd_writer* out, merge_node* node) {
+	merge_node* first;
+
+	if (!node->var) {
+		if (openvcd_writer_scope(out, node->name, node->scope_type) != 0) { return -1; }
+		if (declare_node(out, node) != 0) { return -1; }
+		return openvcd_writer_upscope(out);
+	}
+
+	/* whichever variable of a signal comes first is declared, and the
+	 * others alias it */
+	first = first_node(node);
+	if (first->written == NULL) {
+		first->written = openvcd_writer_var(out, node->var_type, node->width, node->name, node->msb_index, node->lsb_index);
+		return (first->written == NULL) ? -1 : 0;
+	}
+
+	return (openvcd_writer_alias(out, node->var_type, node->name, node->msb_index, node->lsb_index, first->written) == NULL) ? -1 : 0;
+}
+
+static int compare_nodes(const void* a, const void* b) {
+	const merge_node* x;
+	const merge_node* y;
+
+	x = *((merge_node* const*) a);
+	y = *((merge_node* const*) b);
+
+	return (x->order > y->order) - (x->order < y->order);
+}
+
+/* declare the children of a scope in the order they were first declared */
+static int declare_node(openvcd_writer* out, merge_node* node) {
+	merge_node** children;
+	const char* key;
+	merge_node* child;
+	size_t n;
+	int rc;
+
+	OPENVCD_UNUSED(key);
+
+	children = malloc((kh_size(node->children) + 1) * sizeof(merge_node*));
+	if (children == NULL) { return -1; }
+
+	n = 0;
+	kh_foreach(node->children, key, child, children[n++] = child;);
+	qsort(children, n, sizeof(merge_node*), compare_nodes);
+
+	rc = 0;
+	for (size_t i = 0 ; (i < n) && (rc == 0) ; i++) {
+		rc = declare_child(out, children[i]);
+	}
+
+	free(children);
+
+	return rc;
+}
+
+static void free_state(merge_state* st) {
+	if (st->signals != NULL) {
+		for (size_t i = 0 ; i < st->m->ninputs ; i++) { free(st->signals[i]); }
+		free(st->signals);
+	}
+	free_node(st->root);
+}
+
+/* combine the hierarchies of the inputs */
+static int combine(merge_state* st) {
+	openvcd_merge* m;
+
+	m = st->m;
+	st->root = calloc(1, sizeof(merge_node));
+	st->signals = calloc(m->ninputs, sizeof(merge_node**));
+	if ((st->root == NULL) || (st->signals == NULL)) {
+		merge_error(m, "failed to allocate hierarchy", NULL);
+		return -1;
+	}
+
+	st->root->children = kh_init(openvcd_mmerge);
+	if (st->root->children == NULL) {
+		merge_error(m, "failed to allocate hierarchy", NULL);
+		return -1;
+	}
+
+	for (size_t i = 0 ; i < m->ninputs ; i++) {
+		st->signals[i] = calloc((size_t) m->inputs[i].w->signals.length + 1, sizeof(merge_node*));
+		if (st->signals[i] == NULL) {
+			merge_error(m, "failed to allocate hierarchy", NULL);
+			return -1;
+		}
+		if (combine_scope(st, i, st->root, m->inputs[i].w->root) != 0) { return -1; }
+	}
+
+	return 0;
+}
+
+/* write one record of the merged timeline */
+static int write_change(merge_state* st, openvcd_writer* out, size_t i, const openvcd_change* c) {
+	merge_node* first;
+	size_t n;
+
+	if (c->type == OPENVCD_CHANGE_TIME) { return openvcd_writer_time(out, c->time); }
+
+	if (c->type == OPENVCD_CHANGE_COMMAND) { return 0; }
+
+	if (!openvcd_wave_signal_number(st->m->inputs[i].w, c->id, c->id_length, &n)) {
+		openvcd_load_error(st->m->inputs[i].p, OPENVCD_ERROR_SYNTAX, openvcd_change_error(OPENVCD_ERROR_SYNTAX),
+			st->m->inputs[i].consumed - st->m->inputs[i].length + c->offset);
+		input_error(st->m, i);
+		return -1;
+	}
+	first = st->signals[i][n];
+
+	return openvcd_writer_text(out, first->written, c->type, c->value, c->value_length);
+}
+
+int openvcd_merge_write(openvcd_merge* m, FILE* stream) {
+	openvcd_writer* out;
+	openvcd_change c;
+	merge_state st;
+	size_t i;
+	int rc;
+
+	memset(&st, 0, sizeof(st));
+	st.m = m;
+
+	if (combine(&st) != 0) {
+		free_state(&st);
+		return -1;
+	}
+
+	out = openvcd_new_writer(stream, m->timescale, m->inputs[0].w->version);
+	if (out == NULL) {
+		merge_error(m, "failed to allocate writer", NULL);
+		free_state(&st);
+		return -1;
+	}
+
+	rc = declare_node(out, st.root);
+	if (rc == 0) { rc = openvcd_writer_end_definitions(out); }
+	if (rc != 0) { merge_error(m, "failed to write output", NULL); }
+
+	while (rc == 0) {
+		rc = openvcd_merge_next(m, &i, &c);
+		if (rc <= 0) { break; }
+		rc = write_change(&st, out, i, &c);
+		if ((rc != 0) && (m->error_string == NULL)) { merge_error(m, "failed to write output", NULL); }
+	}
+
+	if ((openvcd_writer_flush(out) != 0) && (rc == 0)) {
+		merge_error(m, "failed to write output", NULL);
+		rc = -1;
+	}
+
+	openvcd_free_writer(out);
+	free_state(&st);
+
+	return rc;
+}
@@ -0,0 +1,164 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements merging several VCD files into one timeline, for
+ * instance when a testbench dumps parts of it's hierarchy to separate files,
+ * or a long run rolls over into numbered files.
+ *
+ * Each input is read a chunk at a time by it's own scanner, and the inputs
+ * are merged with a loser tree keyed on the time of their next record, so
+ * producing a record costs O(log n) comparisons for n inputs, and only when
+ * the input it came from moves on to a new time. Memory use is a chunk per
+ * input, and nothing is sorted.
+ *
+ * Times are converted to the coarsest timescale which every input's is a
+ * whole multiple of, see openvcd_timescale_common().
+ *
+ * The merged records can either be read one at a time with
+ * openvcd_merge_next(), or written out as one VCD file with
+ * openvcd_merge_write(). In the latter, variables with the same dotted path
+ * in several inputs become one variable, so that files which continue one
+ * another are joined up.
+ */
+
+#ifndef OPENVCD_MERGE_H
+#define OPENVCD_MERGE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "parser.h"
+#include "scan.h"
+#include "wave.h"
+#include "writer.h"
+
+/**** TYPES ******************************************************************/
+
+typedef struct {
+	openvcd_parser* p;
+
+	/* the declarations of the input, without any changes */
+	openvcd_wave* w;
+
+	/* times are multiplied by this to put them in the merged timescale */
+	uint64_t scale;
+
+	/* the chunk being scanned */
+	openvcd_scanner scanner;
+	char* buffer;
+	size_t length;
+	size_t capacity;
+
+	/* bytes of the value change section read so far */
+	size_t consumed;
+
+	/* the input's next record, if it has one, which points into it's
+	 * buffer */
+	bool has_head;
+	openvcd_change head;
+} openvcd_merge_input;
+
+typedef struct {
+	openvcd_merge_input* inputs;
+	size_t ninputs;
+
+	/* the merged timescale */
+	openvcd_timescale timescale;
+
+	/* The loser tree. tree[0] is the input with the earliest next record,
+	 * and tree[1] to tree[ninputs - 1] are the losers at each node. */
+	size_t* tree;
+
+	/* true if the head of tree[0] has been returned, and should be moved
+	 * past before the next record is found */
+	bool returned;
+
+	/* the latest time returned */
+	bool has_time;
+	uint64_t time;
+
+	/* only meaningful after a failure */
+	char* error_string;
+} openvcd_merge;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Start merging some VCD files.
+ *
+ * The declarations of every input are read. The parsers must not have read
+ * anything yet, and are not free-ed with the merge.
+ *
+ * @param parsers
+ * @param n At least 1.
+ *
+ * Every input must have a valid $timescale, so that their times can be put
+ * in a common timescale.
+ *
+ * @return The new merge, which should be free-ed with openvcd_free_merge(),
+ * or NULL on failure, in which case the details are in the parser of the
+ * input which caused it, or the first parser if no input did, with it's
+ * state set to OPENVCD_PARSER_STATE_ERROR.
+ */
+openvcd_merge* openvcd_new_merge(openvcd_parser** parsers, size_t n);
+
+/**
+ * @brief Free a merge.
+ *
+ * @param m
+ */
+void openvcd_free_merge(openvcd_merge* m);
+
+/**
+ * @brief Read the next record of the merged timeline.
+ *
+ * Records come in time order, and those at the same time in the order of
+ * the inputs. A time record is only returned when the time moves forward,
+ * rather than once for each input. Commands such as $dumpvars are passed
+ * through as they are.
+ *
+ * The record's time is in the merged timescale, and it's identifier code is
+ * that of the input it came from. It points into the input's buffer, and is
+ * only valid until the next call.
+ *
+ * @param m
+ * @param input Set to the index of the input the record came from.
+ * @param c
+ *
+ * @return 1 if a record was read, 0 at the end of every input, or -1 on
+ * failure, in which case the details are in m->error_string.
+ */
+int openvcd_merge_next(openvcd_merge* m, size_t* input, openvcd_change* c);
+
+/**
+ * @brief Write the whole merged timeline to a stream as one VCD file.
+ *
+ * The hierarchies of the inputs are combined, with scopes and variables of
+ * the same dotted path becoming one. Variables which are combined must have
+ * the same width. The version of the first input is kept. Commands in the
+ * inputs are dropped, since the $dumpvars of one input would otherwise
+ * enclose the changes of another.
+ *
+ * No records may have been read with openvcd_merge_next() yet.
+ *
+ * @param m
+ * @param stream
+ *
+ * @return 0 on success, or -1 on failure, in which case the details are in
+ * m->error_string.
+ */
+int openvcd_merge_write(openvcd_merge* m, FILE* stream);
+
+#endif /* OPENVCD_MERGE_H */
@@ -0,0 +1,420 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "merge.h"
+
+/* top.a toggles every ns */
+static const char* input_a =
+	"$version first $end\n"
+	"$timescale 1ns $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 ! a $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\n$dumpvars\n0!\n$end\n#1\n1!\n#2\n0!\n#3\n1!\n";
+
+/* top.sub.b counts every 500ps, and top.a is declared with it */
+static const char* input_b =
+	"$timescale 100ps $end\n"
+	"$scope module top $end\n"
+	"$scope module sub $end\n"
+	"$var reg 4 ! b [3:0] $end\n"
+	"$var reg 4 ! c [3:0] $end\n"
+	"$upscope $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\nb0 !\n#5\nb1 !\n#10\nb10 !\n#15\nb11 !\n#40\n";
+
+/* merge some inputs as a VCD file, and load the result */
+static openvcd_wave* merge(const char** inputs, size_t n) {
+	openvcd_parser* parsers[4];
+	openvcd_merge* m;
+	openvcd_wave* w;
+	char* output;
+	size_t length;
+	FILE* f;
+
+	for (size_t i = 0 ; i < n ; i++) { parsers[i] = string_parser(inputs[i], strlen(inputs[i])); }
+	m = openvcd_new_merge(parsers, n);
+	should_not_be_null(m);
+
+	f = open_memstream(&output, &length);
+	should_not_be_null(f);
+	should_equal(openvcd_merge_write(m, f), 0);
+	fclose(f);
+	openvcd_free_merge(m);
+	for (size_t i = 0 ; i < n ; i++) { openvcd_free_parser(parsers[i]); }
+
+	w = load_buffer(output, length);
+	free(output);
+
+	return w;
+}
+
+void test_merge_next(void) {
+	openvcd_parser* parsers[2];
+	openvcd_merge* m;
+	openvcd_change c;
+	uint64_t times[32];
+	size_t inputs[32];
+	size_t ntimes;
+	size_t nchanges;
+	size_t input;
+	int rc;
+
+	parsers[0] = string_parser(input_a, strlen(input_a));
+	parsers[1] = string_parser(input_b, strlen(input_b));
+	m = openvcd_new_merge(parsers, 2);
+	should_not_be_null(m);
+	should_equal(m->timescale.u, openvcd_unit_ps);
+	should_equal(m->timescale.n, 100);
+
+	ntimes = 0;
+	nchanges = 0;
+	while ((rc = openvcd_merge_next(m, &input, &c)) == 1) {
+		if (c.type == OPENVCD_CHANGE_TIME) {
+			times[ntimes++] = c.time;
+		} else if (c.type != OPENVCD_CHANGE_COMMAND) {
+			inputs[nchanges++] = input;
+		}
+	}
+	should_equal(rc, 0);
+
+	/* each time once, in the merged timescale */
+	should_equal(ntimes, 7);
+	should_equal(times[0], 0);
+	should_equal(times[1], 5);
+	should_equal(times[2], 10);
+	should_equal(times[3], 15);
+	should_equal(times[4], 20);
+	should_equal(times[5], 30);
+	should_equal(times[6], 40);
+
+	/* changes at the same time come in the order of the inputs */
+	should_equal(nchanges, 8);
+	should_equal(inputs[0], 0);
+	should_equal(inputs[1], 1);
+	should_equal(inputs[2], 1);
+	should_equal(inputs[3], 0);
+	should_equal(inputs[4], 1);
+
+	/* and it stays at the end */
+	should_equal(openvcd_merge_next(m, &input, &c), 0);
+
+	openvcd_free_merge(m);
+	openvcd_free_parser(parsers[0]);
+	openvcd_free_parser(parsers[1]);
+}
+
+void test_merge_write(void) {
+	const char* inputs[] = { input_a, input_b };
+	openvcd_scope* top;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	uint64_t aval[1];
+	uint64_t bval[1];
+
+	w = merge(inputs, 2);
+	should_equal(w->timescale.u, openvcd_unit_ps);
+	should_equal(w->timescale.n, 100);
+	should_equal(strcmp(w->version, "first"), 0);
+	should_equal(w->end_time, 40);
+
+	top = child(w->root, "top");
+	should_not_be_null(top);
+	should_equal(kh_size(top->child_variables), 1);
+	should_not_be_null(child(top, "sub"));
+
+	/* b and c still share a signal */
+	should_equal(w->signals.length, 2);
+
+	s = find_width(w, 1);
+	should_not_be_null(s);
+	should_be_true(openvcd_value_at(s, 19, aval, bval));
+	should_equal(aval[0], 1);
+	should_be_true(openvcd_value_at(s, 20, aval, bval));
+	should_equal(aval[0], 0);
+
+	s = find_width(w, 4);
+	should_not_be_null(s);
+	should_be_true(openvcd_value_at(s, 14, aval, bval));
+	should_equal(aval[0], 2);
+	should_be_true(openvcd_value_at(s, 40, aval, bval));
+	should_equal(aval[0], 3);
+
+	openvcd_free_wave(w);
+}
+
+void test_merge_rollover(void) {
+	const char* inputs[] = {
+		"$timescale 1ns $end\n$scope module top $end\n$var wire 1 ! clk $end\n"
+		"$upscope $end\n$enddefinitions $end\n#0\n0!\n#10\n1!\n#20\n0!\n",
+		"$timescale 1ns $end\n$scope module top $end\n$var wire 1 x clk $end\n"
+		"$upscope $end\n$enddefinitions $end\n#30\n1x\n#40\n0x\n",
+	};
+	openvcd_signal* s;
+	openvcd_wave* w;
+	uint64_t aval[1];
+	uint64_t bval[1];
+
+	/* the same variable in files which follow on is joined up, even if
+	 * it's code differs */
+	w = merge(inputs, 2);
+	should_equal(w->signals.length, 1);
+	s = w->signals.data[0];
+	should_equal(s->change_count, 5);
+	should_be_true(openvcd_value_at(s, 35, aval, bval));
+	should_equal(aval[0], 1);
+	should_equal(w->end_time, 40);
+	openvcd_free_wave(w);
+}
+
+void test_merge_stream(void) {
+	openvcd_input_source source;
+	openvcd_parser* parsers[2];
+	openvcd_merge* m;
+	openvcd_change c;
+	uint64_t last;
+	size_t counts[2];
+	size_t input;
+	FILE* files[2];
+	int steps;
+	int rc;
+
+	/* enough changes that the inputs are read in several chunks */
+	steps = (3 * OPENVCD_LOAD_CHUNK_SIZE) / 16;
+	for (size_t i = 0 ; i < 2 ; i++) {
+		files[i] = tmpfile();
+		should_not_be_null(files[i]);
+		fprintf(files[i], "$timescale 1ns $end\n$scope module top $end\n"
+			"$var wire 1 ! s%lu $end\n$upscope $end\n$enddefinitions $end\n",
+			(unsigned long) i);
+		for (int t = 0 ; t < steps ; t++) {
+			fprintf(files[i], "#%d\n%d!\n", (2 * t) + (int) i, t % 2);
+		}
+		rewind(files[i]);
+
+		source.input_stream = files[i];
+		parsers[i] = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+		should_not_be_null(parsers[i]);
+	}
+
+	m = openvcd_new_merge(parsers, 2);
+	should_not_be_null(m);
+
+	counts[0] = 0;
+	counts[1] = 0;
+	last = 0;
+	while ((rc = openvcd_merge_next(m, &input, &c)) == 1) {
+		should_be_true(c.time >= last);
+		last = c.time;
+		if (c.type == OPENVCD_CHANGE_SCALAR) {
+			/* the inputs take turns */
+			should_equal(c.time % 2, input);
+			counts[input]++;
+		}
+	}
+	should_equal(rc, 0);
+	should_equal(counts[0], (size_t) steps);
+	should_equal(counts[1], (size_t) steps);
+	should_equal(last, (uint64_t) (2 * (steps - 1) + 1));
+
+	openvcd_free_merge(m);
+	for (size_t i = 0 ; i < 2 ; i++) {
+		openvcd_free_parser(parsers[i]);
+		fclose(files[i]);
+	}
+}
+
+/* the hierarchy is declared in the order of the inputs, with anything new in
+ * a later input after what came before it */
+void test_merge_order(void) {
+	const char* inputs[] = {
+		"$timescale 1ns $end\n$scope module top $end\n$var wire 1 ! zeta $end\n"
+		"$scope module mid $end\n$var wire 1 # inner $end\n$upscope $end\n"
+		"$var wire 1 $ alpha $end\n$upscope $end\n$enddefinitions $end\n#0\n0!\n",
+		"$timescale 1ns $end\n$scope module top $end\n$var wire 1 % beta $end\n"
+		"$var wire 1 ! zeta $end\n$upscope $end\n$enddefinitions $end\n#0\n0%\n",
+	};
+	const char* names[] = { " top ", " zeta ", " mid ", " inner ", " alpha ", " beta " };
+	openvcd_parser* parsers[2];
+	openvcd_merge* m;
+	const char* at;
+	char* output;
+	size_t length;
+	FILE* f;
+
+	for (size_t i = 0 ; i < 2 ; i++) { parsers[i] = string_parser(inputs[i], strlen(inputs[i])); }
+	m = openvcd_new_merge(parsers, 2);
+	should_not_be_null(m);
+
+	f = open_memstream(&output, &length);
+	should_not_be_null(f);
+	should_equal(openvcd_merge_write(m, f), 0);
+	fclose(f);
+
+	at = output;
+	for (size_t i = 0 ; i < sizeof(names) / sizeof(names[0]) ; i++) {
+		at = strstr(at, names[i]);
+		should_not_be_null(at);
+	}
+
+	free(output);
+	openvcd_free_merge(m);
+	for (size_t i = 0 ; i < 2 ; i++) { openvcd_free_parser(parsers[i]); }
+}
+
+/* an input which fails to read part way through */
+void test_merge_read_error(void) {
+	openvcd_input_source source;
+	openvcd_parser* parser;
+	openvcd_merge* m;
+	openvcd_change c;
+	size_t input;
+	FILE* file;
+	int rc;
+
+	file = tmpfile();
+	should_not_be_null(file);
+	fprintf(file, "$timescale 1ns $end\n$scope module top $end\n"
+		"$var wire 1 ! s $end\n$upscope $end\n$enddefinitions $end\n");
+	for (int t = 0 ; t < (3 * OPENVCD_LOAD_CHUNK_SIZE) / 8 ; t++) {
+		fprintf(file, "#%d\n%d!\n", t, t % 2);
+	}
+	rewind(file);
+
+	source.input_stream = file;
+	parser = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	should_not_be_null(parser);
+	m = openvcd_new_merge(&parser, 1);
+	should_not_be_null(m);
+
+	/* later reads of the stream fail */
+	close(fileno(file));
+	while ((rc = openvcd_merge_next(m, &input, &c)) == 1) { }
+	should_equal(rc, -1);
+	should_not_be_null(strstr(m->error_string, "failed to read input"));
+	parser_should_error(parser);
+
+	openvcd_free_merge(m);
+	openvcd_free_parser(parser);
+	fclose(file);
+}
+
+void test_merge_errors(void) {
+	const char* inputs[] = {
+		input_a,
+		"$timescale 1ns $end\n$scope module top $end\n$var wire 2 ! a $end\n"
+		"$upscope $end\n$enddefinitions $end\n#0\nb0 !\n",
+		"$timescale 1ns $end\n$scope module top $end\n$var wire 1 ! a $end\n"
+		"$upscope $end\n$enddefinitions $end\n#0\n2!\n",
+		"$timescale 1ns $end\n$scope module top $end\n$var wire 1 ! a $end\n"
+		"$upscope $end\n#0\n1!\n",
+		"$scope module top $end\n$var wire 1 ! a $end\n"
+		"$upscope $end\n$enddefinitions $end\n#0\n1!\n",
+		"$timescale 1ns $end\n$scope module top $end\n$var wire 1 ! a $end\n"
+		"$upscope $end\n$enddefinitions $end\n#0\n1!\n#x\n0!\n",
+		"$timescale 1s $end\n$scope module top $end\n$var wire 1 ! a $end\n"
+		"$upscope $end\n$enddefinitions $end\n#0\n1!\n#100000\n0!\n",
+		"$timescale 1fs $end\n$scope module top $end\n$var wire 1 ! a $end\n"
+		"$upscope $end\n$enddefinitions $end\n#0\n1!\n",
+	};
+	openvcd_parser* parsers[2];
+	openvcd_merge* m;
+	char expect[64];
+	char* output;
+	size_t length;
+	FILE* f;
+
+	f = open_memstream(&output, &length);
+	should_not_be_null(f);
+
+	/* top.a has different widths */
+	parsers[0] = string_parser(inputs[0], strlen(inputs[0]));
+	parsers[1] = string_parser(inputs[1], strlen(inputs[1]));
+	m = openvcd_new_merge(parsers, 2);
+	should_not_be_null(m);
+	should_equal(openvcd_merge_write(m, f), -1);
+	should_not_be_null(strstr(m->error_string, "widths"));
+	openvcd_free_merge(m);
+	openvcd_free_parser(parsers[0]);
+	openvcd_free_parser(parsers[1]);
+
+	/* a bad value change in the second input */
+	parsers[0] = string_parser(inputs[0], strlen(inputs[0]));
+	parsers[1] = string_parser(inputs[2], strlen(inputs[2]));
+	m = openvcd_new_merge(parsers, 2);
+	should_not_be_null(m);
+	should_equal(openvcd_merge_write(m, f), -1);
+	should_not_be_null(strstr(m->error_string, "input 1"));
+	parser_should_error(parsers[1]);
+	openvcd_free_merge(m);
+	openvcd_free_parser(parsers[0]);
+	openvcd_free_parser(parsers[1]);
+
+	/* a bad time record in the second input, reported where it is */
+	snprintf(expect, sizeof(expect), "error at byte %lu,", (unsigned long) (strstr(inputs[5], "#x") - inputs[5]));
+	parsers[0] = string_parser(inputs[0], strlen(inputs[0]));
+	parsers[1] = string_parser(inputs[5], strlen(inputs[5]));
+	m = openvcd_new_merge(parsers, 2);
+	should_not_be_null(m);
+	should_equal(openvcd_merge_write(m, f), -1);
+	parser_should_error(parsers[1]);
+	should_equal(strncmp(parsers[1]->error_string, expect, strlen(expect)), 0);
+	openvcd_free_merge(m);
+	openvcd_free_parser(parsers[0]);
+	openvcd_free_parser(parsers[1]);
+
+	/* a time which is too large in the merged timescale */
+	snprintf(expect, sizeof(expect), "error at byte %lu,", (unsigned long) (strstr(inputs[6], "#100000") - inputs[6]));
+	parsers[0] = string_parser(inputs[6], strlen(inputs[6]));
+	parsers[1] = string_parser(inputs[7], strlen(inputs[7]));
+	m = openvcd_new_merge(parsers, 2);
+	should_not_be_null(m);
+	should_equal(openvcd_merge_write(m, f), -1);
+	should_not_be_null(strstr(m->error_string, "input 0"));
+	parser_should_error(parsers[0]);
+	should_equal(strncmp(parsers[0]->error_string, expect, strlen(expect)), 0);
+	openvcd_free_merge(m);
+	openvcd_free_parser(parsers[0]);
+	openvcd_free_parser(parsers[1]);
+
+	/* a bad header */
+	parsers[0] = string_parser(inputs[0], strlen(inputs[0]));
+	parsers[1] = string_parser(inputs[3], strlen(inputs[3]));
+	should_be_null(openvcd_new_merge(parsers, 2));
+	parser_should_error(parsers[1]);
+	openvcd_free_parser(parsers[0]);
+	openvcd_free_parser(parsers[1]);
+
+	/* an input with no timescale */
+	parsers[0] = string_parser(inputs[0], strlen(inputs[0]));
+	parsers[1] = string_parser(inputs[4], strlen(inputs[4]));
+	should_be_null(openvcd_new_merge(parsers, 2));
+	should_be_false(parsers[0]->state == OPENVCD_PARSER_STATE_ERROR);
+	parser_should_error(parsers[1]);
+	should_not_be_null(strstr(parsers[1]->error_string, "$timescale"));
+	openvcd_free_parser(parsers[0]);
+	openvcd_free_parser(parsers[1]);
+
+	fclose(f);
+	free(output);
+}
+
+int main(void) {
+	test_merge_next();
+	test_merge_write();
+	test_merge_rollover();
+	test_merge_stream();
+	test_merge_order();
+	test_merge_read_error();
+	test_merge_errors();
+	return 0;
+}
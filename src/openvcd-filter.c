@@ -0,0 +1,106 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/*
+ * openvcd-filter copies the given variables and scopes of a VCD file, and
+ * their changes between two times, to a new VCD file. See filter.h.
+ *
+ *	openvcd-filter [-f FROM] [-t TO] [-o OUTPUT] INPUT [PATH...]
+ *
+ * INPUT may be - to read standard input, and the output is written to
+ * standard output unless -o is given.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "filter.h"
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-f FROM] [-t TO] [-o OUTPUT] INPUT [PATH...]\n", name);
+}
+
+static bool parse_time(const char* s, uint64_t* t) {
+	char* end;
+
+	*t = strtoull(s, &end, 10);
+	return (*s != '\0') && (*end == '\0');
+}
+
+int main(int argc, char** argv) {
+	openvcd_filter_options o;
+	openvcd_input_source source;
+	openvcd_parser* p;
+	const char* output;
+	FILE* in;
+	FILE* out;
+	int opt;
+	int rc;
+
+	openvcd_init_filter_options(&o);
+	output = NULL;
+
+	while ((opt = getopt(argc, argv, "f:t:o:h")) != -1) {
+		switch (opt) {
+			case 'f':
+				if (!parse_time(optarg, &o.from)) { usage(argv[0]); return 1; }
+				break;
+			case 't':
+				if (!parse_time(optarg, &o.to)) { usage(argv[0]); return 1; }
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	in = (strcmp(argv[optind], "-") == 0) ? stdin : fopen(argv[optind], "r");
+	if (in == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	out = (output == NULL) ? stdout : fopen(output, "w");
+	if (out == NULL) {
+		perror(output);
+		if (in != stdin) { fclose(in); }
+		return 1;
+	}
+
+	o.signals = (const char**) (argv + optind + 1);
+	o.nsignals = (size_t) (argc - optind - 1);
+
+	source.input_stream = in;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	if (p == NULL) {
+		fprintf(stderr, "%s: failed to allocate parser\n", argv[optind]);
+		rc = 1;
+	} else {
+		rc = 0;
+		if (openvcd_filter(p, &o, out) != 0) {
+			fprintf(stderr, "%s: %s\n", argv[optind], p->error_string);
+			rc = 1;
+		}
+		openvcd_free_parser(p);
+	}
+
+	if ((out != stdout) && (fclose(out) != 0)) {
+		perror(output);
+		rc = 1;
+	}
+	if (in != stdin) { fclose(in); }
+
+	return rc;
+}
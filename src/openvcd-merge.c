@@ -0,0 +1,123 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/*
+ * openvcd-merge merges several VCD files into one, in time order. See
+ * merge.h.
+ *
+ *	openvcd-merge [-o OUTPUT] INPUT...
+ *
+ * One INPUT may be - to read standard input, and the output is written to
+ * standard output unless -o is given.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "merge.h"
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-o OUTPUT] INPUT...\n", name);
+}
+
+int main(int argc, char** argv) {
+	openvcd_input_source source;
+	openvcd_parser** parsers;
+	openvcd_merge* m;
+	const char* output;
+	FILE** in;
+	FILE* out;
+	size_t n;
+	int opt;
+	int rc;
+
+	output = NULL;
+
+	while ((opt = getopt(argc, argv, "o:h")) != -1) {
+		switch (opt) {
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	n = (size_t) (argc - optind);
+	in = calloc(n, sizeof(FILE*));
+	parsers = calloc(n, sizeof(openvcd_parser*));
+	if ((in == NULL) || (parsers == NULL)) {
+		fprintf(stderr, "%s: failed to allocate inputs\n", argv[0]);
+		free(in);
+		free(parsers);
+		return 1;
+	}
+
+	rc = 0;
+	for (size_t i = 0 ; (i < n) && (rc == 0) ; i++) {
+		in[i] = (strcmp(argv[optind + i], "-") == 0) ? stdin : fopen(argv[optind + i], "r");
+		if (in[i] == NULL) {
+			perror(argv[optind + i]);
+			rc = 1;
+			break;
+		}
+
+		source.input_stream = in[i];
+		parsers[i] = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+		if (parsers[i] == NULL) {
+			fprintf(stderr, "%s: failed to allocate parser\n", argv[optind + i]);
+			rc = 1;
+		}
+	}
+
+	out = NULL;
+	if (rc == 0) {
+		out = (output == NULL) ? stdout : fopen(output, "w");
+		if (out == NULL) {
+			perror(output);
+			rc = 1;
+		}
+	}
+
+	if (rc == 0) {
+		m = openvcd_new_merge(parsers, n);
+		if (m == NULL) {
+			for (size_t i = 0 ; i < n ; i++) {
+				if (parsers[i]->state != OPENVCD_PARSER_STATE_ERROR) { continue; }
+				fprintf(stderr, "%s: %s\n", argv[optind + i], parsers[i]->error_string);
+				break;
+			}
+			rc = 1;
+		} else {
+			if (openvcd_merge_write(m, out) != 0) {
+				fprintf(stderr, "%s: %s\n", argv[0], m->error_string);
+				rc = 1;
+			}
+			openvcd_free_merge(m);
+		}
+	}
+
+	if ((out != NULL) && (out != stdout) && (fclose(out) != 0)) {
+		perror(output);
+		rc = 1;
+	}
+
+	for (size_t i = 0 ; i < n ; i++) {
+		if (parsers[i] != NULL) { openvcd_free_parser(parsers[i]); }
+		if ((in[i] != NULL) && (in[i] != stdin)) { fclose(in[i]); }
+	}
+	free(parsers);
+	free(in);
+
+	return rc;
+}
@@ -0,0 +1,120 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/*
+ * openvcd-serve loads waveforms and answers queries about them over a UNIX
+ * domain socket until it is interrupted, see serve.h.
+ *
+ *	openvcd-serve [-j THREADS] SOCKET FILE...
+ *
+ * The files are loaded with THREADS threads, by default one per CPU. Files
+ * which can't be loaded are reported, and their queries answered with
+ * OPENVCD_STATUS_NOT_FOUND.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "serve.h"
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-j THREADS] SOCKET FILE...\n", name);
+}
+
+/* stop the server on SIGINT or SIGTERM, which are blocked in every thread */
+static void* wait_for_signal(void* arg) {
+	sigset_t signals;
+	int sig;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigwait(&signals, &sig);
+
+	openvcd_server_stop((openvcd_server*) arg);
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	openvcd_collection* c;
+	unsigned int nthreads;
+	openvcd_server* s;
+	pthread_t waiter;
+	sigset_t signals;
+	char* end;
+	int opt;
+	int rc;
+
+	nthreads = 0;
+	while ((opt = getopt(argc, argv, "j:h")) != -1) {
+		if (opt == 'j') {
+			nthreads = (unsigned int) strtoul(optarg, &end, 10);
+			if ((*optarg != '\0') && (*end == '\0')) { continue; }
+		}
+		usage(argv[0]);
+		return (opt == 'h') ? 0 : 1;
+	}
+
+	if (optind > argc - 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	c = openvcd_load_collection((const char**) (argv + optind + 1), (size_t) (argc - optind - 1), nthreads);
+	if (c == NULL) {
+		fprintf(stderr, "failed to load the files\n");
+		return 1;
+	}
+	for (size_t i = 0 ; i < c->nentries ; i++) {
+		if (c->entries[i].wave == NULL) {
+			fprintf(stderr, "%s: %s\n", c->entries[i].path, c->entries[i].error_string);
+		}
+	}
+
+	s = openvcd_new_server(c);
+	if (s == NULL) {
+		fprintf(stderr, "failed to allocate server\n");
+		openvcd_free_collection(c);
+		return 1;
+	}
+
+	if (openvcd_server_listen(s, argv[optind]) != 0) {
+		perror(argv[optind]);
+		openvcd_free_server(s);
+		openvcd_free_collection(c);
+		return 1;
+	}
+
+	/* blocked before any thread is created, so that only the waiter gets
+	 * them */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	if (pthread_create(&waiter, NULL, wait_for_signal, s) != 0) {
+		fprintf(stderr, "failed to start thread\n");
+		openvcd_free_server(s);
+		openvcd_free_collection(c);
+		return 1;
+	}
+
+	rc = 0;
+	if (openvcd_server_run(s) != 0) {
+		perror(argv[optind]);
+		rc = 1;
+
+		/* wake up the waiter */
+		pthread_kill(waiter, SIGTERM);
+	}
+	pthread_join(waiter, NULL);
+
+	openvcd_free_server(s);
+	openvcd_free_collection(c);
+
+	return rc;
+}
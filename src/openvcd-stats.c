@@ -0,0 +1,139 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/*
+ * openvcd-stats prints the activity of every variable and scope of a VCD
+ * file, see stats.h.
+ *
+ *	openvcd-stats [-s] INPUT
+ *
+ * Each line is a dotted path followed by the number of changes, the number
+ * of toggles, the time spent at 0, 1, z and x, and the times of the first
+ * and last changes, separated by tabs. The lines for scopes are the totals
+ * of everything in them. With -s, only scopes are printed. INPUT may be - to
+ * read standard input.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s [-s] INPUT\n", name);
+}
+
+static void print_activity(const char* path, const openvcd_activity* a) {
+	printf("%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64,
+		path, a->changes, a->toggles,
+		a->time[OPENVCD_STATE_0], a->time[OPENVCD_STATE_1],
+		a->time[OPENVCD_STATE_Z], a->time[OPENVCD_STATE_X]);
+	if (a->changes > 0) {
+		printf("\t%" PRIu64 "\t%" PRIu64 "\n", a->first_change, a->last_change);
+	} else {
+		printf("\t-\t-\n");
+	}
+}
+
+static void print_var(openvcd_stats* st, const openvcd_var* v, const char* prefix) {
+	const openvcd_activity* a;
+	const char* name;
+	char* path;
+
+	a = openvcd_stats_signal(st, v->identifier_code);
+	if (a == NULL) { return; }
+
+	name = (v->reference != NULL) ? v->reference->identifier : v->identifier_code;
+	if (asprintf(&path, "%s.%s", prefix, name) < 0) { return; }
+	print_activity(path, a);
+	free(path);
+}
+
+static void print_scope(openvcd_stats* st, const openvcd_scope* s, const char* prefix, bool scopes_only) {
+	openvcd_activity total;
+	openvcd_scope* child;
+	openvcd_var* v;
+	const char* key;
+	char* path;
+
+	OPENVCD_UNUSED(key);
+
+	if (asprintf(&path, "%s%s%s", prefix, (*prefix == '\0') ? "" : ".", s->identifier) < 0) {
+		return;
+	}
+
+	openvcd_stats_scope(st, s, &total);
+	print_activity(path, &total);
+
+	if (!scopes_only) {
+		kh_foreach(s->child_variables, key, v, print_var(st, v, path););
+	}
+	kh_foreach(s->child_scopes, key, child, print_scope(st, child, path, scopes_only););
+
+	free(path);
+}
+
+int main(int argc, char** argv) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_stats* st;
+	openvcd_scope* child;
+	const char* key;
+	bool scopes_only;
+	FILE* in;
+	int opt;
+	int rc;
+
+	OPENVCD_UNUSED(key);
+
+	scopes_only = false;
+
+	while ((opt = getopt(argc, argv, "sh")) != -1) {
+		switch (opt) {
+			case 's':
+				scopes_only = true;
+				break;
+			default:
+				usage(argv[0]);
+				return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	in = (strcmp(argv[optind], "-") == 0) ? stdin : fopen(argv[optind], "r");
+	if (in == NULL) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	source.input_stream = in;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	if (p == NULL) {
+		fprintf(stderr, "%s: failed to allocate parser\n", argv[optind]);
+		rc = 1;
+	} else {
+		st = openvcd_collect_stats(p);
+		if (st == NULL) {
+			fprintf(stderr, "%s: %s\n", argv[optind], p->error_string);
+			rc = 1;
+		} else {
+			kh_foreach(st->w->root->child_scopes, key, child, print_scope(st, child, "", scopes_only););
+			openvcd_free_stats(st);
+			rc = 0;
+		}
+		openvcd_free_parser(p);
+	}
+
+	if (in != stdin) { fclose(in); }
+
+	return rc;
+}
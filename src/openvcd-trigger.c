@@ -0,0 +1,105 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/*
+ * openvcd-trigger prints the intervals of time during which a trigger
+ * expression holds, see trigger.h.
+ *
+ *	openvcd-trigger EXPRESSION INPUT
+ *
+ * Each line is the start and end of an interval separated by a tab, with -
+ * as the end of an interval which lasts to the end of the input. INPUT may
+ * be - to read standard input.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "trigger.h"
+
+static void usage(const char* name) {
+	fprintf(stderr, "usage: %s EXPRESSION INPUT\n", name);
+}
+
+static int print_intervals(openvcd_wave* w, const char* expression) {
+	openvcd_interval* intervals;
+	openvcd_trigger* t;
+	char* error;
+	long n;
+
+	t = openvcd_compile_trigger(w, expression, &error);
+	if (t == NULL) {
+		fprintf(stderr, "%s: %s\n", expression, (error != NULL) ? error : "out of memory");
+		free(error);
+		return 1;
+	}
+
+	n = openvcd_trigger_intervals(t, &intervals);
+	openvcd_free_trigger(t);
+	if (n < 0) {
+		fprintf(stderr, "%s: failed to evaluate\n", expression);
+		return 1;
+	}
+
+	for (long i = 0 ; i < n ; i++) {
+		if (intervals[i].end == UINT64_MAX) {
+			printf("%" PRIu64 "\t-\n", intervals[i].start);
+		} else {
+			printf("%" PRIu64 "\t%" PRIu64 "\n", intervals[i].start, intervals[i].end);
+		}
+	}
+	free(intervals);
+
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	FILE* in;
+	int opt;
+	int rc;
+
+	while ((opt = getopt(argc, argv, "h")) != -1) {
+		usage(argv[0]);
+		return (opt == 'h') ? 0 : 1;
+	}
+
+	if (optind != argc - 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	in = (strcmp(argv[optind + 1], "-") == 0) ? stdin : fopen(argv[optind + 1], "r");
+	if (in == NULL) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+
+	source.input_stream = in;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	if (p == NULL) {
+		fprintf(stderr, "%s: failed to allocate parser\n", argv[optind + 1]);
+		rc = 1;
+	} else {
+		w = openvcd_load(p);
+		if (w == NULL) {
+			fprintf(stderr, "%s: %s\n", argv[optind + 1], p->error_string);
+			rc = 1;
+		} else {
+			rc = print_intervals(w, argv[optind]);
+			openvcd_free_wave(w);
+		}
+		openvcd_free_parser(p);
+	}
+
+	if (in != stdin) { fclose(in); }
+
+	return rc;
+}
@@ -0,0 +1,398 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "parallel.h"
+
+/* the ranges to merge into a waveform's signals */
+typedef struct {
+	openvcd_wave* w;
+	openvcd_chunk* chunks;
+	size_t nchunks;
+	int rc;
+} openvcd_merge;
+
+/* true if the whole token starts at offset i of the body */
+static bool token_at(const char* body, size_t length, size_t i, const char* token) {
+	size_t n;
+
+	n = strlen(token);
+	if ((n > length - i) || (memcmp(body + i, token, n) != 0)) { return false; }
+	if ((i > 0) && !OPENVCD_IS_WHITESPACE(body[i - 1])) { return false; }
+
+	return (i + n == length) || OPENVCD_IS_WHITESPACE(body[i + n]);
+}
+
+/* the offset of the next whole token at or after from, or length if there
+ * isn't one */
+static size_t find_token(const char* body, size_t length, size_t from, const char* token) {
+	const char* found;
+
+	while (from < length) {
+		found = memmem(body + from, length - from, token, strlen(token));
+		if (found == NULL) { return length; }
+		from = (size_t) (found - body);
+		if (token_at(body, length, from, token)) { return from; }
+		from++;
+	}
+
+	return length;
+}
+
+/* where to split the body instead of at, which must be the start of a line,
+ * so as not to split a $comment block. outside is an offset before at which
+ * is not in a block, and is moved forward to at or to the end of the block
+ * which at is in. */
+static size_t skip_comment(const char* body, size_t length, size_t* outside, size_t at) {
+	size_t end;
+
+	for (;;) {
+		*outside = find_token(body, length, *outside, "$comment");
+		if (*outside >= at) {
+			*outside = at;
+			return at;
+		}
+
+		end = find_token(body, length, *outside + strlen("$comment"), "$end");
+		*outside = (end == length) ? length : end + strlen("$end");
+		if (*outside > at) { return *outside; }
+	}
+}
+
+size_t openvcd_split_body(const char* body, size_t length, size_t n, size_t* starts) {
+	const char* nl;
+	size_t outside;
+	size_t count;
+	size_t from;
+	size_t to;
+
+	if (n == 0) { return 0; }
+
+	starts[0] = 0;
+	count = 1;
+	outside = 0;
+	for (size_t k = 1 ; k < n ; k++) {
+		from = (length / n) * k;
+		if (from <= starts[count - 1]) { from = starts[count - 1] + 1; }
+
+		for (;;) {
+			/* the next line at or after from which starts with '#' */
+			while ((from < length) && !((body[from] == '#') && (body[from - 1] == '\n'))) {
+				nl = memchr(body + from, '\n', length - from);
+				if (nl == NULL) { return count; }
+				from = (size_t) (nl - body) + 1;
+			}
+			if (from >= length) { return count; }
+
+			/* which mustn't be inside a comment, or the range would
+			 * start part way through it */
+			to = skip_comment(body, length, &outside, from);
+			if (to == from) { break; }
+			from = to;
+		}
+
+		starts[count++] = from;
+	}
+
+	return count;
+}
+
+static openvcd_parser_error chunk_apply(openvcd_chunk* ch, const openvcd_change* c) {
+	const openvcd_signal* ws;
+	openvcd_signal* s;
+	size_t n;
+	bool ok;
+
+	if (c->type == OPENVCD_CHANGE_TIME) {
+		if (ch->has_time && (c->time < ch->last_time)) { return OPENVCD_ERROR_SYNTAX; }
+		if (!ch->has_time) {
+			ch->first_time = c->time;
+			ch->first_offset = c->offset;
+		}
+		ch->has_time = true;
+		ch->last_time = c->time;
+		return OPENVCD_ERROR_NONE;
+	}
+
+	if (c->type == OPENVCD_CHANGE_COMMAND) { return OPENVCD_ERROR_NONE; }
+
+	if (!openvcd_wave_signal_number(ch->w, c->id, c->id_length, &n)) {
+		return OPENVCD_ERROR_SYNTAX;
+	}
+	ws = ch->w->signals.data[n];
+
+	if (c->type == OPENVCD_CHANGE_REAL) {
+		ok = openvcd_value_parse_real(c->value, c->value_length,
+			ch->scratch_aval, ch->scratch_bval);
+	} else {
+		ok = openvcd_value_parse(c->value, c->value_length, ws->width,
+			ch->scratch_aval, ch->scratch_bval);
+	}
+	if (!ok) { return OPENVCD_ERROR_SYNTAX; }
+
+	s = ch->signals[n];
+	if (s == NULL) {
+		s = openvcd_alloc_signal(NULL, ws->width, ws->real);
+		if (s == NULL) { return OPENVCD_ERROR_ALLOC_FAILED; }
+		ch->signals[n] = s;
+	}
+
+	if (openvcd_signal_append(s, c->time, ch->scratch_aval, ch->scratch_bval) != 0) {
+		return OPENVCD_ERROR_ALLOC_FAILED;
+	}
+
+	return OPENVCD_ERROR_NONE;
+}
+
+static void scan_chunk(void* ctx, size_t i) {
+	openvcd_parser_error err;
+	openvcd_scan_status st;
+	openvcd_chunk* ch;
+	openvcd_scanner s;
+	openvcd_change c;
+
+	ch = &(((openvcd_chunk*) ctx)[i]);
+
+	openvcd_init_scanner(&s, ch->body, ch->end, true);
+	s.position = ch->start;
+
+	while ((st = openvcd_scan_next(&s, &c)) == OPENVCD_SCAN_OK) {
+		err = chunk_apply(ch, &c);
+		if (err != OPENVCD_ERROR_NONE) {
+			ch->error = err;
+			ch->error_offset = c.offset;
+			break;
+		}
+	}
+
+	if (st == OPENVCD_SCAN_ERROR) {
+		ch->error = OPENVCD_ERROR_SYNTAX;
+		ch->error_string = s.error_string;
+		ch->error_offset = s.error_offset;
+		s.error_string = NULL;
+	}
+
+	openvcd_clear_scanner(&s);
+}
+
+/* append each range's changes of signal n in turn */
+static void merge_signal(void* ctx, size_t n) {
+	openvcd_merge* m;
+	openvcd_signal* s;
+
+	m = (openvcd_merge*) ctx;
+	for (size_t i = 0 ; i < m->nchunks ; i++) {
+		s = m->chunks[i].signals[n];
+		if (s == NULL) { continue; }
+
+		if (openvcd_signal_concat(m->w->signals.data[n], s) != 0) {
+			__atomic_store_n(&(m->rc), -1, __ATOMIC_RELAXED);
+			return;
+		}
+		openvcd_free_signal(s);
+		m->chunks[i].signals[n] = NULL;
+	}
+}
+
+static unsigned int max_nwords(const openvcd_wave* w) {
+	const openvcd_signal* s;
+	unsigned int nwords;
+	int i;
+
+	nwords = 1;
+	vec_foreach(&(w->signals), s, i) {
+		if (s->nwords > nwords) { nwords = s->nwords; }
+	}
+
+	return nwords;
+}
+
+static void free_chunks(openvcd_chunk* chunks, size_t nchunks, size_t nsignals) {
+	for (size_t i = 0 ; i < nchunks ; i++) {
+		if (chunks[i].signals != NULL) {
+			for (size_t n = 0 ; n < nsignals ; n++) {
+				if (chunks[i].signals[n] != NULL) { openvcd_free_signal(chunks[i].signals[n]); }
+			}
+		}
+		free(chunks[i].signals);
+		free(chunks[i].scratch_aval);
+		free(chunks[i].scratch_bval);
+		free(chunks[i].error_string);
+	}
+	free(chunks);
+}
+
+static openvcd_chunk* alloc_chunks(const openvcd_wave* w, const char* body, size_t length, const size_t* starts, size_t nchunks) {
+	openvcd_chunk* chunks;
+	openvcd_chunk* ch;
+	unsigned int nwords;
+
+	chunks = calloc(nchunks, sizeof(openvcd_chunk));
+	if (chunks == NULL) { return NULL; }
+
+	nwords = max_nwords(w);
+	for (size_t i = 0 ; i < nchunks ; i++) {
+		ch = &(chunks[i]);
+		ch->w = w;
+		ch->body = body;
+		ch->body_length = length;
+		ch->start = starts[i];
+		ch->end = (i + 1 < nchunks) ? starts[i + 1] : length;
+		ch->signals = calloc((size_t) w->signals.length + 1, sizeof(openvcd_signal*));
+		ch->scratch_aval = malloc(nwords * sizeof(uint64_t));
+		ch->scratch_bval = malloc(nwords * sizeof(uint64_t));
+		ch->error = OPENVCD_ERROR_NONE;
+
+		if ((ch->signals == NULL) || (ch->scratch_aval == NULL) || (ch->scratch_bval == NULL)) {
+			free_chunks(chunks, i + 1, (size_t) w->signals.length);
+			return NULL;
+		}
+	}
+
+	return chunks;
+}
+
+/* find the first problem in any range, in file order */
+static bool check_chunks(openvcd_parser* p, openvcd_wave* w, const openvcd_chunk* chunks, size_t nchunks) {
+	const openvcd_chunk* ch;
+
+	for (size_t i = 0 ; i < nchunks ; i++) {
+		ch = &(chunks[i]);
+
+		/* time must not go backwards across a range boundary either */
+		if (ch->has_time && (ch->first_time < w->end_time)) {
+			openvcd_load_error(p, OPENVCD_ERROR_SYNTAX,
+				openvcd_change_error(OPENVCD_ERROR_SYNTAX), ch->first_offset);
+			return false;
+		}
+
+		/* the ranges are scanned in place, so offsets are already within
+		 * the value change section */
+		if (ch->error_string != NULL) {
+			openvcd_load_error(p, ch->error, ch->error_string, ch->error_offset);
+			return false;
+		}
+
+		if (ch->error != OPENVCD_ERROR_NONE) {
+			openvcd_load_error(p, ch->error, openvcd_change_error(ch->error), ch->error_offset);
+			return false;
+		}
+
+		if (ch->has_time) { w->end_time = ch->last_time; }
+	}
+
+	return true;
+}
+
+/* signals are merged one task each, since a few of them often hold most
+ * of the changes */
+static int merge_chunks(openvcd_pool* pool, openvcd_wave* w, openvcd_chunk* chunks, size_t nchunks) {
+	openvcd_merge m;
+
+	m.w = w;
+	m.chunks = chunks;
+	m.nchunks = nchunks;
+	m.rc = 0;
+
+	openvcd_pool_run(pool, merge_signal, &m, (size_t) w->signals.length);
+
+	return m.rc;
+}
+
+openvcd_wave* openvcd_load_parallel(openvcd_parser* p, unsigned int nthreads) {
+	openvcd_chunk* chunks;
+	openvcd_pool* pool;
+	openvcd_wave* w;
+	const char* body;
+	size_t* starts;
+	size_t nchunks;
+	size_t length;
+	bool ok;
+
+	if (p->type != OPENVCD_PARSER_STRING) { return openvcd_load(p); }
+
+	w = openvcd_load_header(p);
+	if (w == NULL) { return NULL; }
+
+	length = 0;
+	body = p->source.input_string + p->body_offset;
+	if (p->body_offset < p->input_length) {
+		length = strnlen(body, p->input_length - p->body_offset);
+	}
+
+	if (nthreads == 0) { nthreads = openvcd_processors(); }
+	if (nthreads > length / OPENVCD_PARALLEL_MIN_CHUNK) {
+		nthreads = (unsigned int) (length / OPENVCD_PARALLEL_MIN_CHUNK);
+	}
+	if (nthreads == 0) { nthreads = 1; }
+
+	starts = malloc(nthreads * sizeof(size_t));
+	if (starts == NULL) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate ranges", 0);
+		openvcd_free_wave(w);
+		return NULL;
+	}
+	nchunks = openvcd_split_body(body, length, nthreads, starts);
+
+	chunks = alloc_chunks(w, body, length, starts, nchunks);
+	free(starts);
+	if (chunks == NULL) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate ranges", 0);
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	/* without a pool, everything runs on this thread */
+	pool = openvcd_new_pool(nthreads);
+	openvcd_pool_run(pool, scan_chunk, chunks, nchunks);
+
+	ok = check_chunks(p, w, chunks, nchunks);
+	if (ok && (merge_chunks(pool, w, chunks, nchunks) != 0)) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to store value change", 0);
+		ok = false;
+	}
+	if (pool != NULL) { openvcd_free_pool(pool); }
+
+	free_chunks(chunks, nchunks, (size_t) w->signals.length);
+	if (!ok) {
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+openvcd_wave* openvcd_load_file_parallel(const char* path, unsigned int nthreads, char** error) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	char* mapping;
+	size_t length;
+
+	if (error != NULL) { *error = NULL; }
+
+	mapping = openvcd_map_file(path, &length);
+	if (mapping == NULL) {
+		if (error != NULL) { *error = strdup("failed to open file"); }
+		return NULL;
+	}
+
+	source.input_string = mapping;
+	p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, length);
+	if (p == NULL) {
+		openvcd_unmap(mapping, length);
+		return NULL;
+	}
+
+	/* the waveform owns all of it's changes, so the mapping can go */
+	w = openvcd_load_parallel(p, nthreads);
+	if ((p->state == OPENVCD_PARSER_STATE_ERROR) && (error != NULL)) {
+		*error = strdup(p->error_string);
+	}
+
+	openvcd_free_parser(p);
+	openvcd_unmap(mapping, length);
+
+	return w;
+}
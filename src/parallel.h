@@ -0,0 +1,130 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements loading of the value change section on several
+ * threads at once.
+ *
+ * When the whole input is in memory (a string, or a mapped file), the value
+ * change section is split into byte ranges, each starting at a line which
+ * begins with '#'. Since every range starts with a time record, no state
+ * needs to be carried into a range: each thread scans it's range into
+ * signals of it's own, and the signals' blocks are then concatenated in
+ * range order, which leaves every signal's changes in time order. The value
+ * of a signal before the start of a range is simply it's last change in an
+ * earlier range. $dumpoff and $dumpon only set values, so they need no
+ * special treatment either.
+ *
+ * Both steps run on a work stealing pool, with one task per range and then
+ * one task per signal.
+ *
+ * A line inside a $comment which starts with '#' would be mistaken for a
+ * range boundary, so files with such comments should be loaded with
+ * openvcd_load() instead.
+ */
+
+#ifndef OPENVCD_PARALLEL_H
+#define OPENVCD_PARALLEL_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "parser.h"
+#include "scan.h"
+#include "wave.h"
+#include "pool.h"
+
+/**** TYPES ******************************************************************/
+
+/* ranges are not made smaller than this, so small files use fewer threads */
+#define OPENVCD_PARALLEL_MIN_CHUNK (256 * 1024)
+
+/* one range of the value change section, and what was read from it */
+typedef struct {
+	const openvcd_wave* w;
+
+	/* the value change section, and the range within it */
+	const char* body;
+	size_t body_length;
+	size_t start;
+	size_t end;
+
+	/* this range's changes, indexed by signal number, NULL for signals
+	 * which don't change in the range */
+	openvcd_signal** signals;
+
+	uint64_t* scratch_aval;
+	uint64_t* scratch_bval;
+
+	/* the first and last time records in the range, and the offset of
+	 * the first within the value change section */
+	bool has_time;
+	uint64_t first_time;
+	uint64_t last_time;
+	size_t first_offset;
+
+	/* set if the range could not be read, with the offset of the
+	 * problem within the value change section */
+	openvcd_parser_error error;
+	char* error_string;
+	size_t error_offset;
+} openvcd_chunk;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Split the value change section into ranges starting at time records.
+ *
+ * Lines inside a $comment block which look like time records are not split
+ * at, so that each range can be scanned on it's own.
+ *
+ * @param body
+ * @param length
+ * @param n The maximum number of ranges.
+ * @param starts Set to the start of each range, must have room for n.
+ *
+ * @return The number of ranges, each ending where the next one starts and
+ * the last one ending at length.
+ */
+size_t openvcd_split_body(const char* body, size_t length, size_t n, size_t* starts);
+
+/**
+ * @brief Load a complete VCD file into a new waveform, on several threads.
+ *
+ * This is the same as openvcd_load(), except that the value change section
+ * is read using up to nthreads threads. Only string parsers can be loaded in
+ * parallel, and other parsers are loaded with openvcd_load().
+ *
+ * @param p
+ * @param nthreads The number of threads, or 0 to use one per processor.
+ *
+ * @return The new waveform, or NULL on error.
+ */
+openvcd_wave* openvcd_load_parallel(openvcd_parser* p, unsigned int nthreads);
+
+/**
+ * @brief Load a VCD file into a new waveform, on several threads.
+ *
+ * The file is mapped into memory, and loaded with openvcd_load_parallel().
+ *
+ * @param path
+ * @param nthreads
+ * @param error If not NULL, set on failure to a message describing the
+ * problem which must be free-ed, or NULL if memory ran out.
+ *
+ * @return The new waveform, or NULL on error.
+ */
+openvcd_wave* openvcd_load_file_parallel(const char* path, unsigned int nthreads, char** error);
+
+#endif /* OPENVCD_PARALLEL_H */
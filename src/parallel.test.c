@@ -0,0 +1,253 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "parallel.h"
+
+void test_split_body(void) {
+	const char* body;
+	size_t starts[8];
+	size_t n;
+
+	body = "#0\n1!\n#10\n0!\n$comment x $end\n#20\n1!\n#30\n";
+
+	/* every range starts with a time record */
+	n = openvcd_split_body(body, strlen(body), 4, starts);
+	should_be_true(n > 1);
+	should_be_true(n <= 4);
+	should_equal(starts[0], 0);
+	for (size_t i = 1 ; i < n ; i++) {
+		should_be_true(starts[i] > starts[i - 1]);
+		should_equal(body[starts[i]], '#');
+		should_equal(body[starts[i] - 1], '\n');
+	}
+
+	should_equal(openvcd_split_body(body, strlen(body), 1, starts), 1);
+	should_equal(openvcd_split_body(body, strlen(body), 0, starts), 0);
+
+	/* nor inside a comment, even where a line of it looks like a time */
+	body = "#0\n$comment\n#5\n#6 $end\n#10\n1!\n$comment x\n#15\n";
+	n = openvcd_split_body(body, strlen(body), 8, starts);
+	should_equal(n, 2);
+	should_equal(starts[1], strlen("#0\n$comment\n#5\n#6 $end\n"));
+
+	/* there's nowhere to split a body with only one time record */
+	should_equal(openvcd_split_body("#0\n1!\n0!\n", 9, 8, starts), 1);
+	should_equal(openvcd_split_body("", 0, 8, starts), 1);
+}
+
+void test_load_parallel(void) {
+	openvcd_parser* p;
+	openvcd_wave* expect;
+	openvcd_wave* w;
+	unsigned int threads[] = {1, 2, 3, 4, 7, 0};
+	char* buffer;
+	size_t length;
+
+	buffer = make_vcd(40, 30000, &length);
+	should_be_true(length > 4 * OPENVCD_PARALLEL_MIN_CHUNK);
+
+	p = string_parser(buffer, length);
+	expect = openvcd_load(p);
+	check_parser_error(p);
+	openvcd_free_parser(p);
+
+	for (size_t i = 0 ; i < sizeof(threads) / sizeof(threads[0]) ; i++) {
+		p = string_parser(buffer, length);
+		w = openvcd_load_parallel(p, threads[i]);
+		check_parser_error(p);
+		should_not_be_null(w);
+		check_same(expect, w);
+		openvcd_free_wave(w);
+		openvcd_free_parser(p);
+	}
+
+	openvcd_free_wave(expect);
+	free(buffer);
+}
+
+/* a comment which spans where the body would be split, with lines in it
+ * which look like time records */
+void test_load_parallel_comment(void) {
+	openvcd_parser* p;
+	openvcd_wave* expect;
+	openvcd_wave* w;
+	char* buffer;
+	size_t length;
+	FILE* f;
+
+	f = open_memstream(&buffer, &length);
+	should_not_be_null(f);
+	fprintf(f, "$timescale 1ns $end\n$scope module top $end\n$var wire 1 c clk $end\n"
+		"$upscope $end\n$enddefinitions $end\n");
+	for (int t = 0 ; t < 60000 ; t++) { fprintf(f, "#%d\n%dc\n", t, t % 2); }
+	fprintf(f, "$comment\n");
+	for (int i = 0 ; i < 60000 ; i++) { fprintf(f, "#oops %d\n", i); }
+	fprintf(f, "$end\n");
+	for (int t = 60000 ; t < 120000 ; t++) { fprintf(f, "#%d\n%dc\n", t, t % 2); }
+	fclose(f);
+	should_be_true(length > 4 * OPENVCD_PARALLEL_MIN_CHUNK);
+
+	p = string_parser(buffer, length);
+	expect = openvcd_load(p);
+	check_parser_error(p);
+	openvcd_free_parser(p);
+
+	for (unsigned int threads = 2 ; threads <= 8 ; threads++) {
+		p = string_parser(buffer, length);
+		w = openvcd_load_parallel(p, threads);
+		check_parser_error(p);
+		should_not_be_null(w);
+		check_same(expect, w);
+		openvcd_free_wave(w);
+		openvcd_free_parser(p);
+	}
+
+	openvcd_free_wave(expect);
+	free(buffer);
+}
+
+/* errors are reported the same way as by openvcd_load() */
+void test_load_parallel_errors(void) {
+	openvcd_parser* p;
+	openvcd_wave* w;
+	char* expect;
+	char* buffer;
+	char* saved;
+	char* bad;
+	size_t starts[2];
+	size_t length;
+	size_t body;
+
+	buffer = make_vcd(10, 40000, &length);
+	should_be_true(openvcd_find_body(buffer, length, &body));
+	should_be_true(length - body > 2 * OPENVCD_PARALLEL_MIN_CHUNK);
+	should_equal(openvcd_split_body(buffer + body, length - body, 2, starts), 2);
+	saved = strdup(buffer);
+
+	/* time goes backwards right at the start of the second range */
+	for (size_t i = body + starts[1] + 1 ; buffer[i] != '\n' ; i++) {
+		buffer[i] = '0';
+	}
+
+	p = string_parser(buffer, length);
+	should_be_null(openvcd_load(p));
+	parser_should_error(p);
+	expect = strdup(p->error_string);
+	openvcd_free_parser(p);
+
+	p = string_parser(buffer, length);
+	w = openvcd_load_parallel(p, 2);
+	should_be_null(w);
+	parser_should_error(p);
+	str_should_equal(p->error_string, expect);
+	openvcd_free_parser(p);
+	free(expect);
+
+	/* and within a range */
+	memcpy(buffer, saved, length);
+	memcpy(buffer + length - 8, "b2 s0\n\n\n", 8);
+
+	p = string_parser(buffer, length);
+	should_be_null(openvcd_load(p));
+	parser_should_error(p);
+	expect = strdup(p->error_string);
+	openvcd_free_parser(p);
+
+	p = string_parser(buffer, length);
+	should_be_null(openvcd_load_parallel(p, 2));
+	parser_should_error(p);
+	str_should_equal(p->error_string, expect);
+	openvcd_free_parser(p);
+	free(expect);
+
+	/* and a record the scanner can't read, in the second range */
+	memcpy(buffer, saved, length);
+	bad = strstr(buffer + body + starts[1] + (length - body - starts[1]) / 2, "\n#");
+	should_not_be_null(bad);
+	bad[1] = '%';
+
+	p = string_parser(buffer, length);
+	should_be_null(openvcd_load(p));
+	parser_should_error(p);
+	expect = strdup(p->error_string);
+	openvcd_free_parser(p);
+
+	p = string_parser(buffer, length);
+	should_be_null(openvcd_load_parallel(p, 2));
+	parser_should_error(p);
+	str_should_equal(p->error_string, expect);
+	openvcd_free_parser(p);
+	free(expect);
+
+	free(saved);
+	free(buffer);
+}
+
+void test_load_file_parallel(void) {
+	char path[] = "/tmp/openvcd-parallel-XXXXXX";
+	openvcd_parser* p;
+	openvcd_wave* expect;
+	openvcd_wave* w;
+	char* buffer;
+	char* error;
+	size_t length;
+	FILE* f;
+
+	buffer = make_vcd(20, 20000, &length);
+	f = temp_file(path);
+	should_equal(fwrite(buffer, 1, length, f), length);
+	fclose(f);
+
+	p = string_parser(buffer, length);
+	expect = openvcd_load(p);
+	check_parser_error(p);
+	openvcd_free_parser(p);
+
+	w = openvcd_load_file_parallel(path, 4, &error);
+	should_not_be_null(w);
+	should_be_null(error);
+	check_same(expect, w);
+
+	openvcd_free_wave(w);
+	openvcd_free_wave(expect);
+
+	/* a parse error comes back instead of being printed */
+	buffer[length - 2] = '%';
+	f = fopen(path, "w");
+	should_equal(fwrite(buffer, 1, length, f), length);
+	fclose(f);
+
+	p = string_parser(buffer, length);
+	should_be_null(openvcd_load(p));
+	should_not_be_null(p->error_string);
+
+	should_be_null(openvcd_load_file_parallel(path, 4, &error));
+	should_not_be_null(error);
+	str_should_equal(error, p->error_string);
+	free(error);
+	openvcd_free_parser(p);
+
+	free(buffer);
+	unlink(path);
+
+	should_be_null(openvcd_load_file_parallel("/nonexistent/openvcd", 4, &error));
+	str_should_equal(error, "failed to open file");
+	free(error);
+	should_be_null(openvcd_load_file_parallel("/nonexistent/openvcd", 4, NULL));
+}
+
+int main(void) {
+	test_split_body();
+	test_load_parallel();
+	test_load_parallel_comment();
+	test_load_parallel_errors();
+	test_load_file_parallel();
+	return 0;
+}
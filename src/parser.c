@@ -5,6 +5,14 @@
 
 #include "parser.h"
 
+static void parser_error(openvcd_parser* p, openvcd_parser_error error, const char* what) {
+	p->state = OPENVCD_PARSER_STATE_ERROR;
+	p->error = error;
+	asprintf(&(p->error_string),
+		"syntax error on line %lu, %s",
+		p->lineno, what);
+}
+
 openvcd_parser* openvcd_new_parser(openvcd_parser_type type, openvcd_input_source source, size_t input_length) {
 	openvcd_parser* p;
 
@@ -21,7 +29,15 @@ openvcd_parser* openvcd_new_parser(openvcd_parser_type type, openvcd_input_sourc
 	p->error_string = NULL;
 	p->current_token = NULL;
 	p->next_token = NULL;
-	p->lineno = 0;
+	p->lineno = 1;
+	p->root = NULL;
+	p->timescale.u = openvcd_unit_undefined;
+	p->timescale.n = -1;
+	p->version = NULL;
+	p->date = NULL;
+	p->scope = NULL;
+	p->body_offset = 0;
+	p->changes_base = 0;
 
 	if ((input_length == 0) && (type != OPENVCD_PARSER_FILE)) {
 		p->state = OPENVCD_PARSER_STATE_ERROR;
@@ -37,6 +53,9 @@ void openvcd_free_parser(openvcd_parser* p) {
 	openvcd_clear_error(p);
 	if (p->current_token != NULL){ openvcd_free_token(p->current_token); }
 	if (p->next_token != NULL){ openvcd_free_token(p->next_token); }
+	if (p->root != NULL) { openvcd_free_scope(p->root); }
+	free(p->version);
+	free(p->date);
 	free(p);
 }
 
@@ -129,57 +148,59 @@ openvcd_token* openvcd_next_token(openvcd_parser* p) {
 		openvcd_next_char(p);
 	}
 
-	t = openvcd_new_tokenn(read_text, text_size);
-	free(read_text);
+	t = openvcd_new_tokenn(read_text, pos);
 	if (t == NULL) {
 		p->state = OPENVCD_PARSER_STATE_ERROR;
 		p->error = OPENVCD_ERROR_TOKEN;
 		asprintf(&(p->error_string),
-			"failed to create token from text '%s' of length %ld",
+			"failed to create token from text '%s' of length %lu",
 			read_text,
-			text_size );
+			(unsigned long) pos);
+		free(read_text);
 		return NULL;
 	}
 
+	free(read_text);
 	return t;
 }
 
+/* read the character at p->position into p->cursor */
+static void read_char(openvcd_parser* p) {
+	int ch;
+
+	/* input_length is always non-zero for strings, see
+	 * openvcd_new_parser() */
+	if ((p->input_length != 0) && (p->position >= p->input_length)) {
+		p->state = OPENVCD_PARSER_STATE_EOF;
+		p->cursor = '\0';
+		return;
+	}
+
+	if (p->type == OPENVCD_PARSER_STRING) {
+		p->cursor = p->source.input_string[p->position];
+	} else {
+		ch = fgetc(p->source.input_stream);
+		if (ch == EOF) {
+			p->state = OPENVCD_PARSER_STATE_EOF;
+			p->cursor = '\0';
+			return;
+		}
+		p->cursor = (char) ch;
+	}
+
+	if (p->cursor == '\n') { p->lineno ++; }
+}
+
 void openvcd_next_char(openvcd_parser* p) {
 	/* we were just initialized */
 	if (p->state == OPENVCD_PARSER_STATE_INITIALIZED) {
 		p->state = OPENVCD_PARSER_STATE_RUNNING;
 		p->position = 0;
-
-		if (p->type == OPENVCD_PARSER_STRING) {
-			/* case where we get called on an empty string */
-			if (p->input_length < 1) {
-				p->state = OPENVCD_PARSER_STATE_EOF;
-				p->cursor = '\0';
-			} else {
-				p->cursor = p->source.input_string[0];
-				if (p->cursor == '\n') { p->lineno ++; }
-			}
-
-		} else {
-			fprintf(stderr, "READING FROM FILE NOT IMPLEMENTED YET\n");
-			exit(1);
-		}
 	} else {
 		p->position++;
-		if (p->type == OPENVCD_PARSER_STRING) {
-			if (p->position >= p->input_length) {
-				p->state = OPENVCD_PARSER_STATE_EOF;
-				p->cursor = '\0';
-			} else {
-				p->cursor = p->source.input_string[p->position];
-			}
-
-		} else {
-			fprintf(stderr, "READING FROM FILE NOT IMPLEMENTED YET\n");
-			exit(1);
-		}
-
 	}
+
+	read_char(p);
 }
 
 void openvcd_advance(openvcd_parser* p) {
@@ -215,11 +236,13 @@ char* openvcd_parse_until(openvcd_parser* p, char* until, char* type) {
 				"syntax error on line %lu, got EOF while parsing %s",
 				p->lineno,
 				type);
+			free(text);
 			return NULL;
 		}
 
 		if ((p->state != OPENVCD_PARSER_STATE_RUNNING) && \
 			(!openvcd_token_eq_str(p->next_token, until))) {
+			free(text);
 			return NULL;
 		}
 
@@ -244,23 +267,276 @@ char* openvcd_parse_until(openvcd_parser* p, char* until, char* type) {
 }
 
 void openvcd_parse(openvcd_parser* p) {
-	p->current_token = NULL;
-	p->next_token = openvcd_next_token(p);
+	openvcd_parse_header(p);
+}
 
-	while(p->state == OPENVCD_PARSER_STATE_RUNNING) {
+static void parse_comment(openvcd_parser* p) {
+	/* consume $comment */
+	openvcd_advance(p);
 
-		if (openvcd_token_eq_str(p->next_token, "$version")) {
-			openvcd_parse_version(p);
+	free(openvcd_parse_until(p, "$end", "$comment"));
+
+	/* consume $end */
+	openvcd_advance(p);
+}
+
+static void parse_declaration(openvcd_parser* p) {
+	openvcd_timescale ts;
+	char* s;
+
+	if (openvcd_token_eq_str(p->next_token, "$version")) {
+		s = openvcd_parse_version(p);
+		free(p->version);
+		p->version = s;
+	} else if (openvcd_token_eq_str(p->next_token, "$date")) {
+		s = openvcd_parse_date(p);
+		free(p->date);
+		p->date = s;
+	} else if (openvcd_token_eq_str(p->next_token, "$timescale")) {
+		ts = openvcd_parse_timescale(p);
+		if (p->state != OPENVCD_PARSER_STATE_ERROR) { p->timescale = ts; }
+	} else if (openvcd_token_eq_str(p->next_token, "$scope")) {
+		openvcd_parse_scope(p);
+	} else if (openvcd_token_eq_str(p->next_token, "$upscope")) {
+		openvcd_parse_upscope(p);
+	} else if (openvcd_token_eq_str(p->next_token, "$var")) {
+		openvcd_parse_var(p);
+	} else if (openvcd_token_eq_str(p->next_token, "$comment")) {
+		parse_comment(p);
+	} else {
+		parser_error(p, OPENVCD_ERROR_SYNTAX, "unexpected token in declarations");
+	}
+}
+
+static void parse_enddefinitions(openvcd_parser* p) {
+	/* consume $enddefinitions, but do not read past the $end, since the
+	 * value changes are not handled by the token lexer */
+	openvcd_advance(p);
+
+	if (!openvcd_token_eq_str(p->next_token, "$end")) {
+		parser_error(p, OPENVCD_ERROR_SYNTAX, "expected $end after $enddefinitions");
+		return;
+	}
+
+	/* the lexer has also consumed the character following $end, unless
+	 * it hit EOF */
+	p->body_offset = p->position;
+	if (p->state == OPENVCD_PARSER_STATE_RUNNING) { p->body_offset++; }
+}
+
+void openvcd_parse_header(openvcd_parser* p) {
+	if (p->root == NULL) {
+		p->root = openvcd_alloc_scope(NULL, "", OPENVCD_SCOPE_MODULE);
+		if (p->root == NULL) {
+			parser_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate root scope");
+			return;
 		}
+		p->scope = p->root;
+	}
 
-		openvcd_advance(p);
+	if (p->next_token == NULL) {
+		p->next_token = openvcd_next_token(p);
+	}
+
+	while ((p->state == OPENVCD_PARSER_STATE_RUNNING) && (p->next_token != NULL)) {
+		if (openvcd_token_eq_str(p->next_token, "$enddefinitions")) {
+			parse_enddefinitions(p);
+			return;
+		}
 
+		parse_declaration(p);
 	}
 
+	if (p->state != OPENVCD_PARSER_STATE_ERROR) {
+		parser_error(p, OPENVCD_ERROR_SYNTAX, "got EOF before $enddefinitions");
+	}
+}
+
+void openvcd_parse_scope(openvcd_parser* p) {
+	openvcd_scope_type type;
+	openvcd_scope* s;
+	char* fields;
+	char* typestr;
+	char* name;
+	char* save;
+	khint_t k;
+
+	/* consume $scope */
+	openvcd_advance(p);
+
+	fields = openvcd_parse_until(p, "$end", "$scope");
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) { return; }
+
+	typestr = (fields == NULL) ? NULL : strtok_r(fields, " ", &save);
+	name = (typestr == NULL) ? NULL : strtok_r(NULL, " ", &save);
+
+	if ((name == NULL) || (strtok_r(NULL, " ", &save) != NULL) ||
+		!openvcd_scope_type_from_str(typestr, &type)) {
+		parser_error(p, OPENVCD_ERROR_SYNTAX, "invalid $scope declaration");
+		free(fields);
+		return;
+	}
+
+	k = kh_get(openvcd_mscope, p->scope->child_scopes, name);
+	if (k != kh_end(p->scope->child_scopes)) {
+		s = kh_val(p->scope->child_scopes, k);
+	} else {
+		s = openvcd_alloc_scope(p->scope, name, type);
+	}
+	free(fields);
+
+	if (s == NULL) {
+		parser_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate scope");
+		return;
+	}
+	p->scope = s;
+
+	/* consume $end */
+	openvcd_advance(p);
+}
+
+void openvcd_parse_upscope(openvcd_parser* p) {
+	char* fields;
+
+	/* consume $upscope */
+	openvcd_advance(p);
+
+	fields = openvcd_parse_until(p, "$end", "$upscope");
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) { return; }
+
+	if (fields != NULL) {
+		parser_error(p, OPENVCD_ERROR_SYNTAX, "unexpected text in $upscope");
+		free(fields);
+		return;
+	}
+
+	if (p->scope->parent == NULL) {
+		parser_error(p, OPENVCD_ERROR_SYNTAX, "$upscope without matching $scope");
+		return;
+	}
+	p->scope = p->scope->parent;
+
+	/* consume $end */
+	openvcd_advance(p);
+}
+
+/* Parse a reference such as "data", "data[7:0]" or "data[3]". The reference
+ * may have been split across several tokens, which the caller should
+ * concatenate without spaces. */
+static openvcd_reference* parse_reference(char* ref, bool* valid) {
+	char* bracket;
+	int msb;
+	int lsb;
+	int n;
+
+	msb = -1;
+	lsb = -1;
+	*valid = true;
+
+	bracket = strchr(ref, '[');
+	if (bracket != NULL) {
+		*bracket = '\0';
+		n = sscanf(bracket + 1, "%d:%d", &msb, &lsb);
+		if (n == 1) { lsb = msb; }
+		if ((n < 1) || (strchr(bracket + 1, ']') == NULL)) {
+			*valid = false;
+			return NULL;
+		}
+	}
+
+	if (strlen(ref) == 0) {
+		*valid = false;
+		return NULL;
+	}
+
+	return openvcd_alloc_reference(ref, lsb, msb);
+}
+
+/* split a $var declaration into its fields, returning false if any are
+ * missing or invalid */
+static bool split_var(char* fields, openvcd_var_type* type, unsigned long* width, char** id, char** ref) {
+	char* typestr;
+	char* widthstr;
+	char* end;
+	char* save;
+	char* tok;
+	size_t pos;
+
+	typestr = strtok_r(fields, " ", &save);
+	widthstr = (typestr == NULL) ? NULL : strtok_r(NULL, " ", &save);
+	*id = (widthstr == NULL) ? NULL : strtok_r(NULL, " ", &save);
+	*ref = (*id == NULL) ? NULL : strtok_r(NULL, " ", &save);
+	if (*ref == NULL) { return false; }
+
+	if (!openvcd_var_type_from_str(typestr, type)) { return false; }
+
+	*width = strtoul(widthstr, &end, 10);
+	if ((*end != '\0') || (*width == 0)) { return false; }
+
+	/* join the remaining tokens, e.g. "data [7:0]" becomes "data[7:0]",
+	 * this is safe since the joined string is never longer */
+	pos = strlen(*ref);
+	while ((tok = strtok_r(NULL, " ", &save)) != NULL) {
+		memmove(*ref + pos, tok, strlen(tok) + 1);
+		pos += strlen(tok);
+	}
+
+	return true;
+}
+
+void openvcd_parse_var(openvcd_parser* p) {
+	openvcd_var_type type;
+	openvcd_reference* r;
+	openvcd_var* v;
+	unsigned long width;
+	char* fields;
+	char* id;
+	char* ref;
+	bool valid;
+
+	/* consume $var */
+	openvcd_advance(p);
+
+	fields = openvcd_parse_until(p, "$end", "$var");
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) { return; }
+
+	valid = (fields != NULL) && split_var(fields, &type, &width, &id, &ref);
+	r = valid ? parse_reference(ref, &valid) : NULL;
+
+	if (!valid) {
+		parser_error(p, OPENVCD_ERROR_SYNTAX, "invalid $var declaration");
+		free(fields);
+		return;
+	}
+
+	if (r == NULL) {
+		parser_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate reference");
+		free(fields);
+		return;
+	}
+
+	if (kh_containsk(openvcd_mvar, p->scope->child_variables, id)) {
+		/* see the note in the prototype */
+		openvcd_free_reference(r);
+	} else {
+		v = openvcd_alloc_var(p->scope, type, (unsigned int) width, r, id);
+		if (v == NULL) {
+			openvcd_free_reference(r);
+			parser_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate variable");
+			free(fields);
+			return;
+		}
+	}
+
+	free(fields);
+
+	/* consume $end */
+	openvcd_advance(p);
 }
 
 bool openvcd_token_eq_str(openvcd_token* t, char* s) {
-	return (strncmp(t->literal, s, t->length) == 0);
+	if (t == NULL) { return false; }
+	return (t->length == strlen(s)) && (strncmp(t->literal, s, t->length) == 0);
 }
 
 char* openvcd_parse_version(openvcd_parser* p) {
@@ -309,6 +585,11 @@ openvcd_timescale openvcd_parse_timescale(openvcd_parser* p) {
 		return ts;
 	}
 
+	if (tsstring == NULL) {
+		parser_error(p, OPENVCD_ERROR_SYNTAX, "empty timescale");
+		return ts;
+	}
+
 	/* validate the timescale string and throw a syntax error if it fails
 	 * */
 	validating_unit = false;
@@ -33,6 +33,7 @@
 #include <string.h>
 
 #include "util.h"
+#include "scope.h"
 
 /**** TYPES ******************************************************************/
 
@@ -154,11 +155,28 @@ typedef struct {
 	openvcd_token* current_token;
 	openvcd_token* next_token;
 
-} openvcd_parser;
+	/* The declarations read by openvcd_parse_header(). The root scope is
+	 * an unnamed module which contains every top level scope, and any
+	 * variables declared outside of a scope. Any of these may be NULL if
+	 * the corresponding declaration has not been read. */
+	openvcd_scope* root;
+	openvcd_timescale timescale;
+	char* version;
+	char* date;
+
+	/* the scope which $var and $scope currently declare into */
+	openvcd_scope* scope;
 
-/**** UTILITIES **************************************************************/
+	/* Offset of the first byte of the value change section. Only valid
+	 * once openvcd_parse_header() has returned without error. */
+	size_t body_offset;
 
-#define OPENVCD_IS_WHITESPACE(_ch) ( ((_ch) == ' ') || ((_ch) == '\t') || ((_ch) == '\n') || ((_ch) == '\r') )
+	/* While the value change section is being read, the offset within it
+	 * of the buffer which the offsets of records are relative to, and
+	 * once it has been read, it's length. */
+	size_t changes_base;
+
+} openvcd_parser;
 
 /**** PROTOTYPES *************************************************************/
 
@@ -273,12 +291,57 @@ openvcd_token* openvcd_next_token(openvcd_parser* p);
 void openvcd_next_char(openvcd_parser* p);
 
 /**
- * @brief Parse the entire input.
+ * @brief Parse the entire declaration section of the input.
+ *
+ * This is currently equivalent to openvcd_parse_header(), value changes are
+ * read into a waveform by openvcd_load() in wave.h.
  *
  * @param p
  */
 void openvcd_parse(openvcd_parser* p);
 
+/**
+ * @brief Parse declarations up to and including $enddefinitions $end.
+ *
+ * The results are stored in p->root, p->timescale, p->version, and p->date.
+ * When this function returns without error, p->body_offset is the number of
+ * bytes consumed from the input, and no value change has been read yet.
+ *
+ * @param p
+ */
+void openvcd_parse_header(openvcd_parser* p);
+
+/**
+ * @brief Parse a $scope declaration, and make the new scope current.
+ *
+ * If the scope has already been declared in the current scope, for example
+ * because a simulator closed and re-opened it, it is re-used.
+ *
+ * @param p
+ */
+void openvcd_parse_scope(openvcd_parser* p);
+
+/**
+ * @brief Parse an $upscope declaration, returning to the parent scope.
+ *
+ * @param p
+ */
+void openvcd_parse_upscope(openvcd_parser* p);
+
+/**
+ * @brief Parse a $var declaration into the current scope.
+ *
+ * If the variable has no bit select, it's reference has both msb_index and
+ * lsb_index set to -1.
+ *
+ * Since scopes key their variables on identifier code, a second variable in
+ * the same scope with an identifier code that is already in use is parsed
+ * but not recorded.
+ *
+ * @param p
+ */
+void openvcd_parse_var(openvcd_parser* p);
+
 /**
  * @brief Advance the parser by one token.
  *
@@ -160,7 +160,7 @@ void test_timescale_parsing(void) {
 		s.input_string = errors[i],
 		p = openvcd_new_parser(OPENVCD_PARSER_STRING,
 				s,
-				strlen(tests[i].input_string));
+				strlen(errors[i]));
 		p->current_token = openvcd_next_token(p);
 
 		openvcd_parse_timescale(p);
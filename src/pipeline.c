@@ -0,0 +1,420 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "pipeline.h"
+
+#include <pthread.h>
+
+static void free_pipeline(openvcd_pipeline* pl) {
+	for (size_t i = 0 ; i < OPENVCD_PIPELINE_DEPTH ; i++) {
+		free(pl->buffers[i].data);
+		free(pl->batches[i].changes);
+		free(pl->batches[i].words);
+		free(pl->batches[i].error_string);
+	}
+
+	openvcd_ring_clear(&(pl->full_buffers));
+	openvcd_ring_clear(&(pl->free_buffers));
+	openvcd_ring_clear(&(pl->full_batches));
+	openvcd_ring_clear(&(pl->free_batches));
+	free(pl);
+}
+
+/* make the reader and lexer give up, waking them if they are waiting */
+static void stop_pipeline(openvcd_pipeline* pl) {
+	__atomic_store_n(&(pl->stop), 1, __ATOMIC_RELEASE);
+	openvcd_ring_wake(&(pl->full_buffers));
+	openvcd_ring_wake(&(pl->free_buffers));
+	openvcd_ring_wake(&(pl->free_batches));
+}
+
+static openvcd_pipeline* new_pipeline(openvcd_parser* p, const openvcd_wave* w) {
+	openvcd_pipeline* pl;
+	int rc;
+
+	pl = calloc(1, sizeof(openvcd_pipeline));
+	if (pl == NULL) { return NULL; }
+
+	pl->p = p;
+	pl->w = w;
+	pl->stop = 0;
+
+	rc = openvcd_ring_init(&(pl->full_buffers), OPENVCD_PIPELINE_DEPTH);
+	rc |= openvcd_ring_init(&(pl->free_buffers), OPENVCD_PIPELINE_DEPTH);
+	rc |= openvcd_ring_init(&(pl->full_batches), OPENVCD_PIPELINE_DEPTH);
+	rc |= openvcd_ring_init(&(pl->free_batches), OPENVCD_PIPELINE_DEPTH);
+	if (rc != 0) {
+		free_pipeline(pl);
+		return NULL;
+	}
+
+	for (size_t i = 0 ; i < OPENVCD_PIPELINE_DEPTH ; i++) {
+		pl->buffers[i].data = malloc(OPENVCD_LOAD_CHUNK_SIZE);
+		pl->batches[i].changes = malloc(OPENVCD_PIPELINE_BATCH * sizeof(openvcd_decoded_change));
+		pl->batches[i].words_capacity = 2 * OPENVCD_PIPELINE_BATCH;
+		pl->batches[i].words = malloc(pl->batches[i].words_capacity * sizeof(uint64_t));
+		if ((pl->buffers[i].data == NULL) || (pl->batches[i].changes == NULL) ||
+			(pl->batches[i].words == NULL)) {
+			free_pipeline(pl);
+			return NULL;
+		}
+
+		/* the rings are big enough for every buffer and batch, so
+		 * pushing never fails */
+		openvcd_ring_push(&(pl->free_buffers), &(pl->buffers[i]));
+		openvcd_ring_push(&(pl->free_batches), &(pl->batches[i]));
+	}
+
+	return pl;
+}
+
+/* fill buffers from the stream until it, or the input length, runs out */
+static void* read_stage(void* arg) {
+	openvcd_read_buffer* b;
+	openvcd_pipeline* pl;
+	openvcd_parser* p;
+	size_t consumed;
+	size_t want;
+
+	pl = (openvcd_pipeline*) arg;
+	p = pl->p;
+	consumed = 0;
+	do {
+		b = openvcd_ring_wait_pop(&(pl->free_buffers), &(pl->stop));
+		if (b == NULL) { return NULL; }
+
+		want = OPENVCD_LOAD_CHUNK_SIZE;
+		if (p->input_length != 0) {
+			if (p->body_offset + consumed >= p->input_length) {
+				want = 0;
+			} else if (p->input_length - p->body_offset - consumed < want) {
+				want = p->input_length - p->body_offset - consumed;
+			}
+		}
+
+		b->length = (want == 0) ? 0 : fread(b->data, 1, want, p->source.input_stream);
+		b->failed = (b->length < want) && ferror(p->source.input_stream);
+		b->final = b->failed || (b->length < OPENVCD_LOAD_CHUNK_SIZE);
+		consumed += b->length;
+
+		openvcd_ring_push(&(pl->full_buffers), b);
+	} while (!b->final);
+
+	return NULL;
+}
+
+/* get an empty batch, or NULL if the builder has given up */
+static openvcd_change_batch* next_batch(openvcd_pipeline* pl) {
+	openvcd_change_batch* batch;
+
+	batch = openvcd_ring_wait_pop(&(pl->free_batches), &(pl->stop));
+	if (batch == NULL) { return NULL; }
+
+	batch->count = 0;
+	batch->nwords = 0;
+	batch->last = false;
+	batch->error = OPENVCD_ERROR_NONE;
+	free(batch->error_string);
+	batch->error_string = NULL;
+	batch->error_offset = 0;
+
+	return batch;
+}
+
+static int reserve_words(openvcd_change_batch* batch, size_t need) {
+	uint64_t* words;
+	size_t cap;
+
+	if (batch->nwords + need <= batch->words_capacity) { return 0; }
+
+	cap = batch->words_capacity * 2;
+	while (cap < batch->nwords + need) { cap *= 2; }
+	words = realloc(batch->words, cap * sizeof(uint64_t));
+	if (words == NULL) { return -1; }
+
+	batch->words = words;
+	batch->words_capacity = cap;
+	return 0;
+}
+
+static openvcd_parser_error decode_change(const openvcd_wave* w, openvcd_change_batch* batch, const openvcd_change* c, size_t base) {
+	openvcd_decoded_change* d;
+	const openvcd_signal* s;
+	uint64_t* aval;
+	uint64_t* bval;
+	size_t n;
+	bool ok;
+
+	d = &(batch->changes[batch->count]);
+	d->time = c->time;
+	d->offset = base + c->offset;
+	d->word = batch->nwords;
+
+	if (c->type == OPENVCD_CHANGE_TIME) {
+		d->signal = OPENVCD_PIPELINE_TIME;
+		batch->count++;
+		return OPENVCD_ERROR_NONE;
+	}
+
+	if (!openvcd_wave_signal_number(w, c->id, c->id_length, &n)) {
+		return OPENVCD_ERROR_SYNTAX;
+	}
+	s = w->signals.data[n];
+
+	if (reserve_words(batch, 2 * s->nwords) != 0) { return OPENVCD_ERROR_ALLOC_FAILED; }
+	aval = batch->words + batch->nwords;
+	bval = aval + s->nwords;
+
+	if (c->type == OPENVCD_CHANGE_REAL) {
+		ok = openvcd_value_parse_real(c->value, c->value_length, aval, bval);
+	} else {
+		ok = openvcd_value_parse(c->value, c->value_length, s->width, aval, bval);
+	}
+	if (!ok) { return OPENVCD_ERROR_SYNTAX; }
+
+	d->signal = n;
+	batch->nwords += 2 * s->nwords;
+	batch->count++;
+
+	return OPENVCD_ERROR_NONE;
+}
+
+/* decode every complete record in the scanner's buffer into batches,
+ * returning OPENVCD_SCAN_EOF without a batch if the builder gave up */
+static openvcd_scan_status lex_changes(openvcd_pipeline* pl, openvcd_scanner* s, openvcd_change_batch** batch, size_t base) {
+	openvcd_parser_error err;
+	openvcd_scan_status st;
+	openvcd_change c;
+
+	while ((st = openvcd_scan_next(s, &c)) == OPENVCD_SCAN_OK) {
+		if (c.type == OPENVCD_CHANGE_COMMAND) { continue; }
+
+		if ((*batch != NULL) && ((*batch)->count == OPENVCD_PIPELINE_BATCH)) {
+			openvcd_ring_push(&(pl->full_batches), *batch);
+			*batch = NULL;
+		}
+		if ((*batch == NULL) && ((*batch = next_batch(pl)) == NULL)) {
+			return OPENVCD_SCAN_EOF;
+		}
+
+		err = decode_change(pl->w, *batch, &c, base);
+		if (err != OPENVCD_ERROR_NONE) {
+			(*batch)->error = err;
+			(*batch)->error_offset = base + c.offset;
+			return OPENVCD_SCAN_ERROR;
+		}
+	}
+
+	if (st == OPENVCD_SCAN_ERROR) {
+		if ((*batch == NULL) && ((*batch = next_batch(pl)) == NULL)) {
+			return OPENVCD_SCAN_EOF;
+		}
+		(*batch)->error = OPENVCD_ERROR_SYNTAX;
+		(*batch)->error_string = s->error_string;
+		(*batch)->error_offset = base + s->error_offset;
+		s->error_string = NULL;
+	}
+
+	return st;
+}
+
+/* scan buffers from the reader into batches for the builder */
+static void* lex_stage(void* arg) {
+	openvcd_change_batch* batch;
+	openvcd_read_buffer* b;
+	openvcd_pipeline* pl;
+	openvcd_scan_status st;
+	openvcd_scanner s;
+	char* buffer;
+	char* temp;
+	size_t capacity;
+	size_t length;
+	size_t carry;
+	size_t base;
+	bool final;
+
+	pl = (openvcd_pipeline*) arg;
+	batch = NULL;
+	buffer = NULL;
+	capacity = 0;
+	carry = 0;
+	base = 0;
+	openvcd_init_scanner(&s, NULL, 0, false);
+
+	for (;;) {
+		/* hand over what is decoded so far rather than wait with it */
+		if ((batch != NULL) && (batch->count > 0) && openvcd_ring_empty(&(pl->full_buffers))) {
+			openvcd_ring_push(&(pl->full_batches), batch);
+			batch = NULL;
+		}
+
+		b = openvcd_ring_wait_pop(&(pl->full_buffers), &(pl->stop));
+		if (b == NULL) { break; }
+
+		if (b->failed) {
+			openvcd_ring_push(&(pl->free_buffers), b);
+			if ((batch == NULL) && ((batch = next_batch(pl)) == NULL)) { break; }
+			batch->error = OPENVCD_ERROR_GENERAL;
+			batch->error_string = strdup("failed to read input");
+			batch->error_offset = base + carry;
+			batch->last = true;
+			openvcd_ring_push(&(pl->full_batches), batch);
+			batch = NULL;
+			break;
+		}
+
+		/* the buffer is copied after any held back record */
+		if (carry + b->length > capacity) {
+			temp = realloc(buffer, carry + OPENVCD_LOAD_CHUNK_SIZE + b->length);
+			if (temp == NULL) {
+				openvcd_ring_push(&(pl->free_buffers), b);
+				if ((batch == NULL) && ((batch = next_batch(pl)) == NULL)) { break; }
+				batch->error = OPENVCD_ERROR_ALLOC_FAILED;
+				batch->error_string = strdup("failed to grow read buffer");
+				batch->error_offset = 0;
+				batch->last = true;
+				openvcd_ring_push(&(pl->full_batches), batch);
+				batch = NULL;
+				break;
+			}
+			buffer = temp;
+			capacity = carry + OPENVCD_LOAD_CHUNK_SIZE + b->length;
+		}
+		memcpy(buffer + carry, b->data, b->length);
+		length = carry + b->length;
+		final = b->final;
+		openvcd_ring_push(&(pl->free_buffers), b);
+
+		openvcd_scanner_feed(&s, buffer, length, final);
+		st = lex_changes(pl, &s, &batch, base);
+		if (st == OPENVCD_SCAN_NEED_MORE) {
+			carry = length - s.position;
+			memmove(buffer, buffer + s.position, carry);
+			base += s.position;
+			continue;
+		}
+
+		if ((batch == NULL) && ((batch = next_batch(pl)) == NULL)) { break; }
+		batch->last = true;
+		openvcd_ring_push(&(pl->full_batches), batch);
+		batch = NULL;
+		break;
+	}
+
+	/* only left over if the builder gave up */
+	if (batch != NULL) { openvcd_ring_push(&(pl->free_batches), batch); }
+
+	openvcd_clear_scanner(&s);
+	free(buffer);
+	return NULL;
+}
+
+/* apply one batch to the waveform, returning false on error */
+static bool build_batch(openvcd_pipeline* pl, openvcd_wave* w, const openvcd_change_batch* batch) {
+	const openvcd_decoded_change* d;
+	openvcd_parser_error err;
+	const uint64_t* aval;
+
+	for (size_t i = 0 ; i < batch->count ; i++) {
+		d = &(batch->changes[i]);
+		if (d->signal == OPENVCD_PIPELINE_TIME) {
+			err = openvcd_wave_set_time(w, d->time);
+		} else {
+			aval = batch->words + d->word;
+			err = openvcd_wave_append(w, d->signal, d->time, aval,
+				aval + w->signals.data[d->signal]->nwords);
+		}
+
+		if (err != OPENVCD_ERROR_NONE) {
+			openvcd_load_error(pl->p, err, openvcd_change_error(err), d->offset);
+			return false;
+		}
+	}
+
+	if (batch->error != OPENVCD_ERROR_NONE) {
+		openvcd_load_error(pl->p, batch->error, (batch->error_string != NULL) ?
+			batch->error_string : openvcd_change_error(batch->error),
+			batch->error_offset);
+		return false;
+	}
+
+	return true;
+}
+
+/* run the pipeline, with the calling thread as the builder, returning -1
+ * without reading anything if the other stages could not be started */
+static int run_pipeline(openvcd_parser* p, openvcd_wave* w) {
+	openvcd_change_batch* batch;
+	openvcd_pipeline* pl;
+	pthread_t reader;
+	pthread_t lexer;
+	bool last;
+
+	pl = new_pipeline(p, w);
+	if (pl == NULL) { return -1; }
+
+	if (pthread_create(&lexer, NULL, lex_stage, pl) != 0) {
+		free_pipeline(pl);
+		return -1;
+	}
+
+	if (pthread_create(&reader, NULL, read_stage, pl) != 0) {
+		stop_pipeline(pl);
+		pthread_join(lexer, NULL);
+		free_pipeline(pl);
+		return -1;
+	}
+
+	/* the lexer always finishes with a last batch */
+	do {
+		batch = openvcd_ring_wait_pop(&(pl->full_batches), NULL);
+		last = !build_batch(pl, w, batch) || batch->last;
+		openvcd_ring_push(&(pl->free_batches), batch);
+	} while (!last);
+
+	stop_pipeline(pl);
+	pthread_join(lexer, NULL);
+	pthread_join(reader, NULL);
+	free_pipeline(pl);
+
+	return 0;
+}
+
+static openvcd_parser_error apply_change(void* ctx, const openvcd_change* c) {
+	return openvcd_wave_apply((openvcd_wave*) ctx, c);
+}
+
+openvcd_wave* openvcd_load_pipelined(openvcd_parser* p) {
+	return openvcd_load_pipelined_snapshots(p, 0, 0);
+}
+
+openvcd_wave* openvcd_load_pipelined_snapshots(openvcd_parser* p, uint64_t time_interval, uint64_t change_interval) {
+	openvcd_wave* w;
+
+	if (p->type == OPENVCD_PARSER_STRING) {
+		return openvcd_load_snapshots(p, time_interval, change_interval);
+	}
+
+	w = openvcd_load_header(p);
+	if (w == NULL) { return NULL; }
+
+	if (openvcd_wave_set_snapshots(w, time_interval, change_interval) != 0) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate snapshot", 0);
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	/* without threads, load the changes on this one */
+	if (run_pipeline(p, w) != 0) {
+		openvcd_parse_changes(p, apply_change, w);
+	}
+
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) {
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	return w;
+}
@@ -0,0 +1,144 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements loading of the value change section from a stream
+ * on three threads, for input which can't be split up front like the
+ * parallel loader requires, such as a pipe from a simulator.
+ *
+ * A reader thread fills buffers from the stream. A lexer thread scans them
+ * and decodes each value change into a batch, with it's signal number and
+ * it's value already parsed. The calling thread appends the batches to the
+ * waveform. Reading, scanning, and appending therefore overlap, and each
+ * stage only waits when the next one falls behind.
+ *
+ * Buffers and batches are allocated up front, and handed from one stage to
+ * the next and back again through single producer, single consumer rings,
+ * so no locks are taken while the stages keep up with each other, see
+ * ring.h. Allocation while loading is limited to growing a batch's values
+ * for unusually wide signals, and the lexer's buffer for a record which
+ * spans several buffers; both keep their size for the rest of the load.
+ */
+
+#ifndef OPENVCD_PIPELINE_H
+#define OPENVCD_PIPELINE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "parser.h"
+#include "scan.h"
+#include "ring.h"
+#include "wave.h"
+
+/**** TYPES ******************************************************************/
+
+/* the number of buffers and batches in flight between each pair of stages */
+#define OPENVCD_PIPELINE_DEPTH 4
+
+/* the maximum number of changes in a batch */
+#define OPENVCD_PIPELINE_BATCH 4096
+
+/* the signal number of a decoded time record */
+#define OPENVCD_PIPELINE_TIME SIZE_MAX
+
+typedef struct {
+	char* data;
+	size_t length;
+
+	/* true if this is the last of the input */
+	bool final;
+
+	/* true if the stream could not be read, in which case this is also
+	 * the last buffer */
+	bool failed;
+} openvcd_read_buffer;
+
+typedef struct {
+	/* the signal number, or OPENVCD_PIPELINE_TIME */
+	size_t signal;
+	uint64_t time;
+
+	/* offset of the value within the batch's words, aval followed by
+	 * bval */
+	size_t word;
+
+	/* offset of the record within the value change section */
+	size_t offset;
+} openvcd_decoded_change;
+
+typedef struct {
+	openvcd_decoded_change* changes;
+	size_t count;
+
+	uint64_t* words;
+	size_t nwords;
+	size_t words_capacity;
+
+	/* true if this is the last batch, possibly because of an error in the
+	 * record after it's last change */
+	bool last;
+	openvcd_parser_error error;
+	char* error_string;
+	size_t error_offset;
+} openvcd_change_batch;
+
+typedef struct {
+	openvcd_parser* p;
+	const openvcd_wave* w;
+
+	/* buffers go from the reader to the lexer through full_buffers, and
+	 * back through free_buffers, and likewise for batches between the
+	 * lexer and the builder */
+	openvcd_ring full_buffers;
+	openvcd_ring free_buffers;
+	openvcd_ring full_batches;
+	openvcd_ring free_batches;
+
+	openvcd_read_buffer buffers[OPENVCD_PIPELINE_DEPTH];
+	openvcd_change_batch batches[OPENVCD_PIPELINE_DEPTH];
+
+	/* set by the builder to make the other stages give up */
+	int stop;
+} openvcd_pipeline;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Load a complete VCD file into a new waveform, see openvcd_load().
+ *
+ * The value change section is read, scanned, and stored on separate
+ * threads. Only stream parsers are pipelined, and string parsers, which
+ * have nothing to read, are loaded with openvcd_load().
+ *
+ * @param p
+ *
+ * @return The new waveform, or NULL on error.
+ */
+openvcd_wave* openvcd_load_pipelined(openvcd_parser* p);
+
+/**
+ * @brief Load a complete VCD file into a new waveform, taking snapshots.
+ *
+ * See openvcd_load_pipelined() and openvcd_load_snapshots().
+ *
+ * @param p
+ * @param time_interval
+ * @param change_interval
+ *
+ * @return The new waveform, or NULL on error.
+ */
+openvcd_wave* openvcd_load_pipelined_snapshots(openvcd_parser* p, uint64_t time_interval, uint64_t change_interval);
+
+#endif /* OPENVCD_PIPELINE_H */
@@ -0,0 +1,217 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "test_util.h"
+#include "pipeline.h"
+
+typedef openvcd_wave* (*loader)(openvcd_parser* p, uint64_t time_interval, uint64_t change_interval);
+
+/* load a file, returning the parser's error string if there was one */
+static openvcd_wave* load(loader fn, const char* path, size_t input_length, uint64_t interval, char** error) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	FILE* f;
+
+	f = fopen(path, "r");
+	should_not_be_null(f);
+	source.input_stream = f;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, input_length);
+	w = fn(p, interval, 0);
+
+	*error = NULL;
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) {
+		should_be_null(w);
+		*error = strdup(p->error_string);
+	}
+
+	openvcd_free_parser(p);
+	fclose(f);
+	return w;
+}
+
+/* changes are appended in the same order either way, so the waveforms
+ * must be identical */
+static void check_identical(const openvcd_wave* expect, const openvcd_wave* w) {
+	const openvcd_snapshots* ss[2];
+	openvcd_signal* s;
+	openvcd_signal* e;
+	int i;
+
+	should_equal(w->signals.length, expect->signals.length);
+	should_equal(w->end_time, expect->end_time);
+
+	vec_foreach(&(expect->signals), e, i) {
+		s = w->signals.data[i];
+		str_should_equal(s->id_code, e->id_code);
+		should_equal(s->change_count, e->change_count);
+		should_equal(s->nblocks, e->nblocks);
+		should_equal(s->data_length, e->data_length);
+		should_equal(memcmp(s->blocks, e->blocks, e->nblocks * sizeof(openvcd_block)), 0);
+		should_equal(memcmp(s->data, e->data, e->data_length), 0);
+	}
+
+	ss[0] = &(expect->snapshots);
+	ss[1] = &(w->snapshots);
+	should_equal(ss[1]->nsnapshots, ss[0]->nsnapshots);
+	should_equal(ss[1]->ndirty, ss[0]->ndirty);
+	should_equal(ss[1]->data_length, ss[0]->data_length);
+	if (ss[0]->nsnapshots > 0) {
+		should_equal(memcmp(ss[1]->snapshots, ss[0]->snapshots, ss[0]->nsnapshots * sizeof(openvcd_snapshot)), 0);
+		should_equal(memcmp(ss[1]->data, ss[0]->data, ss[0]->data_length), 0);
+	}
+}
+
+/* returns true if the file could not be loaded */
+static bool check_file(const char* path, size_t input_length, uint64_t interval) {
+	openvcd_wave* expect;
+	openvcd_wave* w;
+	char* error[2];
+	bool failed;
+
+	expect = load(openvcd_load_snapshots, path, input_length, interval, &(error[0]));
+	w = load(openvcd_load_pipelined_snapshots, path, input_length, interval, &(error[1]));
+
+	if (error[0] != NULL) {
+		should_not_be_null(error[1]);
+		str_should_equal(error[1], error[0]);
+	} else {
+		should_be_null(error[1]);
+		check_identical(expect, w);
+		openvcd_free_wave(expect);
+		openvcd_free_wave(w);
+	}
+
+	failed = (error[0] != NULL);
+	free(error[0]);
+	free(error[1]);
+
+	return failed;
+}
+
+void test_load_pipelined(void) {
+	char path[] = "/tmp/openvcd-pipeline-XXXXXX";
+
+	/* several read buffers, and many batches */
+	write_vcd(path, 40, 25000, "");
+	should_be_false(check_file(path, 0, 0));
+	should_be_false(check_file(path, 0, 1000));
+
+	/* stopping part way through a record */
+	check_file(path, OPENVCD_LOAD_CHUNK_SIZE + 12345, 0);
+
+	unlink(path);
+}
+
+void test_load_pipelined_errors(void) {
+	char path[] = "/tmp/openvcd-pipeline-XXXXXX";
+	const char* tails[] = {
+		"b2 s0\n",
+		"1nosuchsignal\n",
+		"#1\n",
+		"$comment never ends\n",
+		"#99999999 $dumpoff\n1c\n$end\n#1\n",
+	};
+
+	for (size_t i = 0 ; i < sizeof(tails) / sizeof(tails[0]) ; i++) {
+		strcpy(path, "/tmp/openvcd-pipeline-XXXXXX");
+		write_vcd(path, 20, 20000, tails[i]);
+		should_be_true(check_file(path, 0, 0));
+		unlink(path);
+	}
+}
+
+void test_load_pipelined_error_offset(void) {
+	char path[] = "/tmp/openvcd-pipeline-XXXXXX";
+	struct stat st;
+	char expect[64];
+	char* error;
+
+	/* the bad time record is past the first read buffer */
+	write_vcd(path, 40, 25000, "#x\n");
+	should_equal(stat(path, &st), 0);
+	should_be_true((size_t) st.st_size > OPENVCD_LOAD_CHUNK_SIZE);
+	snprintf(expect, sizeof(expect), "error at byte %lu,", (unsigned long) st.st_size - 3);
+
+	should_be_null(load(openvcd_load_pipelined_snapshots, path, 0, 0, &error));
+	should_not_be_null(error);
+	should_equal(strncmp(error, expect, strlen(expect)), 0);
+	free(error);
+
+	unlink(path);
+}
+
+/* a stream which fails once the text has been read */
+static ssize_t failing_read(void* cookie, char* buf, size_t size) {
+	const char** text;
+	size_t n;
+
+	text = (const char**) cookie;
+	n = strlen(*text);
+	if (n == 0) {
+		errno = EIO;
+		return -1;
+	}
+
+	if (n > size) { n = size; }
+	memcpy(buf, *text, n);
+	*text += n;
+	return (ssize_t) n;
+}
+
+void test_load_pipelined_read_error(void) {
+	const char* vcd = "$var wire 1 ! a $end $enddefinitions $end\n#0\n1!\n";
+	cookie_io_functions_t io = { failing_read, NULL, NULL, NULL };
+	openvcd_input_source source;
+	openvcd_parser* p;
+	const char* text;
+	loader fns[2] = { openvcd_load_snapshots, openvcd_load_pipelined_snapshots };
+
+	for (int i = 0 ; i < 2 ; i++) {
+		text = vcd;
+		source.input_stream = fopencookie(&text, "r", io);
+		should_not_be_null(source.input_stream);
+		p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+		should_be_null(fns[i](p, 0, 0));
+		parser_should_error(p);
+		should_equal(p->error, OPENVCD_ERROR_GENERAL);
+		should_not_be_null(strstr(p->error_string, "failed to read input"));
+		openvcd_free_parser(p);
+		fclose(source.input_stream);
+	}
+}
+
+void test_load_pipelined_string(void) {
+	const char* vcd = "$var wire 1 ! a $end $enddefinitions $end #0 1! #5 0!";
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+
+	source.input_string = (char*) vcd;
+	p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, strlen(vcd));
+	w = openvcd_load_pipelined(p);
+	check_parser_error(p);
+	should_not_be_null(w);
+	should_equal(w->end_time, 5);
+	should_equal(w->signals.data[0]->change_count, 2);
+
+	openvcd_free_wave(w);
+	openvcd_free_parser(p);
+}
+
+int main(void) {
+	test_load_pipelined();
+	test_load_pipelined_errors();
+	test_load_pipelined_error_offset();
+	test_load_pipelined_read_error();
+	test_load_pipelined_string();
+	return 0;
+}
@@ -0,0 +1,207 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "pool.h"
+
+#include <unistd.h>
+
+unsigned int openvcd_processors(void) {
+	long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n < 1) ? 1 : (unsigned int) n;
+}
+
+/* take the next task from a thread's own range */
+static bool take(openvcd_pool_range* r, size_t* i) {
+	bool found;
+
+	pthread_mutex_lock(&(r->lock));
+	found = (r->next < r->end);
+	if (found) { *i = r->next++; }
+	pthread_mutex_unlock(&(r->lock));
+
+	return found;
+}
+
+/* move the back half of the largest other range into thread k's range */
+static bool steal(openvcd_pool* pool, unsigned int k) {
+	openvcd_pool_range* victim;
+	openvcd_pool_range* r;
+	size_t largest;
+	size_t half;
+	size_t end;
+
+	victim = NULL;
+	largest = 0;
+	for (unsigned int j = 0 ; j < pool->nthreads ; j++) {
+		r = &(pool->ranges[j]);
+		if (j == k) { continue; }
+
+		/* only a hint, the range is checked again under it's lock */
+		pthread_mutex_lock(&(r->lock));
+		if (r->end - r->next > largest) {
+			largest = r->end - r->next;
+			victim = r;
+		}
+		pthread_mutex_unlock(&(r->lock));
+	}
+	if (victim == NULL) { return false; }
+
+	pthread_mutex_lock(&(victim->lock));
+	half = (victim->end - victim->next + 1) / 2;
+	end = victim->end;
+	victim->end -= half;
+	pthread_mutex_unlock(&(victim->lock));
+	if (half == 0) { return true; }
+
+	r = &(pool->ranges[k]);
+	pthread_mutex_lock(&(r->lock));
+	r->next = end - half;
+	r->end = end;
+	pthread_mutex_unlock(&(r->lock));
+
+	__atomic_add_fetch(&(pool->steals), 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+static void work(openvcd_pool* pool, unsigned int k) {
+	size_t i;
+
+	for (;;) {
+		while (take(&(pool->ranges[k]), &i)) {
+			pool->task(pool->ctx, i);
+		}
+		if (!steal(pool, k)) { return; }
+	}
+}
+
+static void* worker(void* arg) {
+	openvcd_pool* pool;
+	unsigned int k;
+	uint64_t job;
+	bool shutdown;
+
+	pool = (openvcd_pool*) arg;
+
+	/* find this thread's number */
+	pthread_mutex_lock(&(pool->lock));
+	for (k = 1 ; !pthread_equal(pool->threads[k - 1], pthread_self()) ; k++) { }
+	pthread_mutex_unlock(&(pool->lock));
+
+	/* a job may have been posted before this thread first ran */
+	job = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&(pool->lock));
+		while ((pool->job == job) && !pool->shutdown) {
+			pthread_cond_wait(&(pool->start), &(pool->lock));
+		}
+		job = pool->job;
+		shutdown = pool->shutdown;
+		pthread_mutex_unlock(&(pool->lock));
+		if (shutdown) { return NULL; }
+
+		work(pool, k);
+
+		pthread_mutex_lock(&(pool->lock));
+		if (--pool->busy == 0) { pthread_cond_signal(&(pool->done)); }
+		pthread_mutex_unlock(&(pool->lock));
+	}
+}
+
+openvcd_pool* openvcd_new_pool(unsigned int nthreads) {
+	openvcd_pool* pool;
+	unsigned int started;
+
+	if (nthreads == 0) { nthreads = openvcd_processors(); }
+
+	pool = calloc(1, sizeof(openvcd_pool));
+	if (pool == NULL) { return NULL; }
+
+	pool->threads = calloc(nthreads, sizeof(pthread_t));
+	pool->ranges = calloc(nthreads, sizeof(openvcd_pool_range));
+	if ((pool->threads == NULL) || (pool->ranges == NULL)) {
+		free(pool->threads);
+		free(pool->ranges);
+		free(pool);
+		return NULL;
+	}
+
+	for (unsigned int i = 0 ; i < nthreads ; i++) {
+		pthread_mutex_init(&(pool->ranges[i].lock), NULL);
+	}
+	pthread_mutex_init(&(pool->lock), NULL);
+	pthread_cond_init(&(pool->start), NULL);
+	pthread_cond_init(&(pool->done), NULL);
+
+	/* workers wait for the lock until every thread is started, since
+	 * they look themselves up in threads */
+	pthread_mutex_lock(&(pool->lock));
+	for (started = 0 ; started + 1 < nthreads ; started++) {
+		if (pthread_create(&(pool->threads[started]), NULL, worker, pool) != 0) { break; }
+	}
+	pool->nthreads = started + 1;
+	pthread_mutex_unlock(&(pool->lock));
+
+	return pool;
+}
+
+void openvcd_free_pool(openvcd_pool* pool) {
+	pthread_mutex_lock(&(pool->lock));
+	pool->shutdown = true;
+	pthread_cond_broadcast(&(pool->start));
+	pthread_mutex_unlock(&(pool->lock));
+
+	for (unsigned int i = 0 ; i + 1 < pool->nthreads ; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	for (unsigned int i = 0 ; i < pool->nthreads ; i++) {
+		pthread_mutex_destroy(&(pool->ranges[i].lock));
+	}
+	pthread_mutex_destroy(&(pool->lock));
+	pthread_cond_destroy(&(pool->start));
+	pthread_cond_destroy(&(pool->done));
+
+	free(pool->threads);
+	free(pool->ranges);
+	free(pool);
+}
+
+void openvcd_pool_run(openvcd_pool* pool, openvcd_task task, void* ctx, size_t ntasks) {
+	openvcd_pool_range* r;
+	size_t n;
+
+	if ((pool == NULL) || (pool->nthreads == 1) || (ntasks < 2)) {
+		for (size_t i = 0 ; i < ntasks ; i++) { task(ctx, i); }
+		return;
+	}
+
+	n = pool->nthreads;
+	for (size_t k = 0 ; k < n ; k++) {
+		r = &(pool->ranges[k]);
+		pthread_mutex_lock(&(r->lock));
+		r->next = (ntasks * k) / n;
+		r->end = (ntasks * (k + 1)) / n;
+		pthread_mutex_unlock(&(r->lock));
+	}
+
+	pthread_mutex_lock(&(pool->lock));
+	pool->task = task;
+	pool->ctx = ctx;
+	pool->busy = pool->nthreads - 1;
+	pool->job++;
+	pthread_cond_broadcast(&(pool->start));
+	pthread_mutex_unlock(&(pool->lock));
+
+	work(pool, 0);
+
+	pthread_mutex_lock(&(pool->lock));
+	while (pool->busy > 0) {
+		pthread_cond_wait(&(pool->done), &(pool->lock));
+	}
+	pthread_mutex_unlock(&(pool->lock));
+}
@@ -0,0 +1,116 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements a pool of threads which run numbered tasks, such as
+ * one task per signal, with work stealing.
+ *
+ * The tasks of a job are split evenly into one range per thread, and each
+ * thread runs the tasks in it's own range from the front. A thread which
+ * runs out takes the back half of the largest range it can find, so when a
+ * few tasks are much bigger than the rest, as with a clock among registers
+ * that rarely change, the other threads keep busy with what is left instead
+ * of waiting. Each range has it's own lock, which is only contended while
+ * stealing.
+ *
+ * The threads are started once, and sleep between jobs. The calling thread
+ * takes part in every job, so a pool of one thread starts no threads at all.
+ */
+
+#ifndef OPENVCD_POOL_H
+#define OPENVCD_POOL_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "util.h"
+
+/**** TYPES ******************************************************************/
+
+/* run task number i of a job */
+typedef void (*openvcd_task)(void* ctx, size_t i);
+
+/* the tasks [next, end) waiting to be run by one thread */
+typedef struct {
+	pthread_mutex_t lock;
+	size_t next;
+	size_t end;
+} openvcd_pool_range;
+
+typedef struct openvcd_pool_t {
+	/* the number of threads, including the calling thread */
+	unsigned int nthreads;
+	pthread_t* threads;
+	openvcd_pool_range* ranges;
+
+	/* the current job */
+	openvcd_task task;
+	void* ctx;
+
+	/* protects the fields below, with start signalled when a job is
+	 * posted and done when the last thread finishes it */
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	uint64_t job;
+	unsigned int busy;
+	bool shutdown;
+
+	/* the number of ranges taken from another thread, for tuning */
+	uint64_t steals;
+} openvcd_pool;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Start a new pool of threads.
+ *
+ * If fewer threads can be started than asked for, the pool uses those that
+ * did start.
+ *
+ * @param nthreads The number of threads including the calling thread, or 0
+ * to use one per processor.
+ *
+ * @return The new pool, or NULL on failure.
+ */
+openvcd_pool* openvcd_new_pool(unsigned int nthreads);
+
+/**
+ * @brief Stop the threads of a pool, and free it.
+ *
+ * @param pool
+ */
+void openvcd_free_pool(openvcd_pool* pool);
+
+/**
+ * @brief Run task(ctx, i) for every i from 0 to ntasks - 1, in any order.
+ *
+ * Returns once every task has finished. Tasks must not call
+ * openvcd_pool_run() on the same pool.
+ *
+ * @param pool May be NULL, to run every task on the calling thread.
+ * @param task
+ * @param ctx
+ * @param ntasks
+ */
+void openvcd_pool_run(openvcd_pool* pool, openvcd_task task, void* ctx, size_t ntasks);
+
+/**
+ * @brief Return the number of processors online, and at least 1.
+ *
+ * @return
+ */
+unsigned int openvcd_processors(void);
+
+#endif /* OPENVCD_POOL_H */
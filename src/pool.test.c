@@ -0,0 +1,91 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "pool.h"
+
+#define POOL_TEST_TASKS 1000
+
+typedef struct {
+	int runs[POOL_TEST_TASKS];
+	size_t slow;
+} pool_test_job;
+
+static void count_task(void* ctx, size_t i) {
+	pool_test_job* job;
+
+	job = (pool_test_job*) ctx;
+	__atomic_add_fetch(&(job->runs[i]), 1, __ATOMIC_RELAXED);
+
+	/* one task much bigger than the rest */
+	if (i == job->slow) { usleep(100000); }
+}
+
+/* every task must run exactly once */
+static void check_job(openvcd_pool* pool, size_t ntasks, size_t slow) {
+	pool_test_job job;
+
+	memset(&job, 0, sizeof(job));
+	job.slow = slow;
+	openvcd_pool_run(pool, count_task, &job, ntasks);
+
+	for (size_t i = 0 ; i < POOL_TEST_TASKS ; i++) {
+		should_equal(job.runs[i], (i < ntasks) ? 1 : 0);
+	}
+}
+
+void test_pool(void) {
+	openvcd_pool* pool;
+
+	pool = openvcd_new_pool(4);
+	should_not_be_null(pool);
+	should_equal(pool->nthreads, 4);
+
+	check_job(pool, 0, POOL_TEST_TASKS);
+	check_job(pool, 1, POOL_TEST_TASKS);
+	check_job(pool, 3, POOL_TEST_TASKS);
+
+	/* the pool is reused from job to job */
+	for (int i = 0 ; i < 50 ; i++) {
+		check_job(pool, POOL_TEST_TASKS, POOL_TEST_TASKS);
+	}
+
+	/* while the calling thread is stuck in it's first task, the others
+	 * take the rest of it's range */
+	pool->steals = 0;
+	check_job(pool, POOL_TEST_TASKS, 0);
+	should_be_true(pool->steals > 0);
+
+	openvcd_free_pool(pool);
+}
+
+void test_pool_serial(void) {
+	openvcd_pool* pool;
+
+	/* a pool of one thread, or none, runs on the calling thread */
+	pool = openvcd_new_pool(1);
+	should_not_be_null(pool);
+	should_equal(pool->nthreads, 1);
+	check_job(pool, POOL_TEST_TASKS, POOL_TEST_TASKS);
+	openvcd_free_pool(pool);
+
+	check_job(NULL, POOL_TEST_TASKS, POOL_TEST_TASKS);
+
+	pool = openvcd_new_pool(0);
+	should_not_be_null(pool);
+	should_equal(pool->nthreads, openvcd_processors());
+	check_job(pool, POOL_TEST_TASKS, POOL_TEST_TASKS);
+	openvcd_free_pool(pool);
+}
+
+int main(void) {
+	test_pool();
+	test_pool_serial();
+	return 0;
+}
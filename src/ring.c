@@ -0,0 +1,107 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "ring.h"
+
+#include <sched.h>
+
+int openvcd_ring_init(openvcd_ring* r, size_t capacity) {
+	size_t size;
+
+	size = 1;
+	while (size < capacity) { size *= 2; }
+
+	r->slots = calloc(size, sizeof(void*));
+	if (r->slots == NULL) { return -1; }
+
+	r->mask = size - 1;
+	r->head = 0;
+	r->tail = 0;
+	r->sleeping = 0;
+	pthread_mutex_init(&(r->lock), NULL);
+	pthread_cond_init(&(r->wake), NULL);
+
+	return 0;
+}
+
+void openvcd_ring_clear(openvcd_ring* r) {
+	if (r->slots == NULL) { return; }
+
+	free(r->slots);
+	r->slots = NULL;
+	pthread_mutex_destroy(&(r->lock));
+	pthread_cond_destroy(&(r->wake));
+}
+
+void openvcd_ring_wake(openvcd_ring* r) {
+	pthread_mutex_lock(&(r->lock));
+	pthread_cond_broadcast(&(r->wake));
+	pthread_mutex_unlock(&(r->lock));
+}
+
+bool openvcd_ring_push(openvcd_ring* r, void* item) {
+	size_t head;
+	size_t tail;
+
+	tail = r->tail;
+	head = __atomic_load_n(&(r->head), __ATOMIC_ACQUIRE);
+	if (tail - head > r->mask) { return false; }
+
+	r->slots[tail & r->mask] = item;
+	__atomic_store_n(&(r->tail), tail + 1, __ATOMIC_RELEASE);
+
+	/* either the consumer sees the new tail before it sleeps, or this
+	 * sees that it is asleep, since both sides use sequentially
+	 * consistent ordering between the two */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&(r->sleeping), __ATOMIC_RELAXED)) { openvcd_ring_wake(r); }
+
+	return true;
+}
+
+void* openvcd_ring_pop(openvcd_ring* r) {
+	size_t head;
+	size_t tail;
+	void* item;
+
+	head = r->head;
+	tail = __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE);
+	if (head == tail) { return NULL; }
+
+	item = r->slots[head & r->mask];
+	__atomic_store_n(&(r->head), head + 1, __ATOMIC_RELEASE);
+
+	return item;
+}
+
+bool openvcd_ring_empty(openvcd_ring* r) {
+	return r->head == __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE);
+}
+
+static bool stopped(const int* stop) {
+	return (stop != NULL) && __atomic_load_n(stop, __ATOMIC_ACQUIRE);
+}
+
+void* openvcd_ring_wait_pop(openvcd_ring* r, const int* stop) {
+	void* item;
+
+	for (int i = 0 ; i < OPENVCD_RING_SPINS ; i++) {
+		item = openvcd_ring_pop(r);
+		if (item != NULL) { return item; }
+		if (stopped(stop)) { return NULL; }
+		sched_yield();
+	}
+
+	pthread_mutex_lock(&(r->lock));
+	__atomic_store_n(&(r->sleeping), 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (((item = openvcd_ring_pop(r)) == NULL) && !stopped(stop)) {
+		pthread_cond_wait(&(r->wake), &(r->lock));
+	}
+	__atomic_store_n(&(r->sleeping), 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&(r->lock));
+
+	return item;
+}
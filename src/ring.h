@@ -0,0 +1,138 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements a bounded, lock-free queue of pointers between
+ * exactly one producer thread and exactly one consumer thread.
+ *
+ * The producer only writes tail and the consumer only writes head, so
+ * neither needs a lock: each publishes it's index with a release store, and
+ * reads the other's with an acquire load. The indices count up forever, and
+ * are reduced modulo the capacity, which is a power of two, when used.
+ *
+ * Pushing to a full ring and popping from an empty one fail rather than
+ * block, and openvcd_ring_wait_pop() can be used to wait for an item. A
+ * waiting consumer spins for a while, since the producer is usually about
+ * to push, but then sleeps on a condition variable, so that a stage waiting
+ * on a slow producer, such as a simulator writing to a pipe, doesn't keep a
+ * processor busy. The producer only takes the lock to wake a consumer which
+ * is actually asleep.
+ */
+
+#ifndef OPENVCD_RING_H
+#define OPENVCD_RING_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "util.h"
+
+/**** TYPES ******************************************************************/
+
+/* keeps the producer's and consumer's indices on separate cache lines */
+#define OPENVCD_RING_PAD 64
+
+/* the number of times openvcd_ring_wait_pop() checks for an item before it
+ * goes to sleep */
+#define OPENVCD_RING_SPINS 64
+
+typedef struct {
+	void** slots;
+	size_t mask;
+
+	/* next slot to pop, only written by the consumer */
+	char pad0[OPENVCD_RING_PAD];
+	size_t head;
+
+	/* next slot to push, only written by the producer */
+	char pad1[OPENVCD_RING_PAD];
+	size_t tail;
+	char pad2[OPENVCD_RING_PAD];
+
+	/* set while the consumer is asleep, or about to be, under lock */
+	int sleeping;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+} openvcd_ring;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Initialize an empty ring in place.
+ *
+ * @param r
+ * @param capacity The minimum number of items the ring can hold, which is
+ * rounded up to a power of two.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_ring_init(openvcd_ring* r, size_t capacity);
+
+/**
+ * @brief Release the memory held by a ring, but not the items in it.
+ *
+ * @param r
+ */
+void openvcd_ring_clear(openvcd_ring* r);
+
+/**
+ * @brief Add an item to the ring, from the producer thread.
+ *
+ * @param r
+ * @param item Must not be NULL.
+ *
+ * @return false if the ring is full.
+ */
+bool openvcd_ring_push(openvcd_ring* r, void* item);
+
+/**
+ * @brief Remove the oldest item from the ring, from the consumer thread.
+ *
+ * @param r
+ *
+ * @return The item, or NULL if the ring is empty.
+ */
+void* openvcd_ring_pop(openvcd_ring* r);
+
+/**
+ * @brief Return true if the ring has no items, from the consumer thread.
+ *
+ * @param r
+ *
+ * @return
+ */
+bool openvcd_ring_empty(openvcd_ring* r);
+
+/**
+ * @brief Wait for an item, sleeping if the ring stays empty.
+ *
+ * @param r
+ * @param stop Checked while waiting, and if it becomes non-zero the wait is
+ * abandoned, once openvcd_ring_wake() is called. May be NULL.
+ *
+ * @return The item, or NULL if *stop became non-zero.
+ */
+void* openvcd_ring_wait_pop(openvcd_ring* r, const int* stop);
+
+/**
+ * @brief Wake the consumer if it is waiting, so that it checks it's stop
+ * flag again.
+ *
+ * This may be called from any thread, after setting the flag.
+ *
+ * @param r
+ */
+void openvcd_ring_wake(openvcd_ring* r);
+
+#endif /* OPENVCD_RING_H */
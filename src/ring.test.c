@@ -0,0 +1,126 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <pthread.h>
+#include <unistd.h>
+
+#include "test_util.h"
+#include "ring.h"
+
+#define RING_TEST_ITEMS 100000
+
+void test_ring(void) {
+	openvcd_ring r;
+	int items[8];
+
+	should_equal(openvcd_ring_init(&r, 3), 0);
+	should_equal(r.mask, 3);
+	should_be_true(openvcd_ring_empty(&r));
+	should_be_null(openvcd_ring_pop(&r));
+
+	for (int i = 0 ; i < 4 ; i++) {
+		should_be_true(openvcd_ring_push(&r, &(items[i])));
+	}
+	should_be_false(openvcd_ring_push(&r, &(items[4])));
+	should_be_false(openvcd_ring_empty(&r));
+
+	/* items come out in the order they went in, across the wrap */
+	should_equal(openvcd_ring_pop(&r), &(items[0]));
+	should_equal(openvcd_ring_pop(&r), &(items[1]));
+	should_be_true(openvcd_ring_push(&r, &(items[4])));
+	should_be_true(openvcd_ring_push(&r, &(items[5])));
+	for (int i = 2 ; i < 6 ; i++) {
+		should_equal(openvcd_ring_wait_pop(&r, NULL), &(items[i]));
+	}
+	should_be_true(openvcd_ring_empty(&r));
+
+	openvcd_ring_clear(&r);
+}
+
+static void* produce(void* arg) {
+	openvcd_ring* r;
+
+	r = (openvcd_ring*) arg;
+	for (uintptr_t i = 1 ; i <= RING_TEST_ITEMS ; i++) {
+		while (!openvcd_ring_push(r, (void*) i)) { }
+	}
+
+	return NULL;
+}
+
+void test_ring_threads(void) {
+	pthread_t producer;
+	openvcd_ring r;
+	int stop;
+
+	should_equal(openvcd_ring_init(&r, 16), 0);
+	should_equal(pthread_create(&producer, NULL, produce, &r), 0);
+
+	for (uintptr_t i = 1 ; i <= RING_TEST_ITEMS ; i++) {
+		should_equal((uintptr_t) openvcd_ring_wait_pop(&r, NULL), i);
+	}
+
+	pthread_join(producer, NULL);
+
+	/* a wait is abandoned once stop is set */
+	stop = 1;
+	should_be_null(openvcd_ring_wait_pop(&r, &stop));
+
+	openvcd_ring_clear(&r);
+}
+
+typedef struct {
+	openvcd_ring r;
+	int stop;
+	void* item;
+} sleeper;
+
+static void* sleep_pop(void* arg) {
+	sleeper* z;
+
+	z = (sleeper*) arg;
+	z->item = openvcd_ring_wait_pop(&(z->r), &(z->stop));
+	return NULL;
+}
+
+/* wait until the consumer has given up spinning */
+static void wait_asleep(sleeper* z) {
+	while (!__atomic_load_n(&(z->r.sleeping), __ATOMIC_ACQUIRE)) { usleep(1000); }
+}
+
+void test_ring_sleep(void) {
+	pthread_t consumer;
+	sleeper z;
+	int item;
+
+	/* a slow producer wakes the consumer */
+	should_equal(openvcd_ring_init(&(z.r), 4), 0);
+	z.stop = 0;
+	should_equal(pthread_create(&consumer, NULL, sleep_pop, &z), 0);
+	wait_asleep(&z);
+	should_be_true(openvcd_ring_push(&(z.r), &item));
+	pthread_join(consumer, NULL);
+	should_equal(z.item, &item);
+	should_equal(z.r.sleeping, 0);
+
+	/* and so does stopping it */
+	should_equal(pthread_create(&consumer, NULL, sleep_pop, &z), 0);
+	wait_asleep(&z);
+	__atomic_store_n(&(z.stop), 1, __ATOMIC_RELEASE);
+	openvcd_ring_wake(&(z.r));
+	pthread_join(consumer, NULL);
+	should_be_null(z.item);
+
+	openvcd_ring_clear(&(z.r));
+}
+
+int main(void) {
+	test_ring();
+	test_ring_threads();
+	test_ring_sleep();
+	return 0;
+}
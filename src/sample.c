@@ -0,0 +1,175 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "sample.h"
+
+/* the state of bit 0 of the clock, with OPENVCD_BLOCK_LAST_XZ set if any of
+ * it's bits are x or z */
+static int clock_state(const openvcd_cursor* c) {
+	int state;
+
+	state = (int) (((c->bval[0] & 1) << 1) | (c->aval[0] & 1));
+	if (openvcd_value_has_xz(c->signals[0]->nwords, c->bval)) { state |= OPENVCD_BLOCK_LAST_XZ; }
+
+	return state;
+}
+
+void openvcd_free_table(openvcd_table* t) {
+	if (t->columns != NULL) {
+		for (size_t i = 0 ; i < t->ncolumns ; i++) {
+			free(t->columns[i].aval);
+			free(t->columns[i].bval);
+			free(t->columns[i].validity);
+		}
+	}
+
+	free(t->columns);
+	free(t->times);
+	free(t);
+}
+
+bool openvcd_column_valid(const openvcd_column* c, size_t row) {
+	return (c->validity[row / 8] & (1 << (row % 8))) != 0;
+}
+
+static int grow_table(openvcd_table* t) {
+	openvcd_column* c;
+	uint64_t* words;
+	uint8_t* bytes;
+	size_t cap;
+
+	cap = (t->capacity == 0) ? 64 : t->capacity * 2;
+
+	words = realloc(t->times, cap * sizeof(uint64_t));
+	if (words == NULL) { return -1; }
+	t->times = words;
+
+	for (size_t i = 0 ; i < t->ncolumns ; i++) {
+		c = &(t->columns[i]);
+
+		words = realloc(c->aval, cap * c->nwords * sizeof(uint64_t));
+		if (words == NULL) { return -1; }
+		c->aval = words;
+
+		words = realloc(c->bval, cap * c->nwords * sizeof(uint64_t));
+		if (words == NULL) { return -1; }
+		c->bval = words;
+
+		bytes = realloc(c->validity, cap / 8);
+		if (bytes == NULL) { return -1; }
+		memset(bytes + (t->capacity / 8), 0, (cap - t->capacity) / 8);
+		c->validity = bytes;
+	}
+
+	t->capacity = cap;
+	return 0;
+}
+
+/* add a row of the current values of the sampled signals */
+static int add_row(openvcd_table* t, const openvcd_cursor* values, uint64_t time) {
+	openvcd_column* c;
+	size_t row;
+	size_t n;
+
+	if ((t->nrows == t->capacity) && (grow_table(t) != 0)) { return -1; }
+
+	row = t->nrows++;
+	t->times[row] = time;
+
+	for (size_t i = 0 ; i < t->ncolumns ; i++) {
+		c = &(t->columns[i]);
+		n = c->nwords * sizeof(uint64_t);
+
+		if (values->valid[i]) {
+			memcpy(c->aval + (row * c->nwords), values->aval + values->offsets[i], n);
+			memcpy(c->bval + (row * c->nwords), values->bval + values->offsets[i], n);
+			c->validity[row / 8] |= (uint8_t) (1 << (row % 8));
+		} else {
+			memset(c->aval + (row * c->nwords), 0, n);
+			memset(c->bval + (row * c->nwords), 0, n);
+			c->null_count++;
+		}
+	}
+
+	return 0;
+}
+
+/* apply the changes of the sampled signals up to an edge */
+static int catch_up(openvcd_cursor* values, uint64_t time, bool before_edge) {
+	uint64_t next;
+
+	while (openvcd_cursor_peek(values, &next) && (before_edge ? (next < time) : (next <= time))) {
+		if (openvcd_cursor_next(values) < 0) { return -1; }
+	}
+
+	return 0;
+}
+
+static int sample(openvcd_table* t, openvcd_cursor* clock, openvcd_cursor* values, const openvcd_sample_spec* spec) {
+	int from;
+	int to;
+	int rc;
+
+	from = -1;
+	if (spec->from > 0) {
+		if ((openvcd_cursor_seek(clock, spec->from - 1) != 0) ||
+			(openvcd_cursor_seek(values, spec->from - 1) != 0)) {
+			return -1;
+		}
+		if (clock->valid[0]) { from = clock_state(clock); }
+	}
+
+	while ((rc = openvcd_cursor_next(clock)) > 0) {
+		if (clock->time > spec->to) { break; }
+
+		to = clock_state(clock);
+		if (openvcd_is_edge(spec->clock, spec->edge, from, to)) {
+			if (catch_up(values, clock->time, spec->before_edge) != 0) { return -1; }
+			if (add_row(t, values, clock->time) != 0) { return -1; }
+		}
+		from = to;
+	}
+
+	return (rc < 0) ? -1 : 0;
+}
+
+openvcd_table* openvcd_sample(openvcd_wave* w, const openvcd_sample_spec* spec) {
+	openvcd_cursor* values;
+	openvcd_cursor* clock;
+	openvcd_signal* clocks[1];
+	openvcd_table* t;
+	int rc;
+
+	t = calloc(1, sizeof(openvcd_table));
+	if (t == NULL) { return NULL; }
+
+	t->columns = calloc(spec->nsignals + 1, sizeof(openvcd_column));
+	if (t->columns == NULL) {
+		openvcd_free_table(t);
+		return NULL;
+	}
+	t->ncolumns = spec->nsignals;
+	for (size_t i = 0 ; i < spec->nsignals ; i++) {
+		t->columns[i].signal = spec->signals[i];
+		t->columns[i].nwords = spec->signals[i]->nwords;
+	}
+
+	clocks[0] = spec->clock;
+	clock = openvcd_new_cursor(w, clocks, 1);
+	values = openvcd_new_cursor(w, spec->signals, spec->nsignals);
+
+	rc = ((clock == NULL) || (values == NULL)) ? -1 : 0;
+	if ((rc == 0) && (spec->from <= spec->to)) { rc = sample(t, clock, values, spec); }
+
+	if (clock != NULL) { openvcd_free_cursor(clock); }
+	if (values != NULL) { openvcd_free_cursor(values); }
+
+	if (rc != 0) {
+		openvcd_free_table(t);
+		return NULL;
+	}
+
+	return t;
+}
@@ -0,0 +1,125 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements sampling signals at the edges of a clock into a
+ * table, with one row per edge, for feeding to analysis tools which expect
+ * cycle based data rather than value changes.
+ *
+ * The table is stored by column: each signal's samples are packed one after
+ * the other in arrays of words, with a bitmap of which rows have a value,
+ * so that a column can be handed on without being copied.
+ *
+ * The clock and the sampled signals are walked with two cursors, see
+ * cursor.h. At each edge of the clock, the cursor over the sampled signals
+ * is moved up to the edge and it's dense array of values is copied into
+ * the new row, so the cost depends on the number of changes and rows,
+ * not on looking up each sample separately.
+ */
+
+#ifndef OPENVCD_SAMPLE_H
+#define OPENVCD_SAMPLE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "value.h"
+#include "wave.h"
+#include "edge.h"
+#include "cursor.h"
+
+/**** TYPES ******************************************************************/
+
+typedef struct {
+	/* the clock, and which of it's edges to sample at, see edge.h, with
+	 * OPENVCD_EDGE_ANY sampling at every recorded change of it */
+	openvcd_signal* clock;
+	openvcd_edge_kind edge;
+
+	/* the signals to sample, one column each */
+	openvcd_signal** signals;
+	size_t nsignals;
+
+	/* only edges from from to to, inclusive, are sampled */
+	uint64_t from;
+	uint64_t to;
+
+	/* If true, each sample is the value just before the edge, as a flip
+	 * flop would see it. Otherwise it includes the changes at the same
+	 * time as the edge. */
+	bool before_edge;
+} openvcd_sample_spec;
+
+typedef struct {
+	const openvcd_signal* signal;
+
+	/* the words of each sample, nwords of them per row */
+	unsigned int nwords;
+	uint64_t* aval;
+	uint64_t* bval;
+
+	/* bit i of byte i / 8 is set if row i has a value, the signal having
+	 * changed before it */
+	uint8_t* validity;
+
+	/* the number of rows without a value */
+	size_t null_count;
+} openvcd_column;
+
+typedef struct {
+	/* the time of each row's edge */
+	uint64_t* times;
+	size_t nrows;
+	size_t capacity;
+
+	openvcd_column* columns;
+	size_t ncolumns;
+} openvcd_table;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Sample signals at the edges of a clock.
+ *
+ * Edges are found from the clock's bit 0 as in openvcd_find_edge(). Only
+ * the last value of the clock at each time is looked at, so a glitch which
+ * changes and restores it at a single time is not an edge. Lazily opened
+ * signals are loaded.
+ *
+ * @param w
+ * @param spec
+ *
+ * @return The table, which must be free-ed with openvcd_free_table(), or
+ * NULL on failure.
+ */
+openvcd_table* openvcd_sample(openvcd_wave* w, const openvcd_sample_spec* spec);
+
+/**
+ * @brief Free a table.
+ *
+ * @param t
+ */
+void openvcd_free_table(openvcd_table* t);
+
+/**
+ * @brief Check if a row of a column has a value.
+ *
+ * @param c
+ * @param row
+ *
+ * @return true if it has one.
+ */
+bool openvcd_column_valid(const openvcd_column* c, size_t row);
+
+#endif /* OPENVCD_SAMPLE_H */
@@ -0,0 +1,214 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "sample.h"
+
+/* a clock with a period of 10, a counter which changes on it's rising
+ * edges, a wide bus, and a signal which only changes at 35 */
+static const char* input =
+	"$timescale 1ns $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 c clk $end\n"
+	"$var reg 8 n count [7:0] $end\n"
+	"$var reg 70 w bus [69:0] $end\n"
+	"$var wire 1 l late $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\n0c\nb0 n\nb0 w\n"
+	"#5\n1c\nb1 n\n"
+	"#10\n0c\n"
+	"#15\n1c\nb10 n\n"
+	"#20\n0c\n"
+	"#25\n1c\nb11 n\nb1000000000000000000000000000000000000000000000000000000000000000011 w\n"
+	"#30\n0c\n"
+	"#35\n1c\nb100 n\n1l\n"
+	"#40\n0c\n"
+	"#42\nxc\n"
+	"#45\n1c\nb101 n\n";
+
+static openvcd_table* sample(openvcd_wave* w, openvcd_edge_kind edge, bool before_edge, uint64_t from, uint64_t to) {
+	openvcd_signal* signals[3];
+	openvcd_sample_spec spec;
+	openvcd_table* t;
+
+	signals[0] = openvcd_wave_find_signal(w, "n");
+	signals[1] = openvcd_wave_find_signal(w, "w");
+	signals[2] = openvcd_wave_find_signal(w, "l");
+
+	spec.clock = openvcd_wave_find_signal(w, "c");
+	spec.edge = edge;
+	spec.signals = signals;
+	spec.nsignals = 3;
+	spec.from = from;
+	spec.to = to;
+	spec.before_edge = before_edge;
+
+	t = openvcd_sample(w, &spec);
+	should_not_be_null(t);
+	should_equal(t->ncolumns, 3);
+
+	return t;
+}
+
+void test_sample_posedge(void) {
+	const openvcd_column* count;
+	const openvcd_column* bus;
+	const openvcd_column* late;
+	openvcd_table* t;
+	openvcd_wave* w;
+
+	w = load_string(input);
+
+	/* with the changes at each edge, including 0 to x at 42 and x to 1
+	 * at 45 */
+	t = sample(w, OPENVCD_EDGE_POSEDGE, false, 0, UINT64_MAX);
+	count = &(t->columns[0]);
+	bus = &(t->columns[1]);
+	late = &(t->columns[2]);
+
+	should_equal(t->nrows, 6);
+	for (size_t i = 0 ; i < 4 ; i++) {
+		should_equal(t->times[i], 5 + (10 * i));
+		should_equal(count->aval[i], i + 1);
+		should_be_true(openvcd_column_valid(count, i));
+	}
+	should_equal(t->times[4], 42);
+	should_equal(count->aval[4], 4);
+	should_equal(t->times[5], 45);
+	should_equal(count->aval[5], 5);
+
+	should_equal(bus->nwords, 2);
+	should_equal(bus->aval[(1 * 2) + 1], 0);
+	should_equal(bus->aval[(2 * 2) + 0], 3);
+	should_equal(bus->aval[(2 * 2) + 1], 4);
+
+	should_equal(late->null_count, 3);
+	should_be_false(openvcd_column_valid(late, 2));
+	should_be_true(openvcd_column_valid(late, 3));
+	should_equal(late->aval[3], 1);
+
+	openvcd_free_table(t);
+
+	/* the values just before each edge, as flip flops see them */
+	t = sample(w, OPENVCD_EDGE_POSEDGE, true, 0, UINT64_MAX);
+	should_equal(t->nrows, 6);
+	for (size_t i = 0 ; i < 5 ; i++) {
+		should_equal(t->columns[0].aval[i], i);
+	}
+	should_equal(t->columns[0].aval[5], 4);
+	should_equal(t->columns[2].null_count, 4);
+	openvcd_free_table(t);
+
+	openvcd_free_wave(w);
+}
+
+void test_sample_edges(void) {
+	openvcd_table* t;
+	openvcd_wave* w;
+
+	w = load_string(input);
+
+	/* 1 to 0 at 10 to 40, and 0 to x at 42 isn't falling */
+	t = sample(w, OPENVCD_EDGE_NEGEDGE, false, 0, UINT64_MAX);
+	should_equal(t->nrows, 4);
+	should_equal(t->times[0], 10);
+	should_equal(t->times[3], 40);
+	openvcd_free_table(t);
+
+	/* every change of the clock, including it's first value at 0 */
+	t = sample(w, OPENVCD_EDGE_ANY, false, 0, UINT64_MAX);
+	should_equal(t->nrows, 11);
+	should_equal(t->times[0], 0);
+	openvcd_free_table(t);
+
+	t = sample(w, OPENVCD_EDGE_XZ, false, 0, UINT64_MAX);
+	should_equal(t->nrows, 1);
+	should_equal(t->times[0], 42);
+	should_equal(t->columns[0].aval[0], 4);
+	openvcd_free_table(t);
+
+	openvcd_free_wave(w);
+}
+
+void test_sample_range(void) {
+	openvcd_table* t;
+	openvcd_wave* w;
+
+	w = load_string(input);
+
+	/* edges at the ends of the range are included */
+	t = sample(w, OPENVCD_EDGE_POSEDGE, false, 15, 35);
+	should_equal(t->nrows, 3);
+	should_equal(t->times[0], 15);
+	should_equal(t->columns[0].aval[0], 2);
+	should_equal(t->times[2], 35);
+	openvcd_free_table(t);
+
+	t = sample(w, OPENVCD_EDGE_POSEDGE, true, 16, 34);
+	should_equal(t->nrows, 1);
+	should_equal(t->columns[0].aval[0], 2);
+	openvcd_free_table(t);
+
+	t = sample(w, OPENVCD_EDGE_POSEDGE, false, 30, 20);
+	should_equal(t->nrows, 0);
+	openvcd_free_table(t);
+
+	openvcd_free_wave(w);
+}
+
+/* enough rows to grow the table several times */
+void test_sample_many(void) {
+	openvcd_signal* signals[1];
+	openvcd_sample_spec spec;
+	openvcd_table* t;
+	openvcd_wave* w;
+	char* buffer;
+	size_t length;
+	FILE* f;
+
+	f = open_memstream(&buffer, &length);
+	should_not_be_null(f);
+	fprintf(f, "$var wire 1 c clk $end\n$var reg 16 n count $end\n$enddefinitions $end\n");
+	for (int i = 0 ; i < 1000 ; i++) {
+		fprintf(f, "#%d\n0c\n#%d\n1c\n", 10 * i, (10 * i) + 5);
+		if (i % 3 == 0) { fprintf(f, "b%d%d n\n", (i >> 1) & 1, i & 1); }
+	}
+	fclose(f);
+
+	w = load_buffer(buffer, length);
+
+	signals[0] = openvcd_wave_find_signal(w, "n");
+	spec.clock = openvcd_wave_find_signal(w, "c");
+	spec.edge = OPENVCD_EDGE_POSEDGE;
+	spec.signals = signals;
+	spec.nsignals = 1;
+	spec.from = 0;
+	spec.to = UINT64_MAX;
+	spec.before_edge = true;
+
+	t = openvcd_sample(w, &spec);
+	should_not_be_null(t);
+	should_equal(t->nrows, 1000);
+	should_equal(t->columns[0].null_count, 1);
+	for (size_t i = 1 ; i < 1000 ; i++) {
+		should_equal(t->columns[0].aval[i], ((i - 1) / 3 * 3) & 3);
+	}
+
+	openvcd_free_table(t);
+	openvcd_free_wave(w);
+	free(buffer);
+}
+
+int main(void) {
+	test_sample_posedge();
+	test_sample_edges();
+	test_sample_range();
+	test_sample_many();
+	return 0;
+}
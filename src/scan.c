@@ -0,0 +1,248 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "scan.h"
+
+static bool token_eq(const char* token, size_t length, const char* s) {
+	return (strlen(s) == length) && (strncmp(token, s, length) == 0);
+}
+
+static openvcd_scan_status scan_error(openvcd_scanner* s, size_t offset, const char* what) {
+	free(s->error_string);
+	s->error_string = NULL;
+	s->error_offset = offset;
+	asprintf(&(s->error_string),
+		"syntax error at byte %lu of value change section, %s",
+		(unsigned long) offset, what);
+	return OPENVCD_SCAN_ERROR;
+}
+
+openvcd_scanner* openvcd_new_scanner(const char* buffer, size_t length, bool final) {
+	openvcd_scanner* s;
+
+	s = malloc(sizeof(openvcd_scanner));
+	if (s == NULL) { return NULL; }
+
+	openvcd_init_scanner(s, buffer, length, final);
+
+	return s;
+}
+
+void openvcd_init_scanner(openvcd_scanner* s, const char* buffer, size_t length, bool final) {
+	s->buffer = buffer;
+	s->length = length;
+	s->position = 0;
+	s->final = final;
+	s->time = 0;
+	s->dumping = true;
+	s->error_string = NULL;
+	s->error_offset = 0;
+}
+
+void openvcd_clear_scanner(openvcd_scanner* s) {
+	free(s->error_string);
+	s->error_string = NULL;
+}
+
+void openvcd_free_scanner(openvcd_scanner* s) {
+	openvcd_clear_scanner(s);
+	free(s);
+}
+
+void openvcd_scanner_feed(openvcd_scanner* s, const char* buffer, size_t length, bool final) {
+	s->buffer = buffer;
+	s->length = length;
+	s->position = 0;
+	s->final = final;
+}
+
+openvcd_scan_status openvcd_scan_token(openvcd_scanner* s, const char** token, size_t* length) {
+	size_t start;
+	size_t end;
+
+	start = s->position;
+	while ((start < s->length) && OPENVCD_IS_WHITESPACE(s->buffer[start])) {
+		start++;
+	}
+
+	if (start >= s->length) {
+		return s->final ? OPENVCD_SCAN_EOF : OPENVCD_SCAN_NEED_MORE;
+	}
+
+	end = start;
+	while ((end < s->length) && !OPENVCD_IS_WHITESPACE(s->buffer[end])) {
+		end++;
+	}
+
+	/* we can't know if the token is complete until we see the whitespace
+	 * after it */
+	if ((end >= s->length) && !s->final) {
+		return OPENVCD_SCAN_NEED_MORE;
+	}
+
+	*token = s->buffer + start;
+	*length = end - start;
+	s->position = end;
+
+	return OPENVCD_SCAN_OK;
+}
+
+static openvcd_scan_status scan_time(openvcd_scanner* s, openvcd_change* c, const char* token, size_t length) {
+	uint64_t digit;
+	uint64_t t;
+
+	if (length < 2) {
+		return scan_error(s, c->offset, "expected digits after '#'");
+	}
+
+	t = 0;
+	for (size_t i = 1 ; i < length ; i++) {
+		if ((token[i] < '0') || (token[i] > '9')) {
+			return scan_error(s, c->offset, "invalid simulation time");
+		}
+		digit = (uint64_t) (token[i] - '0');
+		if (t > ((UINT64_MAX - digit) / 10)) {
+			return scan_error(s, c->offset, "simulation time overflows");
+		}
+		t = (t * 10) + digit;
+	}
+
+	s->time = t;
+	c->type = OPENVCD_CHANGE_TIME;
+	c->time = t;
+	c->value = token + 1;
+	c->value_length = length - 1;
+
+	return OPENVCD_SCAN_OK;
+}
+
+static openvcd_scan_status scan_scalar(openvcd_scanner* s, openvcd_change* c, const char* token, size_t length) {
+	if (length < 2) {
+		return scan_error(s, c->offset, "scalar value change has no identifier code");
+	}
+
+	c->type = OPENVCD_CHANGE_SCALAR;
+	c->value = token;
+	c->value_length = 1;
+	c->id = token + 1;
+	c->id_length = length - 1;
+
+	return OPENVCD_SCAN_OK;
+}
+
+static openvcd_scan_status scan_vector(openvcd_scanner* s, openvcd_change* c, const char* token, size_t length) {
+	openvcd_scan_status st;
+
+	c->type = ((token[0] == 'r') || (token[0] == 'R')) ?
+		OPENVCD_CHANGE_REAL : OPENVCD_CHANGE_VECTOR;
+	c->value = token + 1;
+	c->value_length = length - 1;
+
+	st = openvcd_scan_token(s, &(c->id), &(c->id_length));
+	if (st == OPENVCD_SCAN_EOF) {
+		return scan_error(s, c->offset, "vector value change has no identifier code");
+	}
+
+	return st;
+}
+
+/* skip a $comment ... $end block, the $comment token has already been read */
+static openvcd_scan_status scan_comment(openvcd_scanner* s, size_t offset) {
+	openvcd_scan_status st;
+	const char* token;
+	size_t length;
+
+	for (;;) {
+		st = openvcd_scan_token(s, &token, &length);
+		if (st == OPENVCD_SCAN_EOF) {
+			return scan_error(s, offset, "got EOF while parsing $comment");
+		}
+		if (st != OPENVCD_SCAN_OK) { return st; }
+		if (token_eq(token, length, "$end")) { return OPENVCD_SCAN_OK; }
+	}
+}
+
+static openvcd_scan_status scan_command(openvcd_scanner* s, openvcd_change* c, const char* token, size_t length) {
+	if (token_eq(token, length, "$dumpoff")) {
+		s->dumping = false;
+	} else if (token_eq(token, length, "$dumpon")) {
+		s->dumping = true;
+	}
+
+	c->type = OPENVCD_CHANGE_COMMAND;
+	c->value = token;
+	c->value_length = length;
+
+	return OPENVCD_SCAN_OK;
+}
+
+openvcd_scan_status openvcd_scan_next(openvcd_scanner* s, openvcd_change* c) {
+	openvcd_scan_status st;
+	const char* token;
+	size_t length;
+	size_t start;
+
+	for (;;) {
+		start = s->position;
+		st = openvcd_scan_token(s, &token, &length);
+		if (st != OPENVCD_SCAN_OK) { return st; }
+
+		c->offset = (size_t) (token - s->buffer);
+		c->time = s->time;
+		c->id = NULL;
+		c->id_length = 0;
+
+		if (token[0] == '#') {
+			st = scan_time(s, c, token, length);
+		} else if (OPENVCD_IS_SCALAR_STATE(token[0])) {
+			st = scan_scalar(s, c, token, length);
+		} else if ((token[0] == 'b') || (token[0] == 'B') ||
+			   (token[0] == 'r') || (token[0] == 'R')) {
+			st = scan_vector(s, c, token, length);
+		} else if (token_eq(token, length, "$comment")) {
+			st = scan_comment(s, c->offset);
+			if (st == OPENVCD_SCAN_OK) { continue; }
+		} else if (token[0] == '$') {
+			st = scan_command(s, c, token, length);
+		} else {
+			st = scan_error(s, c->offset, "unrecognized value change");
+		}
+
+		/* hold back the whole record so it can be re-read once more
+		 * input is available */
+		if (st == OPENVCD_SCAN_NEED_MORE) { s->position = start; }
+
+		return st;
+	}
+}
+
+bool openvcd_find_body(const char* buffer, size_t length, size_t* offset) {
+	openvcd_scanner s;
+	const char* token;
+	size_t toklen;
+	bool in_enddefinitions;
+
+	openvcd_init_scanner(&s, buffer, length, true);
+
+	in_enddefinitions = false;
+	while (openvcd_scan_token(&s, &token, &toklen) == OPENVCD_SCAN_OK) {
+		if (token_eq(token, toklen, "$comment")) {
+			if (scan_comment(&s, 0) != OPENVCD_SCAN_OK) { break; }
+		} else if (token_eq(token, toklen, "$enddefinitions")) {
+			in_enddefinitions = true;
+		} else if (in_enddefinitions && token_eq(token, toklen, "$end")) {
+			*offset = s.position;
+			openvcd_clear_scanner(&s);
+			return true;
+		}
+	}
+
+	openvcd_clear_scanner(&s);
+	return false;
+}
+
+bool openvcd_change_id_eq(const openvcd_change* c, const char* id, size_t length) {
+	return (c->id_length == length) && (memcmp(c->id, id, length) == 0);
+}
@@ -0,0 +1,233 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements a scanner for the value change section of a VCD file,
+ * that is everything after $enddefinitions.
+ *
+ * The token-at-a-time lexer in parser.h allocates a new token for every
+ * word it reads, which is fine for the declarations but far too slow for
+ * the value changes, which make up nearly all of a real VCD file. The
+ * scanner implemented here instead works directly on a caller-provided
+ * buffer and never allocates; each record it returns points back into that
+ * buffer.
+ *
+ * The scanner can also be used on a buffer which is not the complete input,
+ * for example a chunk read from a pipe. If the buffer is not marked as final,
+ * a record which runs up against the end of the buffer is held back and
+ * OPENVCD_SCAN_NEED_MORE is returned, so that the caller can append more
+ * input and try again.
+ */
+
+#ifndef OPENVCD_SCAN_H
+#define OPENVCD_SCAN_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/**** TYPES ******************************************************************/
+
+typedef enum {
+	/* a record was read successfully */
+	OPENVCD_SCAN_OK=0,
+
+	/* there are no more records in the input */
+	OPENVCD_SCAN_EOF,
+
+	/* the buffer ends part way through a record, and is not final */
+	OPENVCD_SCAN_NEED_MORE,
+
+	/* the input is malformed, see error_string */
+	OPENVCD_SCAN_ERROR,
+} openvcd_scan_status;
+
+typedef enum {
+	/* a simulation time, e.g. #100 */
+	OPENVCD_CHANGE_TIME,
+
+	/* a scalar value change, e.g. 1! */
+	OPENVCD_CHANGE_SCALAR,
+
+	/* a vector value change, e.g. b1010 ! */
+	OPENVCD_CHANGE_VECTOR,
+
+	/* a real value change, e.g. r1.5 ! */
+	OPENVCD_CHANGE_REAL,
+
+	/* a simulation command, such as $dumpvars or $end */
+	OPENVCD_CHANGE_COMMAND,
+} openvcd_change_type;
+
+/* A single record from the value change section. The id and value fields
+ * point into the scanner's buffer and are not null terminated. */
+typedef struct {
+	openvcd_change_type type;
+
+	/* the simulation time at which this record occurs */
+	uint64_t time;
+
+	/* identifier code, only meaningful for value changes */
+	const char* id;
+	size_t id_length;
+
+	/* the value without it's leading 'b' or 'r' for vectors and reals,
+	 * the single state character for scalars, or the full command text
+	 * for commands. */
+	const char* value;
+	size_t value_length;
+
+	/* byte offset of the start of the record within the buffer */
+	size_t offset;
+} openvcd_change;
+
+typedef struct {
+	const char* buffer;
+	size_t length;
+
+	/* offset of the next byte to read */
+	size_t position;
+
+	/* if false, a record touching the end of the buffer is incomplete */
+	bool final;
+
+	/* the most recent simulation time */
+	uint64_t time;
+
+	/* false between $dumpoff and $dumpon */
+	bool dumping;
+
+	/* only safe to read after OPENVCD_SCAN_ERROR is returned, with the
+	 * offset in the buffer of the record which caused it */
+	char* error_string;
+	size_t error_offset;
+} openvcd_scanner;
+
+/**** UTILITIES **************************************************************/
+
+/* true if the given character may begin a scalar value change */
+#define OPENVCD_IS_SCALAR_STATE(_ch) ( \
+	((_ch) == '0') || ((_ch) == '1') || \
+	((_ch) == 'x') || ((_ch) == 'X') || \
+	((_ch) == 'z') || ((_ch) == 'Z') )
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Allocate a new scanner over the given buffer.
+ *
+ * The buffer is not copied, and must remain valid for as long as the scanner
+ * or any record it has returned is in use.
+ *
+ * @param buffer
+ * @param length
+ * @param final true if the buffer contains all remaining input
+ *
+ * @return The new scanner, which should be free-ed with
+ * openvcd_free_scanner(), or NULL on failure.
+ */
+openvcd_scanner* openvcd_new_scanner(const char* buffer, size_t length, bool final);
+
+/**
+ * @brief Initialize a scanner in place, for example one on the stack.
+ *
+ * Scanners initialized this way should be cleaned up with
+ * openvcd_clear_scanner() rather than openvcd_free_scanner().
+ *
+ * @param s
+ * @param buffer
+ * @param length
+ * @param final
+ */
+void openvcd_init_scanner(openvcd_scanner* s, const char* buffer, size_t length, bool final);
+
+/**
+ * @brief Release any resources held by a scanner initialized with
+ * openvcd_init_scanner().
+ *
+ * @param s
+ */
+void openvcd_clear_scanner(openvcd_scanner* s);
+
+/**
+ * @brief Free a previously allocated scanner.
+ *
+ * @param s
+ */
+void openvcd_free_scanner(openvcd_scanner* s);
+
+/**
+ * @brief Replace the scanner's buffer, keeping the simulation time and dump
+ * state.
+ *
+ * This is used when scanning a stream in chunks. The caller is responsible
+ * for carrying over any bytes that were held back, which are those from
+ * s->position to the end of the old buffer.
+ *
+ * @param s
+ * @param buffer
+ * @param length
+ * @param final
+ */
+void openvcd_scanner_feed(openvcd_scanner* s, const char* buffer, size_t length, bool final);
+
+/**
+ * @brief Read the next whitespace delimited token.
+ *
+ * @param s
+ * @param token Set to the start of the token.
+ * @param length Set to the length of the token.
+ *
+ * @return OPENVCD_SCAN_OK, OPENVCD_SCAN_EOF, or OPENVCD_SCAN_NEED_MORE. On
+ * OPENVCD_SCAN_NEED_MORE, the scanner position is not advanced.
+ */
+openvcd_scan_status openvcd_scan_token(openvcd_scanner* s, const char** token, size_t* length);
+
+/**
+ * @brief Read the next record from the value change section.
+ *
+ * $comment blocks are skipped. $dumpon and $dumpoff update s->dumping in
+ * addition to being returned as commands.
+ *
+ * @param s
+ * @param c Filled in with the record if OPENVCD_SCAN_OK is returned.
+ *
+ * @return
+ */
+openvcd_scan_status openvcd_scan_next(openvcd_scanner* s, openvcd_change* c);
+
+/**
+ * @brief Locate the start of the value change section.
+ *
+ * @param buffer
+ * @param length
+ * @param offset Set to the offset of the first byte after the $end which
+ * terminates $enddefinitions.
+ *
+ * @return true if $enddefinitions was found.
+ */
+bool openvcd_find_body(const char* buffer, size_t length, size_t* offset);
+
+/**
+ * @brief Return true if the record's identifier code matches id.
+ *
+ * @param c
+ * @param id
+ * @param length
+ *
+ * @return
+ */
+bool openvcd_change_id_eq(const openvcd_change* c, const char* id, size_t length);
+
+#endif /* OPENVCD_SCAN_H */
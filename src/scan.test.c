@@ -0,0 +1,171 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "scan.h"
+
+#define should_scan(_s, _c, _type) do { \
+		should_equal(openvcd_scan_next(_s, _c), OPENVCD_SCAN_OK); \
+		should_equal((_c)->type, _type); \
+	} while(0)
+
+void test_scan(void) {
+	openvcd_scanner* s;
+	openvcd_change c;
+	char* input;
+
+	input = "#0\n$dumpvars\n1!\nb1010 \"\nr1.5 #\n$end\n"
+		"$comment this is ignored $end\n"
+		"#10 0!\n"
+		"$dumpoff x! $end\n"
+		"#20\n"
+		"$dumpon\n";
+
+	s = openvcd_new_scanner(input, strlen(input), true);
+	should_not_be_null(s);
+
+	should_scan(s, &c, OPENVCD_CHANGE_TIME);
+	should_equal(c.time, 0);
+	should_scan(s, &c, OPENVCD_CHANGE_COMMAND);
+	should_be_true(strncmp(c.value, "$dumpvars", c.value_length) == 0);
+
+	should_scan(s, &c, OPENVCD_CHANGE_SCALAR);
+	should_be_true(openvcd_change_id_eq(&c, "!", 1));
+	should_equal(c.value[0], '1');
+
+	should_scan(s, &c, OPENVCD_CHANGE_VECTOR);
+	should_be_true(openvcd_change_id_eq(&c, "\"", 1));
+	should_equal(c.value_length, 4);
+	should_be_true(strncmp(c.value, "1010", 4) == 0);
+
+	should_scan(s, &c, OPENVCD_CHANGE_REAL);
+	should_be_true(openvcd_change_id_eq(&c, "#", 1));
+	should_be_true(strncmp(c.value, "1.5", 3) == 0);
+
+	should_scan(s, &c, OPENVCD_CHANGE_COMMAND);
+
+	/* the comment should be skipped entirely */
+	should_scan(s, &c, OPENVCD_CHANGE_TIME);
+	should_equal(c.time, 10);
+	should_scan(s, &c, OPENVCD_CHANGE_SCALAR);
+	should_equal(c.time, 10);
+	should_equal(c.value[0], '0');
+
+	should_scan(s, &c, OPENVCD_CHANGE_COMMAND);
+	should_be_false(s->dumping);
+	should_scan(s, &c, OPENVCD_CHANGE_SCALAR);
+	should_equal(c.value[0], 'x');
+	should_scan(s, &c, OPENVCD_CHANGE_COMMAND);
+	should_scan(s, &c, OPENVCD_CHANGE_TIME);
+	should_equal(c.time, 20);
+	should_scan(s, &c, OPENVCD_CHANGE_COMMAND);
+	should_be_true(s->dumping);
+
+	should_equal(openvcd_scan_next(s, &c), OPENVCD_SCAN_EOF);
+
+	openvcd_free_scanner(s);
+}
+
+void test_scan_need_more(void) {
+	openvcd_scanner* s;
+	openvcd_change c;
+	char* input;
+	char* rest;
+
+	/* the vector change is split across the chunk boundary */
+	input = "#5 1! b10";
+	rest = "b101 % #6\n";
+
+	s = openvcd_new_scanner(input, strlen(input), false);
+	should_not_be_null(s);
+
+	should_scan(s, &c, OPENVCD_CHANGE_TIME);
+	should_scan(s, &c, OPENVCD_CHANGE_SCALAR);
+	should_equal(openvcd_scan_next(s, &c), OPENVCD_SCAN_NEED_MORE);
+
+	/* the held back record should still be there */
+	should_equal(strlen(input) - s->position, 4);
+
+	openvcd_scanner_feed(s, rest, strlen(rest), true);
+	should_scan(s, &c, OPENVCD_CHANGE_VECTOR);
+	should_equal(c.time, 5);
+	should_be_true(openvcd_change_id_eq(&c, "%", 1));
+	should_scan(s, &c, OPENVCD_CHANGE_TIME);
+	should_equal(c.time, 6);
+	should_equal(openvcd_scan_next(s, &c), OPENVCD_SCAN_EOF);
+
+	openvcd_free_scanner(s);
+}
+
+void test_scan_errors(void) {
+	static char* errors[] = {
+		"#12a\n",
+		"#18446744073709551616\n",
+		"b1010\n",
+		"1\n",
+		"hello\n",
+		"$comment never closed\n",
+		NULL,
+	};
+
+	for (int i = 0 ; errors[i] != NULL ; i++) {
+		openvcd_scanner* s;
+		openvcd_change c;
+		openvcd_scan_status st;
+
+		s = openvcd_new_scanner(errors[i], strlen(errors[i]), true);
+		do {
+			st = openvcd_scan_next(s, &c);
+		} while (st == OPENVCD_SCAN_OK);
+
+		if (st != OPENVCD_SCAN_ERROR) {
+			printf("considering input string: %s\n", errors[i]);
+			fail("scanner should have returned an error but did not!%s\n", "");
+		}
+		should_not_be_null(s->error_string);
+
+		openvcd_free_scanner(s);
+	}
+}
+
+void test_scan_max_time(void) {
+	openvcd_scanner* s;
+	openvcd_change c;
+	char* input;
+
+	/* the largest time which fits, one more is an error above */
+	input = "#18446744073709551615\n";
+	s = openvcd_new_scanner(input, strlen(input), true);
+	should_scan(s, &c, OPENVCD_CHANGE_TIME);
+	should_equal(c.time, UINT64_MAX);
+	openvcd_free_scanner(s);
+}
+
+void test_find_body(void) {
+	char* input;
+	size_t offset;
+
+	input = "$comment $enddefinitions $end\n"
+		"$var wire 1 ! a $end\n"
+		"$enddefinitions $end\n#0\n";
+
+	should_be_true(openvcd_find_body(input, strlen(input), &offset));
+	should_equal(input[offset], '\n');
+	should_equal(input[offset + 1], '#');
+
+	should_be_false(openvcd_find_body(input, 20, &offset));
+}
+
+int main(void) {
+	test_scan();
+	test_scan_need_more();
+	test_scan_errors();
+	test_scan_max_time();
+	test_find_body();
+	return 0;
+}
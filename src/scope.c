@@ -5,6 +5,18 @@
 
 #include "scope.h"
 
+/* indexed by openvcd_scope_type */
+static const char* scope_type_names[] = {
+	"begin", "fork", "function", "module", "task", NULL
+};
+
+/* indexed by openvcd_var_type */
+static const char* var_type_names[] = {
+	"event", "integer", "parameter", "real", "realtime", "reg", "supply0",
+	"supply1", "time", "tri", "triand", "trior", "trireg", "tri0", "tri1",
+	"wand", "wire", "wor", NULL
+};
+
 openvcd_scope* openvcd_alloc_scope(openvcd_scope* parent, char* identifier, openvcd_scope_type type) {
 	openvcd_scope* s;
 	int khret;
@@ -38,6 +50,8 @@ openvcd_scope* openvcd_alloc_scope(openvcd_scope* parent, char* identifier, open
 	}
 
 	s->parent = parent;
+	s->order = 0;
+	s->declared = 0;
 
 	/* install ourselves into the parent */
 	if (s->parent != NULL) {
@@ -50,6 +64,7 @@ openvcd_scope* openvcd_alloc_scope(openvcd_scope* parent, char* identifier, open
 			return NULL;
 		}
 		kh_val(s->parent->child_scopes, k) = s;
+		s->order = s->parent->declared++;
 	}
 
 	return s;
@@ -126,6 +141,7 @@ openvcd_var* openvcd_alloc_var(openvcd_scope* parent, openvcd_var_type type, uns
 	v->type = type;
 	v->width = width;
 	v->reference = reference;
+	v->order = 0;
 	v->identifier_code = strdup(identifier_code);
 	if (v->identifier_code == NULL) {
 		free(v);
@@ -146,6 +162,7 @@ openvcd_var* openvcd_alloc_var(openvcd_scope* parent, openvcd_var_type type, uns
 			return NULL;
 		}
 		kh_val(v->parent->child_variables, k) = v;
+		v->order = v->parent->declared++;
 	}
 
 	return v;
@@ -165,3 +182,169 @@ void openvcd_free_var(openvcd_var* v) {
 
 	free(v);
 }
+
+bool openvcd_scope_type_from_str(const char* s, openvcd_scope_type* type) {
+	for (int i = 0 ; scope_type_names[i] != NULL ; i++) {
+		if (strcmp(s, scope_type_names[i]) == 0) {
+			*type = (openvcd_scope_type) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* openvcd_scope_type_to_str(openvcd_scope_type type) {
+	return scope_type_names[type];
+}
+
+bool openvcd_var_type_from_str(const char* s, openvcd_var_type* type) {
+	for (int i = 0 ; var_type_names[i] != NULL ; i++) {
+		if (strcmp(s, var_type_names[i]) == 0) {
+			*type = (openvcd_var_type) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* openvcd_var_type_to_str(openvcd_var_type type) {
+	return var_type_names[type];
+}
+
+static uint64_t mix(uint64_t h) {
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+static uint64_t hash_var(const openvcd_var* v) {
+	uint64_t h;
+
+	h = mix(openvcd_hash(v->identifier_code, strlen(v->identifier_code)) ^ ((uint64_t) v->type << 32) ^ v->width);
+	if (v->reference != NULL) {
+		h = mix(h ^ openvcd_hash(v->reference->identifier, strlen(v->reference->identifier)));
+		h = mix(h ^ (uint32_t) v->reference->msb_index ^ ((uint64_t) (uint32_t) v->reference->lsb_index << 32));
+	}
+
+	return h;
+}
+
+uint64_t openvcd_scope_hash(const openvcd_scope* s) {
+	const char* key;
+	openvcd_scope* cs;
+	openvcd_var* cv;
+	uint64_t children;
+	uint64_t h;
+
+	OPENVCD_UNUSED(key);
+
+	/* children are summed, so the order of the hash tables doesn't
+	 * matter */
+	children = 0;
+	kh_foreach(s->child_scopes, key, cs,
+		children += openvcd_scope_hash(cs);
+	);
+	kh_foreach(s->child_variables, key, cv,
+		children += hash_var(cv);
+	);
+
+	h = mix(openvcd_hash(s->identifier, strlen(s->identifier)) ^ s->type);
+	return mix(h + children);
+}
+
+static bool reference_equal(const openvcd_reference* a, const openvcd_reference* b) {
+	if ((a == NULL) || (b == NULL)) { return a == b; }
+	return (strcmp(a->identifier, b->identifier) == 0) &&
+		(a->msb_index == b->msb_index) && (a->lsb_index == b->lsb_index);
+}
+
+bool openvcd_scope_equal(const openvcd_scope* a, const openvcd_scope* b) {
+	const char* key;
+	openvcd_scope* cs;
+	openvcd_var* cv;
+	khint_t k;
+	bool equal;
+
+	if (a->type != b->type) { return false; }
+	if ((a->identifier == NULL) || (b->identifier == NULL)) {
+		if (a->identifier != b->identifier) { return false; }
+	} else if (strcmp(a->identifier, b->identifier) != 0) {
+		return false;
+	}
+
+	if ((kh_size(a->child_scopes) != kh_size(b->child_scopes)) ||
+		(kh_size(a->child_variables) != kh_size(b->child_variables))) {
+		return false;
+	}
+
+	equal = true;
+	kh_foreach(a->child_scopes, key, cs,
+		k = kh_get(openvcd_mscope, b->child_scopes, key);
+		if ((k == kh_end(b->child_scopes)) || !openvcd_scope_equal(cs, kh_val(b->child_scopes, k))) {
+			equal = false;
+			break;
+		}
+	);
+	if (!equal) { return false; }
+
+	kh_foreach(a->child_variables, key, cv,
+		k = kh_get(openvcd_mvar, b->child_variables, key);
+		if ((k == kh_end(b->child_variables)) ||
+			(cv->type != kh_val(b->child_variables, k)->type) ||
+			(cv->width != kh_val(b->child_variables, k)->width) ||
+			!reference_equal(cv->reference, kh_val(b->child_variables, k)->reference)) {
+			equal = false;
+			break;
+		}
+	);
+
+	return equal;
+}
+
+static size_t child_order(const openvcd_child* c) {
+	return (c->scope != NULL) ? c->scope->order : c->var->order;
+}
+
+static int compare_children(const void* a, const void* b) {
+	size_t x;
+	size_t y;
+
+	x = child_order((const openvcd_child*) a);
+	y = child_order((const openvcd_child*) b);
+
+	return (x > y) - (x < y);
+}
+
+openvcd_child* openvcd_scope_children(const openvcd_scope* s, size_t* n) {
+	openvcd_child* children;
+	const char* key;
+	openvcd_scope* cs;
+	openvcd_var* cv;
+	size_t i;
+
+	OPENVCD_UNUSED(key);
+
+	/* one extra, so that there is something to return for an empty scope */
+	children = malloc((kh_size(s->child_scopes) + kh_size(s->child_variables) + 1) * sizeof(openvcd_child));
+	if (children == NULL) { return NULL; }
+
+	i = 0;
+	kh_foreach(s->child_scopes, key, cs,
+		children[i].scope = cs;
+		children[i].var = NULL;
+		i++;
+	);
+	kh_foreach(s->child_variables, key, cv,
+		children[i].scope = NULL;
+		children[i].var = cv;
+		i++;
+	);
+
+	qsort(children, i, sizeof(openvcd_child), compare_children);
+	*n = i;
+
+	return children;
+}
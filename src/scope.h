@@ -62,6 +62,11 @@ typedef struct openvcd_scope_t {
 	khash_t(openvcd_mscope)* child_scopes;
 	khash_t(openvcd_mvar)* child_variables;
 
+	/* Position among the parent's children in declaration order, and the
+	 * number of children declared in this scope so far. */
+	size_t order;
+	size_t declared;
+
 } openvcd_scope;
 
 typedef struct openvcd_reference_t {
@@ -100,8 +105,17 @@ typedef struct openvcd_var_t {
 	unsigned int width;
 	char* identifier_code;
 	openvcd_reference* reference;
+
+	/* Position among the parent's children in declaration order. */
+	size_t order;
 } openvcd_var;
 
+/* a child of a scope, exactly one of scope and var is non-NULL */
+typedef struct {
+	openvcd_scope* scope;
+	openvcd_var* var;
+} openvcd_child;
+
 /**** PROTOTYPES *************************************************************/
 
 /**
@@ -187,5 +201,78 @@ openvcd_var* openvcd_alloc_var(openvcd_scope* parent, openvcd_var_type type, uns
  */
 void openvcd_free_var(openvcd_var* v);
 
+/**
+ * @brief Convert a VCD scope type keyword, such as "module", to a scope type.
+ *
+ * @param s
+ * @param type Set to the scope type if s is valid.
+ *
+ * @return true if s is a valid scope type.
+ */
+bool openvcd_scope_type_from_str(const char* s, openvcd_scope_type* type);
+
+/**
+ * @brief Convert a scope type to it's VCD keyword.
+ *
+ * @param type
+ *
+ * @return The keyword, which should not be free-ed.
+ */
+const char* openvcd_scope_type_to_str(openvcd_scope_type type);
+
+/**
+ * @brief Convert a VCD variable type keyword, such as "wire", to a variable
+ * type.
+ *
+ * @param s
+ * @param type Set to the variable type if s is valid.
+ *
+ * @return true if s is a valid variable type.
+ */
+bool openvcd_var_type_from_str(const char* s, openvcd_var_type* type);
+
+/**
+ * @brief Convert a variable type to it's VCD keyword.
+ *
+ * @param type
+ *
+ * @return The keyword, which should not be free-ed.
+ */
+const char* openvcd_var_type_to_str(openvcd_var_type type);
+
+/**
+ * @brief Hash a scope, with it's children and variables.
+ *
+ * Scopes which are equal according to openvcd_scope_equal() have the same
+ * hash, regardless of the order their children were declared in.
+ *
+ * @param s
+ *
+ * @return
+ */
+uint64_t openvcd_scope_hash(const openvcd_scope* s);
+
+/**
+ * @brief Return true if two scope trees declare the same scopes and
+ * variables, with the same identifier codes.
+ *
+ * @param a
+ * @param b
+ *
+ * @return
+ */
+bool openvcd_scope_equal(const openvcd_scope* a, const openvcd_scope* b);
+
+/**
+ * @brief List the child scopes and variables of a scope, in the order they
+ * were declared.
+ *
+ * @param s
+ * @param n Set to the number of children.
+ *
+ * @return The children, allocated via malloc(), which the caller should
+ * free. Returns NULL on error.
+ */
+openvcd_child* openvcd_scope_children(const openvcd_scope* s, size_t* n);
 
 #endif /* OPENVCD_SCOPE_H */
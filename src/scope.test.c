@@ -202,9 +202,112 @@ void test_scope() {
 }
 
 
+/* build top.{a, b} with a variable in each, adding the children in the
+ * given order */
+static openvcd_scope* make_tree(bool reversed, unsigned int width) {
+	openvcd_scope* root;
+	openvcd_scope* top;
+	openvcd_scope* a;
+	openvcd_scope* b;
+
+	root = openvcd_alloc_scope(NULL, "", OPENVCD_SCOPE_MODULE);
+	top = openvcd_alloc_scope(root, "top", OPENVCD_SCOPE_MODULE);
+	if (reversed) {
+		b = openvcd_alloc_scope(top, "b", OPENVCD_SCOPE_MODULE);
+		a = openvcd_alloc_scope(top, "a", OPENVCD_SCOPE_MODULE);
+	} else {
+		a = openvcd_alloc_scope(top, "a", OPENVCD_SCOPE_MODULE);
+		b = openvcd_alloc_scope(top, "b", OPENVCD_SCOPE_MODULE);
+	}
+	openvcd_alloc_var(a, OPENVCD_VAR_WIRE, width, openvcd_alloc_reference("x", 0, 7), "!");
+	openvcd_alloc_var(b, OPENVCD_VAR_REG, 1, openvcd_alloc_reference("y", -1, -1), "#");
+
+	return root;
+}
+
+void test_scope_equal(void) {
+	openvcd_scope* s[4];
+
+	s[0] = make_tree(false, 8);
+	s[1] = make_tree(true, 8);
+	s[2] = make_tree(false, 16);
+	s[3] = make_tree(false, 8);
+	for (int i = 0 ; i < 4 ; i++) { should_not_be_null(s[i]); }
+
+	/* the order children were declared in doesn't matter */
+	should_be_true(openvcd_scope_equal(s[0], s[1]));
+	should_equal(openvcd_scope_hash(s[0]), openvcd_scope_hash(s[1]));
+	should_be_true(openvcd_scope_equal(s[0], s[0]));
+
+	should_be_false(openvcd_scope_equal(s[0], s[2]));
+	should_not_equal(openvcd_scope_hash(s[0]), openvcd_scope_hash(s[2]));
+
+	/* nor does an extra scope on either side */
+	openvcd_alloc_scope(s[3], "extra", OPENVCD_SCOPE_MODULE);
+	should_be_false(openvcd_scope_equal(s[0], s[3]));
+	should_be_false(openvcd_scope_equal(s[3], s[0]));
+
+	for (int i = 0 ; i < 4 ; i++) { openvcd_free_scope(s[i]); }
+}
+
+void test_scope_children(void) {
+	openvcd_child* children;
+	openvcd_scope* root;
+	openvcd_scope* top;
+	size_t n;
+
+	root = make_tree(true, 8);
+	should_not_be_null(root);
+	top = kh_val(root->child_scopes, kh_get(openvcd_mscope, root->child_scopes, "top"));
+	openvcd_alloc_var(top, OPENVCD_VAR_WIRE, 1, openvcd_alloc_reference("z", -1, -1), "$");
+	openvcd_alloc_scope(top, "c", OPENVCD_SCOPE_TASK);
+
+	/* children come back in the order they were declared, whatever order
+	 * they hash in */
+	children = openvcd_scope_children(top, &n);
+	should_not_be_null(children);
+	should_equal(n, 4);
+	str_should_equal(children[0].scope->identifier, "b");
+	str_should_equal(children[1].scope->identifier, "a");
+	should_be_null(children[2].scope);
+	str_should_equal(children[2].var->identifier_code, "$");
+	str_should_equal(children[3].scope->identifier, "c");
+	free(children);
+
+	children = openvcd_scope_children(kh_val(top->child_scopes, kh_get(openvcd_mscope, top->child_scopes, "c")), &n);
+	should_not_be_null(children);
+	should_equal(n, 0);
+	free(children);
+
+	openvcd_free_scope(root);
+}
+
+void test_type_names(void) {
+	openvcd_scope_type st;
+	openvcd_var_type vt;
+
+	should_be_true(openvcd_scope_type_from_str("fork", &st));
+	should_equal(st, OPENVCD_SCOPE_FORK);
+	str_should_equal(openvcd_scope_type_to_str(OPENVCD_SCOPE_TASK), "task");
+	should_be_false(openvcd_scope_type_from_str("modules", &st));
+
+	should_be_true(openvcd_var_type_from_str("wire", &vt));
+	should_equal(vt, OPENVCD_VAR_WIRE);
+	should_be_true(openvcd_var_type_from_str("tri0", &vt));
+	should_equal(vt, OPENCVD_VAR_TRI0);
+	should_be_true(openvcd_var_type_from_str("wand", &vt));
+	should_equal(vt, OPENVCD_VAR_WANT);
+	str_should_equal(openvcd_var_type_to_str(OPENVCD_VAR_REALTIME), "realtime");
+	str_should_equal(openvcd_var_type_to_str(OPENVCD_VAR_WOR), "wor");
+	should_be_false(openvcd_var_type_from_str("wires", &vt));
+}
+
 int main(void) {
 	test_reference();
+	test_type_names();
 	test_var();
 	test_scope();
+	test_scope_equal();
+	test_scope_children();
 	return 0;
 }
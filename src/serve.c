@@ -0,0 +1,691 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "serve.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* a response being built, which starts with room for it's header */
+typedef struct {
+	unsigned char* data;
+	size_t length;
+	size_t capacity;
+	bool failed;
+} message;
+
+static void put(message* m, const void* data, size_t length) {
+	unsigned char* temp;
+	size_t cap;
+
+	if (m->failed) { return; }
+
+	if (m->length + length > m->capacity) {
+		cap = (m->capacity == 0) ? 256 : m->capacity;
+		while (cap < m->length + length) { cap *= 2; }
+
+		temp = realloc(m->data, cap);
+		if (temp == NULL) {
+			m->failed = true;
+			return;
+		}
+		m->data = temp;
+		m->capacity = cap;
+	}
+
+	memcpy(m->data + m->length, data, length);
+	m->length += length;
+}
+
+static void put_u32(message* m, uint32_t n) {
+	put(m, &n, sizeof(n));
+}
+
+static void put_u64(message* m, uint64_t n) {
+	put(m, &n, sizeof(n));
+}
+
+/* read or write exactly length bytes, or return -1 */
+static int read_all(int fd, void* buffer, size_t length) {
+	ssize_t n;
+	size_t done;
+
+	for (done = 0 ; done < length ; done += (size_t) n) {
+		n = read(fd, (char*) buffer + done, length - done);
+		if ((n < 0) && (errno == EINTR)) {
+			n = 0;
+			continue;
+		}
+		if (n <= 0) { return -1; }
+	}
+
+	return 0;
+}
+
+static int write_all(int fd, const void* buffer, size_t length) {
+	ssize_t n;
+	size_t done;
+
+	for (done = 0 ; done < length ; done += (size_t) n) {
+		n = send(fd, (const char*) buffer + done, length - done, MSG_NOSIGNAL);
+		if ((n < 0) && (errno == EINTR)) {
+			n = 0;
+			continue;
+		}
+		if (n <= 0) { return -1; }
+	}
+
+	return 0;
+}
+
+openvcd_server* openvcd_new_server(openvcd_collection* c) {
+	openvcd_serve_entry* e;
+	openvcd_server* s;
+	openvcd_wave* w;
+
+	s = calloc(1, sizeof(openvcd_server));
+	if (s == NULL) { return NULL; }
+
+	s->c = c;
+	s->listen_fd = -1;
+	s->max_response = OPENVCD_SERVE_MAX_RESPONSE;
+	pthread_mutex_init(&(s->lock), NULL);
+
+	s->entries = calloc(c->nentries + 1, sizeof(openvcd_serve_entry));
+	s->cache = openvcd_alloc_shared_cache(0, 0);
+	if ((s->entries == NULL) || (s->cache == NULL)) {
+		openvcd_free_server(s);
+		return NULL;
+	}
+
+	for (size_t i = 0 ; i < c->nentries ; i++) {
+		pthread_mutex_init(&(s->entries[i].lock), NULL);
+		pthread_cond_init(&(s->entries[i].built), NULL);
+	}
+
+	for (size_t i = 0 ; i < c->nentries ; i++) {
+		w = c->entries[i].wave;
+		if (w == NULL) { continue; }
+
+		e = &(s->entries[i]);
+		e->pyramids = calloc((size_t) w->signals.length + 1, sizeof(openvcd_pyramid*));
+		e->building = calloc((size_t) w->signals.length + 1, sizeof(bool));
+		if ((e->pyramids == NULL) || (e->building == NULL)) {
+			openvcd_free_server(s);
+			return NULL;
+		}
+	}
+
+	return s;
+}
+
+void openvcd_free_server(openvcd_server* s) {
+	openvcd_serve_entry* e;
+	openvcd_wave* w;
+
+	if (s->entries != NULL) {
+		for (size_t i = 0 ; i < s->c->nentries ; i++) {
+			e = &(s->entries[i]);
+			if (e->pyramids != NULL) {
+				w = s->c->entries[i].wave;
+				for (int j = 0 ; j < w->signals.length ; j++) {
+					if (e->pyramids[j] != NULL) { openvcd_free_pyramid(e->pyramids[j]); }
+				}
+				free(e->pyramids);
+			}
+			free(e->building);
+			pthread_cond_destroy(&(e->built));
+			pthread_mutex_destroy(&(e->lock));
+		}
+		free(s->entries);
+	}
+
+	if (s->cache != NULL) { openvcd_free_shared_cache(s->cache); }
+	if (s->listen_fd >= 0) { close(s->listen_fd); }
+	if (s->path != NULL) {
+		unlink(s->path);
+		free(s->path);
+	}
+
+	pthread_mutex_destroy(&(s->lock));
+	free(s);
+}
+
+int openvcd_server_listen(openvcd_server* s, const char* path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	s->path = strdup(path);
+	if (s->path == NULL) { return -1; }
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) { return -1; }
+
+	unlink(path);
+	if ((bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (listen(fd, SOMAXCONN) != 0)) {
+		close(fd);
+		return -1;
+	}
+
+	s->listen_fd = fd;
+	return 0;
+}
+
+/* the signal a request is about, loaded, or NULL */
+static openvcd_signal* find_signal(openvcd_server* s, size_t wave, uint64_t signal) {
+	openvcd_signal* sig;
+	openvcd_wave* w;
+	int rc;
+
+	w = s->c->entries[wave].wave;
+	if (signal >= (uint64_t) w->signals.length) { return NULL; }
+	sig = w->signals.data[signal];
+
+	/* it's changes are complete once loaded is seen to be set */
+	if (__atomic_load_n(&(sig->loaded), __ATOMIC_ACQUIRE)) { return sig; }
+
+	pthread_mutex_lock(&(s->entries[wave].lock));
+	rc = openvcd_wave_load_signal(w, sig);
+	pthread_mutex_unlock(&(s->entries[wave].lock));
+
+	return (rc == 0) ? sig : NULL;
+}
+
+static void put_value(message* m, size_t nwords, const uint64_t* aval, const uint64_t* bval) {
+	put(m, aval, nwords * sizeof(uint64_t));
+	put(m, bval, nwords * sizeof(uint64_t));
+}
+
+static void answer_waves(openvcd_server* s, message* m) {
+	const openvcd_collection_entry* e;
+
+	for (size_t i = 0 ; i < s->c->nentries ; i++) {
+		e = &(s->c->entries[i]);
+		put_u64(m, (e->wave != NULL) ? (uint64_t) e->wave->signals.length : 0);
+		put_u64(m, (e->wave != NULL) ? e->wave->end_time : 0);
+		put_u32(m, e->wave != NULL);
+		put_u32(m, (uint32_t) strlen(e->path));
+		put(m, e->path, strlen(e->path));
+	}
+}
+
+/* append a name to a path, which fails silently like vec_pusharr() */
+static bool add_name(vec_char_t* path, const char* name, const char* separator) {
+	int length;
+
+	length = path->length + (int) strlen(name) + (int) strlen(separator);
+	vec_pusharr(path, name, (int) strlen(name));
+	vec_pusharr(path, separator, (int) strlen(separator));
+
+	return path->length == length;
+}
+
+/* the variables of a scope and the scopes below it, in the order they were
+ * declared, whose names are added to path */
+static void put_scope(const openvcd_wave* w, const openvcd_scope* scope, message* m, vec_char_t* path) {
+	openvcd_child* children;
+	const openvcd_var* v;
+	const char* name;
+	size_t count;
+	size_t n;
+	int length;
+
+	children = openvcd_scope_children(scope, &count);
+	if (children == NULL) {
+		m->failed = true;
+		return;
+	}
+
+	length = path->length;
+
+	for (size_t i = 0 ; i < count ; i++) {
+		if (children[i].scope != NULL) {
+			if (!add_name(path, children[i].scope->identifier, ".")) { m->failed = true; }
+			put_scope(w, children[i].scope, m, path);
+			path->length = length;
+			continue;
+		}
+
+		v = children[i].var;
+		if (openvcd_wave_signal_number(w, v->identifier_code, strlen(v->identifier_code), &n)) {
+			name = (v->reference != NULL) ? v->reference->identifier : v->identifier_code;
+			if (!add_name(path, name, "")) { m->failed = true; }
+			put_u64(m, (uint64_t) n);
+			put_u32(m, v->width);
+			put_u32(m, (uint32_t) path->length);
+			put(m, path->data, (size_t) path->length);
+			path->length = length;
+		}
+	}
+
+	free(children);
+}
+
+static void answer_hierarchy(openvcd_wave* w, message* m) {
+	vec_char_t path;
+
+	vec_init(&path);
+	if (w->root != NULL) { put_scope(w, w->root, m, &path); }
+	vec_deinit(&path);
+}
+
+static openvcd_status answer_value(openvcd_server* s, size_t wave, const openvcd_value_request* r, message* m) {
+	openvcd_signal* sig;
+	uint64_t* aval;
+	uint64_t* bval;
+	bool valid;
+
+	sig = find_signal(s, wave, r->signal);
+	if (sig == NULL) { return OPENVCD_STATUS_NOT_FOUND; }
+
+	aval = calloc(2 * sig->nwords, sizeof(uint64_t));
+	if (aval == NULL) { return OPENVCD_STATUS_FAILED; }
+	bval = aval + sig->nwords;
+
+	valid = openvcd_shared_cache_value_at(s->cache, sig, r->time, aval, bval);
+	if (!valid) { memset(aval, 0, 2 * sig->nwords * sizeof(uint64_t)); }
+
+	put_u32(m, sig->nwords);
+	put_u32(m, valid);
+	put_value(m, sig->nwords, aval, bval);
+
+	free(aval);
+	return OPENVCD_STATUS_OK;
+}
+
+static openvcd_status answer_range(openvcd_server* s, size_t wave, const openvcd_range_request* r, message* m) {
+	openvcd_decoded_block* d;
+	openvcd_signal* sig;
+	uint64_t count;
+	uint64_t limit;
+	size_t at;
+	size_t block;
+	bool done;
+
+	sig = find_signal(s, wave, r->signal);
+	if (sig == NULL) { return OPENVCD_STATUS_NOT_FOUND; }
+
+	/* each change is it's time and value */
+	limit = s->max_response / (sizeof(uint64_t) * (1 + (2 * (size_t) sig->nwords)));
+	if (limit == 0) { limit = 1; }
+	if (r->limit < limit) { limit = r->limit; }
+
+	put_u32(m, sig->nwords);
+	put_u32(m, 0);
+	at = m->length;
+	put_u64(m, 0);
+
+	if (!openvcd_signal_find_block(sig, r->from, &block)) { block = 0; }
+
+	count = 0;
+	done = (r->from > r->to) || (limit == 0);
+	for ( ; (block < sig->nblocks) && !done ; block++) {
+		if (sig->blocks[block].last_time < r->from) { continue; }
+
+		d = openvcd_decode_block(sig, block);
+		if (d == NULL) { return OPENVCD_STATUS_FAILED; }
+
+		for (uint32_t j = 0 ; (j < d->count) && !done ; j++) {
+			if (d->times[j] < r->from) { continue; }
+			if (d->times[j] > r->to) {
+				done = true;
+				break;
+			}
+
+			put_u64(m, d->times[j]);
+			put_value(m, sig->nwords, d->aval + ((size_t) j * sig->nwords), d->bval + ((size_t) j * sig->nwords));
+			done = (++count == limit);
+		}
+
+		openvcd_free_decoded_block(d);
+	}
+
+	if (!m->failed) { memcpy(m->data + at, &count, sizeof(count)); }
+
+	return OPENVCD_STATUS_OK;
+}
+
+static openvcd_status answer_edge(openvcd_server* s, size_t wave, const openvcd_edge_request* r, message* m) {
+	openvcd_signal* sig;
+	uint64_t found;
+	bool ok;
+
+	sig = find_signal(s, wave, r->signal);
+	if (sig == NULL) { return OPENVCD_STATUS_NOT_FOUND; }
+	if ((r->direction > OPENVCD_SEARCH_PREVIOUS) || (r->kind > OPENVCD_EDGE_XZ)) {
+		return OPENVCD_STATUS_BAD_REQUEST;
+	}
+
+	found = 0;
+	ok = openvcd_find_edge(sig, r->time, (openvcd_search_direction) r->direction, (openvcd_edge_kind) r->kind, &found);
+
+	put_u32(m, ok);
+	put_u32(m, 0);
+	put_u64(m, ok ? found : 0);
+
+	return OPENVCD_STATUS_OK;
+}
+
+/* the pyramid of a signal, built the first time it is needed by whichever
+ * client asks first, while any others asking for it wait */
+static const openvcd_pyramid* get_pyramid(openvcd_server* s, size_t wave, size_t signal) {
+	openvcd_serve_entry* e;
+	openvcd_pyramid* p;
+
+	e = &(s->entries[wave]);
+	p = __atomic_load_n(&(e->pyramids[signal]), __ATOMIC_ACQUIRE);
+	if (p != NULL) { return p; }
+
+	pthread_mutex_lock(&(e->lock));
+	while ((e->pyramids[signal] == NULL) && e->building[signal]) {
+		pthread_cond_wait(&(e->built), &(e->lock));
+	}
+	p = e->pyramids[signal];
+	if (p != NULL) {
+		pthread_mutex_unlock(&(e->lock));
+		return p;
+	}
+	e->building[signal] = true;
+	pthread_mutex_unlock(&(e->lock));
+
+	p = openvcd_build_pyramid(s->c->entries[wave].wave->signals.data[signal]);
+
+	/* if it failed, the next client to ask tries again */
+	pthread_mutex_lock(&(e->lock));
+	e->building[signal] = false;
+	__atomic_store_n(&(e->pyramids[signal]), p, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&(e->built));
+	pthread_mutex_unlock(&(e->lock));
+
+	return p;
+}
+
+static openvcd_status answer_tiles(openvcd_server* s, size_t wave, const openvcd_tiles_request* r, message* m) {
+	const openvcd_pyramid* p;
+	openvcd_signal* sig;
+	openvcd_tiles* tiles;
+	size_t n;
+
+	sig = find_signal(s, wave, r->signal);
+	if (sig == NULL) { return OPENVCD_STATUS_NOT_FOUND; }
+	if ((r->t1 < r->t0) || (r->pixels == 0) || (r->pixels > OPENVCD_SERVE_MAX_PIXELS)) {
+		return OPENVCD_STATUS_BAD_REQUEST;
+	}
+
+	p = get_pyramid(s, wave, (size_t) r->signal);
+	if (p == NULL) { return OPENVCD_STATUS_FAILED; }
+
+	tiles = openvcd_render_tiles(p, r->t0, r->t1, (size_t) r->pixels);
+	if (tiles == NULL) { return OPENVCD_STATUS_FAILED; }
+
+	n = tiles->ntiles;
+	put_u32(m, tiles->nwords);
+	put_u32(m, 0);
+	put_u64(m, n);
+	put(m, tiles->times, (n + 1) * sizeof(uint64_t));
+	put(m, tiles->transitions, n * sizeof(uint64_t));
+	for (size_t i = 0 ; i < n ; i++) {
+		put_u64(m, (tiles->valid[i] ? OPENVCD_TILE_VALID : 0) | (tiles->xz[i] ? OPENVCD_TILE_XZ : 0));
+	}
+	put(m, tiles->aval, n * tiles->nwords * sizeof(uint64_t));
+	put(m, tiles->bval, n * tiles->nwords * sizeof(uint64_t));
+
+	openvcd_free_tiles(tiles);
+	return OPENVCD_STATUS_OK;
+}
+
+/* answer a request into m, which holds the response's header */
+static openvcd_status answer(openvcd_server* s, const openvcd_message_header* h, const unsigned char* body, message* m) {
+	openvcd_value_request value;
+	openvcd_range_request range;
+	openvcd_edge_request edge;
+	openvcd_tiles_request tiles;
+	openvcd_wave* w;
+
+	if (h->type == OPENVCD_REQUEST_WAVES) {
+		answer_waves(s, m);
+		return OPENVCD_STATUS_OK;
+	}
+
+	if ((h->wave >= s->c->nentries) || (s->c->entries[h->wave].wave == NULL)) {
+		return OPENVCD_STATUS_NOT_FOUND;
+	}
+	w = s->c->entries[h->wave].wave;
+
+	/* the bodies are copied out, since they may not be aligned */
+	switch (h->type) {
+		case OPENVCD_REQUEST_HIERARCHY:
+			answer_hierarchy(w, m);
+			return OPENVCD_STATUS_OK;
+		case OPENVCD_REQUEST_VALUE_AT:
+			if (h->length != sizeof(value)) { return OPENVCD_STATUS_BAD_REQUEST; }
+			memcpy(&value, body, sizeof(value));
+			return answer_value(s, h->wave, &value, m);
+		case OPENVCD_REQUEST_RANGE:
+			if (h->length != sizeof(range)) { return OPENVCD_STATUS_BAD_REQUEST; }
+			memcpy(&range, body, sizeof(range));
+			return answer_range(s, h->wave, &range, m);
+		case OPENVCD_REQUEST_EDGE:
+			if (h->length != sizeof(edge)) { return OPENVCD_STATUS_BAD_REQUEST; }
+			memcpy(&edge, body, sizeof(edge));
+			return answer_edge(s, h->wave, &edge, m);
+		case OPENVCD_REQUEST_TILES:
+			if (h->length != sizeof(tiles)) { return OPENVCD_STATUS_BAD_REQUEST; }
+			memcpy(&tiles, body, sizeof(tiles));
+			return answer_tiles(s, h->wave, &tiles, m);
+		default:
+			return OPENVCD_STATUS_BAD_REQUEST;
+	}
+}
+
+/* answer one request, returning -1 once the client has gone */
+static int serve_request(openvcd_server* s, int fd, message* m) {
+	unsigned char body[OPENVCD_SERVE_MAX_REQUEST];
+	openvcd_message_header response;
+	openvcd_message_header h;
+	openvcd_status status;
+
+	if (read_all(fd, &h, sizeof(h)) != 0) { return -1; }
+	if (h.length > OPENVCD_SERVE_MAX_REQUEST) { return -1; }
+	if (read_all(fd, body, h.length) != 0) { return -1; }
+
+	m->length = 0;
+	m->failed = false;
+	put(m, &response, sizeof(response));
+
+	status = answer(s, &h, body, m);
+	if (m->failed) { status = OPENVCD_STATUS_FAILED; }
+
+	/* a failed response has no body */
+	if ((status != OPENVCD_STATUS_OK) || (m->length - sizeof(response) > UINT32_MAX)) {
+		if (status == OPENVCD_STATUS_OK) { status = OPENVCD_STATUS_FAILED; }
+		m->length = sizeof(response);
+	}
+
+	response.length = (uint32_t) (m->length - sizeof(response));
+	response.type = (uint16_t) status;
+	response.wave = h.wave;
+	if (m->data == NULL) { return -1; }
+	memcpy(m->data, &response, sizeof(response));
+
+	__atomic_add_fetch(&(s->requests), 1, __ATOMIC_RELAXED);
+
+	return write_all(fd, m->data, m->length);
+}
+
+static void* serve_client(void* arg) {
+	openvcd_client* client;
+	message m;
+
+	client = (openvcd_client*) arg;
+	memset(&m, 0, sizeof(m));
+
+	while (serve_request(client->server, client->fd, &m) == 0) { }
+
+	free(m.data);
+
+	/* the socket is closed once the thread is joined, but the client
+	 * shouldn't have to wait for that */
+	shutdown(client->fd, SHUT_RDWR);
+	__atomic_store_n(&(client->done), true, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static void free_client(openvcd_client* client) {
+	pthread_join(client->thread, NULL);
+	close(client->fd);
+	free(client);
+}
+
+/* free the clients whose threads have finished, or every client */
+static void reap_clients(openvcd_server* s, bool all) {
+	openvcd_client** link;
+	openvcd_client* client;
+
+	pthread_mutex_lock(&(s->lock));
+	link = &(s->clients);
+	while (*link != NULL) {
+		client = *link;
+		if (!all && !__atomic_load_n(&(client->done), __ATOMIC_ACQUIRE)) {
+			link = &(client->next);
+			continue;
+		}
+
+		*link = client->next;
+		pthread_mutex_unlock(&(s->lock));
+		free_client(client);
+		pthread_mutex_lock(&(s->lock));
+	}
+	pthread_mutex_unlock(&(s->lock));
+}
+
+static int add_client(openvcd_server* s, int fd) {
+	openvcd_client* client;
+
+	client = calloc(1, sizeof(openvcd_client));
+	if (client == NULL) { return -1; }
+
+	client->server = s;
+	client->fd = fd;
+
+	pthread_mutex_lock(&(s->lock));
+	if (pthread_create(&(client->thread), NULL, serve_client, client) != 0) {
+		pthread_mutex_unlock(&(s->lock));
+		free(client);
+		return -1;
+	}
+	client->next = s->clients;
+	s->clients = client;
+	pthread_mutex_unlock(&(s->lock));
+
+	return 0;
+}
+
+static bool stopping(openvcd_server* s) {
+	bool stop;
+
+	pthread_mutex_lock(&(s->lock));
+	stop = s->stopping;
+	pthread_mutex_unlock(&(s->lock));
+
+	return stop;
+}
+
+int openvcd_server_run(openvcd_server* s) {
+	openvcd_client* client;
+	int rc;
+	int fd;
+
+	rc = 0;
+	while (!stopping(s)) {
+		fd = accept(s->listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if ((errno == EINTR) || (errno == ECONNABORTED)) { continue; }
+			if (!stopping(s)) { rc = -1; }
+			break;
+		}
+
+		if (add_client(s, fd) != 0) { close(fd); }
+		reap_clients(s, false);
+	}
+
+	/* wake up every client still waiting for a request */
+	pthread_mutex_lock(&(s->lock));
+	for (client = s->clients ; client != NULL ; client = client->next) {
+		shutdown(client->fd, SHUT_RDWR);
+	}
+	pthread_mutex_unlock(&(s->lock));
+	reap_clients(s, true);
+
+	return rc;
+}
+
+void openvcd_server_stop(openvcd_server* s) {
+	pthread_mutex_lock(&(s->lock));
+	s->stopping = true;
+
+	/* makes a blocked accept() fail */
+	if (s->listen_fd >= 0) { shutdown(s->listen_fd, SHUT_RDWR); }
+	pthread_mutex_unlock(&(s->lock));
+}
+
+int openvcd_connect(const char* path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) { return -1; }
+
+	if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int openvcd_request(int fd, openvcd_request_type type, uint16_t wave, const void* body, uint32_t length, openvcd_message_header* response, unsigned char** response_body) {
+	openvcd_message_header h;
+
+	h.length = length;
+	h.type = (uint16_t) type;
+	h.wave = wave;
+
+	if (write_all(fd, &h, sizeof(h)) != 0) { return -1; }
+	if (write_all(fd, body, length) != 0) { return -1; }
+
+	if (read_all(fd, response, sizeof(openvcd_message_header)) != 0) { return -1; }
+
+	*response_body = malloc((size_t) response->length + 1);
+	if (*response_body == NULL) { return -1; }
+	if (read_all(fd, *response_body, response->length) != 0) {
+		free(*response_body);
+		*response_body = NULL;
+		return -1;
+	}
+
+	return 0;
+}
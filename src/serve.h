@@ -0,0 +1,280 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements a server which answers queries about waveforms held
+ * in memory over a UNIX domain socket, so that the tools of a flow can share
+ * one copy of a large dump instead of each parsing it again.
+ *
+ * The files are loaded once into a collection, see collection.h. Every
+ * client gets it's own thread, and since the waveforms are not changed after
+ * they are loaded, clients are answered concurrently without locking, apart
+ * from loading a lazily opened signal, and building a signal's pyramid the
+ * first time it is asked for tiles. Loads lock only their wave, as the
+ * signals of a wave share it's buffers while they load, and pyramids are
+ * built once per signal without holding any lock, so neither holds up
+ * clients of other waves or signals. Values are looked up through a shared
+ * cache of decoded blocks, see cache.h, so that clients scrolling over the
+ * same signals mostly avoid decoding them again.
+ *
+ * Each request and response is a header followed by a body of header.length
+ * bytes. All integers are in the byte order of the machine, as the socket
+ * is local. A request's header gives it's type and the number of the wave
+ * it is about, which is it's position in the list of files; a response's
+ * header gives it's status in place of the type. Signals are given by their
+ * signal number, see the response to OPENVCD_REQUEST_HIERARCHY, and values
+ * as their aval words followed by their bval words, see value.h.
+ */
+
+#ifndef OPENVCD_SERVE_H
+#define OPENVCD_SERVE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "util.h"
+#include "wave.h"
+#include "collection.h"
+#include "lazy.h"
+#include "cache.h"
+#include "edge.h"
+#include "tile.h"
+
+/**** TYPES ******************************************************************/
+
+/* the largest body accepted in a request */
+#define OPENVCD_SERVE_MAX_REQUEST 4096
+
+/* the most tiles in one response */
+#define OPENVCD_SERVE_MAX_PIXELS 65536
+
+/* the most bytes of changes in one OPENVCD_REQUEST_RANGE response by
+ * default, see openvcd_server */
+#define OPENVCD_SERVE_MAX_RESPONSE (16 * 1024 * 1024)
+
+typedef enum {
+	/* No body. The response has an entry per file, in order: uint64_t
+	 * nsignals, uint64_t end_time, uint32_t loaded, uint32_t length, then
+	 * length bytes of the path. The wave number is ignored. */
+	OPENVCD_REQUEST_WAVES,
+
+	/* No body. The response has an entry per variable: uint64_t signal,
+	 * uint32_t width, uint32_t length, then length bytes of the variable's
+	 * path, with scopes separated by '.'. */
+	OPENVCD_REQUEST_HIERARCHY,
+
+	/* openvcd_value_request. The response is uint32_t nwords, uint32_t
+	 * valid, then the value at the time, which is 0 if it is not valid. */
+	OPENVCD_REQUEST_VALUE_AT,
+
+	/* openvcd_range_request. The response is uint32_t nwords, uint32_t 0,
+	 * uint64_t count, then for each of the first count changes from from to
+	 * to inclusive, but no more than limit, uint64_t time and the value.
+	 * Limits are lowered so that the changes fit in the server's
+	 * max_response bytes, though at least one is always sent, so clients
+	 * wanting more should ask again from after the last time they got. */
+	OPENVCD_REQUEST_RANGE,
+
+	/* openvcd_edge_request. The response is uint32_t found, uint32_t 0,
+	 * uint64_t time, see openvcd_find_edge(). */
+	OPENVCD_REQUEST_EDGE,
+
+	/* openvcd_tiles_request. The response is uint32_t nwords, uint32_t 0,
+	 * uint64_t ntiles, then the arrays of openvcd_tiles as uint64_t: times,
+	 * transitions, flags with OPENVCD_TILE_VALID and OPENVCD_TILE_XZ, and
+	 * the values at the start of each tile, see openvcd_render_tiles(). */
+	OPENVCD_REQUEST_TILES,
+} openvcd_request_type;
+
+typedef enum {
+	OPENVCD_STATUS_OK,
+
+	/* unknown type, or a body of the wrong size or with invalid fields */
+	OPENVCD_STATUS_BAD_REQUEST,
+
+	/* no such wave or signal, or the file couldn't be loaded */
+	OPENVCD_STATUS_NOT_FOUND,
+
+	/* the query failed, such as from a block which couldn't be decoded */
+	OPENVCD_STATUS_FAILED,
+} openvcd_status;
+
+/* flags of a tile in a OPENVCD_REQUEST_TILES response */
+#define OPENVCD_TILE_VALID 0x1
+#define OPENVCD_TILE_XZ 0x2
+
+typedef struct {
+	uint32_t length;
+
+	/* openvcd_request_type or openvcd_status */
+	uint16_t type;
+
+	uint16_t wave;
+} openvcd_message_header;
+
+typedef struct {
+	uint64_t signal;
+	uint64_t time;
+} openvcd_value_request;
+
+typedef struct {
+	uint64_t signal;
+	uint64_t from;
+	uint64_t to;
+	uint64_t limit;
+} openvcd_range_request;
+
+typedef struct {
+	uint64_t signal;
+	uint64_t time;
+
+	/* openvcd_search_direction and openvcd_edge_kind */
+	uint32_t direction;
+	uint32_t kind;
+} openvcd_edge_request;
+
+typedef struct {
+	uint64_t signal;
+	uint64_t t0;
+	uint64_t t1;
+	uint64_t pixels;
+} openvcd_tiles_request;
+
+typedef struct openvcd_client_t {
+	struct openvcd_server_t* server;
+	int fd;
+	pthread_t thread;
+
+	/* set by the client's thread when it is about to exit */
+	bool done;
+
+	struct openvcd_client_t* next;
+} openvcd_client;
+
+/* the server's state for one entry of it's collection */
+typedef struct {
+	/* held while a lazily opened signal of the wave is loaded, and while
+	 * pyramids and building are changed */
+	pthread_mutex_t lock;
+
+	/* signalled when a pyramid has been built, or failed to be */
+	pthread_cond_t built;
+
+	/* the pyramid of each signal, built when first needed, and whether
+	 * a client is building it */
+	openvcd_pyramid** pyramids;
+	bool* building;
+} openvcd_serve_entry;
+
+typedef struct openvcd_server_t {
+	/* not owned by the server */
+	openvcd_collection* c;
+
+	/* one for each entry of the collection */
+	openvcd_serve_entry* entries;
+
+	/* the most bytes of changes in a OPENVCD_REQUEST_RANGE response,
+	 * OPENVCD_SERVE_MAX_RESPONSE unless it is changed before the server
+	 * runs */
+	size_t max_response;
+
+	/* decoded blocks for OPENVCD_REQUEST_VALUE_AT, shared by every
+	 * client */
+	openvcd_shared_cache* cache;
+
+	int listen_fd;
+	char* path;
+
+	/* protects the fields below */
+	pthread_mutex_t lock;
+	bool stopping;
+	openvcd_client* clients;
+
+	/* the number of requests answered, for monitoring */
+	uint64_t requests;
+} openvcd_server;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Create a server for the waveforms of a collection.
+ *
+ * @param c The collection, which must outlive the server.
+ *
+ * @return The new server, or NULL on failure.
+ */
+openvcd_server* openvcd_new_server(openvcd_collection* c);
+
+/**
+ * @brief Free a server, which must not be running, removing it's socket.
+ *
+ * @param s
+ */
+void openvcd_free_server(openvcd_server* s);
+
+/**
+ * @brief Create the server's socket.
+ *
+ * Any file already at the path is replaced.
+ *
+ * @param s
+ * @param path
+ *
+ * @return 0 on success, or -1 on failure, with errno set.
+ */
+int openvcd_server_listen(openvcd_server* s, const char* path);
+
+/**
+ * @brief Accept and answer clients until openvcd_server_stop() is called.
+ *
+ * @param s A server which is listening.
+ *
+ * @return 0 once stopped, after every client has been disconnected, or -1
+ * if accepting clients failed.
+ */
+int openvcd_server_run(openvcd_server* s);
+
+/**
+ * @brief Make openvcd_server_run() return, from any thread.
+ *
+ * @param s
+ */
+void openvcd_server_stop(openvcd_server* s);
+
+/**
+ * @brief Connect to a server.
+ *
+ * @param path
+ *
+ * @return The socket, or -1 on failure, with errno set.
+ */
+int openvcd_connect(const char* path);
+
+/**
+ * @brief Send a request to a server and wait for the response.
+ *
+ * @param fd A socket from openvcd_connect().
+ * @param type
+ * @param wave
+ * @param body
+ * @param length The length of the body.
+ * @param response Set to the response's header.
+ * @param response_body Set to the response's body, which must be free-ed.
+ *
+ * @return 0 on success, whatever the response's status, or -1 if the request
+ * could not be sent or the response could not be read.
+ */
+int openvcd_request(int fd, openvcd_request_type type, uint16_t wave, const void* body, uint32_t length, openvcd_message_header* response, unsigned char** response_body);
+
+#endif /* OPENVCD_SERVE_H */
@@ -0,0 +1,509 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "serve.h"
+
+#define NCLIENTS 8
+#define NQUERIES 200
+
+/* the most changes of a one word signal in a range response */
+#define MAX_CHANGES 150
+
+typedef struct {
+	const char* path;
+	openvcd_wave* w;
+	size_t signal;
+	int failures;
+} client_job;
+
+/* a clock, a counter which goes x for a while, and some signals which never
+ * change, declared in the reverse of any order a hash might give */
+static void write_counter(char* path) {
+	FILE* f;
+
+	f = temp_file(path);
+
+	fprintf(f, "$scope module top $end\n$var wire 1 c clk $end\n");
+	fprintf(f, "$scope module core $end\n$var reg 8 n count $end\n$upscope $end\n");
+	for (int i = 7 ; i >= 0 ; i--) { fprintf(f, "$var wire 1 %c v%d $end\n", 'p' + i, i); }
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+	for (int t = 0 ; t <= 1000 ; t += 5) {
+		fprintf(f, "#%d\n%dc\n", t, (t / 5) % 2);
+		if ((t % 10) != 0) { continue; }
+		if ((t >= 500) && (t < 550)) {
+			fprintf(f, "bx n\n");
+			continue;
+		}
+		fprintf(f, "b");
+		for (int b = 7 ; b >= 0 ; b--) { fprintf(f, "%d", ((t / 10) >> b) & 1); }
+		fprintf(f, " n\n");
+	}
+
+	fclose(f);
+}
+
+static void* run_server(void* arg) {
+	should_equal(openvcd_server_run((openvcd_server*) arg), 0);
+	return NULL;
+}
+
+static size_t signal_number(const openvcd_wave* w, const char* id) {
+	size_t n;
+
+	should_be_true(openvcd_wave_signal_number(w, id, strlen(id), &n));
+	return n;
+}
+
+/* send a request, checking the response's status */
+static unsigned char* ask(int fd, openvcd_request_type type, uint16_t wave, const void* body, uint32_t length, openvcd_status status, uint32_t* response_length) {
+	openvcd_message_header h;
+	unsigned char* response;
+
+	should_equal(openvcd_request(fd, type, wave, body, length, &h, &response), 0);
+	should_equal(h.type, status);
+	should_equal(h.wave, wave);
+	if (status != OPENVCD_STATUS_OK) { should_equal(h.length, 0); }
+	if (response_length != NULL) { *response_length = h.length; }
+
+	return response;
+}
+
+static uint64_t get_u64(const unsigned char** p) {
+	uint64_t n;
+
+	memcpy(&n, *p, sizeof(n));
+	*p += sizeof(n);
+	return n;
+}
+
+static uint32_t get_u32(const unsigned char** p) {
+	uint32_t n;
+
+	memcpy(&n, *p, sizeof(n));
+	*p += sizeof(n);
+	return n;
+}
+
+static void test_waves(int fd, const openvcd_collection* c) {
+	const unsigned char* p;
+	unsigned char* r;
+	uint32_t length;
+	uint32_t n;
+
+	r = ask(fd, OPENVCD_REQUEST_WAVES, 0, NULL, 0, OPENVCD_STATUS_OK, &length);
+	p = r;
+
+	should_equal(get_u64(&p), (uint64_t) c->entries[0].wave->signals.length);
+	should_equal(get_u64(&p), 1000);
+	should_equal(get_u32(&p), 1);
+	n = get_u32(&p);
+	should_equal(n, strlen(c->entries[0].path));
+	should_equal(memcmp(p, c->entries[0].path, n), 0);
+	p += n;
+
+	should_equal(get_u64(&p), 0);
+	should_equal(get_u64(&p), 0);
+	should_equal(get_u32(&p), 0);
+	n = get_u32(&p);
+	should_equal(memcmp(p, c->entries[1].path, n), 0);
+	p += n;
+
+	should_equal((size_t) (p - r), length);
+	free(r);
+}
+
+static void test_hierarchy(int fd, const openvcd_wave* w) {
+	const char* paths[] = {
+		"top.clk", "top.core.count", "top.v7", "top.v6", "top.v5",
+		"top.v4", "top.v3", "top.v2", "top.v1", "top.v0",
+	};
+	const unsigned char* p;
+	unsigned char* r;
+	uint64_t signal;
+	uint32_t length;
+	uint32_t width;
+	uint32_t n;
+	size_t i;
+
+	r = ask(fd, OPENVCD_REQUEST_HIERARCHY, 0, NULL, 0, OPENVCD_STATUS_OK, &length);
+
+	/* in declaration order */
+	i = 0;
+	for (p = r ; p < r + length ; p += n) {
+		signal = get_u64(&p);
+		width = get_u32(&p);
+		n = get_u32(&p);
+		should_be_true(i < sizeof(paths) / sizeof(paths[0]));
+		should_equal(n, strlen(paths[i]));
+		should_equal(memcmp(p, paths[i], n), 0);
+		if (i == 0) {
+			should_equal(signal, signal_number(w, "c"));
+			should_equal(width, 1);
+		} else if (i == 1) {
+			should_equal(signal, signal_number(w, "n"));
+			should_equal(width, 8);
+		}
+		i++;
+	}
+
+	should_equal(i, sizeof(paths) / sizeof(paths[0]));
+	should_equal((size_t) (p - r), length);
+	free(r);
+}
+
+static void test_value(int fd, const openvcd_wave* w) {
+	openvcd_value_request q;
+	const unsigned char* p;
+	unsigned char* r;
+	uint64_t value;
+
+	q.signal = signal_number(w, "n");
+
+	q.time = 255;
+	r = ask(fd, OPENVCD_REQUEST_VALUE_AT, 0, &q, sizeof(q), OPENVCD_STATUS_OK, NULL);
+	p = r;
+	should_equal(get_u32(&p), 1);
+	should_equal(get_u32(&p), 1);
+	value = get_u64(&p);
+	should_equal(value, 25);
+	should_equal(get_u64(&p), 0);
+	free(r);
+
+	q.time = 520;
+	r = ask(fd, OPENVCD_REQUEST_VALUE_AT, 0, &q, sizeof(q), OPENVCD_STATUS_OK, NULL);
+	p = r + 8;
+	should_equal(get_u64(&p), 0xff);
+	should_equal(get_u64(&p), 0xff);
+	free(r);
+}
+
+static void test_range(int fd, const openvcd_wave* w) {
+	openvcd_range_request q;
+	const unsigned char* p;
+	unsigned char* r;
+	uint32_t length;
+
+	q.signal = signal_number(w, "n");
+	q.from = 95;
+	q.to = 200;
+	q.limit = 100;
+	r = ask(fd, OPENVCD_REQUEST_RANGE, 0, &q, sizeof(q), OPENVCD_STATUS_OK, &length);
+	p = r;
+	should_equal(get_u32(&p), 1);
+	get_u32(&p);
+	should_equal(get_u64(&p), 11);
+	for (uint64_t t = 100 ; t <= 200 ; t += 10) {
+		should_equal(get_u64(&p), t);
+		should_equal(get_u64(&p), t / 10);
+		should_equal(get_u64(&p), 0);
+	}
+	should_equal((size_t) (p - r), length);
+	free(r);
+
+	/* limited, and across every block of the clock */
+	q.signal = signal_number(w, "c");
+	q.from = 0;
+	q.to = 1000;
+	q.limit = 3;
+	r = ask(fd, OPENVCD_REQUEST_RANGE, 0, &q, sizeof(q), OPENVCD_STATUS_OK, &length);
+	p = r + 8;
+	should_equal(get_u64(&p), 3);
+	should_equal(length, 16 + (3 * 24));
+	free(r);
+
+	/* larger limits are lowered to the server's max_response, so the
+	 * rest are asked for from after the last change */
+	q.limit = UINT64_MAX;
+	r = ask(fd, OPENVCD_REQUEST_RANGE, 0, &q, sizeof(q), OPENVCD_STATUS_OK, &length);
+	p = r + 8;
+	should_equal(get_u64(&p), MAX_CHANGES);
+	should_equal(length, 16 + (MAX_CHANGES * 24));
+	p += (MAX_CHANGES - 1) * 24;
+	q.from = get_u64(&p) + 1;
+	free(r);
+
+	r = ask(fd, OPENVCD_REQUEST_RANGE, 0, &q, sizeof(q), OPENVCD_STATUS_OK, NULL);
+	p = r + 8;
+	should_equal(get_u64(&p), 201 - MAX_CHANGES);
+	free(r);
+
+	q.from = 10;
+	q.to = 5;
+	r = ask(fd, OPENVCD_REQUEST_RANGE, 0, &q, sizeof(q), OPENVCD_STATUS_OK, NULL);
+	p = r + 8;
+	should_equal(get_u64(&p), 0);
+	free(r);
+}
+
+static void test_edge(int fd, const openvcd_wave* w) {
+	openvcd_edge_request q;
+	const unsigned char* p;
+	unsigned char* r;
+
+	q.signal = signal_number(w, "c");
+	q.time = 12;
+	q.direction = OPENVCD_SEARCH_NEXT;
+	q.kind = OPENVCD_EDGE_POSEDGE;
+	r = ask(fd, OPENVCD_REQUEST_EDGE, 0, &q, sizeof(q), OPENVCD_STATUS_OK, NULL);
+	p = r;
+	should_equal(get_u32(&p), 1);
+	get_u32(&p);
+	should_equal(get_u64(&p), 15);
+	free(r);
+
+	q.time = 1000;
+	r = ask(fd, OPENVCD_REQUEST_EDGE, 0, &q, sizeof(q), OPENVCD_STATUS_OK, NULL);
+	p = r;
+	should_equal(get_u32(&p), 0);
+	free(r);
+
+	q.kind = 99;
+	free(ask(fd, OPENVCD_REQUEST_EDGE, 0, &q, sizeof(q), OPENVCD_STATUS_BAD_REQUEST, NULL));
+}
+
+static void test_tiles(int fd, const openvcd_wave* w) {
+	openvcd_tiles_request q;
+	openvcd_pyramid* pyramid;
+	const unsigned char* p;
+	openvcd_tiles* expect;
+	unsigned char* r;
+	uint32_t length;
+	uint64_t flags;
+	size_t n;
+
+	q.signal = signal_number(w, "n");
+	q.t0 = 0;
+	q.t1 = 1000;
+	q.pixels = 37;
+	r = ask(fd, OPENVCD_REQUEST_TILES, 0, &q, sizeof(q), OPENVCD_STATUS_OK, &length);
+
+	pyramid = openvcd_build_pyramid(w->signals.data[q.signal]);
+	should_not_be_null(pyramid);
+	expect = openvcd_render_tiles(pyramid, q.t0, q.t1, q.pixels);
+	should_not_be_null(expect);
+	n = expect->ntiles;
+
+	p = r;
+	should_equal(get_u32(&p), 1);
+	get_u32(&p);
+	should_equal(get_u64(&p), n);
+	for (size_t i = 0 ; i <= n ; i++) { should_equal(get_u64(&p), expect->times[i]); }
+	for (size_t i = 0 ; i < n ; i++) { should_equal(get_u64(&p), expect->transitions[i]); }
+	for (size_t i = 0 ; i < n ; i++) {
+		flags = get_u64(&p);
+		should_equal((flags & OPENVCD_TILE_VALID) != 0, expect->valid[i]);
+		should_equal((flags & OPENVCD_TILE_XZ) != 0, expect->xz[i]);
+	}
+	for (size_t i = 0 ; i < n ; i++) { should_equal(get_u64(&p), expect->aval[i]); }
+	for (size_t i = 0 ; i < n ; i++) { should_equal(get_u64(&p), expect->bval[i]); }
+	should_equal((size_t) (p - r), length);
+
+	openvcd_free_tiles(expect);
+	openvcd_free_pyramid(pyramid);
+	free(r);
+
+	q.pixels = 0;
+	free(ask(fd, OPENVCD_REQUEST_TILES, 0, &q, sizeof(q), OPENVCD_STATUS_BAD_REQUEST, NULL));
+	q.pixels = OPENVCD_SERVE_MAX_PIXELS + 1;
+	free(ask(fd, OPENVCD_REQUEST_TILES, 0, &q, sizeof(q), OPENVCD_STATUS_BAD_REQUEST, NULL));
+}
+
+static void test_errors(int fd, const openvcd_wave* w) {
+	openvcd_value_request q;
+
+	q.signal = signal_number(w, "n");
+	q.time = 0;
+
+	free(ask(fd, 99, 0, NULL, 0, OPENVCD_STATUS_BAD_REQUEST, NULL));
+	free(ask(fd, OPENVCD_REQUEST_VALUE_AT, 0, &q, sizeof(q) - 1, OPENVCD_STATUS_BAD_REQUEST, NULL));
+
+	/* the second file couldn't be loaded, and there is no third */
+	free(ask(fd, OPENVCD_REQUEST_VALUE_AT, 1, &q, sizeof(q), OPENVCD_STATUS_NOT_FOUND, NULL));
+	free(ask(fd, OPENVCD_REQUEST_HIERARCHY, 2, NULL, 0, OPENVCD_STATUS_NOT_FOUND, NULL));
+
+	q.signal = 1000;
+	free(ask(fd, OPENVCD_REQUEST_VALUE_AT, 0, &q, sizeof(q), OPENVCD_STATUS_NOT_FOUND, NULL));
+}
+
+/* query random times, counting the answers which don't match the wave */
+static void* run_client(void* arg) {
+	openvcd_value_request q;
+	openvcd_message_header h;
+	client_job* job;
+	unsigned char* r;
+	uint64_t aval;
+	uint64_t bval;
+	bool valid;
+	int fd;
+
+	job = (client_job*) arg;
+	fd = openvcd_connect(job->path);
+	if (fd < 0) {
+		job->failures = NQUERIES;
+		return NULL;
+	}
+
+	q.signal = job->signal;
+	for (int i = 0 ; i < NQUERIES ; i++) {
+		q.time = (uint64_t) ((i * 37) + (int) job->signal) % 1100;
+		valid = openvcd_value_at(job->w->signals.data[job->signal], q.time, &aval, &bval);
+
+		if (openvcd_request(fd, OPENVCD_REQUEST_VALUE_AT, 0, &q, sizeof(q), &h, &r) != 0) {
+			job->failures++;
+			continue;
+		}
+
+		if ((h.type != OPENVCD_STATUS_OK) || (h.length != 24) ||
+			((uint32_t) valid != *(uint32_t*) (r + 4)) ||
+			(valid && ((memcmp(r + 8, &aval, 8) != 0) || (memcmp(r + 16, &bval, 8) != 0)))) {
+			job->failures++;
+		}
+		free(r);
+	}
+
+	close(fd);
+	return NULL;
+}
+
+/* ask for tiles of a signal whose pyramid hasn't been built, counting the
+ * answers which differ from the first */
+static void* run_tiles_client(void* arg) {
+	openvcd_tiles_request q;
+	openvcd_message_header h;
+	client_job* job;
+	unsigned char* r;
+	int fd;
+
+	job = (client_job*) arg;
+	fd = openvcd_connect(job->path);
+	if (fd < 0) {
+		job->failures = 1;
+		return NULL;
+	}
+
+	q.signal = job->signal;
+	q.t0 = 0;
+	q.t1 = 1000;
+	q.pixels = 64;
+	if ((openvcd_request(fd, OPENVCD_REQUEST_TILES, 0, &q, sizeof(q), &h, &r) != 0) ||
+		(h.type != OPENVCD_STATUS_OK) || (h.length == 0)) {
+		job->failures = 1;
+	} else {
+		free(r);
+	}
+
+	close(fd);
+	return NULL;
+}
+
+void test_serve(void) {
+	char dir[] = "/tmp/openvcd-serve-XXXXXX";
+	char path[] = "/tmp/openvcd-serve-vcd-XXXXXX";
+	pthread_t clients[NCLIENTS];
+	client_job jobs[NCLIENTS];
+	const char* paths[2];
+	openvcd_cache_stats stats;
+	openvcd_collection* c;
+	openvcd_server* s;
+	openvcd_wave* w;
+	pthread_t thread;
+	char* socket_path;
+	int fd;
+
+	write_counter(path);
+	paths[0] = path;
+	paths[1] = "/nonexistent/openvcd";
+	c = openvcd_load_collection(paths, 2, 2);
+	should_not_be_null(c);
+	w = c->entries[0].wave;
+	should_not_be_null(w);
+
+	should_not_be_null(mkdtemp(dir));
+	should_be_true(asprintf(&socket_path, "%s/socket", dir) > 0);
+
+	s = openvcd_new_server(c);
+	should_not_be_null(s);
+	should_equal(s->max_response, OPENVCD_SERVE_MAX_RESPONSE);
+	s->max_response = MAX_CHANGES * 24;
+	should_equal(openvcd_server_listen(s, socket_path), 0);
+	should_equal(pthread_create(&thread, NULL, run_server, s), 0);
+
+	fd = openvcd_connect(socket_path);
+	should_be_true(fd >= 0);
+	test_waves(fd, c);
+	test_hierarchy(fd, w);
+	test_value(fd, w);
+	test_range(fd, w);
+	test_edge(fd, w);
+	test_tiles(fd, w);
+	test_errors(fd, w);
+
+	for (int i = 0 ; i < NCLIENTS ; i++) {
+		jobs[i].path = socket_path;
+		jobs[i].w = w;
+		jobs[i].signal = signal_number(w, (i % 2) ? "c" : "n");
+		jobs[i].failures = 0;
+		should_equal(pthread_create(&(clients[i]), NULL, run_client, &(jobs[i])), 0);
+	}
+	for (int i = 0 ; i < NCLIENTS ; i++) {
+		pthread_join(clients[i], NULL);
+		should_equal(jobs[i].failures, 0);
+	}
+
+	/* the clock's pyramid is built once, however many ask for it at once */
+	for (int i = 0 ; i < NCLIENTS ; i++) {
+		jobs[i].signal = signal_number(w, "c");
+		should_equal(pthread_create(&(clients[i]), NULL, run_tiles_client, &(jobs[i])), 0);
+	}
+	for (int i = 0 ; i < NCLIENTS ; i++) {
+		pthread_join(clients[i], NULL);
+		should_equal(jobs[i].failures, 0);
+	}
+	should_not_be_null(s->entries[0].pyramids[jobs[0].signal]);
+	should_be_false(s->entries[0].building[jobs[0].signal]);
+
+	/* the clients only ever need a few blocks */
+	openvcd_shared_cache_stats(s->cache, &stats);
+	should_be_true(stats.hits > stats.misses);
+
+	/* a request which is too long drops the client */
+	{
+		openvcd_message_header h;
+		unsigned char* r;
+
+		r = malloc(OPENVCD_SERVE_MAX_REQUEST + 1);
+		should_not_be_null(r);
+		memset(r, 0, OPENVCD_SERVE_MAX_REQUEST + 1);
+		should_equal(openvcd_request(fd, OPENVCD_REQUEST_WAVES, 0, r, OPENVCD_SERVE_MAX_REQUEST + 1, &h, &r), -1);
+		free(r);
+	}
+	close(fd);
+
+	/* the first connection is still open when the server stops */
+	fd = openvcd_connect(socket_path);
+	should_be_true(fd >= 0);
+	openvcd_server_stop(s);
+	pthread_join(thread, NULL);
+	close(fd);
+
+	should_be_true(s->requests >= NCLIENTS * NQUERIES);
+	openvcd_free_server(s);
+	should_be_true(access(socket_path, F_OK) != 0);
+
+	openvcd_free_collection(c);
+	free(socket_path);
+	rmdir(dir);
+	unlink(path);
+}
+
+int main(void) {
+	test_serve();
+	return 0;
+}
@@ -0,0 +1,236 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "stats.h"
+
+/* the bits of word i of a value of the given width which are part of it */
+static uint64_t word_mask(const openvcd_signal* s, unsigned int i) {
+	unsigned int bits;
+
+	bits = s->width - (i * 64);
+	return (bits >= 64) ? ~((uint64_t) 0) : ((((uint64_t) 1) << bits) - 1);
+}
+
+/* add the time since a signal's last change to the states of it's bits */
+static void add_time(openvcd_stats* st, size_t n, uint64_t until) {
+	const openvcd_signal* s;
+	const uint64_t* aval;
+	const uint64_t* bval;
+	openvcd_activity* a;
+	uint64_t mask;
+	uint64_t dt;
+
+	s = st->w->signals.data[n];
+	dt = until - st->since[n];
+	if (s->real || (dt == 0)) { return; }
+
+	a = &(st->signals[n]);
+	aval = st->state->aval + s->word;
+	bval = st->state->bval + s->word;
+
+	/* most signals are a single bit */
+	if (s->width == 1) {
+		a->time[(bval[0] << 1) | aval[0]] += dt;
+		return;
+	}
+
+	for (unsigned int i = 0 ; i < s->nwords ; i++) {
+		mask = word_mask(s, i);
+		a->time[OPENVCD_STATE_0] += dt * (uint64_t) __builtin_popcountll(~aval[i] & ~bval[i] & mask);
+		a->time[OPENVCD_STATE_1] += dt * (uint64_t) __builtin_popcountll(aval[i] & ~bval[i] & mask);
+		a->time[OPENVCD_STATE_Z] += dt * (uint64_t) __builtin_popcountll(~aval[i] & bval[i] & mask);
+		a->time[OPENVCD_STATE_X] += dt * (uint64_t) __builtin_popcountll(aval[i] & bval[i] & mask);
+	}
+}
+
+/* the number of bits which differ between a signal's value and a new one */
+static uint64_t count_toggles(const openvcd_stats* st, const openvcd_signal* s, const uint64_t* aval, const uint64_t* bval) {
+	const uint64_t* old_aval;
+	const uint64_t* old_bval;
+	uint64_t toggles;
+
+	old_aval = st->state->aval + s->word;
+	old_bval = st->state->bval + s->word;
+
+	if (s->real) { return (old_aval[0] != aval[0]) ? 1 : 0; }
+
+	toggles = 0;
+	for (unsigned int i = 0 ; i < s->nwords ; i++) {
+		toggles += (uint64_t) __builtin_popcountll((old_aval[i] ^ aval[i]) | (old_bval[i] ^ bval[i]));
+	}
+
+	return toggles;
+}
+
+static void record(openvcd_stats* st, size_t n, uint64_t time, const uint64_t* aval, const uint64_t* bval) {
+	const openvcd_signal* s;
+	openvcd_activity* a;
+	uint64_t toggles;
+
+	s = st->w->signals.data[n];
+	a = &(st->signals[n]);
+
+	if (st->state->valid[n]) {
+		toggles = count_toggles(st, s, aval, bval);
+		if (toggles == 0) { return; }
+		add_time(st, n, time);
+		a->toggles += toggles;
+	} else {
+		st->state->valid[n] = true;
+		a->first_change = time;
+	}
+
+	memcpy(st->state->aval + s->word, aval, s->nwords * sizeof(uint64_t));
+	memcpy(st->state->bval + s->word, bval, s->nwords * sizeof(uint64_t));
+	st->since[n] = time;
+	a->changes++;
+	a->last_change = time;
+}
+
+static openvcd_parser_error stats_change(void* ctx, const openvcd_change* c) {
+	const openvcd_signal* s;
+	openvcd_stats* st;
+	uint64_t* aval;
+	uint64_t* bval;
+	bool valid;
+	int state;
+	size_t n;
+
+	st = (openvcd_stats*) ctx;
+
+	if (c->type == OPENVCD_CHANGE_TIME) {
+		st->end_time = c->time;
+		return OPENVCD_ERROR_NONE;
+	}
+
+	if (c->type == OPENVCD_CHANGE_COMMAND) { return OPENVCD_ERROR_NONE; }
+
+	if (!openvcd_wave_signal_number(st->w, c->id, c->id_length, &n)) {
+		return OPENVCD_ERROR_SYNTAX;
+	}
+	s = st->w->signals.data[n];
+	aval = st->w->scratch_aval;
+	bval = st->w->scratch_bval;
+
+	if (c->type == OPENVCD_CHANGE_REAL) {
+		valid = openvcd_value_parse_real(c->value, c->value_length, aval, bval);
+	} else if ((c->type == OPENVCD_CHANGE_SCALAR) && (s->width == 1)) {
+		state = openvcd_state_from_char(c->value[0]);
+		valid = (state >= 0);
+		aval[0] = (uint64_t) (state & 1);
+		bval[0] = (uint64_t) ((state >> 1) & 1);
+	} else {
+		valid = openvcd_value_parse(c->value, c->value_length, s->width, aval, bval);
+	}
+	if (!valid) { return OPENVCD_ERROR_SYNTAX; }
+
+	record(st, n, c->time, aval, bval);
+
+	return OPENVCD_ERROR_NONE;
+}
+
+void openvcd_free_stats(openvcd_stats* st) {
+	if (st->state != NULL) { openvcd_free_state(st->state); }
+	if (st->w != NULL) { openvcd_free_wave(st->w); }
+	free(st->signals);
+	free(st->since);
+	free(st->marks);
+	free(st);
+}
+
+openvcd_stats* openvcd_collect_stats(openvcd_parser* p) {
+	openvcd_stats* st;
+	size_t nsignals;
+
+	st = calloc(1, sizeof(openvcd_stats));
+	if (st == NULL) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate statistics", 0);
+		return NULL;
+	}
+
+	st->w = openvcd_load_header(p);
+	if (st->w == NULL) {
+		openvcd_free_stats(st);
+		return NULL;
+	}
+
+	nsignals = (size_t) st->w->signals.length;
+	st->signals = calloc(nsignals + 1, sizeof(openvcd_activity));
+	st->since = calloc(nsignals + 1, sizeof(uint64_t));
+	st->marks = calloc(nsignals + 1, sizeof(uint64_t));
+	st->state = openvcd_alloc_state(st->w);
+	if ((st->signals == NULL) || (st->since == NULL) || (st->marks == NULL) || (st->state == NULL)) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate statistics", 0);
+		openvcd_free_stats(st);
+		return NULL;
+	}
+
+	openvcd_parse_changes(p, stats_change, st);
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) {
+		openvcd_free_stats(st);
+		return NULL;
+	}
+
+	/* each signal stays in it's last value until the end */
+	for (size_t n = 0 ; n < nsignals ; n++) {
+		if (st->state->valid[n]) { add_time(st, n, st->end_time); }
+	}
+
+	return st;
+}
+
+const openvcd_activity* openvcd_stats_signal(const openvcd_stats* st, const char* id) {
+	size_t n;
+
+	if (!openvcd_wave_signal_number(st->w, id, strlen(id), &n)) { return NULL; }
+
+	return &(st->signals[n]);
+}
+
+static void add_activity(openvcd_activity* total, const openvcd_activity* a) {
+	if (a->changes == 0) { return; }
+
+	if ((total->changes == 0) || (a->first_change < total->first_change)) {
+		total->first_change = a->first_change;
+	}
+	if ((total->changes == 0) || (a->last_change > total->last_change)) {
+		total->last_change = a->last_change;
+	}
+
+	total->changes += a->changes;
+	total->toggles += a->toggles;
+	for (int i = 0 ; i < 4 ; i++) { total->time[i] += a->time[i]; }
+}
+
+static void add_var(openvcd_stats* st, const openvcd_var* v, openvcd_activity* total) {
+	size_t n;
+
+	if (!openvcd_wave_signal_number(st->w, v->identifier_code, strlen(v->identifier_code), &n)) {
+		return;
+	}
+
+	if (st->marks[n] == st->generation) { return; }
+	st->marks[n] = st->generation;
+
+	add_activity(total, &(st->signals[n]));
+}
+
+static void add_scope(openvcd_stats* st, const openvcd_scope* s, openvcd_activity* total) {
+	const char* key;
+	openvcd_scope* child;
+	openvcd_var* v;
+
+	OPENVCD_UNUSED(key);
+
+	kh_foreach(s->child_variables, key, v, add_var(st, v, total););
+	kh_foreach(s->child_scopes, key, child, add_scope(st, child, total););
+}
+
+void openvcd_stats_scope(openvcd_stats* st, const openvcd_scope* s, openvcd_activity* total) {
+	memset(total, 0, sizeof(openvcd_activity));
+
+	st->generation++;
+	add_scope(st, s, total);
+}
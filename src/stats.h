@@ -0,0 +1,127 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements collecting activity statistics for each signal of a
+ * VCD file, such as are used to estimate power: how many bits toggled, how
+ * long each bit spent in each state, and when the signal first and last
+ * changed.
+ *
+ * The statistics are collected in one pass over the value changes, without
+ * storing them, so memory use depends on the number of signals rather than
+ * the length of the input. Only the latest value of each signal is kept,
+ * and toggles and states are counted a word at a time by XORing or masking
+ * the bit planes of the old and new values and counting the bits set.
+ *
+ * Totals for the signals in a scope and all of the scopes below it can then
+ * be found with openvcd_stats_scope().
+ */
+
+#ifndef OPENVCD_STATS_H
+#define OPENVCD_STATS_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "parser.h"
+#include "value.h"
+#include "wave.h"
+
+/**** TYPES ******************************************************************/
+
+typedef struct {
+	/* the number of value changes which changed the value, including the
+	 * first one */
+	uint64_t changes;
+
+	/* the number of bits which changed state in those changes, or for real
+	 * signals the number of changes after the first */
+	uint64_t toggles;
+
+	/* the time each bit spent in each state, added up over the bits and
+	 * indexed by OPENVCD_STATE_*, which is always 0 for real signals */
+	uint64_t time[4];
+
+	/* the times of the first and last changes, only meaningful if there
+	 * were any */
+	uint64_t first_change;
+	uint64_t last_change;
+} openvcd_activity;
+
+typedef struct {
+	/* the declarations of the VCD file, without any changes */
+	openvcd_wave* w;
+
+	/* the statistics of each signal, indexed by signal number */
+	openvcd_activity* signals;
+
+	/* the last time in the input */
+	uint64_t end_time;
+
+	/* the latest value of each signal, and the time it was set */
+	openvcd_state* state;
+	uint64_t* since;
+
+	/* used to count each signal once in openvcd_stats_scope() */
+	uint64_t* marks;
+	uint64_t generation;
+} openvcd_stats;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Read a VCD file and collect the activity of each of it's signals.
+ *
+ * The parser must not have read anything yet. The time each signal spent
+ * in it's last value runs to the last time in the input.
+ *
+ * @param p
+ *
+ * @return The statistics, which should be free-ed with openvcd_free_stats(),
+ * or NULL on failure, in which case the details are in the parser.
+ */
+openvcd_stats* openvcd_collect_stats(openvcd_parser* p);
+
+/**
+ * @brief Free statistics.
+ *
+ * @param st
+ */
+void openvcd_free_stats(openvcd_stats* st);
+
+/**
+ * @brief Get the statistics of the signal with the given identifier code.
+ *
+ * @param st
+ * @param id
+ *
+ * @return The statistics, or NULL if there is no such signal.
+ */
+const openvcd_activity* openvcd_stats_signal(const openvcd_stats* st, const char* id);
+
+/**
+ * @brief Add up the statistics of every signal in a scope and the scopes
+ * below it.
+ *
+ * Signals which several variables in the scope share are only counted once.
+ * The first and last change times are those of the earliest and latest
+ * changes of any of the signals.
+ *
+ * @param st
+ * @param s A scope of st->w.
+ * @param total
+ */
+void openvcd_stats_scope(openvcd_stats* st, const openvcd_scope* s, openvcd_activity* total);
+
+#endif /* OPENVCD_STATS_H */
@@ -0,0 +1,147 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "stats.h"
+
+static const char* input =
+	"$timescale 1ns $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 c clk $end\n"
+	"$scope module core $end\n"
+	"$var reg 4 d data [3:0] $end\n"
+	"$var real 64 r level $end\n"
+	"$var wire 1 c clk $end\n"
+	"$upscope $end\n"
+	"$scope module wide $end\n"
+	"$var reg 70 w bus [69:0] $end\n"
+	"$upscope $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\n$dumpvars\n0c\nbx d\nr1.5 r\nb0 w\n$end\n"
+	"#10\n1c\nb1010 d\n"
+	"#20\n0c\nb1010 d\nr2.5 r\n"
+	"#30\n1c\nb0101 d\nb1000000000000000000000000000000000000000000000000000000000000000011 w\n"
+	"#40\n0c\nr2.5 r\n"
+	"#100\n";
+
+static openvcd_stats* collect(const char* s) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_stats* st;
+
+	source.input_string = (char*) s;
+	p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, strlen(s));
+	st = openvcd_collect_stats(p);
+	check_parser_error(p);
+	should_not_be_null(st);
+	openvcd_free_parser(p);
+
+	return st;
+}
+
+void test_stats_signals(void) {
+	const openvcd_activity* a;
+	openvcd_stats* st;
+
+	st = collect(input);
+	should_equal(st->end_time, 100);
+
+	a = openvcd_stats_signal(st, "c");
+	should_not_be_null(a);
+	should_equal(a->changes, 5);
+	should_equal(a->toggles, 4);
+	should_equal(a->first_change, 0);
+	should_equal(a->last_change, 40);
+	should_equal(a->time[OPENVCD_STATE_0], 10 + 10 + 60);
+	should_equal(a->time[OPENVCD_STATE_1], 10 + 10);
+	should_equal(a->time[OPENVCD_STATE_X], 0);
+
+	/* repeating a value isn't a change */
+	a = openvcd_stats_signal(st, "d");
+	should_not_be_null(a);
+	should_equal(a->changes, 3);
+	should_equal(a->toggles, 4 + 4);
+	should_equal(a->last_change, 30);
+	should_equal(a->time[OPENVCD_STATE_X], 4 * 10);
+	should_equal(a->time[OPENVCD_STATE_0], (2 * 20) + (2 * 70));
+	should_equal(a->time[OPENVCD_STATE_1], (2 * 20) + (2 * 70));
+	should_equal(a->time[OPENVCD_STATE_Z], 0);
+
+	a = openvcd_stats_signal(st, "r");
+	should_not_be_null(a);
+	should_equal(a->changes, 2);
+	should_equal(a->toggles, 1);
+	should_equal(a->last_change, 20);
+	should_equal(a->time[OPENVCD_STATE_0], 0);
+
+	/* bits past the first word, and not past the width */
+	a = openvcd_stats_signal(st, "w");
+	should_not_be_null(a);
+	should_equal(a->toggles, 3);
+	should_equal(a->time[OPENVCD_STATE_1], 3 * 70);
+	should_equal(a->time[OPENVCD_STATE_0], (70 * 30) + (67 * 70));
+
+	should_be_null(openvcd_stats_signal(st, "nothing"));
+
+	openvcd_free_stats(st);
+}
+
+void test_stats_scopes(void) {
+	openvcd_activity total;
+	openvcd_scope* top;
+	openvcd_stats* st;
+
+	st = collect(input);
+	top = child(st->w->root, "top");
+	should_not_be_null(top);
+
+	/* clk is in both top and top.core, but only counted once */
+	openvcd_stats_scope(st, top, &total);
+	should_equal(total.changes, 5 + 3 + 2 + 2);
+	should_equal(total.toggles, 4 + 8 + 1 + 3);
+	should_equal(total.first_change, 0);
+	should_equal(total.last_change, 40);
+	should_equal(total.time[OPENVCD_STATE_X], 40);
+
+	openvcd_stats_scope(st, child(top, "core"), &total);
+	should_equal(total.changes, 5 + 3 + 2);
+	should_equal(total.last_change, 40);
+
+	openvcd_stats_scope(st, child(top, "wide"), &total);
+	should_equal(total.changes, 2);
+	should_equal(total.first_change, 0);
+	should_equal(total.last_change, 30);
+
+	openvcd_free_stats(st);
+}
+
+void test_stats_errors(void) {
+	const char* errors[] = {
+		"$var wire 1 ! a $end\n$enddefinitions $end\n#0\n1?\n",
+		"$var wire 4 ! a $end\n$enddefinitions $end\n#0\nb12 !\n",
+		"$var wire 1 ! a $end\n#0\n1!\n",
+	};
+	openvcd_input_source source;
+	openvcd_parser* p;
+
+	for (size_t i = 0 ; i < sizeof(errors) / sizeof(errors[0]) ; i++) {
+		source.input_string = (char*) errors[i];
+		p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, strlen(errors[i]));
+		should_be_null(openvcd_collect_stats(p));
+		parser_should_error(p);
+		openvcd_free_parser(p);
+	}
+}
+
+int main(void) {
+	test_stats_signals();
+	test_stats_scopes();
+	test_stats_errors();
+	return 0;
+}
@@ -48,6 +48,8 @@
 
 #include<math.h>
 
+#include "wave.h"
+
 #define fail(fmt, ...) do { \
 		fprintf(stderr, "TEST FAILED (%s, %s:L%i): ", __func__, __FILE__, __LINE__); \
 		fprintf(stderr, fmt, __VA_ARGS__); \
@@ -114,4 +116,181 @@
 	} while(0); \
 
 
+/**** FIXTURES ***************************************************************/
+
+/* These are static inline so that tests which don't use them aren't warned
+ * about it. */
+
+/* a parser reading from a buffer, which must outlive it */
+static inline openvcd_parser* string_parser(const char* buffer, size_t length) {
+	openvcd_input_source source;
+
+	source.input_string = (char*) buffer;
+	return openvcd_new_parser(OPENVCD_PARSER_STRING, source, length);
+}
+
+/* load a waveform from a buffer, failing the test if it doesn't parse */
+static inline openvcd_wave* load_buffer(const char* buffer, size_t length) {
+	openvcd_parser* p;
+	openvcd_wave* w;
+
+	p = string_parser(buffer, length);
+	w = openvcd_load(p);
+	check_parser_error(p);
+	should_not_be_null(w);
+	openvcd_free_parser(p);
+
+	return w;
+}
+
+static inline openvcd_wave* load_string(const char* s) {
+	return load_buffer(s, strlen(s));
+}
+
+/* load a waveform from a file, returning NULL if it doesn't parse */
+static inline openvcd_wave* load_file(const char* path) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	FILE* f;
+
+	f = fopen(path, "r");
+	should_not_be_null(f);
+	source.input_stream = f;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	w = openvcd_load(p);
+	openvcd_free_parser(p);
+	fclose(f);
+
+	return w;
+}
+
+/* create a temporary file from a mkstemp() template, and open it for
+ * writing */
+static inline FILE* temp_file(char* path) {
+	FILE* f;
+	int fd;
+
+	fd = mkstemp(path);
+	should_be_true(fd >= 0);
+	f = fdopen(fd, "w");
+	should_not_be_null(f);
+
+	return f;
+}
+
+/* print a waveform with a real, a clock and nvars vectors, where vector i
+ * changes every i + 1 steps, with x bits, comments and $dumpoff sections
+ * mixed in */
+static inline void print_vcd(FILE* f, int nvars, int nsteps) {
+	fprintf(f, "$timescale 1ns $end\n$scope module top $end\n");
+	fprintf(f, "$var real 64 r level $end\n");
+	fprintf(f, "$var wire 1 c clk $end\n");
+	for (int i = 0 ; i < nvars ; i++) {
+		fprintf(f, "$var wire %d s%d sig%d $end\n", (i % 3 == 0) ? 100 : 8, i, i);
+	}
+	fprintf(f, "$upscope $end\n$enddefinitions $end\n");
+	fprintf(f, "$dumpvars\n0c\nr0 r\n$end\n");
+
+	for (int t = 0 ; t < nsteps ; t++) {
+		fprintf(f, "#%d\n", t);
+		if (t % 1000 == 500) { fprintf(f, "$dumpoff\nxc\n$end\n"); }
+		if (t % 1000 == 600) { fprintf(f, "$dumpon\n$end\n"); }
+		fprintf(f, "%dc\n", t % 2);
+		if (t % 10 == 0) { fprintf(f, "$comment step %d $end\nr%d.5 r\n", t, t); }
+		for (int i = 0 ; i < nvars ; i++) {
+			if (t % (i + 1) == 0) {
+				fprintf(f, "b%d%d%d%s s%d\n", (t >> 2) & 1, (t >> 1) & 1,
+					t & 1, (t % 7 == 0) ? "x" : "0", i);
+			}
+		}
+	}
+}
+
+/* print_vcd() into a buffer allocated via malloc() */
+static inline char* make_vcd(int nvars, int nsteps, size_t* length) {
+	char* buffer;
+	FILE* f;
+
+	f = open_memstream(&buffer, length);
+	should_not_be_null(f);
+	print_vcd(f, nvars, nsteps);
+	fclose(f);
+
+	return buffer;
+}
+
+/* print_vcd() into a temporary file, followed by tail */
+static inline void write_vcd(char* path, int nvars, int nsteps, const char* tail) {
+	FILE* f;
+
+	f = temp_file(path);
+	print_vcd(f, nvars, nsteps);
+	fprintf(f, "%s", tail);
+	fclose(f);
+}
+
+static inline openvcd_scope* child(openvcd_scope* s, const char* name) {
+	khint_t k;
+
+	k = kh_get(openvcd_mscope, s->child_scopes, name);
+	if (k == kh_end(s->child_scopes)) { return NULL; }
+	return kh_val(s->child_scopes, k);
+}
+
+/* the first signal of the given width */
+static inline openvcd_signal* find_width(openvcd_wave* w, unsigned int width) {
+	for (size_t i = 0 ; i < (size_t) w->signals.length ; i++) {
+		if (w->signals.data[i]->width == width) { return w->signals.data[i]; }
+	}
+	return NULL;
+}
+
+/* check that two waveforms have the same signals and changes, which may be
+ * split into blocks differently */
+static inline void check_same(const openvcd_wave* expect, const openvcd_wave* w) {
+	openvcd_decoded_block* d[2];
+	openvcd_signal* s;
+	openvcd_signal* e;
+	size_t blocks[2];
+	uint32_t i[2];
+	int n;
+
+	should_equal(w->signals.length, expect->signals.length);
+	should_equal(w->end_time, expect->end_time);
+
+	vec_foreach(&(expect->signals), e, n) {
+		s = openvcd_wave_find_signal(w, e->id_code);
+		should_not_be_null(s);
+		should_equal(s->change_count, e->change_count);
+
+		/* walk both signals' changes in step */
+		blocks[0] = blocks[1] = 0;
+		i[0] = i[1] = 0;
+		d[0] = (e->nblocks > 0) ? openvcd_decode_block(e, 0) : NULL;
+		d[1] = (s->nblocks > 0) ? openvcd_decode_block(s, 0) : NULL;
+		for (uint64_t k = 0 ; k < e->change_count ; k++) {
+			should_not_be_null(d[0]);
+			should_not_be_null(d[1]);
+			should_equal(d[0]->times[i[0]], d[1]->times[i[1]]);
+			should_be_true(openvcd_value_eq(e->nwords,
+				d[0]->aval + (i[0] * e->nwords), d[0]->bval + (i[0] * e->nwords),
+				d[1]->aval + (i[1] * s->nwords), d[1]->bval + (i[1] * s->nwords)));
+
+			if (++i[0] == d[0]->count) {
+				openvcd_free_decoded_block(d[0]);
+				d[0] = (++blocks[0] < e->nblocks) ? openvcd_decode_block(e, blocks[0]) : NULL;
+				i[0] = 0;
+			}
+			if (++i[1] == d[1]->count) {
+				openvcd_free_decoded_block(d[1]);
+				d[1] = (++blocks[1] < s->nblocks) ? openvcd_decode_block(s, blocks[1]) : NULL;
+				i[1] = 0;
+			}
+		}
+		should_be_null(d[0]);
+		should_be_null(d[1]);
+	}
+}
+
 #endif /* TEST_UTIL */
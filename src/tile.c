@@ -0,0 +1,248 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "tile.h"
+
+/* Where a tile boundary falls among the changes of a signal: the changes at
+ * or before it are those of the blocks before block, and the first index
+ * changes of block. */
+typedef struct {
+	size_t block;
+	uint32_t index;
+
+	/* block decoded, or NULL if no change is at or before the boundary */
+	openvcd_decoded_block* decoded;
+} boundary;
+
+void openvcd_free_pyramid(openvcd_pyramid* p) {
+	if (p->levels != NULL) {
+		for (size_t l = 0 ; l < p->nlevels ; l++) { free(p->levels[l]); }
+	}
+
+	free(p->levels);
+	free(p->sizes);
+	free(p);
+}
+
+openvcd_pyramid* openvcd_build_pyramid(const openvcd_signal* s) {
+	openvcd_summary* below;
+	openvcd_summary* level;
+	openvcd_pyramid* p;
+	size_t size;
+	size_t n;
+
+	p = calloc(1, sizeof(openvcd_pyramid));
+	if (p == NULL) { return NULL; }
+	p->signal = s;
+	p->nblocks = s->nblocks;
+
+	/* enough levels to halve the number of blocks down to one */
+	n = 1;
+	for (size = s->nblocks ; size > 1 ; size = (size + 1) / 2) { n++; }
+
+	p->levels = calloc(n, sizeof(openvcd_summary*));
+	p->sizes = calloc(n, sizeof(size_t));
+	if ((p->levels == NULL) || (p->sizes == NULL)) {
+		openvcd_free_pyramid(p);
+		return NULL;
+	}
+
+	level = calloc(s->nblocks + 1, sizeof(openvcd_summary));
+	if (level == NULL) {
+		openvcd_free_pyramid(p);
+		return NULL;
+	}
+	for (size_t i = 0 ; i < s->nblocks ; i++) {
+		level[i].changes = s->blocks[i].count;
+		level[i].flags = s->blocks[i].flags;
+	}
+	p->levels[0] = level;
+	p->sizes[0] = s->nblocks;
+	p->nlevels = 1;
+
+	for (size = s->nblocks ; size > 1 ; size = (size + 1) / 2) {
+		below = level;
+		level = calloc(((size + 1) / 2) + 1, sizeof(openvcd_summary));
+		if (level == NULL) {
+			openvcd_free_pyramid(p);
+			return NULL;
+		}
+
+		for (size_t i = 0 ; i < size ; i++) {
+			level[i / 2].changes += below[i].changes;
+			level[i / 2].flags |= below[i].flags;
+		}
+
+		p->levels[p->nlevels] = level;
+		p->sizes[p->nlevels] = (size + 1) / 2;
+		p->nlevels++;
+	}
+
+	return p;
+}
+
+openvcd_summary openvcd_pyramid_summary(const openvcd_pyramid* p, size_t first, size_t last) {
+	openvcd_summary sum;
+	const openvcd_summary* e;
+
+	sum.changes = 0;
+	sum.flags = 0;
+	if (last > p->nblocks) { last = p->nblocks; }
+
+	/* take the odd entries at either end, then go up a level for the
+	 * pairs in between */
+	for (size_t l = 0 ; (l < p->nlevels) && (first < last) ; l++) {
+		if ((first & 1) != 0) {
+			e = &(p->levels[l][first++]);
+			sum.changes += e->changes;
+			sum.flags |= e->flags;
+		}
+		if ((last & 1) != 0) {
+			e = &(p->levels[l][--last]);
+			sum.changes += e->changes;
+			sum.flags |= e->flags;
+		}
+
+		first /= 2;
+		last /= 2;
+	}
+
+	return sum;
+}
+
+void openvcd_free_tiles(openvcd_tiles* t) {
+	free(t->times);
+	free(t->valid);
+	free(t->aval);
+	free(t->bval);
+	free(t->transitions);
+	free(t->xz);
+	free(t);
+}
+
+/* Find where time t falls, decoding the block it falls in unless it is the
+ * one already decoded in previous. */
+static int locate(const openvcd_pyramid* p, uint64_t t, const boundary* previous, boundary* b) {
+	b->block = 0;
+	b->index = 0;
+	b->decoded = NULL;
+
+	if ((p->nblocks == 0) || !openvcd_signal_find_block(p->signal, t, &(b->block))) { return 0; }
+	if (b->block >= p->nblocks) { b->block = p->nblocks - 1; }
+
+	if ((previous != NULL) && (previous->decoded != NULL) && (previous->block == b->block)) {
+		b->decoded = previous->decoded;
+	} else {
+		b->decoded = openvcd_decode_block(p->signal, b->block);
+		if (b->decoded == NULL) { return -1; }
+	}
+
+	b->index = (uint32_t) (openvcd_decoded_block_find(b->decoded, t) + 1);
+
+	return 0;
+}
+
+/* whether any of the changes first to last - 1 of a decoded block has x or
+ * z bits */
+static bool any_xz(const openvcd_decoded_block* d, uint32_t first, uint32_t last) {
+	for (uint32_t j = first ; j < last ; j++) {
+		if (openvcd_value_has_xz(d->nwords, d->bval + ((size_t) j * d->nwords))) { return true; }
+	}
+
+	return false;
+}
+
+/* fill in tile i, which runs from boundary from to boundary to */
+static void fill_tile(openvcd_tiles* tiles, const openvcd_pyramid* p, size_t i, const boundary* from, const boundary* to) {
+	const openvcd_signal* s;
+	openvcd_summary whole;
+	size_t n;
+	bool xz;
+
+	s = p->signal;
+	n = s->nwords;
+
+	xz = false;
+	if (from->decoded != NULL) {
+		tiles->valid[i] = true;
+		memcpy(tiles->aval + (i * n), from->decoded->aval + ((size_t) (from->index - 1) * n), n * sizeof(uint64_t));
+		memcpy(tiles->bval + (i * n), from->decoded->bval + ((size_t) (from->index - 1) * n), n * sizeof(uint64_t));
+		xz = !s->real && openvcd_value_has_xz(n, tiles->bval + (i * n));
+	}
+
+	/* the changes of the blocks strictly between the two boundaries, less
+	 * those of the first block up to from */
+	whole = openvcd_pyramid_summary(p, from->block, to->block);
+	tiles->transitions[i] = whole.changes - from->index + to->index;
+	if (s->real) { return; }
+
+	if (from->block == to->block) {
+		if (to->decoded != NULL) { xz = xz || any_xz(to->decoded, from->index, to->index); }
+	} else {
+		if (from->index > 0) {
+			xz = xz || any_xz(from->decoded, from->index, from->decoded->count);
+			whole = openvcd_pyramid_summary(p, from->block + 1, to->block);
+		}
+		xz = xz || ((whole.flags & OPENVCD_BLOCK_XZ) != 0);
+		if (to->index > 0) { xz = xz || any_xz(to->decoded, 0, to->index); }
+	}
+
+	tiles->xz[i] = xz;
+}
+
+openvcd_tiles* openvcd_render_tiles(const openvcd_pyramid* p, uint64_t t0, uint64_t t1, size_t pixels) {
+	openvcd_tiles* tiles;
+	boundary from;
+	boundary to;
+	uint64_t span;
+	size_t n;
+	int rc;
+
+	if ((t1 < t0) || (pixels == 0)) { return NULL; }
+
+	tiles = calloc(1, sizeof(openvcd_tiles));
+	if (tiles == NULL) { return NULL; }
+
+	n = p->signal->nwords;
+	tiles->ntiles = pixels;
+	tiles->nwords = (unsigned int) n;
+	tiles->times = calloc(pixels + 1, sizeof(uint64_t));
+	tiles->valid = calloc(pixels, sizeof(bool));
+	tiles->aval = calloc(pixels * n, sizeof(uint64_t));
+	tiles->bval = calloc(pixels * n, sizeof(uint64_t));
+	tiles->transitions = calloc(pixels, sizeof(uint64_t));
+	tiles->xz = calloc(pixels, sizeof(bool));
+	if ((tiles->times == NULL) || (tiles->valid == NULL) || (tiles->aval == NULL) ||
+		(tiles->bval == NULL) || (tiles->transitions == NULL) || (tiles->xz == NULL)) {
+		openvcd_free_tiles(tiles);
+		return NULL;
+	}
+
+	/* split the span without overflowing it times the number of pixels */
+	span = t1 - t0;
+	for (size_t i = 0 ; i < pixels ; i++) {
+		tiles->times[i] = t0 + ((span / pixels) * i) + (((span % pixels) * i) / pixels);
+	}
+	tiles->times[pixels] = t1;
+
+	rc = locate(p, t0, NULL, &from);
+	for (size_t i = 0 ; (i < pixels) && (rc == 0) ; i++) {
+		rc = locate(p, tiles->times[i + 1], &from, &to);
+		if (rc != 0) { break; }
+
+		fill_tile(tiles, p, i, &from, &to);
+
+		if ((from.decoded != NULL) && (from.decoded != to.decoded)) { openvcd_free_decoded_block(from.decoded); }
+		from = to;
+	}
+	if (from.decoded != NULL) { openvcd_free_decoded_block(from.decoded); }
+
+	if (rc != 0) {
+		openvcd_free_tiles(tiles);
+		return NULL;
+	}
+
+	return tiles;
+}
@@ -0,0 +1,141 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements summarizing a signal over a range of time divided
+ * into equal buckets, one per pixel, which is what a viewer needs to draw a
+ * zoomed out waveform: the value at the start of each bucket, how many
+ * times it changed within it, and whether it was ever x or z.
+ *
+ * Decoding every change in the range would make drawing a clock over a
+ * billion cycles take as long as reading it. Instead, a pyramid is built
+ * once from the signal's block headers. It's bottom level has the number of
+ * changes and the OPENVCD_BLOCK_* flags of each block, and each level above
+ * it combines pairs of the level below, so that the totals over any run of
+ * blocks are found from O(log n) entries. Only the block holding each
+ * bucket boundary is decoded, which is also where the value at the start
+ * of the bucket comes from, so rendering costs O(pixels log n) whatever the
+ * number of changes.
+ */
+
+#ifndef OPENVCD_TILE_H
+#define OPENVCD_TILE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "value.h"
+#include "wave.h"
+
+/**** TYPES ******************************************************************/
+
+/* the totals over a run of blocks */
+typedef struct {
+	uint64_t changes;
+
+	/* the OPENVCD_BLOCK_* flags of the blocks or-ed together */
+	uint16_t flags;
+} openvcd_summary;
+
+typedef struct {
+	const openvcd_signal* signal;
+
+	/* the number of blocks of the signal when the pyramid was built */
+	size_t nblocks;
+
+	/* Level 0 has one summary per block, and entry i of each level above
+	 * it combines entries 2i and 2i + 1 of the level below. The top level
+	 * has a single entry. */
+	openvcd_summary** levels;
+	size_t* sizes;
+	size_t nlevels;
+} openvcd_pyramid;
+
+/* A range of time divided into tiles, stored by column like openvcd_table.
+ * Tile i covers the times after times[i], up to and including
+ * times[i + 1]. */
+typedef struct {
+	size_t ntiles;
+	unsigned int nwords;
+
+	/* ntiles + 1 boundaries */
+	uint64_t* times;
+
+	/* whether the signal has a value at the start of each tile, which is
+	 * then aval/bval + (i * nwords) */
+	bool* valid;
+	uint64_t* aval;
+	uint64_t* bval;
+
+	/* the number of changes within each tile */
+	uint64_t* transitions;
+
+	/* whether any bit was x or z at the start of or within each tile */
+	bool* xz;
+} openvcd_tiles;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Build the pyramid of a signal.
+ *
+ * The signal must be loaded, see lazy.h, and changes appended to it
+ * afterwards are not seen through the pyramid.
+ *
+ * @param s
+ *
+ * @return The pyramid, which must be free-ed with openvcd_free_pyramid(), or
+ * NULL on failure.
+ */
+openvcd_pyramid* openvcd_build_pyramid(const openvcd_signal* s);
+
+/**
+ * @brief Free a pyramid.
+ *
+ * @param p
+ */
+void openvcd_free_pyramid(openvcd_pyramid* p);
+
+/**
+ * @brief Get the totals over a run of blocks.
+ *
+ * @param p
+ * @param first The first block.
+ * @param last The block after the last one.
+ *
+ * @return The totals, which are empty if first is not before last.
+ */
+openvcd_summary openvcd_pyramid_summary(const openvcd_pyramid* p, size_t first, size_t last);
+
+/**
+ * @brief Summarize a signal from time t0 to t1 in equal tiles.
+ *
+ * @param p The pyramid of the signal.
+ * @param t0
+ * @param t1
+ * @param pixels The number of tiles.
+ *
+ * @return The tiles, which must be free-ed with openvcd_free_tiles(), or
+ * NULL on failure, or if t1 is before t0 or pixels is 0.
+ */
+openvcd_tiles* openvcd_render_tiles(const openvcd_pyramid* p, uint64_t t0, uint64_t t1, size_t pixels);
+
+/**
+ * @brief Free tiles.
+ *
+ * @param t
+ */
+void openvcd_free_tiles(openvcd_tiles* t);
+
+#endif /* OPENVCD_TILE_H */
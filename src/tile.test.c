@@ -0,0 +1,227 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "tile.h"
+
+/* a clock with a period of 10 from 100, which is x from 30000 to 30003,
+ * and a 70 bit bus which changes every 7 cycles and has a z bit once */
+static openvcd_wave* load(char** buffer) {
+	openvcd_wave* w;
+	size_t length;
+	FILE* f;
+
+	f = open_memstream(buffer, &length);
+	should_not_be_null(f);
+	fprintf(f, "$var wire 1 c clk $end\n$var reg 70 w bus $end\n$var wire 1 e empty $end\n$enddefinitions $end\n");
+	for (int i = 10 ; i < 10000 ; i++) {
+		fprintf(f, "#%d\n0c\n", 10 * i);
+		if (i == 3000) { fprintf(f, "#%d\nxc\n", (10 * i) + 3); }
+		if (i % 7 == 0) {
+			fprintf(f, "b%s", (i == 5005) ? "z00000000000000000000000000000000000000000000000000000" : "1");
+			for (int bit = 13 ; bit >= 0 ; bit--) { fputc('0' + ((i >> bit) & 1), f); }
+			fprintf(f, " w\n");
+		}
+		fprintf(f, "#%d\n1c\n", (10 * i) + 5);
+	}
+	fclose(f);
+
+	w = load_buffer(*buffer, length);
+
+	return w;
+}
+
+/* compare each tile against every change of the signal */
+static void check_tiles(const openvcd_signal* s, const openvcd_tiles* tiles) {
+	openvcd_decoded_block* d;
+	uint64_t transitions;
+	uint64_t time;
+	uint64_t aval[2];
+	uint64_t bval[2];
+	bool valid;
+	bool xz;
+
+	for (size_t i = 0 ; i < tiles->ntiles ; i++) {
+		transitions = 0;
+		valid = false;
+		xz = false;
+
+		for (size_t b = 0 ; b < s->nblocks ; b++) {
+			d = openvcd_decode_block(s, b);
+			should_not_be_null(d);
+
+			for (uint32_t j = 0 ; j < d->count ; j++) {
+				time = d->times[j];
+				if (time <= tiles->times[i]) {
+					valid = true;
+					memcpy(aval, d->aval + (j * d->nwords), d->nwords * sizeof(uint64_t));
+					memcpy(bval, d->bval + (j * d->nwords), d->nwords * sizeof(uint64_t));
+					xz = openvcd_value_has_xz(d->nwords, bval);
+				} else if (time <= tiles->times[i + 1]) {
+					transitions++;
+					xz = xz || openvcd_value_has_xz(d->nwords, d->bval + (j * d->nwords));
+				}
+			}
+
+			openvcd_free_decoded_block(d);
+		}
+
+		should_equal(tiles->valid[i], valid);
+		if (valid) {
+			should_be_true(openvcd_value_eq(s->nwords, aval, bval, tiles->aval + (i * s->nwords), tiles->bval + (i * s->nwords)));
+		}
+		should_equal(tiles->transitions[i], transitions);
+		should_equal(tiles->xz[i], xz);
+	}
+}
+
+void test_tile_pyramid(void) {
+	openvcd_summary sum;
+	openvcd_pyramid* p;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	char* buffer;
+	uint64_t changes;
+
+	w = load(&buffer);
+	s = openvcd_wave_find_signal(w, "c");
+	should_be_true(s->nblocks > 70);
+
+	p = openvcd_build_pyramid(s);
+	should_not_be_null(p);
+	should_equal(p->sizes[0], s->nblocks);
+	should_equal(p->sizes[p->nlevels - 1], 1);
+	should_equal(p->levels[p->nlevels - 1][0].changes, s->change_count);
+
+	for (size_t first = 0 ; first <= s->nblocks ; first += 3) {
+		for (size_t last = first ; last <= s->nblocks ; last += 5) {
+			changes = 0;
+			for (size_t b = first ; b < last ; b++) { changes += s->blocks[b].count; }
+
+			sum = openvcd_pyramid_summary(p, first, last);
+			should_equal(sum.changes, changes);
+		}
+	}
+
+	/* only the block with 30003 in it has an x */
+	sum = openvcd_pyramid_summary(p, 0, s->nblocks);
+	should_equal(sum.flags & OPENVCD_BLOCK_XZ, OPENVCD_BLOCK_XZ);
+	sum = openvcd_pyramid_summary(p, 0, 2);
+	should_equal(sum.flags & OPENVCD_BLOCK_XZ, 0);
+
+	openvcd_free_pyramid(p);
+	openvcd_free_wave(w);
+	free(buffer);
+}
+
+void test_tile_clock(void) {
+	openvcd_tiles* tiles;
+	openvcd_pyramid* p;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	char* buffer;
+
+	w = load(&buffer);
+	s = openvcd_wave_find_signal(w, "c");
+	p = openvcd_build_pyramid(s);
+	should_not_be_null(p);
+
+	/* 200 changes in each tile after the first */
+	tiles = openvcd_render_tiles(p, 0, 100000, 100);
+	should_not_be_null(tiles);
+	should_equal(tiles->ntiles, 100);
+	should_equal(tiles->times[1], 1000);
+	should_equal(tiles->times[100], 100000);
+	should_be_false(tiles->valid[0]);
+	should_equal(tiles->transitions[0], 181);
+	should_be_true(tiles->valid[1]);
+	should_equal(tiles->aval[1], 0);
+	should_equal(tiles->transitions[1], 200);
+	should_be_false(tiles->xz[29]);
+	should_be_true(tiles->xz[30]);
+	should_equal(tiles->transitions[30], 201);
+	should_be_false(tiles->xz[31]);
+	check_tiles(s, tiles);
+	openvcd_free_tiles(tiles);
+
+	/* uneven tiles, ones smaller than a clock period, and past the end */
+	tiles = openvcd_render_tiles(p, 29977, 30041, 13);
+	should_not_be_null(tiles);
+	check_tiles(s, tiles);
+	openvcd_free_tiles(tiles);
+
+	tiles = openvcd_render_tiles(p, 12345, 67891, 997);
+	should_not_be_null(tiles);
+	check_tiles(s, tiles);
+	openvcd_free_tiles(tiles);
+
+	tiles = openvcd_render_tiles(p, 99000, 200000, 7);
+	should_not_be_null(tiles);
+	should_equal(tiles->transitions[6], 0);
+	should_be_true(tiles->valid[6]);
+	should_equal(tiles->aval[6], 1);
+	check_tiles(s, tiles);
+	openvcd_free_tiles(tiles);
+
+	tiles = openvcd_render_tiles(p, 5, 5, 3);
+	should_not_be_null(tiles);
+	check_tiles(s, tiles);
+	openvcd_free_tiles(tiles);
+
+	should_be_null(openvcd_render_tiles(p, 6, 5, 3));
+	should_be_null(openvcd_render_tiles(p, 0, 5, 0));
+
+	openvcd_free_pyramid(p);
+	openvcd_free_wave(w);
+	free(buffer);
+}
+
+void test_tile_wide(void) {
+	openvcd_tiles* tiles;
+	openvcd_pyramid* p;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	char* buffer;
+
+	w = load(&buffer);
+
+	s = openvcd_wave_find_signal(w, "w");
+	p = openvcd_build_pyramid(s);
+	should_not_be_null(p);
+	tiles = openvcd_render_tiles(p, 0, 100000, 64);
+	should_not_be_null(tiles);
+	should_equal(tiles->nwords, 2);
+	check_tiles(s, tiles);
+	openvcd_free_tiles(tiles);
+	tiles = openvcd_render_tiles(p, 50000, 50200, 40);
+	should_not_be_null(tiles);
+	check_tiles(s, tiles);
+	openvcd_free_tiles(tiles);
+	openvcd_free_pyramid(p);
+
+	/* a signal with no changes */
+	s = openvcd_wave_find_signal(w, "e");
+	p = openvcd_build_pyramid(s);
+	should_not_be_null(p);
+	tiles = openvcd_render_tiles(p, 0, 100, 10);
+	should_not_be_null(tiles);
+	should_be_false(tiles->valid[9]);
+	should_equal(tiles->transitions[9], 0);
+	openvcd_free_tiles(tiles);
+	openvcd_free_pyramid(p);
+
+	openvcd_free_wave(w);
+	free(buffer);
+}
+
+int main(void) {
+	test_tile_pyramid();
+	test_tile_clock();
+	test_tile_wide();
+	return 0;
+}
@@ -0,0 +1,352 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "transpose.h"
+
+#include <unistd.h>
+
+static FILE* open_spill(const char* tmp_dir) {
+	char* path;
+	FILE* f;
+	int fd;
+
+	if (tmp_dir == NULL) { return tmpfile(); }
+
+	path = NULL;
+	if (asprintf(&path, "%s/openvcd-spill-XXXXXX", tmp_dir) < 0) { return NULL; }
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		free(path);
+		return NULL;
+	}
+
+	/* the file lives on until it is closed */
+	unlink(path);
+	free(path);
+
+	f = fdopen(fd, "w+b");
+	if (f == NULL) { close(fd); }
+
+	return f;
+}
+
+openvcd_transposer* openvcd_new_transposer(openvcd_wave* w, size_t budget, const char* tmp_dir) {
+	openvcd_transposer* t;
+	size_t n;
+
+	t = malloc(sizeof(openvcd_transposer));
+	if (t == NULL) { return NULL; }
+
+	n = (size_t) w->signals.length;
+	t->w = w;
+	t->budget = (budget == 0) ? OPENVCD_TRANSPOSE_DEFAULT_BUDGET : budget;
+	t->used = 0;
+	t->peak = 0;
+	t->spill_length = 0;
+	vec_init(&(t->runs));
+	t->nblocks = calloc(n + 1, sizeof(uint64_t));
+	t->data_length = calloc(n + 1, sizeof(uint64_t));
+	t->buffer = NULL;
+	t->cursors = NULL;
+	t->activity = openvcd_new_heatmap(OPENVCD_HEATMAP_BUCKETS, 0);
+	t->spill = open_spill(tmp_dir);
+
+	if ((t->nblocks == NULL) || (t->data_length == NULL) || (t->activity == NULL) || (t->spill == NULL)) {
+		openvcd_free_transposer(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+void openvcd_free_transposer(openvcd_transposer* t) {
+	openvcd_spill_run* run;
+	int i;
+
+	vec_foreach_ptr(&(t->runs), run, i) {
+		vec_deinit(run);
+	}
+	vec_deinit(&(t->runs));
+
+	if (t->spill != NULL) { fclose(t->spill); }
+	free(t->nblocks);
+	free(t->data_length);
+	free(t->buffer);
+	free(t->cursors);
+	if (t->activity != NULL) { openvcd_free_heatmap(t->activity); }
+	free(t);
+}
+
+static size_t signal_memory(const openvcd_signal* s) {
+	return (s->blocks_capacity * sizeof(openvcd_block)) + s->data_capacity;
+}
+
+/* move the changes of one signal to the spill file */
+static int spill_signal(openvcd_transposer* t, openvcd_spill_run* run, size_t n) {
+	openvcd_spill_entry e;
+	openvcd_signal* s;
+
+	s = t->w->signals.data[n];
+
+	e.signal = n;
+	e.offset = t->spill_length;
+	e.nblocks = s->nblocks;
+	e.data_length = s->data_length;
+
+	if (openvcd_heatmap_add_signal(t->activity, s) != 0) { return -1; }
+	if (fwrite(s->blocks, sizeof(openvcd_block), s->nblocks, t->spill) != s->nblocks) { return -1; }
+	if (fwrite(s->data, 1, s->data_length, t->spill) != s->data_length) { return -1; }
+	if (vec_push(run, e) != 0) { return -1; }
+
+	t->spill_length += (s->nblocks * sizeof(openvcd_block)) + s->data_length;
+	t->nblocks[n] += s->nblocks;
+	t->data_length[n] += s->data_length;
+
+	free(s->blocks);
+	free(s->data);
+	s->blocks = NULL;
+	s->nblocks = 0;
+	s->blocks_capacity = 0;
+	s->data = NULL;
+	s->data_length = 0;
+	s->data_capacity = 0;
+
+	return 0;
+}
+
+static int spill(openvcd_transposer* t) {
+	openvcd_spill_run run;
+	openvcd_signal* s;
+	int i;
+
+	vec_init(&run);
+	vec_foreach(&(t->w->signals), s, i) {
+		if (s->nblocks == 0) { continue; }
+		if (spill_signal(t, &run, (size_t) i) != 0) {
+			vec_deinit(&run);
+			return -1;
+		}
+	}
+
+	if (vec_push(&(t->runs), run) != 0) {
+		vec_deinit(&run);
+		return -1;
+	}
+
+	t->used = 0;
+	return 0;
+}
+
+openvcd_parser_error openvcd_transposer_apply(openvcd_transposer* t, const openvcd_change* c) {
+	openvcd_parser_error error;
+	openvcd_wave* w;
+	openvcd_signal* s;
+	size_t before;
+	size_t n;
+
+	w = t->w;
+
+	if (c->type == OPENVCD_CHANGE_TIME) { return openvcd_wave_set_time(w, c->time); }
+
+	if (c->type == OPENVCD_CHANGE_COMMAND) { return OPENVCD_ERROR_NONE; }
+
+	error = openvcd_wave_parse_change(w, c, &n);
+	if (error != OPENVCD_ERROR_NONE) { return error; }
+	s = w->signals.data[n];
+
+	before = signal_memory(s);
+	error = openvcd_wave_append(w, n, c->time, w->scratch_aval, w->scratch_bval);
+	if (error != OPENVCD_ERROR_NONE) { return error; }
+	t->used += signal_memory(s) - before;
+	if (t->used > t->peak) { t->peak = t->used; }
+
+	if ((t->used > t->budget) && (spill(t) != 0)) {
+		return OPENVCD_ERROR_GENERAL;
+	}
+
+	return OPENVCD_ERROR_NONE;
+}
+
+static int read_at(FILE* f, uint64_t offset, void* buffer, size_t length) {
+	if (fseeko(f, (off_t) offset, SEEK_SET) != 0) { return -1; }
+	if (fread(buffer, 1, length, f) != length) { return -1; }
+	return 0;
+}
+
+/* copy the blocks of a run entry, rebasing their offsets */
+static int copy_blocks(openvcd_transposer* t, const openvcd_spill_entry* e, uint64_t base, FILE* stream) {
+	openvcd_block* blocks;
+	uint64_t offset;
+	size_t max;
+	size_t n;
+
+	blocks = (openvcd_block*) t->buffer;
+	max = OPENVCD_TRANSPOSE_COPY_SIZE / sizeof(openvcd_block);
+	offset = e->offset;
+	for (uint64_t done = 0 ; done < e->nblocks ; done += n) {
+		n = (e->nblocks - done < max) ? (size_t) (e->nblocks - done) : max;
+		if (read_at(t->spill, offset, blocks, n * sizeof(openvcd_block)) != 0) { return -1; }
+		for (size_t i = 0 ; i < n ; i++) {
+			blocks[i].offset += base;
+		}
+		if (fwrite(blocks, sizeof(openvcd_block), n, stream) != n) { return -1; }
+		offset += n * sizeof(openvcd_block);
+	}
+
+	return 0;
+}
+
+static int copy_data(openvcd_transposer* t, const openvcd_spill_entry* e, FILE* stream) {
+	uint64_t offset;
+	size_t n;
+
+	offset = e->offset + (e->nblocks * sizeof(openvcd_block));
+	for (uint64_t done = 0 ; done < e->data_length ; done += n) {
+		n = (e->data_length - done < OPENVCD_TRANSPOSE_COPY_SIZE) ?
+			(size_t) (e->data_length - done) : OPENVCD_TRANSPOSE_COPY_SIZE;
+		if (read_at(t->spill, offset, t->buffer, n) != 0) { return -1; }
+		if (fwrite(t->buffer, 1, n, stream) != n) { return -1; }
+		offset += n;
+	}
+
+	return 0;
+}
+
+/* copy every signal's entries, from each run in turn */
+static int merge(openvcd_transposer* t, FILE* stream, bool data) {
+	const openvcd_spill_entry* e;
+	openvcd_spill_run* run;
+	uint64_t base;
+	int r;
+
+	memset(t->cursors, 0, sizeof(size_t) * ((size_t) t->runs.length + 1));
+	for (size_t n = 0 ; n < (size_t) t->w->signals.length ; n++) {
+		base = 0;
+		vec_foreach_ptr(&(t->runs), run, r) {
+			if (t->cursors[r] >= (size_t) run->length) { continue; }
+			e = &(run->data[t->cursors[r]]);
+			if (e->signal != n) { continue; }
+
+			if (data && (copy_data(t, e, stream) != 0)) { return -1; }
+			if (!data && (copy_blocks(t, e, base, stream) != 0)) { return -1; }
+
+			base += e->data_length;
+			t->cursors[r]++;
+		}
+	}
+
+	return 0;
+}
+
+static int write_blocks(void* ctx, FILE* stream) {
+	return merge((openvcd_transposer*) ctx, stream, false);
+}
+
+static int write_data(void* ctx, FILE* stream) {
+	return merge((openvcd_transposer*) ctx, stream, true);
+}
+
+int openvcd_transposer_finish(openvcd_transposer* t, FILE* stream) {
+	openvcd_bin_source source;
+	openvcd_signal* s;
+	int i;
+
+	if (spill(t) != 0) { return -1; }
+	if (fflush(t->spill) != 0) { return -1; }
+
+	t->buffer = malloc(OPENVCD_TRANSPOSE_COPY_SIZE);
+	t->cursors = malloc(sizeof(size_t) * ((size_t) t->runs.length + 1));
+	if ((t->buffer == NULL) || (t->cursors == NULL)) { return -1; }
+
+	/* the signals are empty now, so they only describe the totals */
+	vec_foreach(&(t->w->signals), s, i) {
+		s->nblocks = (size_t) t->nblocks[i];
+		s->data_length = (size_t) t->data_length[i];
+	}
+
+	openvcd_heatmap_cover(t->activity, t->w->end_time);
+	if (t->w->activity != NULL) { openvcd_free_heatmap(t->w->activity); }
+	t->w->activity = t->activity;
+	t->activity = NULL;
+
+	source.write_blocks = write_blocks;
+	source.write_data = write_data;
+	source.ctx = t;
+
+	return openvcd_bin_write_from(t->w, &source, stream);
+}
+
+static openvcd_parser_error apply_change(void* ctx, const openvcd_change* c) {
+	return openvcd_transposer_apply((openvcd_transposer*) ctx, c);
+}
+
+static int transpose_stream(openvcd_parser* p, openvcd_wave* w, const char* bin_path, size_t budget, const char* tmp_dir) {
+	openvcd_transposer* t;
+	FILE* out;
+	int rc;
+
+	t = openvcd_new_transposer(w, budget, tmp_dir);
+	if (t == NULL) { return -1; }
+
+	openvcd_parse_changes(p, apply_change, t);
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) {
+		openvcd_free_transposer(t);
+		return -1;
+	}
+
+	rc = -1;
+	out = fopen(bin_path, "wb");
+	if (out != NULL) {
+		rc = openvcd_transposer_finish(t, out);
+		if (fclose(out) != 0) { rc = -1; }
+	}
+
+	openvcd_free_transposer(t);
+	return rc;
+}
+
+int openvcd_transpose(const char* vcd_path, const char* bin_path, size_t budget, const char* tmp_dir, char** error) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	FILE* in;
+	int rc;
+
+	if (error != NULL) { *error = NULL; }
+
+	in = fopen(vcd_path, "r");
+	if (in == NULL) {
+		if (error != NULL) { *error = strdup("failed to open file"); }
+		return -1;
+	}
+
+	source.input_stream = in;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	if (p == NULL) {
+		fclose(in);
+		return -1;
+	}
+
+	rc = -1;
+	w = openvcd_load_header(p);
+	if (w != NULL) {
+		rc = transpose_stream(p, w, bin_path, budget, tmp_dir);
+		openvcd_free_wave(w);
+	}
+
+	if ((rc != 0) && (error != NULL)) {
+		if (p->state != OPENVCD_PARSER_STATE_ERROR) {
+			*error = strdup("failed to write output");
+		} else if (p->error_string != NULL) {
+			*error = strdup(p->error_string);
+		}
+	}
+
+	openvcd_free_parser(p);
+	fclose(in);
+
+	return rc;
+}
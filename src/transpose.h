@@ -0,0 +1,166 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements an out-of-core conversion of VCD files to the binary
+ * format (see bin.h), for files whose changes do not fit in memory.
+ *
+ * The value change section is streamed into the signals of a waveform as
+ * usual, but whenever the memory used by their blocks exceeds a budget,
+ * every signal's blocks are appended to a spill file as a run, and the
+ * signals are emptied. Each run lists the signals it holds in signal order.
+ * Once the input is exhausted, the runs are merged: each signal's blocks
+ * and data are copied from every run in turn into the binary file, with the
+ * block offsets rebased onto the signal's combined data.
+ *
+ * The memory used for changes is bounded by the budget, plus the growth of
+ * a single signal's buffers; the hierarchy, the signal table, and one small
+ * directory entry per signal per run are kept in memory throughout.
+ *
+ * The changes are also counted into the waveform's activity histogram as
+ * each run is spilled, since the file's activity section can't be built
+ * from blocks which are no longer in memory, see heatmap.h.
+ */
+
+#ifndef OPENVCD_TRANSPOSE_H
+#define OPENVCD_TRANSPOSE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vec.h"
+#include "util.h"
+#include "parser.h"
+#include "wave.h"
+#include "bin.h"
+#include "heatmap.h"
+
+/**** TYPES ******************************************************************/
+
+#define OPENVCD_TRANSPOSE_DEFAULT_BUDGET (256 * 1024 * 1024)
+
+/* size of the buffer used to copy runs out of the spill file */
+#define OPENVCD_TRANSPOSE_COPY_SIZE (1024 * 1024)
+
+/* one signal's changes within a run */
+typedef struct {
+	uint64_t signal;
+
+	/* offset of the signal's blocks in the spill file, which are
+	 * followed by it's data */
+	uint64_t offset;
+	uint64_t nblocks;
+	uint64_t data_length;
+} openvcd_spill_entry;
+
+typedef vec_t(openvcd_spill_entry) openvcd_spill_run;
+typedef vec_t(openvcd_spill_run) openvcd_spill_runlist;
+
+typedef struct {
+	/* the waveform being built, whose signals hold the changes since the
+	 * last spill */
+	openvcd_wave* w;
+
+	size_t budget;
+
+	/* bytes allocated for the signals' blocks and data, and the most that
+	 * has been at once */
+	size_t used;
+	size_t peak;
+
+	FILE* spill;
+	uint64_t spill_length;
+	openvcd_spill_runlist runs;
+
+	/* the totals of each signal across every run */
+	uint64_t* nblocks;
+	uint64_t* data_length;
+
+	/* the changes counted as they are spilled, which become the
+	 * waveform's activity when it is finished */
+	openvcd_heatmap* activity;
+
+	/* scratch space for merging */
+	unsigned char* buffer;
+	size_t* cursors;
+} openvcd_transposer;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Create a transposer for a waveform.
+ *
+ * The waveform should have all of it's signals, but no changes yet. It is
+ * not owned by the transposer, and it's signals should not be queried until
+ * the transposer is free-ed.
+ *
+ * @param w
+ * @param budget Bytes of changes to hold in memory, or 0 to use
+ * OPENVCD_TRANSPOSE_DEFAULT_BUDGET.
+ * @param tmp_dir Directory for the spill file, or NULL to use tmpfile(). The
+ * file is removed as soon as it is created.
+ *
+ * @return The new transposer, or NULL on failure.
+ */
+openvcd_transposer* openvcd_new_transposer(openvcd_wave* w, size_t budget, const char* tmp_dir);
+
+/**
+ * @brief Free a transposer, and remove it's spill file.
+ *
+ * @param t
+ */
+void openvcd_free_transposer(openvcd_transposer* t);
+
+/**
+ * @brief Apply a record from the value change section, see
+ * openvcd_wave_apply().
+ *
+ * @param t
+ * @param c
+ *
+ * @return OPENVCD_ERROR_NONE on success, OPENVCD_ERROR_SYNTAX if the record
+ * is invalid, OPENVCD_ERROR_ALLOC_FAILED, or OPENVCD_ERROR_GENERAL if the
+ * spill file could not be written.
+ */
+openvcd_parser_error openvcd_transposer_apply(openvcd_transposer* t, const openvcd_change* c);
+
+/**
+ * @brief Write every change to a binary waveform file.
+ *
+ * After this, the transposer can only be free-ed.
+ *
+ * @param t
+ * @param stream
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_transposer_finish(openvcd_transposer* t, FILE* stream);
+
+/**
+ * @brief Convert a VCD file to a binary waveform file out-of-core.
+ *
+ * This is the same as openvcd_bin_convert() without snapshots, except that
+ * only about budget bytes of changes are held in memory at once.
+ *
+ * @param vcd_path
+ * @param bin_path
+ * @param budget See openvcd_new_transposer().
+ * @param tmp_dir See openvcd_new_transposer().
+ * @param error If not NULL, set on failure to a message describing the
+ * problem which must be free-ed, or NULL if memory ran out.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_transpose(const char* vcd_path, const char* bin_path, size_t budget, const char* tmp_dir, char** error);
+
+#endif /* OPENVCD_TRANSPOSE_H */
@@ -0,0 +1,156 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <unistd.h>
+
+#include "test_util.h"
+#include "transpose.h"
+#include "lazy.h"
+
+/* the transposed file must hold exactly the same changes as a normal load */
+static void check_transposed(const char* vcd_path, const char* bin_path) {
+	openvcd_heatmap* activity;
+	openvcd_wave* expect;
+	openvcd_wave* w;
+	openvcd_signal* s;
+	openvcd_signal* e;
+	uint64_t aval[2][2];
+	uint64_t bval[2][2];
+	bool found;
+	int i;
+
+	expect = load_file(vcd_path);
+	w = openvcd_bin_open(bin_path);
+	should_not_be_null(expect);
+	should_not_be_null(w);
+	should_equal(w->signals.length, expect->signals.length);
+	should_equal(w->end_time, expect->end_time);
+
+	/* the activity counted while spilling matches the loaded changes */
+	activity = openvcd_wave_heatmap(expect, NULL, NULL, OPENVCD_HEATMAP_BUCKETS);
+	should_not_be_null(activity);
+	should_not_be_null(w->activity);
+	should_equal(w->activity->width, activity->width);
+	for (size_t j = 0 ; j < activity->nbuckets ; j++) {
+		should_equal(w->activity->counts[j], activity->counts[j]);
+	}
+	openvcd_free_heatmap(activity);
+
+	vec_foreach(&(expect->signals), e, i) {
+		s = openvcd_wave_find_signal(w, e->id_code);
+		should_not_be_null(s);
+		should_equal(s->change_count, e->change_count);
+		should_equal(s->width, e->width);
+		for (uint64_t t = 0 ; t <= expect->end_time + 1 ; t++) {
+			found = openvcd_value_at(e, t, aval[0], bval[0]);
+			should_equal(openvcd_wave_value_at(w, s, t, aval[1], bval[1]), found);
+			if (!found) { continue; }
+			should_be_true(openvcd_value_eq(s->nwords, aval[0], bval[0], aval[1], bval[1]));
+		}
+	}
+
+	openvcd_free_wave(expect);
+	openvcd_free_wave(w);
+}
+
+static openvcd_parser_error apply_change(void* ctx, const openvcd_change* c) {
+	return openvcd_transposer_apply((openvcd_transposer*) ctx, c);
+}
+
+void test_transposer(void) {
+	char vcd_path[] = "/tmp/openvcd-transpose-vcd-XXXXXX";
+	char bin_path[] = "/tmp/openvcd-transpose-XXXXXX";
+	openvcd_input_source source;
+	openvcd_transposer* t;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	FILE* in;
+	FILE* out;
+	int fd;
+
+	write_vcd(vcd_path, 30, 3000, "");
+	fd = mkstemp(bin_path);
+	close(fd);
+
+	in = fopen(vcd_path, "r");
+	source.input_stream = in;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	openvcd_parse_header(p);
+	w = openvcd_alloc_wave(p->root, p->timescale);
+	p->root = NULL;
+	p->scope = NULL;
+	should_equal(openvcd_wave_add_vars(w, w->root), 0);
+
+	should_be_null(openvcd_new_transposer(w, 8192, "/nonexistent/openvcd"));
+	t = openvcd_new_transposer(w, 8192, "/tmp");
+	should_not_be_null(t);
+	openvcd_parse_changes(p, apply_change, t);
+	check_parser_error(p);
+
+	/* the changes didn't fit, and memory stayed close to the budget */
+	should_be_true(t->runs.length > 10);
+	should_be_true(t->peak < 2 * 8192);
+
+	out = fopen(bin_path, "wb");
+	should_equal(openvcd_transposer_finish(t, out), 0);
+	fclose(out);
+	openvcd_free_transposer(t);
+	openvcd_free_wave(w);
+	openvcd_free_parser(p);
+	fclose(in);
+
+	check_transposed(vcd_path, bin_path);
+
+	unlink(vcd_path);
+	unlink(bin_path);
+}
+
+void test_transpose(void) {
+	char vcd_path[] = "/tmp/openvcd-transpose-vcd-XXXXXX";
+	char bin_path[] = "/tmp/openvcd-transpose-XXXXXX";
+	char* error;
+	FILE* f;
+	int fd;
+
+	write_vcd(vcd_path, 10, 500, "");
+	fd = mkstemp(bin_path);
+	close(fd);
+
+	/* a budget large enough that nothing is spilled until the end */
+	should_equal(openvcd_transpose(vcd_path, bin_path, 0, NULL, &error), 0);
+	should_be_null(error);
+	check_transposed(vcd_path, bin_path);
+
+	should_equal(openvcd_transpose(vcd_path, bin_path, 1, NULL, NULL), 0);
+	check_transposed(vcd_path, bin_path);
+
+	should_equal(openvcd_transpose(vcd_path, "/nonexistent/openvcd", 0, NULL, &error), -1);
+	str_should_equal(error, "failed to write output");
+	free(error);
+
+	should_equal(openvcd_transpose("/nonexistent/openvcd", bin_path, 0, NULL, &error), -1);
+	str_should_equal(error, "failed to open file");
+	free(error);
+
+	/* the parse error comes back instead of being printed */
+	f = fopen(vcd_path, "a");
+	fputs("#1\nb2 s0\n", f);
+	fclose(f);
+	should_equal(openvcd_transpose(vcd_path, bin_path, 0, NULL, &error), -1);
+	should_not_be_null(error);
+	should_not_be_null(strstr(error, "error at byte"));
+	free(error);
+
+	unlink(vcd_path);
+	unlink(bin_path);
+}
+
+int main(void) {
+	test_transposer();
+	test_transpose();
+	return 0;
+}
@@ -0,0 +1,672 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "trigger.h"
+
+/* the state of compiling an expression */
+typedef struct {
+	openvcd_trigger* t;
+	const char* expression;
+	const char* p;
+
+	/* the first error, and whether there was one */
+	char* error;
+	bool failed;
+
+	/* the number of values on the stack at this point of the code */
+	size_t depth;
+} compiler;
+
+static uint64_t width_mask(unsigned int width) {
+	return (width >= 64) ? ~((uint64_t) 0) : ((((uint64_t) 1) << width) - 1);
+}
+
+/* returns 0 so that it can end any of the parsing functions */
+static unsigned int fail(compiler* c, const char* what) {
+	if (c->failed) { return 0; }
+
+	c->failed = true;
+	if (asprintf(&(c->error), "%s at offset %zu", what, (size_t) (c->p - c->expression)) < 0) {
+		c->error = NULL;
+	}
+
+	return 0;
+}
+
+static void skip_space(compiler* c) {
+	while (isspace((unsigned char) *(c->p))) { c->p++; }
+}
+
+/* consume an operator, unless it is followed by a character which would
+ * make it a different one */
+static bool accept(compiler* c, const char* op, const char* not_followed_by) {
+	size_t length;
+
+	skip_space(c);
+	length = strlen(op);
+	if (strncmp(c->p, op, length) != 0) { return false; }
+	if ((c->p[length] != '\0') && (strchr(not_followed_by, c->p[length]) != NULL)) {
+		return false;
+	}
+
+	c->p += length;
+	return true;
+}
+
+static bool emit(compiler* c, openvcd_trigger_op op, unsigned int width) {
+	openvcd_trigger* t;
+	openvcd_trigger_insn* code;
+	size_t cap;
+
+	t = c->t;
+	if (t->ncode == t->code_capacity) {
+		cap = (t->code_capacity == 0) ? 16 : t->code_capacity * 2;
+		code = realloc(t->code, cap * sizeof(openvcd_trigger_insn));
+		if (code == NULL) { return fail(c, "out of memory"); }
+		t->code = code;
+		t->code_capacity = cap;
+	}
+
+	memset(&(t->code[t->ncode]), 0, sizeof(openvcd_trigger_insn));
+	t->code[t->ncode].op = op;
+	t->code[t->ncode].width = width;
+	t->ncode++;
+
+	switch (op) {
+		case OPENVCD_TRIGGER_CONST:
+		case OPENVCD_TRIGGER_LOAD:
+			c->depth++;
+			if (c->depth > t->depth) { t->depth = c->depth; }
+			break;
+		case OPENVCD_TRIGGER_LOGICAL_NOT:
+		case OPENVCD_TRIGGER_NOT:
+			break;
+		default:
+			c->depth--;
+			break;
+	}
+
+	return true;
+}
+
+static unsigned int parse_expression(compiler* c);
+
+/* the digits of a literal in the given base, each of which may be x or z
+ * unless the base is 10 */
+static unsigned int parse_digits(compiler* c, unsigned int base, uint64_t* aval, uint64_t* bval) {
+	unsigned int bits;
+	unsigned int ndigits;
+	uint64_t digit;
+	uint64_t unknown;
+	char ch;
+
+	bits = (base == 2) ? 1 : (base == 8) ? 3 : 4;
+	*aval = 0;
+	*bval = 0;
+	ndigits = 0;
+
+	for (;; c->p++) {
+		ch = (char) tolower((unsigned char) *(c->p));
+		unknown = 0;
+		if (ch == '_') { continue; }
+
+		if ((ch >= '0') && (ch <= '9')) {
+			digit = (uint64_t) (ch - '0');
+		} else if ((ch >= 'a') && (ch <= 'f')) {
+			digit = (uint64_t) (ch - 'a' + 10);
+		} else if ((ch == 'x') || (ch == 'z') || (ch == '?')) {
+			if (base == 10) { return fail(c, "x or z in a decimal literal"); }
+			unknown = width_mask(bits);
+			digit = (ch == 'x') ? unknown : 0;
+		} else {
+			break;
+		}
+		if ((digit >= base) && (unknown == 0)) { return fail(c, "bad digit in literal"); }
+
+		if (base == 10) {
+			if (*aval > (UINT64_MAX - digit) / 10) { return fail(c, "literal wider than 64 bits"); }
+			*aval = (*aval * 10) + digit;
+		} else {
+			if (((*aval | *bval) >> (64 - bits)) != 0) { return fail(c, "literal wider than 64 bits"); }
+			*aval = (*aval << bits) | digit;
+			*bval = (*bval << bits) | unknown;
+		}
+		ndigits++;
+	}
+
+	if (ndigits == 0) { return fail(c, "expected digits"); }
+
+	return ndigits;
+}
+
+static unsigned int parse_literal(compiler* c) {
+	openvcd_trigger_insn* insn;
+	unsigned int width;
+	unsigned int base;
+	uint64_t aval;
+	uint64_t bval;
+	uint64_t size;
+
+	size = 0;
+	aval = 0;
+	bval = 0;
+	if (*(c->p) != '\'') {
+		if (parse_digits(c, 10, &aval, &bval) == 0) { return 0; }
+		skip_space(c);
+		if (*(c->p) == '\'') {
+			size = aval;
+			if ((size == 0) || (size > 64)) { return fail(c, "literal size must be from 1 to 64"); }
+		}
+	}
+
+	if (*(c->p) == '\'') {
+		/* skip the ' and whether it is signed */
+		c->p++;
+		if (tolower((unsigned char) *(c->p)) == 's') { c->p++; }
+
+		switch (tolower((unsigned char) *(c->p))) {
+			case 'b': base = 2; break;
+			case 'o': base = 8; break;
+			case 'd': base = 10; break;
+			case 'h': base = 16; break;
+			default: return fail(c, "expected a base");
+		}
+		c->p++;
+		skip_space(c);
+
+		if (parse_digits(c, base, &aval, &bval) == 0) { return 0; }
+	}
+
+	/* unsized literals are at least 32 bits wide */
+	width = (size != 0) ? (unsigned int) size : ((((aval | bval) >> 32) != 0) ? 64 : 32);
+
+	if (!emit(c, OPENVCD_TRIGGER_CONST, width)) { return 0; }
+	insn = &(c->t->code[c->t->ncode - 1]);
+	insn->aval = aval & width_mask(width);
+	insn->bval = bval & width_mask(width);
+
+	return width;
+}
+
+/* a non-negative decimal index in a bit or part select */
+static bool parse_index(compiler* c, long* index) {
+	uint64_t aval;
+	uint64_t bval;
+
+	skip_space(c);
+	if (!isdigit((unsigned char) *(c->p))) { return fail(c, "expected an index"); }
+	if (parse_digits(c, 10, &aval, &bval) == 0) { return false; }
+	if (aval > INT32_MAX) { return fail(c, "index out of range"); }
+
+	*index = (long) aval;
+	return true;
+}
+
+/* the bit of a variable's signal at one of it's declared indices */
+static bool var_bit(compiler* c, const openvcd_var* v, long index, unsigned int* bit) {
+	const openvcd_reference* r;
+
+	r = v->reference;
+	if ((r != NULL) && (r->msb_index >= 0) && (r->lsb_index >= 0)) {
+		index = (r->msb_index >= r->lsb_index) ? index - r->lsb_index : r->lsb_index - index;
+	}
+
+	if ((index < 0) || (index >= (long) v->width)) { return fail(c, "index out of range"); }
+
+	*bit = (unsigned int) index;
+	return true;
+}
+
+static bool add_input(compiler* c, openvcd_signal* s, size_t* input) {
+	openvcd_trigger* t;
+	openvcd_signal** inputs;
+	size_t cap;
+
+	t = c->t;
+	for (size_t i = 0 ; i < t->ninputs ; i++) {
+		if (t->inputs[i] == s) {
+			*input = i;
+			return true;
+		}
+	}
+
+	if (t->ninputs == t->inputs_capacity) {
+		cap = (t->inputs_capacity == 0) ? 4 : t->inputs_capacity * 2;
+		inputs = realloc(t->inputs, cap * sizeof(openvcd_signal*));
+		if (inputs == NULL) { return fail(c, "out of memory"); }
+		t->inputs = inputs;
+		t->inputs_capacity = cap;
+	}
+
+	*input = t->ninputs;
+	t->inputs[t->ninputs++] = s;
+	return true;
+}
+
+static unsigned int parse_signal(compiler* c) {
+	openvcd_trigger_insn* insn;
+	const openvcd_var* v;
+	openvcd_signal* s;
+	const char* start;
+	unsigned int lsb;
+	unsigned int msb;
+	unsigned int temp;
+	size_t input;
+	long index;
+
+	start = c->p;
+	while (isalnum((unsigned char) *(c->p)) || ((*(c->p) != '\0') && (strchr("_$.", *(c->p)) != NULL))) {
+		c->p++;
+	}
+
+	v = openvcd_wave_find_var(c->t->w, start, (size_t) (c->p - start));
+	if (v == NULL) {
+		c->p = start;
+		return fail(c, "no such variable");
+	}
+
+	s = openvcd_wave_find_signal(c->t->w, v->identifier_code);
+	if (s == NULL) { return fail(c, "variable has no signal"); }
+	if (s->real) { return fail(c, "real variables are not supported"); }
+
+	lsb = 0;
+	msb = s->width - 1;
+	if (accept(c, "[", "")) {
+		if (!parse_index(c, &index) || !var_bit(c, v, index, &msb)) { return 0; }
+		lsb = msb;
+
+		if (accept(c, ":", "")) {
+			if (!parse_index(c, &index) || !var_bit(c, v, index, &lsb)) { return 0; }
+		}
+		if (!accept(c, "]", "")) { return fail(c, "expected ]"); }
+
+		if (lsb > msb) {
+			temp = lsb;
+			lsb = msb;
+			msb = temp;
+		}
+	}
+
+	if (msb - lsb >= 64) { return fail(c, "value wider than 64 bits, select part of it"); }
+	if (!add_input(c, s, &input)) { return 0; }
+
+	if (!emit(c, OPENVCD_TRIGGER_LOAD, msb - lsb + 1)) { return 0; }
+	insn = &(c->t->code[c->t->ncode - 1]);
+	insn->input = input;
+	insn->lsb = lsb;
+
+	return msb - lsb + 1;
+}
+
+static unsigned int parse_primary(compiler* c) {
+	unsigned int width;
+
+	skip_space(c);
+
+	if (accept(c, "(", "")) {
+		width = parse_expression(c);
+		if (width == 0) { return 0; }
+		if (!accept(c, ")", "")) { return fail(c, "expected )"); }
+		return width;
+	}
+
+	if (isdigit((unsigned char) *(c->p)) || (*(c->p) == '\'')) {
+		return parse_literal(c);
+	}
+
+	if (isalpha((unsigned char) *(c->p)) || (*(c->p) == '_')) {
+		return parse_signal(c);
+	}
+
+	return fail(c, "expected a value");
+}
+
+static unsigned int parse_unary(compiler* c) {
+	unsigned int width;
+
+	if (accept(c, "!", "=")) {
+		if (parse_unary(c) == 0) { return 0; }
+		return emit(c, OPENVCD_TRIGGER_LOGICAL_NOT, 1) ? 1 : 0;
+	}
+
+	if (accept(c, "~", "")) {
+		width = parse_unary(c);
+		if (width == 0) { return 0; }
+		return emit(c, OPENVCD_TRIGGER_NOT, width) ? width : 0;
+	}
+
+	return parse_primary(c);
+}
+
+/* the operators at one level of precedence */
+typedef struct {
+	const char* op;
+	const char* not_followed_by;
+	openvcd_trigger_op code;
+} binary_op;
+
+static const binary_op levels[][5] = {
+	{{"||", "", OPENVCD_TRIGGER_LOGICAL_OR}, {NULL, NULL, 0}},
+	{{"&&", "", OPENVCD_TRIGGER_LOGICAL_AND}, {NULL, NULL, 0}},
+	{{"|", "|", OPENVCD_TRIGGER_OR}, {NULL, NULL, 0}},
+	{{"^", "", OPENVCD_TRIGGER_XOR}, {NULL, NULL, 0}},
+	{{"&", "&", OPENVCD_TRIGGER_AND}, {NULL, NULL, 0}},
+	{{"==", "", OPENVCD_TRIGGER_EQ}, {"!=", "", OPENVCD_TRIGGER_NE}, {NULL, NULL, 0}},
+	{{"<=", "", OPENVCD_TRIGGER_LE}, {">=", "", OPENVCD_TRIGGER_GE},
+		{"<", "", OPENVCD_TRIGGER_LT}, {">", "", OPENVCD_TRIGGER_GT}, {NULL, NULL, 0}},
+};
+
+#define NLEVELS (sizeof(levels) / sizeof(levels[0]))
+
+static bool is_bitwise(openvcd_trigger_op op) {
+	return (op == OPENVCD_TRIGGER_AND) || (op == OPENVCD_TRIGGER_OR) || (op == OPENVCD_TRIGGER_XOR);
+}
+
+static unsigned int parse_level(compiler* c, size_t level) {
+	const binary_op* op;
+	unsigned int left;
+	unsigned int right;
+
+	if (level == NLEVELS) { return parse_unary(c); }
+
+	left = parse_level(c, level + 1);
+	while (left != 0) {
+		for (op = levels[level] ; op->op != NULL ; op++) {
+			if (accept(c, op->op, op->not_followed_by)) { break; }
+		}
+		if (op->op == NULL) { break; }
+
+		right = parse_level(c, level + 1);
+		if (right == 0) { return 0; }
+
+		left = is_bitwise(op->code) ? ((left > right) ? left : right) : 1;
+		if (!emit(c, op->code, left)) { return 0; }
+	}
+
+	return left;
+}
+
+static unsigned int parse_expression(compiler* c) {
+	return parse_level(c, 0);
+}
+
+void openvcd_free_trigger(openvcd_trigger* t) {
+	free(t->code);
+	free(t->stack_aval);
+	free(t->stack_bval);
+	free(t->inputs);
+	free(t);
+}
+
+openvcd_trigger* openvcd_compile_trigger(openvcd_wave* w, const char* expression, char** error) {
+	openvcd_trigger* t;
+	compiler c;
+
+	if (error != NULL) { *error = NULL; }
+
+	memset(&c, 0, sizeof(compiler));
+	c.expression = expression;
+	c.p = expression;
+
+	t = calloc(1, sizeof(openvcd_trigger));
+	if (t == NULL) { return NULL; }
+	t->w = w;
+	c.t = t;
+
+	if (parse_expression(&c) != 0) {
+		skip_space(&c);
+		if (*(c.p) != '\0') { fail(&c, "unexpected character"); }
+	}
+
+	if (!c.failed) {
+		t->stack_aval = calloc(t->depth + 1, sizeof(uint64_t));
+		t->stack_bval = calloc(t->depth + 1, sizeof(uint64_t));
+		if ((t->stack_aval == NULL) || (t->stack_bval == NULL)) { fail(&c, "out of memory"); }
+	}
+
+	if (c.failed) {
+		if (error != NULL) {
+			*error = c.error;
+		} else {
+			free(c.error);
+		}
+		openvcd_free_trigger(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+/* the state of a value used as a condition */
+static int truth(uint64_t aval, uint64_t bval) {
+	if ((aval & ~bval) != 0) { return OPENVCD_STATE_1; }
+	if (bval == 0) { return OPENVCD_STATE_0; }
+	return OPENVCD_STATE_X;
+}
+
+static void load(const openvcd_trigger_insn* insn, const openvcd_cursor* c, uint64_t* aval, uint64_t* bval) {
+	const openvcd_signal* s;
+	unsigned int word;
+	unsigned int shift;
+	size_t offset;
+
+	if (!c->valid[insn->input]) {
+		*aval = width_mask(insn->width);
+		*bval = *aval;
+		return;
+	}
+
+	s = c->signals[insn->input];
+	offset = c->offsets[insn->input];
+	word = insn->lsb / 64;
+	shift = insn->lsb % 64;
+
+	*aval = c->aval[offset + word] >> shift;
+	*bval = c->bval[offset + word] >> shift;
+	if ((shift != 0) && (word + 1 < s->nwords)) {
+		*aval |= c->aval[offset + word + 1] << (64 - shift);
+		*bval |= c->bval[offset + word + 1] << (64 - shift);
+	}
+
+	*aval &= width_mask(insn->width);
+	*bval &= width_mask(insn->width);
+}
+
+/* the result of a comparison of two values with no x or z bits */
+static bool compare(openvcd_trigger_op op, uint64_t a, uint64_t b) {
+	switch (op) {
+		case OPENVCD_TRIGGER_LT: return a < b;
+		case OPENVCD_TRIGGER_LE: return a <= b;
+		case OPENVCD_TRIGGER_GT: return a > b;
+		default: return a >= b;
+	}
+}
+
+/* apply a binary operator, putting the result in a1 and b1 */
+static void binary(const openvcd_trigger_insn* insn, uint64_t* a1, uint64_t* b1, uint64_t a2, uint64_t b2) {
+	uint64_t one;
+	uint64_t zero;
+	uint64_t x;
+	int state;
+	int t1;
+	int t2;
+
+	switch (insn->op) {
+		case OPENVCD_TRIGGER_AND:
+			one = (*a1 & ~*b1) & (a2 & ~b2);
+			zero = (~*a1 & ~*b1) | (~a2 & ~b2);
+			x = ~(one | zero);
+			*a1 = one | x;
+			*b1 = x;
+			return;
+		case OPENVCD_TRIGGER_OR:
+			one = (*a1 & ~*b1) | (a2 & ~b2);
+			zero = (~*a1 & ~*b1) & (~a2 & ~b2);
+			x = ~(one | zero);
+			*a1 = one | x;
+			*b1 = x;
+			return;
+		case OPENVCD_TRIGGER_XOR:
+			x = *b1 | b2;
+			*a1 = (*a1 ^ a2) | x;
+			*b1 = x;
+			return;
+		case OPENVCD_TRIGGER_LOGICAL_AND:
+			t1 = truth(*a1, *b1);
+			t2 = truth(a2, b2);
+			if ((t1 == OPENVCD_STATE_0) || (t2 == OPENVCD_STATE_0)) {
+				state = OPENVCD_STATE_0;
+			} else {
+				state = ((t1 == OPENVCD_STATE_1) && (t2 == OPENVCD_STATE_1)) ? OPENVCD_STATE_1 : OPENVCD_STATE_X;
+			}
+			break;
+		case OPENVCD_TRIGGER_LOGICAL_OR:
+			t1 = truth(*a1, *b1);
+			t2 = truth(a2, b2);
+			if ((t1 == OPENVCD_STATE_1) || (t2 == OPENVCD_STATE_1)) {
+				state = OPENVCD_STATE_1;
+			} else {
+				state = ((t1 == OPENVCD_STATE_0) && (t2 == OPENVCD_STATE_0)) ? OPENVCD_STATE_0 : OPENVCD_STATE_X;
+			}
+			break;
+		case OPENVCD_TRIGGER_EQ:
+		case OPENVCD_TRIGGER_NE:
+			/* a known bit which differs decides it even if others are x */
+			x = *b1 | b2;
+			if (((*a1 ^ a2) & ~x) != 0) {
+				state = OPENVCD_STATE_0;
+			} else {
+				state = (x != 0) ? OPENVCD_STATE_X : OPENVCD_STATE_1;
+			}
+			if ((insn->op == OPENVCD_TRIGGER_NE) && (state != OPENVCD_STATE_X)) {
+				state ^= 1;
+			}
+			break;
+		default:
+			if ((*b1 | b2) != 0) {
+				state = OPENVCD_STATE_X;
+			} else {
+				state = compare(insn->op, *a1, a2) ? OPENVCD_STATE_1 : OPENVCD_STATE_0;
+			}
+			break;
+	}
+
+	*a1 = (uint64_t) (state & 1);
+	*b1 = (uint64_t) ((state >> 1) & 1);
+}
+
+int openvcd_trigger_eval(openvcd_trigger* t, const openvcd_cursor* c) {
+	const openvcd_trigger_insn* insn;
+	uint64_t* aval;
+	uint64_t* bval;
+	uint64_t mask;
+	size_t sp;
+	int state;
+
+	aval = t->stack_aval;
+	bval = t->stack_bval;
+	sp = 0;
+
+	for (size_t i = 0 ; i < t->ncode ; i++) {
+		insn = &(t->code[i]);
+		mask = width_mask(insn->width);
+
+		switch (insn->op) {
+			case OPENVCD_TRIGGER_CONST:
+				aval[sp] = insn->aval;
+				bval[sp] = insn->bval;
+				sp++;
+				break;
+			case OPENVCD_TRIGGER_LOAD:
+				load(insn, c, &(aval[sp]), &(bval[sp]));
+				sp++;
+				break;
+			case OPENVCD_TRIGGER_LOGICAL_NOT:
+				state = truth(aval[sp - 1], bval[sp - 1]);
+				if (state != OPENVCD_STATE_X) { state ^= 1; }
+				aval[sp - 1] = (uint64_t) (state & 1);
+				bval[sp - 1] = (uint64_t) ((state >> 1) & 1);
+				break;
+			case OPENVCD_TRIGGER_NOT:
+				aval[sp - 1] = (~aval[sp - 1] | bval[sp - 1]) & mask;
+				break;
+			default:
+				sp--;
+				binary(insn, &(aval[sp - 1]), &(bval[sp - 1]), aval[sp], bval[sp]);
+				aval[sp - 1] &= mask;
+				bval[sp - 1] &= mask;
+				break;
+		}
+	}
+
+	return truth(aval[0], bval[0]);
+}
+
+static int add_interval(openvcd_interval** intervals, size_t* n, size_t* capacity, uint64_t start, uint64_t end) {
+	openvcd_interval* grown;
+	size_t cap;
+
+	if (*n == *capacity) {
+		cap = (*capacity == 0) ? 16 : *capacity * 2;
+		grown = realloc(*intervals, cap * sizeof(openvcd_interval));
+		if (grown == NULL) { return -1; }
+		*intervals = grown;
+		*capacity = cap;
+	}
+
+	(*intervals)[*n].start = start;
+	(*intervals)[*n].end = end;
+	(*n)++;
+
+	return 0;
+}
+
+long openvcd_trigger_intervals(openvcd_trigger* t, openvcd_interval** intervals) {
+	openvcd_cursor* c;
+	size_t capacity;
+	uint64_t start;
+	size_t n;
+	bool holds;
+	bool now;
+	int rc;
+
+	*intervals = NULL;
+	capacity = 0;
+	n = 0;
+
+	c = openvcd_new_cursor(t->w, t->inputs, t->ninputs);
+	if (c == NULL) { return -1; }
+
+	/* an expression of constants may hold from the start */
+	start = 0;
+	holds = (openvcd_trigger_eval(t, c) == OPENVCD_STATE_1);
+
+	while ((rc = openvcd_cursor_next(c)) > 0) {
+		now = (openvcd_trigger_eval(t, c) == OPENVCD_STATE_1);
+		if (now == holds) { continue; }
+
+		if (now) {
+			start = c->time;
+		} else if (add_interval(intervals, &n, &capacity, start, c->time) != 0) {
+			rc = -1;
+			break;
+		}
+		holds = now;
+	}
+
+	if ((rc == 0) && holds && (add_interval(intervals, &n, &capacity, start, UINT64_MAX) != 0)) {
+		rc = -1;
+	}
+
+	openvcd_free_cursor(c);
+
+	if (rc < 0) {
+		free(*intervals);
+		*intervals = NULL;
+		return -1;
+	}
+
+	return (long) n;
+}
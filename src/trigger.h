@@ -0,0 +1,168 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements trigger expressions over the signals of a waveform,
+ * such as
+ *
+ *	top.valid && top.ready && top.data[7:0] == 8'hA5
+ *
+ * and finding the intervals of time during which they hold.
+ *
+ * Signals are named by their dotted paths, optionally followed by a bit
+ * select [i] or a part select [msb:lsb] using the indices of the variable's
+ * declaration. Literals are decimal numbers or Verilog based literals such
+ * as 'b1x0z, 4'd9, or 16'hFF_FF. The operators are those of Verilog, from
+ * the lowest to the highest precedence:
+ *
+ *	||
+ *	&&
+ *	|
+ *	^
+ *	&
+ *	== !=
+ *	< <= > >=
+ *	! ~ (unary)
+ *
+ * and parentheses. Values have four states and at most 64 bits, and x and z
+ * propagate as they do in Verilog, so that == with an x bit is x unless
+ * some other bit differs. An expression holds when it's value is known and
+ * not zero. A signal which hasn't changed yet is all x.
+ *
+ * An expression is parsed once, with it's paths resolved, into bytecode for
+ * a small stack machine. The changes of it's signals are then walked with a
+ * cursor, see cursor.h, and the bytecode is only run at the times one of
+ * them changes.
+ */
+
+#ifndef OPENVCD_TRIGGER_H
+#define OPENVCD_TRIGGER_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "util.h"
+#include "wave.h"
+#include "cursor.h"
+
+/**** TYPES ******************************************************************/
+
+typedef enum {
+	OPENVCD_TRIGGER_CONST,
+	OPENVCD_TRIGGER_LOAD,
+	OPENVCD_TRIGGER_LOGICAL_NOT,
+	OPENVCD_TRIGGER_NOT,
+	OPENVCD_TRIGGER_AND,
+	OPENVCD_TRIGGER_OR,
+	OPENVCD_TRIGGER_XOR,
+	OPENVCD_TRIGGER_LOGICAL_AND,
+	OPENVCD_TRIGGER_LOGICAL_OR,
+	OPENVCD_TRIGGER_EQ,
+	OPENVCD_TRIGGER_NE,
+	OPENVCD_TRIGGER_LT,
+	OPENVCD_TRIGGER_LE,
+	OPENVCD_TRIGGER_GT,
+	OPENVCD_TRIGGER_GE,
+} openvcd_trigger_op;
+
+typedef struct {
+	openvcd_trigger_op op;
+
+	/* the width of the result, from 1 to 64 */
+	unsigned int width;
+
+	/* for OPENVCD_TRIGGER_LOAD, the input to load from and the first bit
+	 * of it to load */
+	size_t input;
+	unsigned int lsb;
+
+	/* for OPENVCD_TRIGGER_CONST, the value */
+	uint64_t aval;
+	uint64_t bval;
+} openvcd_trigger_insn;
+
+typedef struct {
+	/* the instructions, each popping it's operands and pushing it's
+	 * result */
+	openvcd_trigger_insn* code;
+	size_t ncode;
+	size_t code_capacity;
+
+	/* the most values on the stack at once, and the stack */
+	size_t depth;
+	uint64_t* stack_aval;
+	uint64_t* stack_bval;
+
+	/* the distinct signals the expression reads */
+	openvcd_signal** inputs;
+	size_t ninputs;
+	size_t inputs_capacity;
+
+	openvcd_wave* w;
+} openvcd_trigger;
+
+/* The time from start up to but not including end. */
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+} openvcd_interval;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Compile a trigger expression.
+ *
+ * @param w The waveform whose signals the expression names.
+ * @param expression
+ * @param error If not NULL, set on failure to a message describing the
+ * problem which must be free-ed, or NULL if memory ran out.
+ *
+ * @return The trigger, which must be free-ed with openvcd_free_trigger(), or
+ * NULL on failure.
+ */
+openvcd_trigger* openvcd_compile_trigger(openvcd_wave* w, const char* expression, char** error);
+
+/**
+ * @brief Free a trigger.
+ *
+ * @param t
+ */
+void openvcd_free_trigger(openvcd_trigger* t);
+
+/**
+ * @brief Evaluate a trigger with the current values of a cursor.
+ *
+ * @param t
+ * @param c A cursor over t->inputs, in the same order.
+ *
+ * @return The state of the expression's value as a condition, one of
+ * OPENVCD_STATE_0, OPENVCD_STATE_1, or OPENVCD_STATE_X.
+ */
+int openvcd_trigger_eval(openvcd_trigger* t, const openvcd_cursor* c);
+
+/**
+ * @brief Find every interval of time during which a trigger holds.
+ *
+ * Intervals are in order and don't touch. If the expression still holds
+ * after the last change of it's signals, the end of the last interval is
+ * UINT64_MAX.
+ *
+ * @param t
+ * @param intervals Set to the intervals, which must be free-ed.
+ *
+ * @return The number of intervals, or -1 on failure.
+ */
+long openvcd_trigger_intervals(openvcd_trigger* t, openvcd_interval** intervals);
+
+#endif /* OPENVCD_TRIGGER_H */
@@ -0,0 +1,195 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "trigger.h"
+
+static const char* input =
+	"$timescale 1ns $end\n"
+	"$scope module top $end\n"
+	"$var wire 1 v valid $end\n"
+	"$var wire 1 r ready $end\n"
+	"$var reg 16 d data [15:0] $end\n"
+	"$var reg 4 u up [0:3] $end\n"
+	"$var reg 70 w wide [69:0] $end\n"
+	"$var real 64 f level $end\n"
+	"$scope module core $end\n"
+	"$var wire 1 e enable $end\n"
+	"$upscope $end\n"
+	"$upscope $end\n"
+	"$enddefinitions $end\n"
+	"#0\n0v\n0r\nb0 d\nb0001 u\nb0 w\n1e\nr0.5 f\n"
+	"#10\n1v\nb1010010100000000 d\n"
+	"#20\nb1111000010100101 d\n"
+	"#25\n1r\n"
+	"#30\nb1x10100101 d\n"
+	"#40\nb10100101 d\n"
+	"#50\n0v\n"
+	"#60\n1v\n"
+	"#70\nb1000000000000000000000000000000000000000000000000000000000000000011 w\n";
+
+/* find the intervals of an expression, checking there are n of them */
+static openvcd_interval* intervals(openvcd_wave* w, const char* expression, long n) {
+	openvcd_interval* found;
+	openvcd_trigger* t;
+	char* error;
+
+	t = openvcd_compile_trigger(w, expression, &error);
+	if (t == NULL) { fprintf(stderr, "%s: %s\n", expression, error); }
+	should_not_be_null(t);
+	should_equal(openvcd_trigger_intervals(t, &found), n);
+	openvcd_free_trigger(t);
+
+	return found;
+}
+
+void test_trigger_intervals(void) {
+	openvcd_interval* found;
+	openvcd_wave* w;
+
+	w = load_string(input);
+
+	/* the example, with data's low byte A5 from 20 on */
+	found = intervals(w, "top.valid && top.ready && top.data[7:0] == 8'hA5", 2);
+	should_equal(found[0].start, 25);
+	should_equal(found[0].end, 50);
+	should_equal(found[1].start, 60);
+	should_equal(found[1].end, UINT64_MAX);
+	free(found);
+
+	/* still holding at the end */
+	found = intervals(w, "top.valid", 2);
+	should_equal(found[0].start, 10);
+	should_equal(found[0].end, 50);
+	should_equal(found[1].start, 60);
+	should_equal(found[1].end, UINT64_MAX);
+	free(found);
+
+	found = intervals(w, "!top.valid", 2);
+	should_equal(found[0].start, 0);
+	should_equal(found[0].end, 10);
+	should_equal(found[1].start, 50);
+	should_equal(found[1].end, 60);
+	free(found);
+
+	found = intervals(w, "top.core.enable", 1);
+	should_equal(found[0].start, 0);
+	free(found);
+
+	found = intervals(w, "1 || top.valid", 1);
+	should_equal(found[0].start, 0);
+	should_equal(found[0].end, UINT64_MAX);
+	free(found);
+
+	found = intervals(w, "0", 0);
+	free(found);
+
+	openvcd_free_wave(w);
+}
+
+void test_trigger_operators(void) {
+	const struct {
+		const char* expression;
+		uint64_t start;
+		uint64_t end;
+	} cases[] = {
+		/* selects use the declared indices */
+		{"top.data[15:8] == 'hA5", 10, 20},
+		{"top.data[15] & top.data[13]", 10, 30},
+		{"top.up[3]", 0, UINT64_MAX},
+		{"top.up[0:2] == 0", 0, UINT64_MAX},
+		{"top.wide[64] ^ top.wide[0]", 70, UINT64_MAX},
+		{"top.wide[66:65] == 2'b10", 70, UINT64_MAX},
+		{"top.wide[66:63] == 4'b1000", 70, UINT64_MAX},
+
+		/* x bits make comparisons x, unless a known bit differs */
+		{"top.data[7:0] >= 8'd165 && top.data[7:0] <= 165", 20, UINT64_MAX},
+		{"top.data[9:8] != 2'b11 && top.ready", 25, 30},
+		{"(top.data | 16'h0f00) == 16'h0fa5 && top.valid", 30, 50},
+		{"!(~top.data[9:8] == 2'bx0)", 0, 10},
+		{"(top.data[15:8] ^ 8'h0f) > 8'hf0", 20, 30},
+		{"top.data[3:0] < 4'b01_01", 0, 20},
+	};
+	openvcd_interval* found;
+	openvcd_trigger* t;
+	openvcd_wave* w;
+	long n;
+
+	w = load_string(input);
+
+	for (size_t i = 0 ; i < sizeof(cases) / sizeof(cases[0]) ; i++) {
+		t = openvcd_compile_trigger(w, cases[i].expression, NULL);
+		should_not_be_null(t);
+		n = openvcd_trigger_intervals(t, &found);
+		if ((n < 1) || (found[0].start != cases[i].start) || (found[0].end != cases[i].end)) {
+			fprintf(stderr, "%s: %ld intervals\n", cases[i].expression, n);
+		}
+		should_be_true(n >= 1);
+		should_equal(found[0].start, cases[i].start);
+		should_equal(found[0].end, cases[i].end);
+		free(found);
+		openvcd_free_trigger(t);
+	}
+
+	openvcd_free_wave(w);
+}
+
+void test_trigger_inputs(void) {
+	openvcd_trigger* t;
+	openvcd_wave* w;
+
+	w = load_string(input);
+
+	/* each signal is read once however often it is named */
+	t = openvcd_compile_trigger(w, "top.data[0] && (top.data[1] || top.valid) && top.data == 0", NULL);
+	should_not_be_null(t);
+	should_equal(t->ninputs, 2);
+	should_equal(t->depth, 3);
+	openvcd_free_trigger(t);
+
+	openvcd_free_wave(w);
+}
+
+void test_trigger_errors(void) {
+	const char* errors[] = {
+		"",
+		"top.nothing",
+		"top.valid &&",
+		"(top.valid",
+		"top.valid top.ready",
+		"top.wide",
+		"top.level",
+		"top.data[16]",
+		"top.data[3:",
+		"65'h0",
+		"'h1_0000_0000_0000_0000",
+		"4'q3",
+		"12x",
+		"3'dx",
+	};
+	openvcd_wave* w;
+	char* error;
+
+	w = load_string(input);
+
+	for (size_t i = 0 ; i < sizeof(errors) / sizeof(errors[0]) ; i++) {
+		should_be_null(openvcd_compile_trigger(w, errors[i], &error));
+		should_not_be_null(error);
+		free(error);
+	}
+
+	openvcd_free_wave(w);
+}
+
+int main(void) {
+	test_trigger_intervals();
+	test_trigger_operators();
+	test_trigger_inputs();
+	test_trigger_errors();
+	return 0;
+}
@@ -1,5 +1,10 @@
 #include "util.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 
 char* openvcd_charfilter(char* s, char* filter) {
 	char* r;
@@ -26,3 +31,43 @@ i_in_filter:
 
 	return r;
 }
+
+uint64_t openvcd_hash(const char* s, size_t length) {
+	uint64_t h;
+
+	h = 0xcbf29ce484222325ULL;
+	for (size_t i = 0 ; i < length ; i++) {
+		h ^= (unsigned char) s[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+void* openvcd_map_file(const char* path, size_t* length) {
+	struct stat st;
+	void* mapping;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) { return NULL; }
+
+	if ((fstat(fd, &st) != 0) || (st.st_size <= 0)) {
+		close(fd);
+		return NULL;
+	}
+
+	mapping = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	/* the mapping stays valid after the descriptor is closed */
+	close(fd);
+
+	if (mapping == MAP_FAILED) { return NULL; }
+
+	*length = (size_t) st.st_size;
+	return mapping;
+}
+
+void openvcd_unmap(void* mapping, size_t length) {
+	munmap(mapping, length);
+}
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "khash.h"
 
@@ -25,6 +26,8 @@
 
 #define OPENVCD_UNUSED(x) (void)(x)
 
+#define OPENVCD_IS_WHITESPACE(_ch) ( ((_ch) == ' ') || ((_ch) == '\t') || ((_ch) == '\n') || ((_ch) == '\r') )
+
 /**
  * @brief Works identically to kh_del(name, h, k), but key is a key rather than
  * a khint_t.
@@ -71,4 +74,39 @@
  */
 char* openvcd_charfilter(char* s, char* filter);
 
+/**
+ * @brief Compute a 64-bit FNV-1a hash of the given bytes.
+ *
+ * This is not cryptographically secure, it is intended for hash tables and
+ * probabilistic filters keyed on VCD identifier codes.
+ *
+ * @param s
+ * @param length
+ *
+ * @return
+ */
+uint64_t openvcd_hash(const char* s, size_t length);
+
+/**
+ * @brief Map a file into memory read-only.
+ *
+ * The mapping is shared, so that every process which maps the same file
+ * shares the same pages of the page cache.
+ *
+ * @param path
+ * @param length Set to the length of the file.
+ *
+ * @return The mapping, which must be released with openvcd_unmap(), or NULL
+ * on failure. Empty files can't be mapped, and also return NULL.
+ */
+void* openvcd_map_file(const char* path, size_t* length);
+
+/**
+ * @brief Release a mapping created by openvcd_map_file().
+ *
+ * @param mapping
+ * @param length
+ */
+void openvcd_unmap(void* mapping, size_t length);
+
 #endif /* OPENVCD_UTIL_H */
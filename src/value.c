@@ -0,0 +1,137 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "value.h"
+
+int openvcd_state_from_char(char ch) {
+	switch (ch) {
+		case '0': return OPENVCD_STATE_0;
+		case '1': return OPENVCD_STATE_1;
+		case 'z':
+		case 'Z': return OPENVCD_STATE_Z;
+		case 'x':
+		case 'X': return OPENVCD_STATE_X;
+		default: return -1;
+	}
+}
+
+char openvcd_state_to_char(int state) {
+	static const char chars[] = "01zx";
+	return chars[state & 3];
+}
+
+int openvcd_value_get(const uint64_t* aval, const uint64_t* bval, unsigned int bit) {
+	return (int) (((aval[bit / 64] >> (bit % 64)) & 1) |
+		(((bval[bit / 64] >> (bit % 64)) & 1) << 1));
+}
+
+bool openvcd_state_posedge(int from, int to) {
+	if (from == to) { return false; }
+	return (from == OPENVCD_STATE_0) || (to == OPENVCD_STATE_1);
+}
+
+bool openvcd_state_negedge(int from, int to) {
+	if (from == to) { return false; }
+	return (from == OPENVCD_STATE_1) || (to == OPENVCD_STATE_0);
+}
+
+void openvcd_value_set(uint64_t* aval, uint64_t* bval, unsigned int bit, int state) {
+	uint64_t mask;
+
+	mask = ((uint64_t) 1) << (bit % 64);
+	aval[bit / 64] = (aval[bit / 64] & ~mask) | ((state & 1) ? mask : 0);
+	bval[bit / 64] = (bval[bit / 64] & ~mask) | ((state & 2) ? mask : 0);
+}
+
+bool openvcd_value_parse(const char* s, size_t length, unsigned int width, uint64_t* aval, uint64_t* bval) {
+	unsigned int bit;
+	uint64_t chars;
+	size_t nwords;
+	int state;
+	int fill;
+
+	nwords = OPENVCD_VALUE_WORDS(width);
+	memset(aval, 0, nwords * sizeof(uint64_t));
+	memset(bval, 0, nwords * sizeof(uint64_t));
+
+	if (length == 0) { return false; }
+
+	fill = openvcd_state_from_char(s[0]);
+	if (fill < 0) { return false; }
+	if (fill == OPENVCD_STATE_1) { fill = OPENVCD_STATE_0; }
+
+	/* eight bits at a time, from the end, for as long as they are all 0 or
+	 * 1, gathering the low bit of each character into one byte */
+	bit = 0;
+	while ((bit + 8 <= width) && (bit + 8 <= length)) {
+		memcpy(&chars, s + length - bit - 8, 8);
+		if ((chars & 0xfefefefefefefefeULL) != 0x3030303030303030ULL) { break; }
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		chars = __builtin_bswap64(chars);
+#endif
+		chars = ((chars & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56;
+		aval[bit / 64] |= chars << (bit % 64);
+		bit += 8;
+	}
+
+	for ( ; bit < width ; bit++) {
+		if (bit < length) {
+			state = openvcd_state_from_char(s[length - 1 - bit]);
+			if (state < 0) { return false; }
+		} else if (fill == OPENVCD_STATE_0) {
+			/* the rest is already 0 */
+			break;
+		} else {
+			state = fill;
+		}
+
+		if (state & 1) { aval[bit / 64] |= ((uint64_t) 1) << (bit % 64); }
+		if (state & 2) { bval[bit / 64] |= ((uint64_t) 1) << (bit % 64); }
+	}
+
+	return true;
+}
+
+bool openvcd_value_parse_real(const char* s, size_t length, uint64_t* aval, uint64_t* bval) {
+	char small[64];
+	char* text;
+	char* end;
+	double d;
+	bool valid;
+
+	text = (length < sizeof(small)) ? small : malloc(length + 1);
+	if (text == NULL) { return false; }
+	memcpy(text, s, length);
+	text[length] = '\0';
+
+	d = strtod(text, &end);
+	valid = (length > 0) && (*end == '\0');
+
+	if (text != small) { free(text); }
+
+	memcpy(aval, &d, sizeof(d));
+	bval[0] = 0;
+
+	return valid;
+}
+
+double openvcd_value_real(const uint64_t* aval) {
+	double d;
+
+	memcpy(&d, aval, sizeof(d));
+	return d;
+}
+
+bool openvcd_value_eq(size_t nwords, const uint64_t* aval1, const uint64_t* bval1, const uint64_t* aval2, const uint64_t* bval2) {
+	return (memcmp(aval1, aval2, nwords * sizeof(uint64_t)) == 0) &&
+		(memcmp(bval1, bval2, nwords * sizeof(uint64_t)) == 0);
+}
+
+bool openvcd_value_has_xz(size_t nwords, const uint64_t* bval) {
+	for (size_t i = 0 ; i < nwords ; i++) {
+		if (bval[i] != 0) { return true; }
+	}
+	return false;
+}
@@ -0,0 +1,179 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file defines OpenVCD's representation of 4-state values.
+ *
+ * A value of width n is stored as two "planes" of ceil(n/64) 64-bit words,
+ * following the aval/bval convention used by the Verilog VPI. Bit i of the
+ * value is stored in bit (i % 64) of word (i / 64) of each plane, with the
+ * state given by:
+ *
+ *	aval	bval	state
+ *	0	0	0
+ *	1	0	1
+ *	0	1	z
+ *	1	1	x
+ *
+ * Bits above the width of the value are always 0 in both planes. Real
+ * values are stored as the bits of a double in the first word of aval, with
+ * bval 0.
+ */
+
+#ifndef OPENVCD_VALUE_H
+#define OPENVCD_VALUE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/**** UTILITIES **************************************************************/
+
+/* number of 64-bit words in each plane of a value of the given width */
+#define OPENVCD_VALUE_WORDS(_width) ((((size_t) (_width)) + 63) / 64)
+
+/* the states of a single bit, as (bval << 1) | aval */
+#define OPENVCD_STATE_0 0
+#define OPENVCD_STATE_1 1
+#define OPENVCD_STATE_Z 2
+#define OPENVCD_STATE_X 3
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Convert a VCD state character to a state.
+ *
+ * @param ch One of 0, 1, x, X, z, or Z.
+ *
+ * @return One of the OPENVCD_STATE_* constants, or -1 if ch is not a state.
+ */
+int openvcd_state_from_char(char ch);
+
+/**
+ * @brief Convert a state to it's lower case VCD character.
+ *
+ * @param state
+ *
+ * @return
+ */
+char openvcd_state_to_char(int state);
+
+/**
+ * @brief Get the state of a single bit of a value.
+ *
+ * @param aval
+ * @param bval
+ * @param bit
+ *
+ * @return One of the OPENVCD_STATE_* constants.
+ */
+int openvcd_value_get(const uint64_t* aval, const uint64_t* bval, unsigned int bit);
+
+/**
+ * @brief Check if a bit going from one state to another is a rising edge.
+ *
+ * As in Verilog, this is 0 to 1, 0 to x or z, or x or z to 1.
+ *
+ * @param from
+ * @param to
+ *
+ * @return true if it is a rising edge.
+ */
+bool openvcd_state_posedge(int from, int to);
+
+/**
+ * @brief Check if a bit going from one state to another is a falling edge.
+ *
+ * This is 1 to 0, 1 to x or z, or x or z to 0.
+ *
+ * @param from
+ * @param to
+ *
+ * @return true if it is a falling edge.
+ */
+bool openvcd_state_negedge(int from, int to);
+
+/**
+ * @brief Set the state of a single bit of a value.
+ *
+ * @param aval
+ * @param bval
+ * @param bit
+ * @param state One of the OPENVCD_STATE_* constants.
+ */
+void openvcd_value_set(uint64_t* aval, uint64_t* bval, unsigned int bit, int state);
+
+/**
+ * @brief Parse the digits of a binary VCD value, such as "10xz".
+ *
+ * If the string is shorter than width, it is extended on the left as
+ * specified by IEEE Std. 1800-2012: with x if the leftmost digit is x, z if
+ * it is z, and 0 otherwise. If it is longer, only the rightmost width
+ * digits are used.
+ *
+ * @param s
+ * @param length
+ * @param width
+ * @param aval OPENVCD_VALUE_WORDS(width) words.
+ * @param bval OPENVCD_VALUE_WORDS(width) words.
+ *
+ * @return false if the string is empty or contains an invalid digit.
+ */
+bool openvcd_value_parse(const char* s, size_t length, unsigned int width, uint64_t* aval, uint64_t* bval);
+
+/**
+ * @brief Parse the text of a real value, such as "1.5".
+ *
+ * @param s
+ * @param length
+ * @param aval Set to the bits of the parsed double.
+ * @param bval Set to 0.
+ *
+ * @return false if the text is not a valid real number.
+ */
+bool openvcd_value_parse_real(const char* s, size_t length, uint64_t* aval, uint64_t* bval);
+
+/**
+ * @brief Interpret the first word of aval as a double.
+ *
+ * @param aval
+ *
+ * @return
+ */
+double openvcd_value_real(const uint64_t* aval);
+
+/**
+ * @brief Return true if two values are identical, including x and z bits.
+ *
+ * @param nwords
+ * @param aval1
+ * @param bval1
+ * @param aval2
+ * @param bval2
+ *
+ * @return
+ */
+bool openvcd_value_eq(size_t nwords, const uint64_t* aval1, const uint64_t* bval1, const uint64_t* aval2, const uint64_t* bval2);
+
+/**
+ * @brief Return true if any bit of the value is x or z.
+ *
+ * @param nwords
+ * @param bval
+ *
+ * @return
+ */
+bool openvcd_value_has_xz(size_t nwords, const uint64_t* bval);
+
+#endif /* OPENVCD_VALUE_H */
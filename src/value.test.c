@@ -0,0 +1,105 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "value.h"
+
+void test_value_states(void) {
+	uint64_t aval[1];
+	uint64_t bval[1];
+
+	should_equal(openvcd_state_from_char('0'), OPENVCD_STATE_0);
+	should_equal(openvcd_state_from_char('1'), OPENVCD_STATE_1);
+	should_equal(openvcd_state_from_char('Z'), OPENVCD_STATE_Z);
+	should_equal(openvcd_state_from_char('x'), OPENVCD_STATE_X);
+	should_equal(openvcd_state_from_char('q'), -1);
+
+	for (int state = 0 ; state < 4 ; state++) {
+		should_equal(openvcd_state_from_char(openvcd_state_to_char(state)), state);
+	}
+
+	aval[0] = 0;
+	bval[0] = 0;
+	openvcd_value_set(aval, bval, 5, OPENVCD_STATE_X);
+	openvcd_value_set(aval, bval, 6, OPENVCD_STATE_1);
+	should_equal(aval[0], 0x60);
+	should_equal(bval[0], 0x20);
+	should_equal(openvcd_value_get(aval, bval, 5), OPENVCD_STATE_X);
+	should_equal(openvcd_value_get(aval, bval, 6), OPENVCD_STATE_1);
+	should_equal(openvcd_value_get(aval, bval, 7), OPENVCD_STATE_0);
+}
+
+void test_value_parse(void) {
+	uint64_t aval[2];
+	uint64_t bval[2];
+
+	should_be_true(openvcd_value_parse("1010", 4, 4, aval, bval));
+	should_equal(aval[0], 0xa);
+	should_equal(bval[0], 0);
+	should_be_false(openvcd_value_has_xz(1, bval));
+
+	/* a leading 1 is extended with 0s, x and z with themselves */
+	should_be_true(openvcd_value_parse("1", 1, 8, aval, bval));
+	should_equal(aval[0], 0x1);
+	should_be_true(openvcd_value_parse("x0", 2, 4, aval, bval));
+	should_equal(aval[0], 0xe);
+	should_equal(bval[0], 0xe);
+	should_be_true(openvcd_value_parse("z", 1, 3, aval, bval));
+	should_equal(aval[0], 0);
+	should_equal(bval[0], 0x7);
+	should_be_true(openvcd_value_has_xz(1, bval));
+
+	/* values wider than a word */
+	should_be_true(openvcd_value_parse("1x", 2, 70, aval, bval));
+	should_equal(aval[0], 0x3);
+	should_equal(bval[0], 0x1);
+	should_equal(aval[1], 0);
+	should_equal(bval[1], 0);
+
+	/* long runs of 0 and 1 are read eight at a time, up to the first
+	 * other state */
+	should_be_true(openvcd_value_parse("1100101011110000z000000111111110", 32, 72, aval, bval));
+	should_equal(aval[0], 0xcaf001feULL);
+	should_equal(bval[0], 0x8000);
+	should_be_true(openvcd_value_parse(
+		"101111111111111111111111111111111111111111111111111111111111111101", 66, 66, aval, bval));
+	should_equal(aval[0], 0xfffffffffffffffdULL);
+	should_equal(aval[1], 0x2);
+	should_equal(bval[0], 0);
+	should_equal(bval[1], 0);
+
+	should_be_false(openvcd_value_parse("", 0, 4, aval, bval));
+	should_be_false(openvcd_value_parse("102", 3, 4, aval, bval));
+	should_be_false(openvcd_value_parse("10101010101010102", 17, 17, aval, bval));
+}
+
+void test_value_real(void) {
+	uint64_t aval[1];
+	uint64_t bval[1];
+	uint64_t aval2[1];
+	uint64_t bval2[1];
+
+	should_be_true(openvcd_value_parse_real("1.5", 3, aval, bval));
+	should_equal_epsilon(openvcd_value_real(aval), 1.5, 0.0001);
+	should_equal(bval[0], 0);
+
+	should_be_true(openvcd_value_parse_real("-2e3", 4, aval2, bval2));
+	should_equal_epsilon(openvcd_value_real(aval2), -2000.0, 0.0001);
+	should_be_false(openvcd_value_eq(1, aval, bval, aval2, bval2));
+	should_be_true(openvcd_value_eq(1, aval, bval, aval, bval));
+
+	should_be_false(openvcd_value_parse_real("1.5q", 4, aval, bval));
+	should_be_false(openvcd_value_parse_real("", 0, aval, bval));
+}
+
+int main(void) {
+	test_value_states();
+	test_value_parse();
+	test_value_real();
+	return 0;
+}
@@ -0,0 +1,1291 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "wave.h"
+#include "cache.h"
+#include "heatmap.h"
+#include "lazy.h"
+#include "live.h"
+
+/* the largest possible encoding of a 64-bit varint */
+#define MAX_VARINT 10
+
+static size_t put_varint(unsigned char* out, uint64_t v) {
+	size_t n;
+
+	n = 0;
+	while (v >= 0x80) {
+		out[n++] = (unsigned char) (v | 0x80);
+		v >>= 7;
+	}
+	out[n++] = (unsigned char) v;
+
+	return n;
+}
+
+static bool get_varint(const unsigned char** p, const unsigned char* end, uint64_t* v) {
+	unsigned int shift;
+	uint64_t b;
+
+	*v = 0;
+	for (shift = 0 ; shift < 64 ; shift += 7) {
+		if (*p >= end) { return false; }
+		b = **p;
+		(*p)++;
+		*v |= (b & 0x7f) << shift;
+		if (!(b & 0x80)) { return true; }
+	}
+
+	return false;
+}
+
+openvcd_wave* openvcd_alloc_wave(openvcd_scope* root, openvcd_timescale timescale) {
+	openvcd_wave* w;
+
+	w = malloc(sizeof(openvcd_wave));
+	if (w == NULL) { return NULL; }
+
+	w->signal_numbers = kh_init(openvcd_msignal);
+	if (w->signal_numbers == NULL) {
+		free(w);
+		return NULL;
+	}
+
+	w->root = root;
+	w->root_owned = true;
+	w->timescale = timescale;
+	w->version = NULL;
+	w->date = NULL;
+	vec_init(&(w->signals));
+	w->end_time = 0;
+	memset(&(w->snapshots), 0, sizeof(openvcd_snapshots));
+	w->snapshots.owned = true;
+	w->state_words = 0;
+	w->scratch_aval = NULL;
+	w->scratch_bval = NULL;
+	w->scratch_words = 0;
+	w->mapping = NULL;
+	w->mapping_length = 0;
+	w->index = NULL;
+	w->cache = NULL;
+	w->activity = NULL;
+
+	return w;
+}
+
+void openvcd_free_signal(openvcd_signal* s) {
+	if (s->owned) {
+		free(s->blocks);
+		free(s->data);
+	}
+	free(s->id_code);
+	free(s);
+}
+
+void openvcd_free_wave(openvcd_wave* w) {
+	openvcd_signal* s;
+	int i;
+
+	/* the cache refers to the signals */
+	if (w->cache != NULL) { openvcd_free_cache(w->cache); }
+	if (w->activity != NULL) { openvcd_free_heatmap(w->activity); }
+
+	vec_foreach(&(w->signals), s, i) {
+		openvcd_free_signal(s);
+	}
+	vec_deinit(&(w->signals));
+
+	/* the keys are owned by the signals */
+	kh_destroy(openvcd_msignal, w->signal_numbers);
+
+	if ((w->root != NULL) && w->root_owned) { openvcd_free_scope(w->root); }
+	free(w->version);
+	free(w->date);
+	free(w->scratch_aval);
+	free(w->scratch_bval);
+
+	if (w->snapshots.owned) {
+		free(w->snapshots.snapshots);
+		free(w->snapshots.dirty);
+		free(w->snapshots.data);
+	}
+	if (w->snapshots.current != NULL) { openvcd_free_state(w->snapshots.current); }
+
+	if (w->index != NULL) { openvcd_free_index(w->index); }
+	if (w->mapping != NULL) { openvcd_unmap(w->mapping, w->mapping_length); }
+
+	free(w);
+}
+
+static int grow_scratch(openvcd_wave* w, size_t nwords) {
+	uint64_t* aval;
+	uint64_t* bval;
+
+	if (nwords <= w->scratch_words) { return 0; }
+
+	aval = realloc(w->scratch_aval, nwords * sizeof(uint64_t));
+	if (aval == NULL) { return -1; }
+	w->scratch_aval = aval;
+
+	bval = realloc(w->scratch_bval, nwords * sizeof(uint64_t));
+	if (bval == NULL) { return -1; }
+	w->scratch_bval = bval;
+
+	w->scratch_words = nwords;
+	return 0;
+}
+
+openvcd_signal* openvcd_alloc_signal(const char* id_code, unsigned int width, bool real) {
+	openvcd_signal* s;
+
+	s = malloc(sizeof(openvcd_signal));
+	if (s == NULL) { return NULL; }
+
+	s->id_code = NULL;
+	if ((id_code != NULL) && ((s->id_code = strdup(id_code)) == NULL)) {
+		free(s);
+		return NULL;
+	}
+
+	if (real) { width = 64; }
+	s->width = width;
+	s->nwords = (unsigned int) OPENVCD_VALUE_WORDS(width);
+	s->real = real;
+	s->var = NULL;
+	s->blocks = NULL;
+	s->nblocks = 0;
+	s->blocks_capacity = 0;
+	s->data = NULL;
+	s->data_length = 0;
+	s->data_capacity = 0;
+	s->change_count = 0;
+	s->last_flags = -1;
+	s->owned = true;
+	s->word = 0;
+	s->dirty_snapshot = OPENVCD_NO_SNAPSHOT;
+	s->loaded = true;
+	s->published = 0;
+	s->epochs = NULL;
+
+	return s;
+}
+
+openvcd_signal* openvcd_wave_add_signal(openvcd_wave* w, const char* id_code, unsigned int width, bool real) {
+	openvcd_signal* s;
+	khint_t k;
+	int khret;
+
+	k = kh_get(openvcd_msignal, w->signal_numbers, id_code);
+	if (k != kh_end(w->signal_numbers)) {
+		return w->signals.data[kh_val(w->signal_numbers, k)];
+	}
+
+	if (real) { width = 64; }
+	if (grow_scratch(w, OPENVCD_VALUE_WORDS(width)) != 0) { return NULL; }
+
+	s = openvcd_alloc_signal(id_code, width, real);
+	if (s == NULL) { return NULL; }
+	s->word = w->state_words;
+
+	k = kh_put(openvcd_msignal, w->signal_numbers, s->id_code, &khret);
+	if (khret <= 0) {
+		openvcd_free_signal(s);
+		return NULL;
+	}
+	kh_val(w->signal_numbers, k) = (size_t) w->signals.length;
+
+	if (vec_push(&(w->signals), s) != 0) {
+		kh_del(openvcd_msignal, w->signal_numbers, k);
+		openvcd_free_signal(s);
+		return NULL;
+	}
+	w->state_words += s->nwords;
+
+	return s;
+}
+
+int openvcd_wave_add_vars(openvcd_wave* w, openvcd_scope* s) {
+	const char* key;
+	openvcd_scope* cs;
+	openvcd_var* v;
+	openvcd_signal* sig;
+	bool real;
+	int rc;
+
+	OPENVCD_UNUSED(key);
+
+	rc = 0;
+	kh_foreach(s->child_variables, key, v,
+		real = (v->type == OPENVCD_VAR_REAL) || (v->type == OPENVCD_VAR_REALTIME);
+		sig = openvcd_wave_add_signal(w, v->identifier_code, v->width, real);
+		if (sig == NULL) { return -1; }
+		if (sig->var == NULL) { sig->var = v; }
+	);
+
+	kh_foreach(s->child_scopes, key, cs,
+		rc = openvcd_wave_add_vars(w, cs);
+		if (rc != 0) { return rc; }
+	);
+
+	return rc;
+}
+
+/* link each variable in s to it's existing signal */
+static int relink_vars(openvcd_wave* w, openvcd_scope* s) {
+	const char* key;
+	openvcd_scope* cs;
+	openvcd_signal* sig;
+	openvcd_var* v;
+
+	OPENVCD_UNUSED(key);
+
+	kh_foreach(s->child_variables, key, v,
+		sig = openvcd_wave_find_signal(w, v->identifier_code);
+		if (sig == NULL) { return -1; }
+		if (sig->var == NULL) { sig->var = v; }
+	);
+
+	kh_foreach(s->child_scopes, key, cs,
+		if (relink_vars(w, cs) != 0) { return -1; }
+	);
+
+	return 0;
+}
+
+int openvcd_wave_set_root(openvcd_wave* w, openvcd_scope* root, bool owned) {
+	openvcd_signal* s;
+	int i;
+
+	if ((w->root != NULL) && w->root_owned && (w->root != root)) {
+		openvcd_free_scope(w->root);
+	}
+	w->root = root;
+	w->root_owned = owned;
+
+	vec_foreach(&(w->signals), s, i) {
+		s->var = NULL;
+	}
+
+	if (root == NULL) { return 0; }
+	return relink_vars(w, root);
+}
+
+bool openvcd_wave_signal_number(const openvcd_wave* w, const char* id, size_t length, size_t* number) {
+	char small[64];
+	char* key;
+	khint_t k;
+	bool found;
+
+	key = (length < sizeof(small)) ? small : malloc(length + 1);
+	if (key == NULL) { return false; }
+	memcpy(key, id, length);
+	key[length] = '\0';
+
+	k = kh_get(openvcd_msignal, w->signal_numbers, key);
+	found = (k != kh_end(w->signal_numbers));
+	if (found) { *number = kh_val(w->signal_numbers, k); }
+
+	if (key != small) { free(key); }
+
+	return found;
+}
+
+openvcd_signal* openvcd_wave_find_signal(const openvcd_wave* w, const char* id) {
+	size_t n;
+
+	if (!openvcd_wave_signal_number(w, id, strlen(id), &n)) { return NULL; }
+	return w->signals.data[n];
+}
+
+openvcd_var* openvcd_wave_find_var(const openvcd_wave* w, const char* path, size_t length) {
+	const openvcd_scope* scope;
+	const char* name;
+	const char* key;
+	const char* dot;
+	openvcd_var* found;
+	openvcd_var* v;
+	char* part;
+	khint_t k;
+
+	OPENVCD_UNUSED(key);
+
+	scope = w->root;
+	for (;;) {
+		dot = memchr(path, '.', length);
+		if (dot == NULL) { break; }
+
+		part = strndup(path, (size_t) (dot - path));
+		if (part == NULL) { return NULL; }
+		k = kh_get(openvcd_mscope, scope->child_scopes, part);
+		free(part);
+		if (k == kh_end(scope->child_scopes)) { return NULL; }
+
+		scope = kh_val(scope->child_scopes, k);
+		length -= (size_t) (dot - path) + 1;
+		path = dot + 1;
+	}
+
+	/* variables are keyed by identifier code, not by name */
+	found = NULL;
+	kh_foreach(scope->child_variables, key, v,
+		name = (v->reference != NULL) ? v->reference->identifier : v->identifier_code;
+		if ((strlen(name) == length) && (memcmp(name, path, length) == 0)) { found = v; }
+	);
+
+	return found;
+}
+
+/* grow an array of a signal, leaving the old one in place if the signal is
+ * shared so that it can be retired once the new one is published */
+static void* grow(const openvcd_signal* s, void* array, size_t length, size_t size) {
+	void* grown;
+
+	if (s->epochs == NULL) { return realloc(array, size); }
+
+	grown = malloc(size);
+	if (grown == NULL) { return NULL; }
+	if (length > 0) { memcpy(grown, array, length); }
+
+	return grown;
+}
+
+/* retire an array of a shared signal which has been replaced, which can't
+ * fail as reserve_change() made room for it */
+static void retire(const openvcd_signal* s, void* array) {
+	if ((s->epochs == NULL) || (array == NULL)) { return; }
+	openvcd_epoch_retire(s->epochs, array);
+}
+
+/* make sure there is room to append one more change */
+static int reserve_change(openvcd_signal* s) {
+	openvcd_block* blocks;
+	unsigned char* data;
+	void* old;
+	size_t need;
+	size_t cap;
+
+	/* readers may still be using the old arrays, so there must be room to
+	 * retire them before they are replaced */
+	if ((s->epochs != NULL) && (openvcd_epoch_reserve(s->epochs, 2) != 0)) {
+		return -1;
+	}
+
+	if (s->nblocks == s->blocks_capacity) {
+		cap = (s->blocks_capacity == 0) ? 1 : s->blocks_capacity * 2;
+		blocks = grow(s, s->blocks, s->nblocks * sizeof(openvcd_block), cap * sizeof(openvcd_block));
+		if (blocks == NULL) { return -1; }
+		old = s->blocks;
+		__atomic_store_n(&(s->blocks), blocks, __ATOMIC_RELEASE);
+		s->blocks_capacity = cap;
+		retire(s, old);
+	}
+
+	need = s->data_length + MAX_VARINT + (2 * MAX_VARINT * s->nwords);
+	if (need > s->data_capacity) {
+		cap = (s->data_capacity == 0) ? 64 : s->data_capacity;
+		while (cap < need) { cap *= 2; }
+		data = grow(s, s->data, s->data_length, cap);
+		if (data == NULL) { return -1; }
+		old = s->data;
+		__atomic_store_n(&(s->data), data, __ATOMIC_RELEASE);
+		s->data_capacity = cap;
+		retire(s, old);
+	}
+
+	return 0;
+}
+
+static size_t encode_change(const openvcd_signal* s, unsigned char* out, uint64_t dt, const uint64_t* aval, const uint64_t* bval) {
+	size_t n;
+	bool xz;
+
+	if ((s->width == 1) && !s->real) {
+		return put_varint(out, (dt << 2) | (aval[0] & 1) | ((bval[0] & 1) << 1));
+	}
+
+	xz = openvcd_value_has_xz(s->nwords, bval);
+	n = put_varint(out, (dt << 1) | (xz ? 1 : 0));
+	for (unsigned int i = 0 ; i < s->nwords ; i++) {
+		n += put_varint(out + n, aval[i]);
+	}
+	if (xz) {
+		for (unsigned int i = 0 ; i < s->nwords ; i++) {
+			n += put_varint(out + n, bval[i]);
+		}
+	}
+
+	return n;
+}
+
+/* the OPENVCD_BLOCK_* flags for a change to the given value, counting any
+ * edges from the signal's last change */
+static int change_flags(const openvcd_signal* s, const uint64_t* aval, const uint64_t* bval) {
+	int flags;
+	int from;
+	int to;
+
+	if (s->real) { return 0; }
+
+	to = (int) (((bval[0] & 1) << 1) | (aval[0] & 1));
+	flags = to;
+	if ((s->width == 1) ? ((bval[0] & 1) != 0) : openvcd_value_has_xz(s->nwords, bval)) {
+		flags |= OPENVCD_BLOCK_LAST_XZ | OPENVCD_BLOCK_XZ;
+	}
+
+	if (s->last_flags >= 0) {
+		from = s->last_flags & OPENVCD_BLOCK_LAST_STATE;
+		if (openvcd_state_posedge(from, to)) { flags |= OPENVCD_BLOCK_POSEDGE; }
+		if (openvcd_state_negedge(from, to)) { flags |= OPENVCD_BLOCK_NEGEDGE; }
+	}
+
+	return flags;
+}
+
+int openvcd_signal_append(openvcd_signal* s, uint64_t time, const uint64_t* aval, const uint64_t* bval) {
+	openvcd_block* b;
+	size_t n;
+	int flags;
+
+	if (!s->owned) { return -1; }
+	if (reserve_change(s) != 0) { return -1; }
+
+	if ((s->nblocks == 0) || (s->blocks[s->nblocks - 1].count >= OPENVCD_BLOCK_CHANGES)) {
+		b = &(s->blocks[s->nblocks]);
+		b->first_time = time;
+		b->last_time = time;
+		b->offset = s->data_length;
+		b->size = 0;
+		b->count = 0;
+		b->flags = 0;
+		s->nblocks++;
+	}
+
+	b = &(s->blocks[s->nblocks - 1]);
+	n = encode_change(s, s->data + s->data_length, time - b->last_time, aval, bval);
+	flags = change_flags(s, aval, bval);
+
+	b->size += (uint32_t) n;
+	b->count++;
+	b->flags = (uint16_t) ((b->flags & ~OPENVCD_BLOCK_LAST_STATE & ~OPENVCD_BLOCK_LAST_XZ) | flags);
+	b->last_time = time;
+	s->last_flags = flags & (OPENVCD_BLOCK_LAST_STATE | OPENVCD_BLOCK_LAST_XZ);
+	s->change_count++;
+
+	/* readers see the change once both of these are stored */
+	__atomic_store_n(&(s->data_length), s->data_length + n, __ATOMIC_RELEASE);
+	__atomic_store_n(&(s->published), OPENVCD_PUBLISHED(s->nblocks, b->count), __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* make sure an array has room for at least need elements */
+static int reserve(void** array, size_t* capacity, size_t need, size_t size) {
+	void* temp;
+	size_t cap;
+
+	if (need <= *capacity) { return 0; }
+
+	cap = (*capacity == 0) ? 16 : *capacity;
+	while (cap < need) { cap *= 2; }
+
+	temp = realloc(*array, cap * size);
+	if (temp == NULL) { return -1; }
+	*array = temp;
+	*capacity = cap;
+
+	return 0;
+}
+
+static int resize_state(openvcd_state* state, size_t nsignals, size_t nwords) {
+	uint64_t* aval;
+	uint64_t* bval;
+	bool* valid;
+
+	aval = realloc(state->aval, sizeof(uint64_t) * (nwords + 1));
+	if (aval == NULL) { return -1; }
+	state->aval = aval;
+
+	bval = realloc(state->bval, sizeof(uint64_t) * (nwords + 1));
+	if (bval == NULL) { return -1; }
+	state->bval = bval;
+
+	valid = realloc(state->valid, sizeof(bool) * (nsignals + 1));
+	if (valid == NULL) { return -1; }
+	state->valid = valid;
+
+	for (size_t i = state->nsignals ; i < nsignals ; i++) {
+		state->valid[i] = false;
+	}
+	state->nsignals = nsignals;
+	state->nwords = nwords;
+
+	return 0;
+}
+
+openvcd_state* openvcd_alloc_state(const openvcd_wave* w) {
+	openvcd_state* state;
+
+	state = malloc(sizeof(openvcd_state));
+	if (state == NULL) { return NULL; }
+
+	state->time = 0;
+	state->nsignals = 0;
+	state->nwords = 0;
+	state->aval = NULL;
+	state->bval = NULL;
+	state->valid = NULL;
+
+	if (resize_state(state, (size_t) w->signals.length, w->state_words) != 0) {
+		openvcd_free_state(state);
+		return NULL;
+	}
+
+	return state;
+}
+
+void openvcd_free_state(openvcd_state* state) {
+	free(state->aval);
+	free(state->bval);
+	free(state->valid);
+	free(state);
+}
+
+/* signals may be added after snapshots are enabled */
+static int update_current(openvcd_wave* w) {
+	openvcd_state* current;
+
+	current = w->snapshots.current;
+	if (current->nsignals == (size_t) w->signals.length) { return 0; }
+
+	return resize_state(current, (size_t) w->signals.length, w->state_words);
+}
+
+/* encode the current value of a signal, returning the number of bytes */
+static size_t encode_state(const openvcd_signal* s, const openvcd_state* current, size_t i, unsigned char* out) {
+	if (!current->valid[i]) {
+		out[0] = 0;
+		return 1;
+	}
+
+	return encode_change(s, out, 1, current->aval + s->word, current->bval + s->word);
+}
+
+static int take_snapshot(openvcd_wave* w, uint64_t time) {
+	openvcd_snapshots* ss;
+	openvcd_snapshot* snap;
+	openvcd_signal* s;
+	size_t start;
+	size_t end;
+	int i;
+
+	ss = &(w->snapshots);
+	if (update_current(w) != 0) { return -1; }
+	if (reserve((void**) &(ss->snapshots), &(ss->snapshots_capacity),
+		ss->nsnapshots + 1, sizeof(openvcd_snapshot)) != 0) {
+		return -1;
+	}
+
+	/* trailing signals with no value are left out */
+	start = ss->data_length;
+	end = start;
+	vec_foreach(&(w->signals), s, i) {
+		if (reserve((void**) &(ss->data), &(ss->data_capacity),
+			ss->data_length + MAX_VARINT + (2 * MAX_VARINT * s->nwords), 1) != 0) {
+			return -1;
+		}
+		ss->data_length += encode_state(s, ss->current, (size_t) i, ss->data + ss->data_length);
+		if (ss->current->valid[i]) { end = ss->data_length; }
+	}
+	ss->data_length = end;
+
+	snap = &(ss->snapshots[ss->nsnapshots]);
+	snap->time = time;
+	snap->offset = start;
+	snap->size = end - start;
+	snap->dirty_offset = ss->ndirty;
+	snap->ndirty = 0;
+	ss->nsnapshots++;
+	ss->changes = 0;
+
+	return 0;
+}
+
+int openvcd_wave_set_snapshots(openvcd_wave* w, uint64_t time_interval, uint64_t change_interval) {
+	openvcd_signal* s;
+	int i;
+
+	if ((w->snapshots.nsnapshots != 0) || !w->snapshots.owned) { return -1; }
+	vec_foreach(&(w->signals), s, i) {
+		if (s->change_count != 0) { return -1; }
+	}
+
+	if ((time_interval == 0) && (change_interval == 0)) { return 0; }
+
+	w->snapshots.time_interval = time_interval;
+	w->snapshots.change_interval = change_interval;
+	w->snapshots.current = openvcd_alloc_state(w);
+	if (w->snapshots.current == NULL) { return -1; }
+
+	/* the first snapshot has no values */
+	return take_snapshot(w, w->end_time);
+}
+
+static int maybe_snapshot(openvcd_wave* w, uint64_t time) {
+	openvcd_snapshots* ss;
+	uint64_t last;
+
+	ss = &(w->snapshots);
+	if ((ss->nsnapshots == 0) || (time <= w->end_time)) { return 0; }
+
+	last = ss->snapshots[ss->nsnapshots - 1].time;
+	if (((ss->time_interval != 0) && (time - last >= ss->time_interval)) ||
+		((ss->change_interval != 0) && (ss->changes >= ss->change_interval))) {
+		return take_snapshot(w, time);
+	}
+
+	return 0;
+}
+
+/* update the current state, and mark the signal as dirty in the last
+ * snapshot */
+static int record_change(openvcd_wave* w, size_t n) {
+	openvcd_snapshots* ss;
+	openvcd_signal* s;
+	size_t last;
+
+	ss = &(w->snapshots);
+	if (ss->nsnapshots == 0) { return 0; }
+	if (update_current(w) != 0) { return -1; }
+
+	s = w->signals.data[n];
+	memcpy(ss->current->aval + s->word, w->scratch_aval, s->nwords * sizeof(uint64_t));
+	memcpy(ss->current->bval + s->word, w->scratch_bval, s->nwords * sizeof(uint64_t));
+	ss->current->valid[n] = true;
+	ss->changes++;
+
+	last = ss->nsnapshots - 1;
+	if (s->dirty_snapshot == last) { return 0; }
+
+	if (reserve((void**) &(ss->dirty), &(ss->dirty_capacity),
+		ss->ndirty + 1, sizeof(uint64_t)) != 0) {
+		return -1;
+	}
+	ss->dirty[ss->ndirty++] = n;
+	ss->snapshots[last].ndirty++;
+	s->dirty_snapshot = last;
+
+	return 0;
+}
+
+int openvcd_signal_concat(openvcd_signal* dst, const openvcd_signal* src) {
+	openvcd_block* blocks;
+	unsigned char* data;
+
+	if (!dst->owned) { return -1; }
+	if (src->nblocks == 0) { return 0; }
+
+	if (dst->nblocks + src->nblocks > dst->blocks_capacity) {
+		blocks = realloc(dst->blocks, (dst->nblocks + src->nblocks) * sizeof(openvcd_block));
+		if (blocks == NULL) { return -1; }
+		dst->blocks = blocks;
+		dst->blocks_capacity = dst->nblocks + src->nblocks;
+	}
+
+	if (dst->data_length + src->data_length > dst->data_capacity) {
+		data = realloc(dst->data, dst->data_length + src->data_length);
+		if (data == NULL) { return -1; }
+		dst->data = data;
+		dst->data_capacity = dst->data_length + src->data_length;
+	}
+
+	for (size_t i = 0 ; i < src->nblocks ; i++) {
+		dst->blocks[dst->nblocks + i] = src->blocks[i];
+		dst->blocks[dst->nblocks + i].offset += dst->data_length;
+	}
+	memcpy(dst->data + dst->data_length, src->data, src->data_length);
+
+	/* src's first change wasn't compared against dst's last one, so it
+	 * may be an edge */
+	if ((dst->last_flags >= 0) && !dst->real) {
+		dst->blocks[dst->nblocks].flags |= OPENVCD_BLOCK_POSEDGE | OPENVCD_BLOCK_NEGEDGE;
+	}
+	dst->last_flags = src->last_flags;
+
+	dst->nblocks += src->nblocks;
+	dst->data_length += src->data_length;
+	dst->change_count += src->change_count;
+	dst->published = OPENVCD_PUBLISHED(dst->nblocks, dst->blocks[dst->nblocks - 1].count);
+
+	return 0;
+}
+
+openvcd_parser_error openvcd_wave_parse_change(openvcd_wave* w, const openvcd_change* c, size_t* n) {
+	const openvcd_signal* s;
+	bool ok;
+
+	if (!openvcd_wave_signal_number(w, c->id, c->id_length, n)) {
+		return OPENVCD_ERROR_SYNTAX;
+	}
+	s = w->signals.data[*n];
+
+	if (c->type == OPENVCD_CHANGE_REAL) {
+		ok = openvcd_value_parse_real(c->value, c->value_length,
+			w->scratch_aval, w->scratch_bval);
+	} else {
+		ok = openvcd_value_parse(c->value, c->value_length, s->width,
+			w->scratch_aval, w->scratch_bval);
+	}
+
+	return ok ? OPENVCD_ERROR_NONE : OPENVCD_ERROR_SYNTAX;
+}
+
+openvcd_parser_error openvcd_wave_set_time(openvcd_wave* w, uint64_t time) {
+	if (time < w->end_time) { return OPENVCD_ERROR_SYNTAX; }
+	if (maybe_snapshot(w, time) != 0) { return OPENVCD_ERROR_ALLOC_FAILED; }
+	__atomic_store_n(&(w->end_time), time, __ATOMIC_RELEASE);
+	return OPENVCD_ERROR_NONE;
+}
+
+openvcd_parser_error openvcd_wave_append(openvcd_wave* w, size_t n, uint64_t time, const uint64_t* aval, const uint64_t* bval) {
+	openvcd_signal* s;
+
+	s = w->signals.data[n];
+	if (openvcd_signal_append(s, time, aval, bval) != 0) {
+		return OPENVCD_ERROR_ALLOC_FAILED;
+	}
+
+	/* record_change() works from the scratch value */
+	if (aval != w->scratch_aval) {
+		memcpy(w->scratch_aval, aval, s->nwords * sizeof(uint64_t));
+		memcpy(w->scratch_bval, bval, s->nwords * sizeof(uint64_t));
+	}
+	if (record_change(w, n) != 0) { return OPENVCD_ERROR_ALLOC_FAILED; }
+
+	return OPENVCD_ERROR_NONE;
+}
+
+openvcd_parser_error openvcd_wave_apply(openvcd_wave* w, const openvcd_change* c) {
+	openvcd_parser_error error;
+	size_t n;
+
+	if (c->type == OPENVCD_CHANGE_TIME) { return openvcd_wave_set_time(w, c->time); }
+
+	if (c->type == OPENVCD_CHANGE_COMMAND) { return OPENVCD_ERROR_NONE; }
+
+	error = openvcd_wave_parse_change(w, c, &n);
+	if (error != OPENVCD_ERROR_NONE) { return error; }
+
+	return openvcd_wave_append(w, n, c->time, w->scratch_aval, w->scratch_bval);
+}
+
+const char* openvcd_change_error(openvcd_parser_error error) {
+	switch (error) {
+		case OPENVCD_ERROR_SYNTAX: return "invalid value change";
+		case OPENVCD_ERROR_ALLOC_FAILED: return "failed to allocate value change";
+		default: return "failed to store value change";
+	}
+}
+
+/* the size of a unit in fs */
+static uint64_t unit_fs(openvcd_unit u) {
+	uint64_t size;
+
+	size = 1;
+	for (int i = (int) u ; i < (int) openvcd_unit_fs ; i++) { size *= 1000; }
+
+	return size;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+	uint64_t t;
+
+	while (b != 0) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+bool openvcd_timescale_common(const openvcd_timescale* timescales, size_t n, openvcd_timescale* common, uint64_t* scales) {
+	uint64_t cn;
+	uint64_t g;
+
+	*common = timescales[0];
+	for (size_t i = 0 ; i < n ; i++) { scales[i] = 1; }
+
+	for (size_t i = 0 ; i < n ; i++) {
+		if ((timescales[i].u == openvcd_unit_undefined) || (timescales[i].n <= 0)) { return false; }
+		if ((uint64_t) timescales[i].n > UINT64_MAX / unit_fs(timescales[i].u)) { return false; }
+	}
+
+	/* work in fs, which each unit is a whole number of */
+	g = 0;
+	for (size_t i = 0 ; i < n ; i++) {
+		scales[i] = (uint64_t) timescales[i].n * unit_fs(timescales[i].u);
+		g = gcd(scales[i], g);
+	}
+	for (size_t i = 0 ; i < n ; i++) { scales[i] /= g; }
+
+	/* and then in the largest unit which divides the result */
+	common->u = openvcd_unit_fs;
+	while ((common->u > openvcd_unit_s) && (g % unit_fs(common->u - 1) == 0)) {
+		common->u--;
+	}
+	/* no larger than the n of the finest timescale, but checked rather
+	 * than assumed */
+	cn = g / unit_fs(common->u);
+	if (cn > INT_MAX) {
+		*common = timescales[0];
+		for (size_t i = 0 ; i < n ; i++) { scales[i] = 1; }
+		return false;
+	}
+	common->n = (int) cn;
+
+	return true;
+}
+
+void openvcd_load_error(openvcd_parser* p, openvcd_parser_error error, const char* what, size_t offset) {
+	p->state = OPENVCD_PARSER_STATE_ERROR;
+	p->error = error;
+	free(p->error_string);
+	p->error_string = NULL;
+	asprintf(&(p->error_string),
+		"error at byte %lu, %s",
+		(unsigned long) (p->body_offset + offset), what);
+}
+
+/* pass every complete record in the scanner's buffer to the handler */
+static openvcd_scan_status load_changes(openvcd_parser* p, openvcd_change_handler handler, void* ctx, openvcd_scanner* s, size_t base) {
+	openvcd_parser_error err;
+	openvcd_scan_status st;
+	openvcd_change c;
+
+	while ((st = openvcd_scan_next(s, &c)) == OPENVCD_SCAN_OK) {
+		err = handler(ctx, &c);
+		if (err != OPENVCD_ERROR_NONE) {
+			openvcd_load_error(p, err, openvcd_change_error(err), base + c.offset);
+			return OPENVCD_SCAN_ERROR;
+		}
+	}
+
+	if (st == OPENVCD_SCAN_ERROR) {
+		openvcd_load_error(p, OPENVCD_ERROR_SYNTAX, s->error_string, base + s->error_offset);
+	}
+
+	return st;
+}
+
+static void load_string(openvcd_parser* p, openvcd_change_handler handler, void* ctx) {
+	openvcd_scanner s;
+	const char* body;
+	size_t length;
+
+	length = 0;
+	body = p->source.input_string + p->body_offset;
+	if (p->body_offset < p->input_length) {
+		/* the input length may be longer than the string */
+		length = strnlen(body, p->input_length - p->body_offset);
+	}
+
+	p->changes_base = 0;
+	openvcd_init_scanner(&s, body, length, true);
+	load_changes(p, handler, ctx, &s, 0);
+	openvcd_clear_scanner(&s);
+	p->changes_base = length;
+}
+
+/* read the next chunk from the stream after any held back bytes, setting
+ * length to the number of bytes now in the buffer, or return -1 if the
+ * stream could not be read */
+static int load_read(openvcd_parser* p, char* buffer, size_t carry, size_t capacity, size_t* consumed, size_t* length, bool* final) {
+	size_t want;
+	size_t n;
+
+	want = capacity - carry;
+	if (p->input_length != 0) {
+		if (p->body_offset + *consumed >= p->input_length) {
+			want = 0;
+		} else if (p->input_length - p->body_offset - *consumed < want) {
+			want = p->input_length - p->body_offset - *consumed;
+		}
+	}
+
+	n = (want == 0) ? 0 : fread(buffer + carry, 1, want, p->source.input_stream);
+	if ((n < want) && ferror(p->source.input_stream)) {
+		openvcd_load_error(p, OPENVCD_ERROR_GENERAL, "failed to read input", *consumed);
+		return -1;
+	}
+	*consumed += n;
+	*length = carry + n;
+	*final = (n < (capacity - carry));
+
+	return 0;
+}
+
+static void load_stream(openvcd_parser* p, openvcd_change_handler handler, void* ctx) {
+	openvcd_scanner s;
+	openvcd_scan_status st;
+	char* buffer;
+	char* temp;
+	size_t capacity;
+	size_t length;
+	size_t carry;
+	size_t consumed;
+	bool final;
+
+	capacity = OPENVCD_LOAD_CHUNK_SIZE;
+	buffer = malloc(capacity);
+	if (buffer == NULL) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate read buffer", 0);
+		return;
+	}
+
+	openvcd_init_scanner(&s, NULL, 0, false);
+	carry = 0;
+	consumed = 0;
+	do {
+		if (load_read(p, buffer, carry, capacity, &consumed, &length, &final) != 0) { break; }
+		openvcd_scanner_feed(&s, buffer, length, final);
+		p->changes_base = consumed - length;
+		st = load_changes(p, handler, ctx, &s, p->changes_base);
+
+		if (st == OPENVCD_SCAN_NEED_MORE) {
+			/* move the held back record to the front, growing the
+			 * buffer if it is the whole buffer */
+			carry = length - s.position;
+			memmove(buffer, buffer + s.position, carry);
+			if (carry == capacity) {
+				temp = realloc(buffer, capacity * 2);
+				if (temp == NULL) {
+					openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to grow read buffer", 0);
+					break;
+				}
+				buffer = temp;
+				capacity *= 2;
+			}
+		}
+	} while (st == OPENVCD_SCAN_NEED_MORE);
+
+	p->changes_base = consumed;
+	openvcd_clear_scanner(&s);
+	free(buffer);
+}
+
+void openvcd_parse_changes(openvcd_parser* p, openvcd_change_handler handler, void* ctx) {
+	if (p->type == OPENVCD_PARSER_STRING) {
+		load_string(p, handler, ctx);
+	} else {
+		load_stream(p, handler, ctx);
+	}
+}
+
+static openvcd_parser_error apply_change(void* ctx, const openvcd_change* c) {
+	return openvcd_wave_apply((openvcd_wave*) ctx, c);
+}
+
+openvcd_wave* openvcd_load(openvcd_parser* p) {
+	return openvcd_load_snapshots(p, 0, 0);
+}
+
+openvcd_wave* openvcd_load_header(openvcd_parser* p) {
+	openvcd_wave* w;
+
+	openvcd_parse_header(p);
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) { return NULL; }
+
+	w = openvcd_alloc_wave(p->root, p->timescale);
+	if (w == NULL) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate wave", 0);
+		return NULL;
+	}
+
+	p->root = NULL;
+	p->scope = NULL;
+	w->version = p->version;
+	w->date = p->date;
+	p->version = NULL;
+	p->date = NULL;
+
+	if (openvcd_wave_add_vars(w, w->root) != 0) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate signals", 0);
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+openvcd_wave* openvcd_load_snapshots(openvcd_parser* p, uint64_t time_interval, uint64_t change_interval) {
+	openvcd_wave* w;
+
+	w = openvcd_load_header(p);
+	if (w == NULL) { return NULL; }
+
+	if (openvcd_wave_set_snapshots(w, time_interval, change_interval) != 0) {
+		openvcd_load_error(p, OPENVCD_ERROR_ALLOC_FAILED, "failed to allocate snapshot", 0);
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	openvcd_parse_changes(p, apply_change, w);
+
+	if (p->state == OPENVCD_PARSER_STATE_ERROR) {
+		openvcd_free_wave(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+bool openvcd_signal_find_block(const openvcd_signal* s, uint64_t t, size_t* block) {
+	size_t lo;
+	size_t hi;
+	size_t mid;
+
+	/* find the first block starting after t, the one before it is the
+	 * one we want */
+	lo = 0;
+	hi = s->nblocks;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (s->blocks[mid].first_time > t) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	if (lo == 0) { return false; }
+	*block = lo - 1;
+
+	return true;
+}
+
+void openvcd_free_decoded_block(openvcd_decoded_block* d) {
+	free(d->times);
+	free(d->aval);
+	free(d->bval);
+	free(d);
+}
+
+static openvcd_decoded_block* alloc_decoded_block(uint32_t count, unsigned int nwords) {
+	openvcd_decoded_block* d;
+
+	d = malloc(sizeof(openvcd_decoded_block));
+	if (d == NULL) { return NULL; }
+
+	d->count = count;
+	d->nwords = nwords;
+	d->times = malloc(sizeof(uint64_t) * (count + 1));
+	d->aval = malloc(sizeof(uint64_t) * ((size_t) count * nwords + 1));
+	d->bval = malloc(sizeof(uint64_t) * ((size_t) count * nwords + 1));
+
+	if ((d->times == NULL) || (d->aval == NULL) || (d->bval == NULL)) {
+		openvcd_free_decoded_block(d);
+		return NULL;
+	}
+
+	return d;
+}
+
+static bool decode_change(const openvcd_signal* s, const unsigned char** p, const unsigned char* end, uint64_t* dt, uint64_t* aval, uint64_t* bval) {
+	uint64_t v;
+	bool xz;
+
+	if (!get_varint(p, end, &v)) { return false; }
+
+	if ((s->width == 1) && !s->real) {
+		*dt = v >> 2;
+		aval[0] = v & 1;
+		bval[0] = (v >> 1) & 1;
+		return true;
+	}
+
+	*dt = v >> 1;
+	xz = v & 1;
+	for (unsigned int i = 0 ; i < s->nwords ; i++) {
+		if (!get_varint(p, end, &(aval[i]))) { return false; }
+	}
+	for (unsigned int i = 0 ; i < s->nwords ; i++) {
+		bval[i] = 0;
+		if (xz && !get_varint(p, end, &(bval[i]))) { return false; }
+	}
+
+	return true;
+}
+
+openvcd_decoded_block* openvcd_decode_changes(const openvcd_signal* s, const openvcd_block* b, const unsigned char* data, size_t data_length) {
+	openvcd_decoded_block* d;
+	const unsigned char* p;
+	const unsigned char* end;
+	uint64_t t;
+	uint64_t dt;
+	size_t w;
+
+	/* blocks may come from a file, so don't trust them */
+	if ((b->offset > data_length) || (b->size > data_length - b->offset)) {
+		return NULL;
+	}
+
+	d = alloc_decoded_block(b->count, s->nwords);
+	if (d == NULL) { return NULL; }
+
+	p = data + b->offset;
+	end = p + b->size;
+	t = b->first_time;
+	for (uint32_t i = 0 ; i < b->count ; i++) {
+		w = (size_t) i * s->nwords;
+		if (!decode_change(s, &p, end, &dt, d->aval + w, d->bval + w)) {
+			openvcd_free_decoded_block(d);
+			return NULL;
+		}
+		t += dt;
+		d->times[i] = t;
+	}
+
+	return d;
+}
+
+openvcd_decoded_block* openvcd_decode_block(const openvcd_signal* s, size_t block) {
+	if (block >= s->nblocks) { return NULL; }
+
+	return openvcd_decode_changes(s, &(s->blocks[block]), s->data, s->data_length);
+}
+
+long openvcd_decoded_block_find(const openvcd_decoded_block* d, uint64_t t) {
+	size_t lo;
+	size_t hi;
+	size_t mid;
+
+	lo = 0;
+	hi = d->count;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (d->times[mid] > t) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	return ((long) lo) - 1;
+}
+
+bool openvcd_value_at(const openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval) {
+	openvcd_decoded_block* d;
+	size_t block;
+	long i;
+
+	if (!openvcd_signal_find_block(s, t, &block)) { return false; }
+
+	d = openvcd_decode_block(s, block);
+	if (d == NULL) { return false; }
+
+	i = openvcd_decoded_block_find(d, t);
+	if (i >= 0) {
+		memcpy(aval, d->aval + ((size_t) i * s->nwords), s->nwords * sizeof(uint64_t));
+		memcpy(bval, d->bval + ((size_t) i * s->nwords), s->nwords * sizeof(uint64_t));
+	}
+
+	openvcd_free_decoded_block(d);
+
+	return i >= 0;
+}
+
+static int decode_snapshot(const openvcd_wave* w, const openvcd_snapshot* snap, openvcd_state* state) {
+	const openvcd_snapshots* ss;
+	const unsigned char* p;
+	const unsigned char* end;
+	openvcd_signal* s;
+	uint64_t dt;
+	int i;
+
+	ss = &(w->snapshots);
+	if ((snap->offset > ss->data_length) || (snap->size > ss->data_length - snap->offset)) {
+		return -1;
+	}
+
+	p = ss->data + snap->offset;
+	end = p + snap->size;
+	vec_foreach(&(w->signals), s, i) {
+		state->valid[i] = false;
+		if (p >= end) { continue; }
+
+		if (*p == 0) {
+			p++;
+			continue;
+		}
+
+		if (!decode_change(s, &p, end, &dt, state->aval + s->word, state->bval + s->word)) {
+			return -1;
+		}
+		state->valid[i] = true;
+	}
+
+	return 0;
+}
+
+/* the last snapshot at or before t, or the first one if there is none */
+static size_t find_snapshot(const openvcd_snapshots* ss, uint64_t t) {
+	size_t lo;
+	size_t hi;
+	size_t mid;
+
+	lo = 0;
+	hi = ss->nsnapshots;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (ss->snapshots[mid].time > t) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	return (lo == 0) ? 0 : lo - 1;
+}
+
+int openvcd_wave_state_at(openvcd_wave* w, uint64_t t, openvcd_state* state) {
+	const openvcd_snapshots* ss;
+	const openvcd_snapshot* snap;
+	openvcd_signal* s;
+	uint64_t n;
+	int i;
+
+	if ((state->nsignals != (size_t) w->signals.length) || (state->nwords != w->state_words)) {
+		return -1;
+	}
+	state->time = t;
+
+	ss = &(w->snapshots);
+	if (ss->nsnapshots == 0) {
+		vec_foreach(&(w->signals), s, i) {
+			state->valid[i] = openvcd_wave_value_at(w, s, t,
+				state->aval + s->word, state->bval + s->word);
+		}
+		return 0;
+	}
+
+	snap = &(ss->snapshots[find_snapshot(ss, t)]);
+	if (decode_snapshot(w, snap, state) != 0) { return -1; }
+
+	if ((snap->dirty_offset > ss->ndirty) || (snap->ndirty > ss->ndirty - snap->dirty_offset)) {
+		return -1;
+	}
+
+	for (uint64_t j = 0 ; j < snap->ndirty ; j++) {
+		n = ss->dirty[snap->dirty_offset + j];
+		if (n >= state->nsignals) { return -1; }
+
+		s = w->signals.data[n];
+		if (openvcd_wave_value_at(w, s, t, state->aval + s->word, state->bval + s->word)) {
+			state->valid[n] = true;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,686 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file defines OpenVCD's waveform store, which holds the value changes
+ * of a VCD file in signal-major order.
+ *
+ * Each distinct identifier code is a signal. Signals are numbered densely in
+ * the order they are added, and each one keeps it's changes in time order as
+ * a sequence of compressed blocks of at most OPENVCD_BLOCK_CHANGES changes.
+ * The block headers record the time range covered by each block, so that a
+ * query for a particular time only has to decode a single block.
+ *
+ * Within a block, each change is encoded as a LEB128 varint time delta from
+ * the previous change (or from first_time for the first change), followed by
+ * the value. For 1-bit signals the state is packed into the low 2 bits of
+ * the time delta. For other signals the low bit of the time delta is set if
+ * the value contains any x or z bits, and it is followed by each word of
+ * aval, then each word of bval if that bit was set, all as varints.
+ *
+ * The block headers and block data are plain offset-based arrays, so that
+ * a waveform can also point straight into a mapped binary file, see bin.h.
+ *
+ * Optionally, a waveform also keeps snapshots of the values of every signal,
+ * taken every so many time units or changes while it is loaded. A snapshot
+ * records the state before the first change at it's time, encoded as one
+ * change per signal in signal order (with a time delta of 1, or a single 0
+ * byte for signals with no value yet), along with the list of signals which
+ * change before the next snapshot. The state of every signal at time t is
+ * then the preceding snapshot, updated with the value at t of only those
+ * signals which changed since.
+ */
+
+#ifndef OPENVCD_WAVE_H
+#define OPENVCD_WAVE_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "khash.h"
+#include "vec.h"
+#include "util.h"
+#include "scope.h"
+#include "parser.h"
+#include "scan.h"
+#include "value.h"
+#include "index.h"
+
+/**** TYPES ******************************************************************/
+
+/* the maximum number of changes in a single block, which must fit in it's
+ * 16 bit count */
+#define OPENVCD_BLOCK_CHANGES 256
+
+/* Flags for openvcd_block, summarizing the changes in it so that searches
+ * can skip the block without decoding it. The LAST flags give the value of
+ * the block's last change, so that the value before a block can be found
+ * from the flags of the one before it. The others are set if the block may
+ * contain such a change, counting one from the value before the block. */
+#define OPENVCD_BLOCK_LAST_STATE 0x3 /* the state of bit 0 */
+#define OPENVCD_BLOCK_LAST_XZ 0x4 /* whether any bit is x or z */
+#define OPENVCD_BLOCK_POSEDGE 0x8 /* bit 0 rising, see openvcd_state_posedge() */
+#define OPENVCD_BLOCK_NEGEDGE 0x10 /* bit 0 falling */
+#define OPENVCD_BLOCK_XZ 0x20 /* a value with any x or z bits */
+
+/* size of the buffer used to read the value change section from a stream */
+#define OPENVCD_LOAD_CHUNK_SIZE (1024 * 1024)
+
+typedef struct {
+	/* times of the first and last change in the block */
+	uint64_t first_time;
+	uint64_t last_time;
+
+	/* offset of the encoded changes within the signal's data */
+	uint64_t offset;
+
+	/* size of the encoded changes in bytes */
+	uint32_t size;
+
+	/* number of changes in the block */
+	uint16_t count;
+
+	/* OPENVCD_BLOCK_* flags */
+	uint16_t flags;
+} openvcd_block;
+
+typedef struct {
+	/* the identifier code this signal was declared with */
+	char* id_code;
+
+	unsigned int width;
+	unsigned int nwords;
+	bool real;
+
+	/* The first variable declared with this identifier code. Other
+	 * variables may share the same signal. */
+	openvcd_var* var;
+
+	/* The blocks of this signal, in time order. The last block may be
+	 * partially filled, and is extended as changes are appended. */
+	openvcd_block* blocks;
+	size_t nblocks;
+	size_t blocks_capacity;
+
+	/* the encoded changes, block offsets are relative to this */
+	unsigned char* data;
+	size_t data_length;
+	size_t data_capacity;
+
+	uint64_t change_count;
+
+	/* the OPENVCD_BLOCK_LAST_* flags of the last change appended, or -1
+	 * if there hasn't been one */
+	int last_flags;
+
+	/* false if blocks and data are borrowed, e.g. from a mapped file, and
+	 * the signal can't be appended to */
+	bool owned;
+
+	/* offset of this signal's value within an openvcd_state, in words */
+	size_t word;
+
+	/* the last snapshot after which this signal changed, or
+	 * OPENVCD_NO_SNAPSHOT */
+	size_t dirty_snapshot;
+
+	/* false until the changes of a lazily opened signal have been read,
+	 * see lazy.h */
+	bool loaded;
+
+	/* the number of blocks and the number of changes in the last one, as
+	 * seen by readers while the signal is loaded, see live.h */
+	uint64_t published;
+
+	/* where blocks and data go when they are outgrown, or NULL to free
+	 * them straight away, see live.h */
+	struct openvcd_epochs_t* epochs;
+} openvcd_signal;
+
+/* A decoded block, with times[i] giving the time of the i-th change and
+ * aval/bval + (i * nwords) giving it's value. */
+typedef struct {
+	uint32_t count;
+	unsigned int nwords;
+	uint64_t* times;
+	uint64_t* aval;
+	uint64_t* bval;
+} openvcd_decoded_block;
+
+/* the value of every signal of a wave at a particular time */
+typedef struct {
+	uint64_t time;
+	size_t nsignals;
+	size_t nwords;
+
+	/* the value of signal i is at aval/bval + signal->word, and is only
+	 * valid if valid[i] is set */
+	uint64_t* aval;
+	uint64_t* bval;
+	bool* valid;
+} openvcd_state;
+
+#define OPENVCD_NO_SNAPSHOT SIZE_MAX
+
+typedef struct {
+	/* the state before any change at this time */
+	uint64_t time;
+
+	/* the encoded state within the snapshot data */
+	uint64_t offset;
+	uint64_t size;
+
+	/* the signals which change after this snapshot and before the next
+	 * one, as a range of the dirty signal list */
+	uint64_t dirty_offset;
+	uint64_t ndirty;
+} openvcd_snapshot;
+
+typedef struct {
+	/* take a snapshot once either this many time units or this many
+	 * changes have passed since the last one, 0 to disable */
+	uint64_t time_interval;
+	uint64_t change_interval;
+
+	openvcd_snapshot* snapshots;
+	size_t nsnapshots;
+	size_t snapshots_capacity;
+
+	/* the signal numbers listed by each snapshot */
+	uint64_t* dirty;
+	size_t ndirty;
+	size_t dirty_capacity;
+
+	unsigned char* data;
+	size_t data_length;
+	size_t data_capacity;
+
+	/* changes applied since the last snapshot */
+	uint64_t changes;
+
+	/* the state as of the last applied change, only maintained while
+	 * snapshots are being taken */
+	openvcd_state* current;
+
+	/* false if the arrays are borrowed from a mapped file */
+	bool owned;
+} openvcd_snapshots;
+
+typedef vec_t(openvcd_signal*) openvcd_signallist;
+
+/* called with each record of the value change section, see
+ * openvcd_parse_changes() */
+typedef openvcd_parser_error (*openvcd_change_handler)(void* ctx, const openvcd_change* c);
+
+/* mapping of identifier codes to signal numbers */
+KHASH_MAP_INIT_STR(openvcd_msignal, size_t)
+
+typedef struct openvcd_wave_t {
+	/* The unnamed root scope, see openvcd_parser. Every variable in it
+	 * has a signal. */
+	openvcd_scope* root;
+
+	/* false if the scope tree is shared with other waves, see
+	 * openvcd_wave_set_root() */
+	bool root_owned;
+
+	openvcd_timescale timescale;
+	char* version;
+	char* date;
+
+	openvcd_signallist signals;
+	khash_t(openvcd_msignal)* signal_numbers;
+
+	/* the latest simulation time seen */
+	uint64_t end_time;
+
+	openvcd_snapshots snapshots;
+
+	/* the number of words needed to hold the value of every signal */
+	size_t state_words;
+
+	/* scratch space for decoding values while loading, large enough
+	 * for the widest signal */
+	uint64_t* scratch_aval;
+	uint64_t* scratch_bval;
+	size_t scratch_words;
+
+	/* set if the wave was opened from a mapped binary or VCD file */
+	void* mapping;
+	size_t mapping_length;
+
+	/* the index of the mapped VCD file, if it was opened lazily */
+	openvcd_index* index;
+
+	/* decoded blocks, used by openvcd_wave_value_at() if not NULL */
+	struct openvcd_cache_t* cache;
+
+	/* the number of changes over time, if it was read from a binary file
+	 * or counted while converting to one, see heatmap.h */
+	struct openvcd_heatmap_t* activity;
+} openvcd_wave;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Allocate a new, empty waveform.
+ *
+ * On success the waveform takes ownership of root, which will be free-ed
+ * by openvcd_free_wave(). No signals are created, see
+ * openvcd_wave_add_vars().
+ *
+ * @param root The root scope, may be NULL.
+ * @param timescale
+ *
+ * @return The new waveform, or NULL on failure.
+ */
+openvcd_wave* openvcd_alloc_wave(openvcd_scope* root, openvcd_timescale timescale);
+
+/**
+ * @brief Free a waveform, including it's scope tree and signals.
+ *
+ * @param w
+ */
+void openvcd_free_wave(openvcd_wave* w);
+
+/**
+ * @brief Replace a waveform's scope tree.
+ *
+ * The old tree is free-ed if the waveform owned it, and each signal is
+ * linked to it's variable in the new tree. This lets waves loaded from the
+ * same design share one copy of it's hierarchy.
+ *
+ * @param w
+ * @param root The new root scope, which must declare the same identifier
+ * codes as the old one.
+ * @param owned True if the waveform should take ownership of root.
+ *
+ * @return 0 on success, -1 if root declares a signal the waveform doesn't
+ * have.
+ */
+int openvcd_wave_set_root(openvcd_wave* w, openvcd_scope* root, bool owned);
+
+/**
+ * @brief Allocate a signal which does not belong to any waveform.
+ *
+ * @param id_code Will be strdup()-ed, may be NULL.
+ * @param width
+ * @param real
+ *
+ * @return The new signal, which must be free-ed with openvcd_free_signal(),
+ * or NULL on failure.
+ */
+openvcd_signal* openvcd_alloc_signal(const char* id_code, unsigned int width, bool real);
+
+/**
+ * @brief Free a signal allocated with openvcd_alloc_signal().
+ *
+ * @param s
+ */
+void openvcd_free_signal(openvcd_signal* s);
+
+/**
+ * @brief Add a signal to a waveform.
+ *
+ * @param w
+ * @param id_code Will be strdup()-ed.
+ * @param width
+ * @param real
+ *
+ * @return The new signal, or the existing one if id_code is already known.
+ * NULL on failure.
+ */
+openvcd_signal* openvcd_wave_add_signal(openvcd_wave* w, const char* id_code, unsigned int width, bool real);
+
+/**
+ * @brief Add a signal for every variable in a scope and it's children.
+ *
+ * @param w
+ * @param s
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_wave_add_vars(openvcd_wave* w, openvcd_scope* s);
+
+/**
+ * @brief Look up the signal number of an identifier code.
+ *
+ * @param w
+ * @param id Need not be null terminated.
+ * @param length
+ * @param number Set to the signal number if it is found.
+ *
+ * @return true if the signal exists.
+ */
+bool openvcd_wave_signal_number(const openvcd_wave* w, const char* id, size_t length, size_t* number);
+
+/**
+ * @brief Look up a signal by identifier code.
+ *
+ * @param w
+ * @param id
+ *
+ * @return The signal, or NULL if there is none.
+ */
+openvcd_signal* openvcd_wave_find_signal(const openvcd_wave* w, const char* id);
+
+/**
+ * @brief Look up a variable by it's dotted path, such as "top.core.data".
+ *
+ * The path is made of the identifiers of the scopes leading to the
+ * variable and it's reference, without any bit range.
+ *
+ * @param w
+ * @param path
+ * @param length The length of the path, which need not be null terminated.
+ *
+ * @return The variable, or NULL if there is none.
+ */
+openvcd_var* openvcd_wave_find_var(const openvcd_wave* w, const char* path, size_t length);
+
+/**
+ * @brief Append a change to a signal.
+ *
+ * Changes must be appended in non-decreasing time order.
+ *
+ * @param s
+ * @param time
+ * @param aval s->nwords words.
+ * @param bval s->nwords words.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_signal_append(openvcd_signal* s, uint64_t time, const uint64_t* aval, const uint64_t* bval);
+
+/**
+ * @brief Append every change of one signal to another.
+ *
+ * The blocks of src are copied after those of dst as they are, so the
+ * first change of src must not be before the last change of dst.
+ *
+ * @param dst
+ * @param src Must have the same width as dst.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_signal_concat(openvcd_signal* dst, const openvcd_signal* src);
+
+/**
+ * @brief Apply a record from the value change section to a waveform.
+ *
+ * @param w
+ * @param c
+ *
+ * @return OPENVCD_ERROR_NONE on success, OPENVCD_ERROR_SYNTAX if the record
+ * is invalid, or OPENVCD_ERROR_ALLOC_FAILED.
+ */
+openvcd_parser_error openvcd_wave_apply(openvcd_wave* w, const openvcd_change* c);
+
+/**
+ * @brief Advance a waveform to a time record.
+ *
+ * This is the part of openvcd_wave_apply() which handles time records, for
+ * loaders which have already decoded the record.
+ *
+ * @param w
+ * @param time
+ *
+ * @return OPENVCD_ERROR_NONE on success, OPENVCD_ERROR_SYNTAX if time is
+ * before the previous time record, or OPENVCD_ERROR_ALLOC_FAILED.
+ */
+openvcd_parser_error openvcd_wave_set_time(openvcd_wave* w, uint64_t time);
+
+/**
+ * @brief Parse the value of a value change record into the waveform's
+ * scratch value.
+ *
+ * This is the part of openvcd_wave_apply() which decodes value changes, for
+ * loaders which store the change themselves.
+ *
+ * @param w
+ * @param c A value change record.
+ * @param n Set to the signal number, see openvcd_wave_signal_number().
+ *
+ * @return OPENVCD_ERROR_NONE on success, with the value in w->scratch_aval
+ * and w->scratch_bval, or OPENVCD_ERROR_SYNTAX if the identifier code is
+ * not declared or the value is invalid.
+ */
+openvcd_parser_error openvcd_wave_parse_change(openvcd_wave* w, const openvcd_change* c, size_t* n);
+
+/**
+ * @brief Append an already decoded value change to a waveform.
+ *
+ * This is the part of openvcd_wave_apply() which handles value changes.
+ *
+ * @param w
+ * @param n The signal number, see openvcd_wave_signal_number().
+ * @param time
+ * @param aval
+ * @param bval
+ *
+ * @return OPENVCD_ERROR_NONE on success, or OPENVCD_ERROR_ALLOC_FAILED.
+ */
+openvcd_parser_error openvcd_wave_append(openvcd_wave* w, size_t n, uint64_t time, const uint64_t* aval, const uint64_t* bval);
+
+/**
+ * @brief Describe an error returned while applying a value change.
+ *
+ * @param error
+ *
+ * @return A static string, as used in parser error messages.
+ */
+const char* openvcd_change_error(openvcd_parser_error error);
+
+/**
+ * @brief Find the coarsest timescale which each of the given ones is a whole
+ * multiple of, and what to multiply times by to convert them to it.
+ *
+ * For instance, 1ns and 100ps have a common timescale of 100ps, with scales
+ * of 10 and 1. If any of the timescales is undefined, they are all taken to
+ * be the same as the first, with scales of 1.
+ *
+ * @param timescales
+ * @param n At least 1.
+ * @param common
+ * @param scales n scales, one for each timescale.
+ *
+ * @return false if any of the timescales was undefined, or is too large to
+ * be counted in fs.
+ */
+bool openvcd_timescale_common(const openvcd_timescale* timescales, size_t n, openvcd_timescale* common, uint64_t* scales);
+
+/**
+ * @brief Start taking snapshots as changes are applied to a waveform.
+ *
+ * Snapshots are taken by openvcd_wave_apply(), at the first time record
+ * which is at least time_interval after the previous snapshot, or after at
+ * least change_interval changes have been applied since it. Smaller
+ * intervals make openvcd_wave_state_at() faster, at the cost of the memory
+ * for one value of every signal per snapshot.
+ *
+ * This must be called before any changes are applied.
+ *
+ * @param w
+ * @param time_interval 0 to not take snapshots based on time.
+ * @param change_interval 0 to not take snapshots based on changes.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_wave_set_snapshots(openvcd_wave* w, uint64_t time_interval, uint64_t change_interval);
+
+/**
+ * @brief Record an error in the value change section in a parser.
+ *
+ * @param p
+ * @param error
+ * @param what A description of the error.
+ * @param offset The offset of the error within the value change section.
+ */
+void openvcd_load_error(openvcd_parser* p, openvcd_parser_error error, const char* what, size_t offset);
+
+/**
+ * @brief Parse the declarations of a VCD file into a new waveform.
+ *
+ * The waveform has a signal for every variable, but no changes. The
+ * parser's root, version, and date are moved into the waveform, and the
+ * parser is left at the start of the value change section.
+ *
+ * @param p
+ *
+ * @return The new waveform, or NULL on error.
+ */
+openvcd_wave* openvcd_load_header(openvcd_parser* p);
+
+/**
+ * @brief Pass every record of the value change section to a handler.
+ *
+ * The header must already have been parsed with openvcd_parse_header(). The
+ * records are read from the parser's input in the same way as
+ * openvcd_load(), and if the handler returns an error, parsing stops and the
+ * error is recorded in the parser.
+ *
+ * @param p
+ * @param handler
+ * @param ctx Passed to the handler.
+ */
+void openvcd_parse_changes(openvcd_parser* p, openvcd_change_handler handler, void* ctx);
+
+/**
+ * @brief Load a complete VCD file into a new waveform.
+ *
+ * The declarations are read using openvcd_parse_header(), and the value
+ * changes with a scanner, see scan.h. On error, the details are available
+ * from the parser in the same way as for any other parse error.
+ *
+ * The parser's root, version, and date are moved into the waveform.
+ *
+ * @param p
+ *
+ * @return The new waveform, or NULL on error.
+ */
+openvcd_wave* openvcd_load(openvcd_parser* p);
+
+/**
+ * @brief Load a complete VCD file into a new waveform, taking snapshots.
+ *
+ * See openvcd_load() and openvcd_wave_set_snapshots().
+ *
+ * @param p
+ * @param time_interval
+ * @param change_interval
+ *
+ * @return The new waveform, or NULL on error.
+ */
+openvcd_wave* openvcd_load_snapshots(openvcd_parser* p, uint64_t time_interval, uint64_t change_interval);
+
+/**
+ * @brief Find the block of a signal which contains it's value at time t.
+ *
+ * @param s
+ * @param t
+ * @param block Set to the last block whose first change is at or before t.
+ *
+ * @return false if the signal has no changes at or before t.
+ */
+bool openvcd_signal_find_block(const openvcd_signal* s, uint64_t t, size_t* block);
+
+/**
+ * @brief Decode a single block of a signal.
+ *
+ * @param s
+ * @param block
+ *
+ * @return The decoded block, which must be free-ed with
+ * openvcd_free_decoded_block(), or NULL if it could not be decoded.
+ */
+openvcd_decoded_block* openvcd_decode_block(const openvcd_signal* s, size_t block);
+
+/**
+ * @brief Decode a block of a signal from the given data.
+ *
+ * See openvcd_decode_block(). This is for blocks which are not in the
+ * signal's own arrays, or not yet, such as while it is read by other
+ * threads.
+ *
+ * @param s
+ * @param b
+ * @param data
+ * @param data_length
+ *
+ * @return The decoded block, or NULL if it could not be decoded.
+ */
+openvcd_decoded_block* openvcd_decode_changes(const openvcd_signal* s, const openvcd_block* b, const unsigned char* data, size_t data_length);
+
+/**
+ * @brief Free a decoded block.
+ *
+ * @param d
+ */
+void openvcd_free_decoded_block(openvcd_decoded_block* d);
+
+/**
+ * @brief Find the last change in a decoded block at or before time t.
+ *
+ * @param d
+ * @param t
+ *
+ * @return The index of the change, or -1 if every change is after t.
+ */
+long openvcd_decoded_block_find(const openvcd_decoded_block* d, uint64_t t);
+
+/**
+ * @brief Get the value of a signal at time t.
+ *
+ * @param s
+ * @param t
+ * @param aval s->nwords words, set to the value.
+ * @param bval s->nwords words, set to the value.
+ *
+ * @return false if the signal has no value at time t.
+ */
+bool openvcd_value_at(const openvcd_signal* s, uint64_t t, uint64_t* aval, uint64_t* bval);
+
+/**
+ * @brief Allocate a state large enough for every signal of a waveform.
+ *
+ * @param w
+ *
+ * @return The new state, which must be free-ed with openvcd_free_state(),
+ * or NULL on failure.
+ */
+openvcd_state* openvcd_alloc_state(const openvcd_wave* w);
+
+/**
+ * @brief Free a state.
+ *
+ * @param state
+ */
+void openvcd_free_state(openvcd_state* state);
+
+/**
+ * @brief Get the value of every signal at time t.
+ *
+ * If the waveform has snapshots, this decodes the last snapshot at or before
+ * t, and then only looks up the signals which changed after it. Otherwise
+ * every signal is looked up. Signals are looked up with
+ * openvcd_wave_value_at(), so lazily opened signals are loaded as needed.
+ *
+ * @param w
+ * @param t
+ * @param state Allocated by openvcd_alloc_state() for this waveform.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_wave_state_at(openvcd_wave* w, uint64_t t, openvcd_state* state);
+
+#endif /* OPENVCD_WAVE_H */
@@ -0,0 +1,357 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+
+#include "test_util.h"
+#include "wave.h"
+
+/* A VCD where the clock "!" toggles every time step, "d" counts up every
+ * other step, "w" is a 100 bit bus, and "r" is a real. */
+static char* make_mixed(int nsteps, size_t* length) {
+	char* buffer;
+	FILE* f;
+
+	f = open_memstream(&buffer, length);
+	fprintf(f, "$date today $end\n$version test $end\n$timescale 10ps $end\n");
+	fprintf(f, "$scope module top $end\n");
+	fprintf(f, "$var wire 1 ! clk $end\n");
+	fprintf(f, "$var reg 8 d count [7:0] $end\n");
+	fprintf(f, "$scope module sub $end\n");
+	fprintf(f, "$var wire 1 ! clk $end\n");
+	fprintf(f, "$var wire 100 w bus $end\n");
+	fprintf(f, "$var real 64 r level $end\n");
+	fprintf(f, "$upscope $end\n$upscope $end\n$enddefinitions $end\n");
+
+	fprintf(f, "#0\n$dumpvars\n0!\nbx d\nbz w\nr0 r\n$end\n");
+	for (int t = 1 ; t <= nsteps ; t++) {
+		fprintf(f, "#%d\n%d!\n", t * 5, t % 2);
+		if (t % 2 == 0) { fprintf(f, "b%d%d%d%d%d%d%d%d d\n",
+			(t >> 8) & 1, (t >> 7) & 1, (t >> 6) & 1, (t >> 5) & 1,
+			(t >> 4) & 1, (t >> 3) & 1, (t >> 2) & 1, (t >> 1) & 1); }
+		if (t == 100) { fprintf(f, "b1%0*d w\nr2.5 r\n", 98, 0); }
+	}
+
+	fclose(f);
+	return buffer;
+}
+
+static void check_wave(openvcd_wave* w, int nsteps) {
+	openvcd_signal* clk;
+	openvcd_signal* d;
+	openvcd_signal* bus;
+	openvcd_signal* r;
+	uint64_t aval[2];
+	uint64_t bval[2];
+
+	should_not_be_null(w);
+	should_equal(w->signals.length, 4);
+	should_equal(w->end_time, (uint64_t) nsteps * 5);
+	should_equal(w->timescale.n, 10);
+	should_equal(w->timescale.u, openvcd_unit_ps);
+	str_should_equal(w->date, "today");
+	str_should_equal(w->version, "test");
+
+	clk = openvcd_wave_find_signal(w, "!");
+	d = openvcd_wave_find_signal(w, "d");
+	bus = openvcd_wave_find_signal(w, "w");
+	r = openvcd_wave_find_signal(w, "r");
+	should_not_be_null(clk);
+	should_not_be_null(d);
+	should_not_be_null(bus);
+	should_not_be_null(r);
+	should_be_null(openvcd_wave_find_signal(w, "?"));
+
+	should_equal(clk->change_count, (uint64_t) nsteps + 1);
+	should_be_true(clk->nblocks > 1);
+	should_equal(bus->nwords, 2);
+	should_be_true(r->real);
+	should_not_be_null(clk->var);
+
+	/* at and between changes */
+	should_be_true(openvcd_value_at(clk, 0, aval, bval));
+	should_equal(aval[0], 0);
+	should_be_true(openvcd_value_at(clk, 1000, aval, bval));
+	should_equal(aval[0], 0);
+	should_be_true(openvcd_value_at(clk, 1007, aval, bval));
+	should_equal(aval[0], 1);
+
+	should_be_true(openvcd_value_at(d, 0, aval, bval));
+	should_equal(aval[0], 0xff);
+	should_equal(bval[0], 0xff);
+	should_be_true(openvcd_value_at(d, 504, aval, bval));
+	should_equal(aval[0], 50);
+	should_equal(bval[0], 0);
+
+	should_be_true(openvcd_value_at(bus, 499, aval, bval));
+	should_equal(bval[0], UINT64_MAX);
+	should_be_true(openvcd_value_at(bus, 500, aval, bval));
+	should_equal(aval[0], 0);
+	should_equal(aval[1], ((uint64_t) 1) << 34);
+	should_equal(bval[0], 0);
+	should_equal(bval[1], 0);
+
+	should_be_true(openvcd_value_at(r, 600, aval, bval));
+	should_equal_epsilon(openvcd_value_real(aval), 2.5, 0.0001);
+}
+
+static openvcd_wave* load_snapshots(char* vcd, size_t length, uint64_t time_interval, uint64_t change_interval) {
+	openvcd_parser* p;
+	openvcd_wave* w;
+
+	p = string_parser(vcd, length);
+	w = openvcd_load_snapshots(p, time_interval, change_interval);
+	if (w == NULL) { fprintf(stderr, "%s\n", p->error_string); }
+	openvcd_free_parser(p);
+
+	return w;
+}
+
+void test_wave_load_string(void) {
+	openvcd_wave* w;
+	char* vcd;
+	size_t length;
+
+	vcd = make_mixed(1000, &length);
+	w = load_snapshots(vcd, length, 0, 0);
+	check_wave(w, 1000);
+
+	openvcd_free_wave(w);
+	free(vcd);
+}
+
+void test_wave_load_stream(void) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	openvcd_wave* w;
+	char* vcd;
+	size_t length;
+	FILE* f;
+
+	vcd = make_mixed(1000, &length);
+	f = fmemopen(vcd, length, "r");
+	source.input_stream = f;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	w = openvcd_load(p);
+	check_wave(w, 1000);
+
+	openvcd_free_wave(w);
+	openvcd_free_parser(p);
+	fclose(f);
+	free(vcd);
+}
+
+void test_wave_blocks(void) {
+	openvcd_decoded_block* d;
+	openvcd_signal* s;
+	openvcd_wave* w;
+	openvcd_timescale ts;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	size_t block;
+
+	ts.n = 1;
+	ts.u = openvcd_unit_ns;
+	w = openvcd_alloc_wave(NULL, ts);
+	s = openvcd_wave_add_signal(w, "a", 4, false);
+	should_not_be_null(s);
+	should_equal(openvcd_wave_add_signal(w, "a", 4, false), s);
+
+	for (uint64_t i = 0 ; i < 1000 ; i++) {
+		aval[0] = i & 0xf;
+		bval[0] = (i % 7 == 0) ? 1 : 0;
+		should_equal(openvcd_signal_append(s, i * 3, aval, bval), 0);
+	}
+
+	should_equal(s->nblocks, (1000 + OPENVCD_BLOCK_CHANGES - 1) / OPENVCD_BLOCK_CHANGES);
+	should_be_true(openvcd_signal_find_block(s, 0, &block));
+	should_equal(block, 0);
+	should_be_true(openvcd_signal_find_block(s, 3 * 300, &block));
+	should_equal(block, 1);
+
+	d = openvcd_decode_block(s, 1);
+	should_not_be_null(d);
+	should_equal(d->count, OPENVCD_BLOCK_CHANGES);
+	should_equal(d->times[0], 3 * OPENVCD_BLOCK_CHANGES);
+	should_equal(openvcd_decoded_block_find(d, 3 * 300 + 1), 300 - OPENVCD_BLOCK_CHANGES);
+	should_equal(openvcd_decoded_block_find(d, 0), -1);
+	should_equal(d->aval[300 - OPENVCD_BLOCK_CHANGES], 300 & 0xf);
+	should_equal(d->bval[301 - OPENVCD_BLOCK_CHANGES], 1);
+	openvcd_free_decoded_block(d);
+
+	should_be_null(openvcd_decode_block(s, s->nblocks));
+
+	/* a corrupt block must not be decoded */
+	s->blocks[0].offset = s->data_length;
+	should_be_null(openvcd_decode_block(s, 0));
+	s->blocks[0].offset = 0;
+
+	openvcd_free_wave(w);
+}
+
+/* the state at t must match looking up each signal */
+static void check_state(openvcd_wave* w, openvcd_state* state, uint64_t t) {
+	openvcd_signal* s;
+	uint64_t aval[2];
+	uint64_t bval[2];
+	int i;
+
+	should_equal(openvcd_wave_state_at(w, t, state), 0);
+	should_equal(state->time, t);
+	vec_foreach(&(w->signals), s, i) {
+		should_equal(state->valid[i], openvcd_value_at(s, t, aval, bval));
+		if (!state->valid[i]) { continue; }
+		should_be_true(openvcd_value_eq(s->nwords, aval, bval,
+			state->aval + s->word, state->bval + s->word));
+	}
+}
+
+void test_wave_snapshots(void) {
+	openvcd_state* state;
+	openvcd_wave* w;
+	char* vcd;
+	size_t length;
+	uint64_t intervals[][2] = {{0, 0}, {100, 0}, {0, 50}, {1, 0}, {100, 50}};
+
+	vcd = make_mixed(1000, &length);
+
+	for (size_t i = 0 ; i < sizeof(intervals) / sizeof(intervals[0]) ; i++) {
+		w = load_snapshots(vcd, length, intervals[i][0], intervals[i][1]);
+		check_wave(w, 1000);
+
+		if (intervals[i][0] + intervals[i][1] == 0) {
+			should_equal(w->snapshots.nsnapshots, 0);
+		} else {
+			should_be_true(w->snapshots.nsnapshots > 10);
+			should_equal(w->snapshots.snapshots[0].size, 0);
+		}
+		if (intervals[i][0] == 1) {
+			/* one snapshot per time step */
+			should_equal(w->snapshots.nsnapshots, 1001);
+		}
+
+		state = openvcd_alloc_state(w);
+		should_not_be_null(state);
+		for (uint64_t t = 0 ; t <= 5010 ; t += 7) {
+			check_state(w, state, t);
+		}
+		check_state(w, state, 500);
+		check_state(w, state, 505);
+		openvcd_free_state(state);
+
+		/* it's too late to start taking snapshots */
+		should_equal(openvcd_wave_set_snapshots(w, 10, 10), -1);
+		openvcd_free_wave(w);
+	}
+
+	free(vcd);
+}
+
+void test_wave_errors(void) {
+	openvcd_input_source source;
+	openvcd_parser* p;
+	char* errors[] = {
+		/* undeclared identifier code */
+		"$var wire 1 ! a $end\n$enddefinitions $end\n#0\n1?\n",
+		/* time going backwards */
+		"$var wire 1 ! a $end\n$enddefinitions $end\n#5\n1!\n#4\n0!\n",
+		/* invalid value */
+		"$var wire 4 ! a $end\n$enddefinitions $end\n#0\nb12 !\n",
+		/* no $enddefinitions */
+		"$var wire 1 ! a $end\n#0\n1!\n",
+	};
+
+	for (size_t i = 0 ; i < sizeof(errors) / sizeof(errors[0]) ; i++) {
+		source.input_string = errors[i];
+		p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, strlen(errors[i]));
+		should_be_null(openvcd_load(p));
+		should_not_be_null(p->error_string);
+		openvcd_free_parser(p);
+	}
+}
+
+/* syntax errors are reported at the record which caused them, whether the
+ * file is read from a string or a stream */
+void test_wave_error_offset(void) {
+	const char* text = "$var wire 1 ! a $end\n$enddefinitions $end\n#0\n1!\n#10\n0!\n#x\n1!\n";
+	openvcd_input_source source;
+	openvcd_parser* p;
+	char expect[64];
+	FILE* f;
+
+	snprintf(expect, sizeof(expect), "error at byte %lu,", (unsigned long) (strstr(text, "#x") - text));
+
+	source.input_string = (char*) text;
+	p = openvcd_new_parser(OPENVCD_PARSER_STRING, source, strlen(text));
+	should_be_null(openvcd_load(p));
+	parser_should_error(p);
+	should_equal(strncmp(p->error_string, expect, strlen(expect)), 0);
+	openvcd_free_parser(p);
+
+	f = fmemopen((void*) text, strlen(text), "r");
+	should_not_be_null(f);
+	source.input_stream = f;
+	p = openvcd_new_parser(OPENVCD_PARSER_FILE, source, 0);
+	should_be_null(openvcd_load(p));
+	parser_should_error(p);
+	should_equal(strncmp(p->error_string, expect, strlen(expect)), 0);
+	openvcd_free_parser(p);
+	fclose(f);
+}
+
+void test_wave_timescale_common(void) {
+	openvcd_timescale timescales[3];
+	openvcd_timescale common;
+	uint64_t scales[3];
+
+	timescales[0].u = openvcd_unit_ns;
+	timescales[0].n = 1;
+	timescales[1].u = openvcd_unit_ps;
+	timescales[1].n = 100;
+	timescales[2].u = openvcd_unit_us;
+	timescales[2].n = 10;
+	should_be_true(openvcd_timescale_common(timescales, 3, &common, scales));
+	should_equal(common.u, openvcd_unit_ps);
+	should_equal(common.n, 100);
+	should_equal(scales[0], 10);
+	should_equal(scales[1], 1);
+	should_equal(scales[2], 100000);
+
+	/* the result is in the largest unit it can be */
+	should_be_true(openvcd_timescale_common(timescales + 2, 1, &common, scales));
+	should_equal(common.u, openvcd_unit_us);
+	should_equal(common.n, 10);
+	should_equal(scales[0], 1);
+
+	/* 100000s is more fs than fit in 64 bits */
+	timescales[2].u = openvcd_unit_s;
+	timescales[2].n = 100000;
+	should_be_false(openvcd_timescale_common(timescales, 3, &common, scales));
+	should_equal(common.u, openvcd_unit_ns);
+	should_equal(scales[0], 1);
+	should_equal(scales[1], 1);
+	timescales[2].n = 10000;
+	should_be_true(openvcd_timescale_common(timescales, 3, &common, scales));
+	should_equal(scales[2], 10000000000000000000ULL / 100000);
+
+	timescales[1].u = openvcd_unit_undefined;
+	timescales[1].n = -1;
+	should_be_false(openvcd_timescale_common(timescales, 3, &common, scales));
+	should_equal(common.u, openvcd_unit_ns);
+	should_equal(scales[0], 1);
+	should_equal(scales[2], 1);
+}
+
+int main(void) {
+	test_wave_load_string();
+	test_wave_load_stream();
+	test_wave_blocks();
+	test_wave_snapshots();
+	test_wave_errors();
+	test_wave_error_offset();
+	test_wave_timescale_common();
+	return 0;
+}
@@ -0,0 +1,492 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#include "writer.h"
+
+/* indexed by openvcd_unit */
+static const char* unit_names[] = { "s", "ms", "us", "ns", "ps", "fs" };
+
+/* "00" through "99", for writing two decimal digits at a time */
+static const char decimal_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/* identifier codes are made of the printable characters ! through ~ */
+#define ID_CODE_FIRST '!'
+#define ID_CODE_BASE 94
+
+/* enough for "r", a double, a space, the longest identifier code, and a
+ * newline */
+#define REAL_LENGTH 64
+
+/* make room for length more bytes in the buffer, and return where they
+ * go, or NULL if anything has failed */
+static char* reserve(openvcd_writer* w, size_t length) {
+	char* buffer;
+
+	if (w->rc != 0) { return NULL; }
+
+	if (w->length + length > w->capacity) {
+		if (openvcd_writer_flush(w) != 0) { return NULL; }
+	}
+
+	/* only for very wide vectors */
+	if (length > w->capacity) {
+		buffer = realloc(w->buffer, length);
+		if (buffer == NULL) {
+			w->rc = -1;
+			return NULL;
+		}
+		w->buffer = buffer;
+		w->capacity = length;
+	}
+
+	return w->buffer + w->length;
+}
+
+static void put_string(openvcd_writer* w, const char* s) {
+	size_t length;
+	char* out;
+
+	length = strlen(s);
+	out = reserve(w, length);
+	if (out == NULL) { return; }
+	memcpy(out, s, length);
+	w->length += length;
+}
+
+/* write x in decimal, returning the end of what was written */
+static char* put_decimal(char* out, uint64_t x) {
+	char digits[20];
+	size_t n;
+
+	n = sizeof(digits);
+	while (x >= 100) {
+		n -= 2;
+		memcpy(digits + n, decimal_pairs + ((x % 100) * 2), 2);
+		x /= 100;
+	}
+	if (x >= 10) {
+		n -= 2;
+		memcpy(digits + n, decimal_pairs + (x * 2), 2);
+	} else {
+		digits[--n] = (char) ('0' + x);
+	}
+
+	memcpy(out, digits + n, sizeof(digits) - n);
+	return out + (sizeof(digits) - n);
+}
+
+/* write the low nbits bits of x in binary, most significant first */
+static char* put_binary(char* out, uint64_t x, unsigned int nbits) {
+	uint64_t spread;
+
+	while ((nbits % 8) != 0) {
+		nbits--;
+		*out++ = (char) ('0' + ((x >> nbits) & 1));
+	}
+
+	/* spread each byte into eight bytes of 0 or 1, with it's most
+	 * significant bit in the first */
+	while (nbits > 0) {
+		nbits -= 8;
+		spread = (((x >> nbits) & 0xff) * 0x8040201008040201ULL) >> 7;
+		spread = (spread & 0x0101010101010101ULL) + 0x3030303030303030ULL;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		spread = __builtin_bswap64(spread);
+#endif
+		memcpy(out, &spread, 8);
+		out += 8;
+	}
+
+	return out;
+}
+
+/* write "code\n" */
+static char* put_id(char* out, const openvcd_var* v) {
+	const char* code;
+
+	for (code = v->identifier_code ; *code != '\0' ; code++) {
+		*out++ = *code;
+	}
+	*out++ = '\n';
+
+	return out;
+}
+
+/* write " code\n" */
+static char* put_code(char* out, const openvcd_var* v) {
+	*out++ = ' ';
+	return put_id(out, v);
+}
+
+/* the number of characters put_code() writes */
+static size_t code_length(const openvcd_var* v) {
+	return strlen(v->identifier_code) + 2;
+}
+
+/* the i-th identifier code, in bijective base ID_CODE_BASE */
+static void make_id_code(uint64_t i, char* code) {
+	size_t n;
+
+	n = 0;
+	for (;;) {
+		code[n++] = (char) (ID_CODE_FIRST + (i % ID_CODE_BASE));
+		i /= ID_CODE_BASE;
+		if (i == 0) { break; }
+		i--;
+	}
+	code[n] = '\0';
+}
+
+openvcd_writer* openvcd_new_writer(FILE* stream, openvcd_timescale timescale, const char* version) {
+	openvcd_writer* w;
+	char* out;
+
+	if ((timescale.u != openvcd_unit_undefined) &&
+		((timescale.u < openvcd_unit_s) || (timescale.u > openvcd_unit_fs) || (timescale.n <= 0))) {
+		return NULL;
+	}
+
+	w = malloc(sizeof(openvcd_writer));
+	if (w == NULL) { return NULL; }
+
+	w->buffer = malloc(OPENVCD_WRITER_BUFFER_SIZE);
+	if (w->buffer == NULL) {
+		free(w);
+		return NULL;
+	}
+
+	w->root = openvcd_alloc_scope(NULL, "", OPENVCD_SCOPE_MODULE);
+	if (w->root == NULL) {
+		free(w->buffer);
+		free(w);
+		return NULL;
+	}
+
+	w->stream = stream;
+	w->length = 0;
+	w->capacity = OPENVCD_WRITER_BUFFER_SIZE;
+	w->rc = 0;
+	w->scope = w->root;
+	w->nvars = 0;
+	w->definitions_done = false;
+	w->has_time = false;
+	w->time = 0;
+
+	if (version != NULL) {
+		put_string(w, "$version ");
+		put_string(w, version);
+		put_string(w, " $end\n");
+	}
+
+	if (timescale.u != openvcd_unit_undefined) {
+		put_string(w, "$timescale ");
+		out = reserve(w, 20);
+		if (out != NULL) {
+			w->length = (size_t) (put_decimal(out, (uint64_t) timescale.n) - w->buffer);
+		}
+		put_string(w, unit_names[timescale.u]);
+		put_string(w, " $end\n");
+	}
+
+	return w;
+}
+
+void openvcd_free_writer(openvcd_writer* w) {
+	/* the stream isn't touched if everything has been flushed, since it
+	 * may have been closed by now */
+	if (w->length > 0) { openvcd_writer_flush(w); }
+	openvcd_free_scope(w->root);
+	free(w->buffer);
+	free(w);
+}
+
+int openvcd_writer_scope(openvcd_writer* w, const char* name, openvcd_scope_type type) {
+	openvcd_scope* s;
+	khint_t k;
+
+	if ((w->rc != 0) || w->definitions_done) { return -1; }
+
+	/* the parser merges scopes which are declared again, so this does
+	 * the same */
+	k = kh_get(openvcd_mscope, w->scope->child_scopes, name);
+	if (k != kh_end(w->scope->child_scopes)) {
+		s = kh_val(w->scope->child_scopes, k);
+	} else {
+		s = openvcd_alloc_scope(w->scope, (char*) name, type);
+		if (s == NULL) { return -1; }
+	}
+	w->scope = s;
+
+	put_string(w, "$scope ");
+	put_string(w, openvcd_scope_type_to_str(s->type));
+	put_string(w, " ");
+	put_string(w, name);
+	put_string(w, " $end\n");
+
+	return w->rc;
+}
+
+int openvcd_writer_upscope(openvcd_writer* w) {
+	if ((w->rc != 0) || w->definitions_done || (w->scope->parent == NULL)) { return -1; }
+
+	w->scope = w->scope->parent;
+	put_string(w, "$upscope $end\n");
+
+	return w->rc;
+}
+
+/* declare a variable with the given identifier code */
+static openvcd_var* declare(openvcd_writer* w, openvcd_var_type type, unsigned int width, const char* name, int msb_index, int lsb_index, const char* code) {
+	openvcd_reference* r;
+	openvcd_var* v;
+	char* out;
+
+	if ((w->rc != 0) || w->definitions_done || (width == 0)) { return NULL; }
+
+	r = openvcd_alloc_reference((char*) name, lsb_index, msb_index);
+	if (r == NULL) { return NULL; }
+
+	v = openvcd_alloc_var(w->scope, type, width, r, (char*) code);
+	if (v == NULL) {
+		openvcd_free_reference(r);
+		return NULL;
+	}
+
+	put_string(w, "$var ");
+	put_string(w, openvcd_var_type_to_str(type));
+	put_string(w, " ");
+	out = reserve(w, 20);
+	if (out != NULL) {
+		w->length = (size_t) (put_decimal(out, width) - w->buffer);
+	}
+	put_string(w, " ");
+	put_string(w, code);
+	put_string(w, " ");
+	put_string(w, name);
+
+	/* at most " [2147483647:-2147483648]" */
+	if (msb_index >= 0) {
+		out = reserve(w, 25);
+		if (out != NULL) {
+			*out++ = ' ';
+			*out++ = '[';
+			out = put_decimal(out, (uint64_t) msb_index);
+			if (lsb_index != msb_index) {
+				*out++ = ':';
+				if (lsb_index < 0) { *out++ = '-'; }
+				out = put_decimal(out, (uint64_t) ((lsb_index < 0) ? -(int64_t) lsb_index : lsb_index));
+			}
+			*out++ = ']';
+			w->length = (size_t) (out - w->buffer);
+		}
+	}
+
+	put_string(w, " $end\n");
+
+	return (w->rc == 0) ? v : NULL;
+}
+
+openvcd_var* openvcd_writer_var(openvcd_writer* w, openvcd_var_type type, unsigned int width, const char* name, int msb_index, int lsb_index) {
+	openvcd_var* v;
+	char code[16];
+
+	make_id_code(w->nvars, code);
+	v = declare(w, type, width, name, msb_index, lsb_index, code);
+	if (v != NULL) { w->nvars++; }
+
+	return v;
+}
+
+openvcd_var* openvcd_writer_alias(openvcd_writer* w, openvcd_var_type type, const char* name, int msb_index, int lsb_index, const openvcd_var* of) {
+	return declare(w, type, of->width, name, msb_index, lsb_index, of->identifier_code);
+}
+
+int openvcd_writer_end_definitions(openvcd_writer* w) {
+	if (w->rc != 0) { return -1; }
+	if (w->definitions_done) { return 0; }
+
+	put_string(w, "$enddefinitions $end\n");
+	w->definitions_done = true;
+
+	return w->rc;
+}
+
+int openvcd_writer_time(openvcd_writer* w, uint64_t time) {
+	char* out;
+
+	if (openvcd_writer_end_definitions(w) != 0) { return -1; }
+
+	if (w->has_time) {
+		if (time < w->time) { return -1; }
+		if (time == w->time) { return 0; }
+	}
+
+	out = reserve(w, 22);
+	if (out == NULL) { return -1; }
+
+	*out++ = '#';
+	out = put_decimal(out, time);
+	*out++ = '\n';
+	w->length = (size_t) (out - w->buffer);
+
+	w->has_time = true;
+	w->time = time;
+
+	return 0;
+}
+
+int openvcd_writer_scalar(openvcd_writer* w, const openvcd_var* v, int state) {
+	char* out;
+
+	if (!w->definitions_done) { return -1; }
+
+	out = reserve(w, code_length(v));
+	if (out == NULL) { return -1; }
+
+	/* scalars have no space between the value and the code */
+	*out++ = openvcd_state_to_char(state);
+	out = put_id(out, v);
+	w->length = (size_t) (out - w->buffer);
+
+	return 0;
+}
+
+/* The value is written with as few digits as it can be without changing
+ * it's meaning, see openvcd_value_parse(). A leading 0 can be left out if
+ * it is followed by a 0 or 1, and a leading x or z if it is followed by
+ * the same. */
+static char* put_vector(char* out, unsigned int width, const uint64_t* aval, const uint64_t* bval) {
+	static const char states[] = "01zx";
+	size_t nwords;
+	size_t top;
+	int state;
+	int next;
+
+	nwords = OPENVCD_VALUE_WORDS(width);
+
+	/* values without any x or z bits are just binary numbers */
+	if (!openvcd_value_has_xz(nwords, bval)) {
+		top = nwords;
+		while ((top > 0) && (aval[top - 1] == 0)) { top--; }
+		if (top == 0) {
+			*out++ = '0';
+			return out;
+		}
+
+		top--;
+		out = put_binary(out, aval[top], 64 - (unsigned int) __builtin_clzll(aval[top]));
+		while (top > 0) {
+			top--;
+			out = put_binary(out, aval[top], 64);
+		}
+		return out;
+	}
+
+	top = width - 1;
+	state = openvcd_value_get(aval, bval, (unsigned int) top);
+	while (top > 0) {
+		next = openvcd_value_get(aval, bval, (unsigned int) (top - 1));
+		if (!(((state == OPENVCD_STATE_0) && (next <= OPENVCD_STATE_1)) ||
+			((state >= OPENVCD_STATE_Z) && (next == state)))) {
+			break;
+		}
+		state = next;
+		top--;
+	}
+
+	for (size_t i = top + 1 ; i > 0 ; i--) {
+		*out++ = states[openvcd_value_get(aval, bval, (unsigned int) (i - 1))];
+	}
+
+	return out;
+}
+
+int openvcd_writer_vector(openvcd_writer* w, const openvcd_var* v, const uint64_t* aval, const uint64_t* bval) {
+	char* out;
+
+	if (!w->definitions_done) { return -1; }
+
+	/* rounded up to whole words, since put_binary() writes them whole */
+	out = reserve(w, 1 + (OPENVCD_VALUE_WORDS(v->width) * 64) + code_length(v));
+	if (out == NULL) { return -1; }
+
+	*out++ = 'b';
+	out = put_vector(out, v->width, aval, bval);
+	out = put_code(out, v);
+	w->length = (size_t) (out - w->buffer);
+
+	return 0;
+}
+
+int openvcd_writer_real(openvcd_writer* w, const openvcd_var* v, double value) {
+	char* out;
+	int n;
+
+	if (!w->definitions_done) { return -1; }
+
+	out = reserve(w, REAL_LENGTH);
+	if (out == NULL) { return -1; }
+
+	/* 17 significant digits are always enough to read the same double
+	 * back */
+	n = snprintf(out, REAL_LENGTH, "r%.17g", value);
+	if ((n < 0) || ((size_t) n + code_length(v) > REAL_LENGTH)) {
+		w->rc = -1;
+		return -1;
+	}
+	out = put_code(out + n, v);
+	w->length = (size_t) (out - w->buffer);
+
+	return 0;
+}
+
+int openvcd_writer_text(openvcd_writer* w, const openvcd_var* v, openvcd_change_type type, const char* value, size_t length) {
+	char* out;
+
+	if (!w->definitions_done) { return -1; }
+
+	out = reserve(w, 1 + length + code_length(v));
+	if (out == NULL) { return -1; }
+
+	if (type == OPENVCD_CHANGE_SCALAR) {
+		memcpy(out, value, length);
+		out = put_id(out + length, v);
+	} else {
+		*out++ = (type == OPENVCD_CHANGE_REAL) ? 'r' : 'b';
+		memcpy(out, value, length);
+		out = put_code(out + length, v);
+	}
+	w->length = (size_t) (out - w->buffer);
+
+	return 0;
+}
+
+int openvcd_writer_command(openvcd_writer* w, const char* command) {
+	if (!w->definitions_done) { return -1; }
+
+	put_string(w, command);
+	put_string(w, "\n");
+
+	return w->rc;
+}
+
+int openvcd_writer_flush(openvcd_writer* w) {
+	if (w->rc != 0) { return -1; }
+
+	if (w->length > 0) {
+		if (fwrite(w->buffer, 1, w->length, w->stream) != w->length) {
+			w->rc = -1;
+			return -1;
+		}
+		w->length = 0;
+	}
+
+	if (fflush(w->stream) != 0) { w->rc = -1; }
+
+	return w->rc;
+}
@@ -0,0 +1,257 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+/**** OVERVIEW ***************************************************************/
+
+/*
+ * This file implements writing VCD files, for instance from a simulator.
+ *
+ * Scopes and variables are declared in order with openvcd_writer_scope(),
+ * openvcd_writer_upscope(), and openvcd_writer_var(). Each variable is given
+ * the next unused identifier code, so the first 94 variables get one
+ * character codes, the next 94*94 get two, and so on. The declarations are
+ * also kept as a scope tree, the same as the one the parser would build
+ * from the output.
+ *
+ * Once the declarations are done, the writer is given times and value
+ * changes. These are formatted by hand into a large buffer, which is only
+ * written to the stream when it fills up, or when the writer is flushed.
+ *
+ * A failed write is remembered, and every later call does nothing and
+ * returns -1, so that callers only have to check the result of
+ * openvcd_writer_flush() at the end.
+ */
+
+#ifndef OPENVCD_WRITER_H
+#define OPENVCD_WRITER_H
+
+/**** INCLUDES ***************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "util.h"
+#include "scope.h"
+#include "parser.h"
+#include "value.h"
+#include "scan.h"
+
+/**** TYPES ******************************************************************/
+
+/* the size of the output buffer */
+#define OPENVCD_WRITER_BUFFER_SIZE (1024 * 1024)
+
+typedef struct {
+	FILE* stream;
+
+	char* buffer;
+	size_t length;
+	size_t capacity;
+
+	/* -1 once anything has gone wrong */
+	int rc;
+
+	/* the declared hierarchy, and the scope being declared */
+	openvcd_scope* root;
+	openvcd_scope* scope;
+
+	/* the number of identifier codes handed out */
+	uint64_t nvars;
+
+	bool definitions_done;
+
+	/* the time of the last #, if there was one */
+	bool has_time;
+	uint64_t time;
+} openvcd_writer;
+
+/**** PROTOTYPES *************************************************************/
+
+/**
+ * @brief Create a writer, and write the $version and $timescale
+ * declarations.
+ *
+ * @param stream Not closed by the writer.
+ * @param timescale If the unit is openvcd_unit_undefined, there is no
+ * $timescale.
+ * @param version May be NULL, in which case there is no $version.
+ *
+ * @return The new writer, which must later be free-ed using
+ * openvcd_free_writer(), or NULL on error.
+ */
+openvcd_writer* openvcd_new_writer(FILE* stream, openvcd_timescale timescale, const char* version);
+
+/**
+ * @brief Free a writer, along with it's scope tree, after writing anything
+ * still buffered.
+ *
+ * The result of the last write is lost, so callers should use
+ * openvcd_writer_flush() first.
+ *
+ * @param w
+ */
+void openvcd_free_writer(openvcd_writer* w);
+
+/**
+ * @brief Declare a scope inside the current one, and make it current.
+ *
+ * @param w
+ * @param name
+ * @param type
+ *
+ * @return 0 on success, -1 on failure, or if the definitions are done.
+ */
+int openvcd_writer_scope(openvcd_writer* w, const char* name, openvcd_scope_type type);
+
+/**
+ * @brief Make the parent of the current scope current.
+ *
+ * @param w
+ *
+ * @return 0 on success, -1 if the current scope is the root, or if the
+ * definitions are done.
+ */
+int openvcd_writer_upscope(openvcd_writer* w);
+
+/**
+ * @brief Declare a variable in the current scope, with a new identifier
+ * code.
+ *
+ * @param w
+ * @param type
+ * @param width
+ * @param name The reference identifier, without any bit select.
+ * @param msb_index The bit select, or -1 if there is none.
+ * @param lsb_index Should equal msb_index for a single bit.
+ *
+ * @return The variable, which belongs to the writer, or NULL on failure, or
+ * if the definitions are done.
+ */
+openvcd_var* openvcd_writer_var(openvcd_writer* w, openvcd_var_type type, unsigned int width, const char* name, int msb_index, int lsb_index);
+
+/**
+ * @brief Declare another variable in the current scope, which shares the
+ * identifier code and width of an existing one.
+ *
+ * As with the parser, a scope can't hold two variables with the same code.
+ *
+ * @param w
+ * @param type
+ * @param name
+ * @param msb_index
+ * @param lsb_index
+ * @param of A variable returned by openvcd_writer_var().
+ *
+ * @return The variable, which belongs to the writer, or NULL on failure, or
+ * if the definitions are done.
+ */
+openvcd_var* openvcd_writer_alias(openvcd_writer* w, openvcd_var_type type, const char* name, int msb_index, int lsb_index, const openvcd_var* of);
+
+/**
+ * @brief Write $enddefinitions, after which no more scopes or variables can
+ * be declared.
+ *
+ * This is done by openvcd_writer_time() if it hasn't been already.
+ *
+ * @param w
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int openvcd_writer_end_definitions(openvcd_writer* w);
+
+/**
+ * @brief Move on to a new simulation time.
+ *
+ * Nothing is written if the time is the current one.
+ *
+ * @param w
+ * @param time
+ *
+ * @return 0 on success, -1 on failure, or if time is before the current
+ * time.
+ */
+int openvcd_writer_time(openvcd_writer* w, uint64_t time);
+
+/**
+ * @brief Write a change of a single bit variable.
+ *
+ * @param w
+ * @param v
+ * @param state One of the OPENVCD_STATE_* constants.
+ *
+ * @return 0 on success, -1 on failure, or if the definitions are not done.
+ */
+int openvcd_writer_scalar(openvcd_writer* w, const openvcd_var* v, int state);
+
+/**
+ * @brief Write a change of a vector variable.
+ *
+ * Leading digits which VCD readers would fill back in are left out, so
+ * for instance 8'b00000101 is written as b101.
+ *
+ * @param w
+ * @param v
+ * @param aval OPENVCD_VALUE_WORDS(v->width) words, see value.h.
+ * @param bval
+ *
+ * @return 0 on success, -1 on failure, or if the definitions are not done.
+ */
+int openvcd_writer_vector(openvcd_writer* w, const openvcd_var* v, const uint64_t* aval, const uint64_t* bval);
+
+/**
+ * @brief Write a change of a real variable.
+ *
+ * @param w
+ * @param v
+ * @param value
+ *
+ * @return 0 on success, -1 on failure, or if the definitions are not done.
+ */
+int openvcd_writer_real(openvcd_writer* w, const openvcd_var* v, double value);
+
+/**
+ * @brief Write a change whose value is already text, as it would be read
+ * by a scanner.
+ *
+ * The text is written as it is, so it must suit the variable.
+ *
+ * @param w
+ * @param v
+ * @param type OPENVCD_CHANGE_SCALAR, OPENVCD_CHANGE_VECTOR, or
+ * OPENVCD_CHANGE_REAL.
+ * @param value The state character, or the digits without their leading b
+ * or r, see openvcd_change.
+ * @param length
+ *
+ * @return 0 on success, -1 on failure, or if the definitions are not done.
+ */
+int openvcd_writer_text(openvcd_writer* w, const openvcd_var* v, openvcd_change_type type, const char* value, size_t length);
+
+/**
+ * @brief Write a simulation command such as $dumpvars, or the $end which
+ * closes one, on a line of it's own.
+ *
+ * @param w
+ * @param command
+ *
+ * @return 0 on success, -1 on failure, or if the definitions are not done.
+ */
+int openvcd_writer_command(openvcd_writer* w, const char* command);
+
+/**
+ * @brief Write everything buffered so far to the stream.
+ *
+ * @param w
+ *
+ * @return 0 if everything the writer has been given has been written, or
+ * -1 if anything failed.
+ */
+int openvcd_writer_flush(openvcd_writer* w);
+
+#endif /* OPENVCD_WRITER_H */
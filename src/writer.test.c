@@ -0,0 +1,331 @@
+/* Copyright 2020 Charles Daniels
+ *
+ * This file is part of OpenVCD and is released under a BSD 3-clause license.
+ * See the LICENSE file in the project root for more information */
+
+#define _GNU_SOURCE
+#include "stdio.h"
+#include <limits.h>
+
+#include "test_util.h"
+#include "writer.h"
+#include "wave.h"
+
+static openvcd_writer* memory_writer(char** buffer, size_t* length, FILE** f) {
+	openvcd_timescale ts;
+	openvcd_writer* w;
+
+	*f = open_memstream(buffer, length);
+	should_not_be_null(*f);
+
+	ts.n = 10;
+	ts.u = openvcd_unit_ps;
+	w = openvcd_new_writer(*f, ts, "test");
+	should_not_be_null(w);
+
+	return w;
+}
+
+void test_writer_roundtrip(void) {
+	openvcd_var* clk;
+	openvcd_var* data;
+	openvcd_var* wide;
+	openvcd_var* r;
+	openvcd_writer* w;
+	openvcd_parser* p;
+	openvcd_wave* wave;
+	openvcd_signal* s;
+	uint64_t aval[3];
+	uint64_t bval[3];
+	char* buffer;
+	size_t length;
+	FILE* f;
+
+	w = memory_writer(&buffer, &length, &f);
+
+	should_equal(openvcd_writer_scope(w, "top", OPENVCD_SCOPE_MODULE), 0);
+	clk = openvcd_writer_var(w, OPENVCD_VAR_WIRE, 1, "clk", -1, -1);
+	should_not_be_null(clk);
+	should_equal(openvcd_writer_scope(w, "core", OPENVCD_SCOPE_MODULE), 0);
+	data = openvcd_writer_var(w, OPENVCD_VAR_REG, 8, "data", 7, 0);
+	should_not_be_null(data);
+	wide = openvcd_writer_var(w, OPENVCD_VAR_WIRE, 130, "wide", -1, -1);
+	should_not_be_null(wide);
+	r = openvcd_writer_var(w, OPENVCD_VAR_REAL, 64, "r", -1, -1);
+	should_not_be_null(r);
+	should_equal(openvcd_writer_upscope(w), 0);
+	should_equal(openvcd_writer_upscope(w), 0);
+
+	str_should_equal(clk->identifier_code, "!");
+	str_should_equal(data->identifier_code, "\"");
+
+	for (uint64_t t = 0 ; t < 1000 ; t++) {
+		should_equal(openvcd_writer_time(w, t * 5), 0);
+		should_equal(openvcd_writer_scalar(w, clk, (int) (t % 2)), 0);
+
+		aval[0] = t & 0xff;
+		bval[0] = ((t % 7) == 0) ? 0x30 : 0;
+		should_equal(openvcd_writer_vector(w, data, aval, bval), 0);
+
+		aval[0] = t * 0x9e3779b97f4a7c15ULL;
+		aval[1] = ~t;
+		aval[2] = t & 3;
+		bval[0] = 0;
+		bval[1] = 0;
+		bval[2] = 0;
+		should_equal(openvcd_writer_vector(w, wide, aval, bval), 0);
+
+		should_equal(openvcd_writer_real(w, r, (double) t / 3.0), 0);
+	}
+
+	should_equal(openvcd_writer_flush(w), 0);
+	fclose(f);
+
+	p = string_parser(buffer, length);
+	wave = openvcd_load(p);
+	check_parser_error(p);
+	should_not_be_null(wave);
+
+	/* the writer's hierarchy is the one that was read back */
+	should_be_true(openvcd_scope_equal(w->root, wave->root));
+	should_equal(wave->timescale.n, 10);
+	should_equal(wave->timescale.u, openvcd_unit_ps);
+	should_equal(wave->end_time, 999 * 5);
+
+	for (uint64_t t = 0 ; t < 1000 ; t++) {
+		s = openvcd_wave_find_signal(wave, "!");
+		should_be_true(openvcd_value_at(s, (t * 5) + 2, aval, bval));
+		should_equal(aval[0], t % 2);
+
+		s = openvcd_wave_find_signal(wave, "\"");
+		should_be_true(openvcd_value_at(s, t * 5, aval, bval));
+		should_equal(bval[0], ((t % 7) == 0) ? 0x30 : 0);
+		should_equal(aval[0], t & 0xff);
+
+		s = openvcd_wave_find_signal(wave, "#");
+		should_be_true(openvcd_value_at(s, t * 5, aval, bval));
+		should_equal(aval[0], t * 0x9e3779b97f4a7c15ULL);
+		should_equal(aval[1], ~t);
+		should_equal(aval[2], t & 3);
+
+		s = openvcd_wave_find_signal(wave, "$");
+		should_be_true(s->real);
+		should_be_true(openvcd_value_at(s, t * 5, aval, bval));
+		should_be_true(openvcd_value_real(aval) == (double) t / 3.0);
+	}
+
+	openvcd_free_wave(wave);
+	openvcd_free_parser(p);
+	openvcd_free_writer(w);
+	free(buffer);
+}
+
+void test_writer_format(void) {
+	openvcd_writer* w;
+	openvcd_var* v;
+	openvcd_var* c;
+	uint64_t aval[1];
+	uint64_t bval[1];
+	char* buffer;
+	char* body;
+	size_t length;
+	FILE* f;
+
+	w = memory_writer(&buffer, &length, &f);
+	v = openvcd_writer_var(w, OPENVCD_VAR_WIRE, 8, "v", -1, -1);
+	c = openvcd_writer_var(w, OPENVCD_VAR_WIRE, 1, "c", 0, 0);
+	should_equal(openvcd_writer_time(w, 12345678901234ULL), 0);
+
+	aval[0] = 0x05; bval[0] = 0x00;
+	should_equal(openvcd_writer_vector(w, v, aval, bval), 0);
+	aval[0] = 0x00; bval[0] = 0x00;
+	should_equal(openvcd_writer_vector(w, v, aval, bval), 0);
+	aval[0] = 0xf5; bval[0] = 0xf0;
+	should_equal(openvcd_writer_vector(w, v, aval, bval), 0);
+	aval[0] = 0x00; bval[0] = 0xff;
+	should_equal(openvcd_writer_vector(w, v, aval, bval), 0);
+	aval[0] = 0x01; bval[0] = 0x01;
+	should_equal(openvcd_writer_vector(w, v, aval, bval), 0);
+	aval[0] = 0x80; bval[0] = 0x00;
+	should_equal(openvcd_writer_vector(w, v, aval, bval), 0);
+	should_equal(openvcd_writer_scalar(w, c, OPENVCD_STATE_Z), 0);
+
+	/* the same time isn't written twice */
+	should_equal(openvcd_writer_time(w, 12345678901234ULL), 0);
+	should_equal(openvcd_writer_time(w, 12345678901235ULL), 0);
+
+	should_equal(openvcd_writer_flush(w), 0);
+	fclose(f);
+
+	body = strstr(buffer, "$enddefinitions $end\n");
+	should_not_be_null(body);
+	str_should_equal(body,
+		"$enddefinitions $end\n"
+		"#12345678901234\n"
+		"b101 !\n"
+		"b0 !\n"
+		"bx0101 !\n"
+		"bz !\n"
+		"b0x !\n"
+		"b10000000 !\n"
+		"z\"\n"
+		"#12345678901235\n");
+	should_not_be_null(strstr(buffer, "$version test $end\n$timescale 10ps $end\n"));
+	should_not_be_null(strstr(buffer, "$var wire 1 \" c [0] $end\n"));
+
+	openvcd_free_writer(w);
+	free(buffer);
+}
+
+void test_writer_range(void) {
+	openvcd_writer* w;
+	char* buffer;
+	char* name;
+	size_t length;
+	size_t n;
+	FILE* f;
+
+	w = memory_writer(&buffer, &length, &f);
+
+	/* the longest range, starting 24 bytes from the end of the buffer */
+	n = w->capacity - 24 - w->length - strlen("$var wire 1 ! ");
+	name = malloc(n + 1);
+	should_not_be_null(name);
+	memset(name, 'a', n);
+	name[n] = '\0';
+	should_not_be_null(openvcd_writer_var(w, OPENVCD_VAR_WIRE, 1, name, INT_MAX, INT_MIN));
+	/* so it doesn't fit, and the buffer was flushed before it */
+	should_equal(w->length, strlen(" [2147483647:-2147483648] $end\n"));
+
+	should_equal(openvcd_writer_flush(w), 0);
+	fclose(f);
+	should_not_be_null(strstr(buffer, "a [2147483647:-2147483648] $end\n"));
+
+	openvcd_free_writer(w);
+	free(name);
+	free(buffer);
+}
+
+void test_writer_text(void) {
+	openvcd_writer* w;
+	openvcd_var* v;
+	openvcd_var* a;
+	openvcd_var* r;
+	char* buffer;
+	char* body;
+	size_t length;
+	FILE* f;
+
+	w = memory_writer(&buffer, &length, &f);
+	v = openvcd_writer_var(w, OPENVCD_VAR_WIRE, 4, "v", -1, -1);
+	should_equal(openvcd_writer_scope(w, "sub", OPENVCD_SCOPE_TASK), 0);
+	a = openvcd_writer_alias(w, OPENVCD_VAR_REG, "copy", 3, 0, v);
+	should_not_be_null(a);
+	str_should_equal(a->identifier_code, v->identifier_code);
+	should_equal(a->width, 4);
+	should_equal(openvcd_writer_upscope(w), 0);
+	r = openvcd_writer_var(w, OPENVCD_VAR_REAL, 64, "r", -1, -1);
+
+	should_equal(openvcd_writer_command(w, "$dumpvars"), -1);
+	should_equal(openvcd_writer_text(w, v, OPENVCD_CHANGE_VECTOR, "1x", 2), -1);
+
+	should_equal(openvcd_writer_time(w, 0), 0);
+	should_equal(openvcd_writer_command(w, "$dumpvars"), 0);
+	should_equal(openvcd_writer_text(w, v, OPENVCD_CHANGE_VECTOR, "1x", 2), 0);
+	should_equal(openvcd_writer_text(w, v, OPENVCD_CHANGE_SCALAR, "z", 1), 0);
+	should_equal(openvcd_writer_text(w, r, OPENVCD_CHANGE_REAL, "2.5", 3), 0);
+	should_equal(openvcd_writer_command(w, "$end"), 0);
+
+	should_equal(openvcd_writer_flush(w), 0);
+	fclose(f);
+
+	should_not_be_null(strstr(buffer, "$scope task sub $end\n$var reg 4 ! copy [3:0] $end\n$upscope $end\n"));
+	body = strstr(buffer, "$enddefinitions $end\n");
+	should_not_be_null(body);
+	str_should_equal(body,
+		"$enddefinitions $end\n"
+		"#0\n"
+		"$dumpvars\n"
+		"b1x !\n"
+		"z!\n"
+		"r2.5 \"\n"
+		"$end\n");
+
+	openvcd_free_writer(w);
+	free(buffer);
+}
+
+void test_writer_id_codes(void) {
+	openvcd_writer* w;
+	openvcd_var* v;
+	char name[32];
+	char* buffer;
+	size_t length;
+	FILE* f;
+
+	w = memory_writer(&buffer, &length, &f);
+	should_equal(openvcd_writer_scope(w, "top", OPENVCD_SCOPE_MODULE), 0);
+
+	for (int i = 0 ; i < 20000 ; i++) {
+		snprintf(name, sizeof(name), "v%d", i);
+		v = openvcd_writer_var(w, OPENVCD_VAR_WIRE, 1, name, -1, -1);
+		should_not_be_null(v);
+		if (i < 94) {
+			should_equal(strlen(v->identifier_code), 1);
+		} else if (i < 94 + (94 * 94)) {
+			should_equal(strlen(v->identifier_code), 2);
+		} else {
+			should_equal(strlen(v->identifier_code), 3);
+		}
+	}
+
+	/* the codes are all different, or some variables would be missing */
+	should_equal(kh_size(w->scope->child_variables), 20000);
+
+	openvcd_free_writer(w);
+	fclose(f);
+	free(buffer);
+}
+
+void test_writer_errors(void) {
+	openvcd_timescale ts;
+	openvcd_writer* w;
+	openvcd_var* v;
+	char* buffer;
+	size_t length;
+	FILE* f;
+
+	ts.n = 0;
+	ts.u = openvcd_unit_ns;
+	should_be_null(openvcd_new_writer(stdout, ts, NULL));
+
+	w = memory_writer(&buffer, &length, &f);
+	should_equal(openvcd_writer_upscope(w), -1);
+	v = openvcd_writer_var(w, OPENVCD_VAR_WIRE, 1, "v", -1, -1);
+	should_not_be_null(v);
+	should_be_null(openvcd_writer_var(w, OPENVCD_VAR_WIRE, 0, "empty", -1, -1));
+
+	/* changes need the definitions to be done */
+	should_equal(openvcd_writer_scalar(w, v, OPENVCD_STATE_1), -1);
+
+	should_equal(openvcd_writer_time(w, 10), 0);
+	should_be_null(openvcd_writer_var(w, OPENVCD_VAR_WIRE, 1, "late", -1, -1));
+	should_equal(openvcd_writer_scope(w, "late", OPENVCD_SCOPE_MODULE), -1);
+	should_equal(openvcd_writer_time(w, 9), -1);
+	should_equal(openvcd_writer_scalar(w, v, OPENVCD_STATE_1), 0);
+
+	should_equal(openvcd_writer_flush(w), 0);
+	openvcd_free_writer(w);
+	fclose(f);
+	free(buffer);
+}
+
+int main(void) {
+	test_writer_roundtrip();
+	test_writer_format();
+	test_writer_range();
+	test_writer_text();
+	test_writer_id_codes();
+	test_writer_errors();
+	return 0;
+}